@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_CORPUS 20000
+#define BENCH_MIN_MS 200.0
+#define BENCH_TOLERANCE 0.20
+#define BENCH_MAX_KERNELS 32
+
+typedef struct {
+    char **names;
+    size_t *lens;
+    size_t count;
+    uint64_t bytes;
+    AudioTrack *tracks;
+    AudioTrack *parsed;
+} Corpus;
+
+typedef struct {
+    const char *name;
+    void (*run)(const Corpus *c, size_t i);
+} Kernel;
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+} Result;
+
+static volatile size_t g_sink;
+static uint64_t g_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rnd(uint32_t n) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng % n);
+}
+
+static const char *pick(const char *const *v, size_t n) {
+    return v[rnd((uint32_t)n)];
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void corpus_build(Corpus *c, size_t count) {
+    static const char *const artists[] = {
+        "Caetano Veloso", "Beyonc\xc3\xa9", "Jo\xc3\xa3o Gilberto", "Mot\xc3\xb6rhead", "Sigur R\xc3\xb3s",
+        "AC/DC", "Guns N' Roses", "Daft Punk", "Ana Carolina", "The Beatles", "Ivete Sangalo",
+        "Bj\xc3\xb6rk", "Los Hermanos", "Pitty", "Skank", "Legi\xc3\xa3o Urbana"};
+    static const char *const titles[] = {
+        "Sozinho", "Halo", "Chega de Saudade", "Ace of Spades", "Hopp\xc3\xadpolla", "Thunderstruck",
+        "Sweet Child O' Mine", "Get Lucky", "Quem de N\xc3\xb3s Dois", "Let It Be", "Festa",
+        "Army of Me", "Anna J\xc3\xbalia", "Na Sua Estante", "Garota Nacional", "Tempo Perdido",
+        "Cora\xc3\xa7\xc3\xa3o de Estudante", "a\xc3\xa7\xc3\xa3o \xc3\xa9 \xc3\xb3tima"};
+    static const char *const extras[] = {
+        "", "", "", " (Official Video)", " [HD]", " (ft. MC Kevinho)", " feat. Anitta", " (Visualizer)",
+        " \xf0\x9f\x94\xa5\xf0\x9f\x8e\xb5", " (Ao Vivo)", " - Remastered 2011", " https://youtu.be/dQw4w9WgXcQ",
+        " | Clipe Oficial", " <live>", " \"acustico\""};
+    static const char *const exts[] = {".mp3", ".mp3", ".mp3", ".flac", ".m4a", ".ogg", ".wav", ".MP3", ".wma", ""};
+
+    memset(c, 0, sizeof(*c));
+    c->names = (char **)calloc(count, sizeof(char *));
+    c->lens = (size_t *)calloc(count, sizeof(size_t));
+    c->tracks = (AudioTrack *)calloc(count, sizeof(AudioTrack));
+    c->parsed = (AudioTrack *)calloc(count, sizeof(AudioTrack));
+    if (!c->names || !c->lens || !c->tracks || !c->parsed) return;
+    for (size_t i = 0; i < count; ++i) {
+        AudioTrack *t = &c->tracks[i];
+        char buf[CARTAG_NAME_MAX];
+        size_t n;
+        if (rnd(10) == 0) {
+            int k = snprintf(buf, sizeof(buf), "%s - %s", pick(artists, 16), pick(titles, 18));
+            while (k > 0 && (size_t)k + 24 < 230) k += snprintf(buf + k, sizeof(buf) - (size_t)k, " %s", pick(titles, 18));
+            str_append(buf, sizeof(buf), pick(exts, 10));
+        } else if (rnd(8) == 0) {
+            snprintf(buf, sizeof(buf), "%02u %s%s%s", rnd(20) + 1, pick(titles, 18), pick(extras, 15), pick(exts, 10));
+        } else {
+            snprintf(buf, sizeof(buf), "%s - %s%s%s", pick(artists, 16), pick(titles, 18), pick(extras, 15),
+                     pick(exts, 10));
+        }
+        n = strlen(buf);
+        c->names[i] = (char *)malloc(n + 1);
+        if (!c->names[i]) return;
+        memcpy(c->names[i], buf, n + 1);
+        c->lens[i] = n;
+        c->bytes += n;
+        str_copy(t->artist, sizeof(t->artist), pick(artists, 16));
+        snprintf(t->title, sizeof(t->title), "%s%s", pick(titles, 18), pick(extras, 15));
+        for (char *p = rnd(2) ? t->artist : t->title; *p; ++p) {
+            if (*p >= 'A' && *p <= 'Z') *p = (char)(*p - 'A' + 'a');
+        }
+        c->count = i + 1;
+    }
+}
+
+static void corpus_free(Corpus *c) {
+    for (size_t i = 0; i < c->count; ++i) free(c->names[i]);
+    free(c->names);
+    free(c->lens);
+    free(c->tracks);
+    free(c->parsed);
+}
+
+static void k_sanitize(const Corpus *c, size_t i) {
+    char name[CARTAG_NAME_MAX];
+    memcpy(name, c->names[i], c->lens[i] + 1);
+    sanitize_filename(name, sizeof(name));
+    g_sink += (unsigned char)name[0];
+}
+
+static void k_fold_key(const Corpus *c, size_t i) {
+    char key[CARTAG_NAME_MAX];
+    g_sink += sanitize_fold_key(c->names[i], key, sizeof(key));
+}
+
+static void k_fix_from_filename(const Corpus *c, size_t i) {
+    AudioTrack *t = &c->parsed[i];
+    memcpy(t->filename, c->names[i], c->lens[i] + 1);
+    t->artist[0] = t->title[0] = t->album[0] = t->genre[0] = '\0';
+    t->year = t->track_no = 0;
+    tags_fix_from_filename(t);
+    g_sink += (unsigned char)t->title[0];
+}
+
+static void k_standardize(const Corpus *c, size_t i) {
+    AudioTrack *t = &c->tracks[i];
+    tags_standardize(t);
+    g_sink += (unsigned char)t->artist[0];
+}
+
+static void k_detect_format(const Corpus *c, size_t i) {
+    g_sink += (size_t)audio_detect_format(c->names[i]);
+}
+
+static void k_str_copy(const Corpus *c, size_t i) {
+    char buf[CARTAG_NAME_MAX];
+    str_copy(buf, sizeof(buf), c->names[i]);
+    g_sink += (unsigned char)buf[0];
+}
+
+static void k_str_append(const Corpus *c, size_t i) {
+    char buf[CARTAG_PATH_MAX];
+    buf[0] = '\0';
+    str_append(buf, sizeof(buf), "Artista/");
+    str_append(buf, sizeof(buf), c->names[i]);
+    g_sink += (unsigned char)buf[9];
+}
+
+static void k_path_join2(const Corpus *c, size_t i) {
+    char buf[CARTAG_PATH_MAX];
+    path_join2(buf, sizeof(buf), "/media/usb0/Musicas", c->names[i]);
+    g_sink += (unsigned char)buf[20];
+}
+
+static const Kernel k_kernels[] = {
+    {"sanitize_filename", k_sanitize},
+    {"sanitize_fold_key", k_fold_key},
+    {"tags_fix_from_filename", k_fix_from_filename},
+    {"tags_standardize", k_standardize},
+    {"audio_detect_format", k_detect_format},
+    {"str_copy", k_str_copy},
+    {"str_append", k_str_append},
+    {"path_join2", k_path_join2},
+};
+
+static double bench_kernel(const Kernel *k, const Corpus *c) {
+    double start;
+    double elapsed;
+    size_t ops = 0;
+
+    for (size_t i = 0; i < c->count; ++i) k->run(c, i);
+    start = now_ms();
+    do {
+        for (size_t i = 0; i < c->count; ++i) k->run(c, i);
+        ops += c->count;
+        elapsed = now_ms() - start;
+    } while (elapsed < BENCH_MIN_MS);
+    return elapsed * 1e6 / (double)ops;
+}
+
+static size_t baseline_load(const char *path, Result *out, size_t cap) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    size_t n = 0;
+    if (!f) return 0;
+    while (n < cap && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %lf", out[n].name, &out[n].ns_per_op) == 2) n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static const Result *baseline_find(const Result *base, size_t n, const char *name) {
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(base[i].name, name) == 0) return &base[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    const char *save = NULL;
+    const char *only = NULL;
+    Result base[BENCH_MAX_KERNELS];
+    Result cur[BENCH_MAX_KERNELS];
+    size_t nbase = 0;
+    size_t nk = sizeof(k_kernels) / sizeof(k_kernels[0]);
+    size_t ncur = 0;
+    int regressions = 0;
+    Corpus c;
+    FILE *sf;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline = argv[++i];
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) save = argv[++i];
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) only = argv[++i];
+        else {
+            fprintf(stderr, "Uso: %s [--baseline arquivo] [--save arquivo] [--only kernel]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (baseline) nbase = baseline_load(baseline, base, BENCH_MAX_KERNELS);
+
+    corpus_build(&c, BENCH_CORPUS);
+    if (c.count != BENCH_CORPUS) {
+        fprintf(stderr, "memoria insuficiente para o corpus\n");
+        corpus_free(&c);
+        return 2;
+    }
+    printf("corpus: %zu nomes, %.1f bytes/nome\n", c.count, (double)c.bytes / (double)c.count);
+    printf("%-24s %10s %10s %10s %8s\n", "kernel", "ns/op", "MB/s", "base", "delta");
+    for (size_t k = 0; k < nk; ++k) {
+        const Result *b;
+        double ns;
+        if (only && strcmp(only, k_kernels[k].name) != 0) continue;
+        ns = bench_kernel(&k_kernels[k], &c);
+        str_copy(cur[ncur].name, sizeof(cur[ncur].name), k_kernels[k].name);
+        cur[ncur++].ns_per_op = ns;
+        b = baseline_find(base, nbase, k_kernels[k].name);
+        printf("%-24s %10.1f %10.1f", k_kernels[k].name, ns, (double)c.bytes / (double)c.count / ns * 1000.0);
+        if (b && b->ns_per_op > 0.0) {
+            double delta = ns / b->ns_per_op - 1.0;
+            printf(" %10.1f %+7.1f%%%s", b->ns_per_op, delta * 100.0, delta > BENCH_TOLERANCE ? "  REGRESSAO" : "");
+            if (delta > BENCH_TOLERANCE) regressions++;
+        }
+        printf("\n");
+    }
+
+    if (save && (sf = fopen(save, "w")) != NULL) {
+        fprintf(sf, "# cartag microbench baseline (ns/op); corpus %d nomes\n", BENCH_CORPUS);
+        for (size_t k = 0; k < ncur; ++k) fprintf(sf, "%s %.1f\n", cur[k].name, cur[k].ns_per_op);
+        fclose(sf);
+    }
+    corpus_free(&c);
+    if (regressions) {
+        printf("%d kernel(s) mais de %.0f%% acima da baseline\n", regressions, BENCH_TOLERANCE * 100.0);
+        return 1;
+    }
+    return 0;
+}
@@ -3,10 +3,23 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #define CARTAG_MAX_TRACKS 20000
 #define CARTAG_PATH_MAX 1024
 #define CARTAG_NAME_MAX 256
+#define CARTAG_MAX_ROOTS 8
+#define CARTAG_MAX_TARGETS 8
+#define FS_PART_SUFFIX ".cartag-part"
+#define EXPORT_JOURNAL_NAME ".cartag-journal"
+#define EXPORT_MANIFEST_NAME ".cartag-manifest"
+#define FS_HASH_SCHEME 2u
+#define FS_HASH_MAX_WINDOW 16384
+#define CUE_MAX_TRACKS 99
+#define CUE_FRAMES_PER_SECOND 75
+#define DEVPROBE_CACHE_FILE "devices"
+#define DEVPROBE_TMP_NAME ".cartag-probe"
+#define DEVPROBE_MAX_WRITERS 4
 
 typedef enum {
     FORMAT_UNKNOWN = 0,
@@ -34,14 +47,92 @@ typedef enum {
     SIM_FILENAME
 } SimulateMode;
 
+typedef enum {
+    FUZZY_OFF = 0,
+    FUZZY_REVIEW,
+    FUZZY_LONGEST,
+    FUZZY_LOSSLESS
+} FuzzyMode;
+
+typedef enum {
+    OUTPUT_TEXT = 0,
+    OUTPUT_JSON
+} OutputMode;
+
+typedef enum {
+    CONV_SKIP = 0,
+    CONV_REENCODE,
+    CONV_REMUX
+} ConvertAction;
+
+typedef enum {
+    SCHED_ENTRIES = 0,
+    SCHED_BYTES
+} SchedUnit;
+
+typedef struct {
+    int valid;
+    int mpeg_version;
+    int layer;
+    int vbr;
+    int bitrate_kbps;
+    int sample_rate;
+    int channels;
+    int channel_mode;
+    int bits_per_sample;
+    int tag_version;
+    uint32_t tag_bytes;
+    int duration_seconds;
+} StreamInfo;
+
+typedef enum {
+    SEL_LEAF = 0,
+    SEL_AND,
+    SEL_OR,
+    SEL_NOT
+} SelectOpKind;
+
+typedef struct {
+    SelectOpKind kind;
+    int field;
+    int cmp;
+    int64_t value;
+    char *values;
+} SelectOp;
+
+typedef struct {
+    SelectOp *ops;
+    size_t count;
+    size_t cap;
+    size_t depth;
+    unsigned fields;
+} SelectQuery;
+
 typedef struct {
     char input[CARTAG_PATH_MAX];
     char export_path[CARTAG_PATH_MAX];
+    char targets[CARTAG_MAX_TARGETS][CARTAG_PATH_MAX];
+    size_t target_count;
+    char batch_file[CARTAG_PATH_MAX];
+    char roots[CARTAG_MAX_ROOTS][CARTAG_PATH_MAX];
+    int root_io[CARTAG_MAX_ROOTS];
+    size_t root_count;
+    int io_per_root;
+    char prefer_root[CARTAG_PATH_MAX];
+    int jobs;
     int keep_format;
     int convert_mp3;
     int group_by_format;
     int fix_tags;
     int dedupe;
+    int fingerprint;
+    FuzzyMode fuzzy;
+    int fuzzy_threshold;
+    int fit;
+    int fit_bitrate;
+    int target_kbps;
+    uint64_t capacity_bytes;
+    char playcounts_file[CARTAG_PATH_MAX];
     int normalize_volume;
     int strip_art;
     int resize_art;
@@ -50,8 +141,19 @@ typedef struct {
     int prefix;
     int limit_name;
     int interactive_tui;
+    int watch;
+    int resume;
+    int verify;
+    int sequential;
+    int reprobe;
+    int background;
+    char reverify[CARTAG_PATH_MAX];
+    char select[512];
+    SelectQuery select_query;
+    char serve[CARTAG_PATH_MAX];
     OrganizeMode organize;
     SimulateMode simulate;
+    OutputMode output;
 } CliOptions;
 
 typedef struct {
@@ -68,8 +170,25 @@ typedef struct {
     AudioFormat format;
     uint64_t size_bytes;
     uint64_t quick_hash;
+    int root_index;
+    size_t slot;
+    int64_t mtime;
     int duration_seconds;
+    int rating;
+    int has_tags;
+    StreamInfo stream;
+    ConvertAction convert;
+    char decision[160];
+    int converted;
+    int target_kbps;
+    uint64_t est_bytes;
     int duplicate;
+    int excluded;
+    int omitted;
+    int unselected;
+    int cue_track;
+    uint32_t cue_start;
+    uint32_t cue_end;
     int unsupported;
     int warning_count;
 } AudioTrack;
@@ -80,6 +199,8 @@ typedef struct {
     size_t capacity;
 } TrackList;
 
+typedef enum { PCACHE_LOAD = 0, PCACHE_DEDUPE, PCACHE_PLAN, PCACHE_ORGANIZE, PCACHE_STAGES } PipelineCacheStage;
+
 typedef struct {
     size_t total_tracks;
     size_t removed_duplicates;
@@ -87,37 +208,341 @@ typedef struct {
     size_t format_count[8];
 } LibraryStats;
 
+typedef struct {
+    TrackList base;
+    TrackList work;
+    LibraryStats base_stats;
+    LibraryStats stats;
+    unsigned char *flags;
+    uint64_t *conv_key;
+    uint64_t sig[PCACHE_STAGES];
+    int level;
+} PipelineCache;
+
+typedef enum {
+    LVL_TEXT = 0,
+    LVL_INFO,
+    LVL_WARN,
+    LVL_ERROR
+} LogLevel;
+
+typedef enum {
+    STAGE_IDLE = 0,
+    STAGE_DOWNLOAD,
+    STAGE_SCAN,
+    STAGE_PROCESS,
+    STAGE_DEDUPE,
+    STAGE_PLAN,
+    STAGE_CONVERT,
+    STAGE_EXPORT,
+    STAGE_VERIFY,
+    STAGE_DONE
+} PipelineStage;
+
+typedef enum {
+    PEV_STAGE = 0,
+    PEV_PROGRESS,
+    PEV_LOG,
+    PEV_DETAIL,
+    PEV_ESTIMATE,
+    PEV_DONE
+} ProgressEventType;
+
+typedef struct {
+    ProgressEventType type;
+    PipelineStage stage;
+    LogLevel level;
+    int rc;
+    size_t done;
+    size_t total;
+    uint64_t bytes;
+    double rate;
+    char text[200];
+} ProgressEvent;
+
+#define PROGRESS_QUEUE_CAP 1024
+
+typedef struct {
+    ProgressEvent slots[PROGRESS_QUEUE_CAP];
+    size_t head;
+    size_t tail;
+    size_t cancel;
+    size_t finished;
+    int rc;
+} ProgressQueue;
+
+typedef struct {
+    int number;
+    uint32_t start;
+    char performer[128];
+    char title[128];
+} CueTrack;
+
+typedef struct {
+    char file[CARTAG_NAME_MAX];
+    char performer[128];
+    char title[128];
+    char genre[64];
+    int year;
+    CueTrack tracks[CUE_MAX_TRACKS];
+    size_t count;
+} CueSheet;
+
+typedef struct {
+    char *hay;
+    size_t hay_len;
+    size_t hay_cap;
+    size_t *offs;
+    size_t count;
+    size_t cap;
+    size_t *view;
+    size_t view_count;
+    char query[128];
+} SearchIndex;
+
+#define FP_WORDS 4
+
+typedef struct {
+    uint64_t bits[FP_WORDS];
+    int valid;
+} Fingerprint;
+
+typedef enum {
+    VERIFY_PENDING = 0,
+    VERIFY_OK,
+    VERIFY_MISMATCH,
+    VERIFY_SIZE,
+    VERIFY_MISSING,
+    VERIFY_READ_ERROR
+} VerifyStatus;
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    uint32_t crc;
+    uint32_t read_crc;
+    int known;
+    int selected;
+    VerifyStatus status;
+} VerifyEntry;
+
+typedef struct {
+    VerifyEntry *items;
+    size_t count;
+    size_t cap;
+    size_t *index;
+    size_t index_cap;
+} Manifest;
+
+typedef int (*FsScanCallback)(void *ctx, const AudioTrack *track);
+typedef int (*FsStopFn)(void *ctx);
+typedef const unsigned char *(*FsReadFn)(void *ctx, uint64_t off, size_t len);
+
+typedef struct {
+    const char *path;
+    int io_limit;
+    int status;
+} ScanRoot;
+
+#define PROC_MAX_PUMP 16
+
+enum { PROC_STDOUT = 0, PROC_STDERR = 1 };
+
+typedef struct {
+    char buf[1024];
+    size_t len;
+} ProcLineBuf;
+
+typedef struct {
+    char id[64];
+    size_t block;
+    int writers;
+    double write_rate;
+    double read_rate;
+    int cached;
+} DeviceProfile;
+
+typedef struct {
+    long pid;
+    int out_fd;
+    int err_fd;
+    int running;
+    int killed;
+    int exit_code;
+    double started;
+    ProcLineBuf lines[2];
+} Proc;
+
+typedef struct {
+    double total_seconds;
+    double done_seconds;
+    double percent;
+    double speed;
+    int finished;
+} ProcProgress;
+
+typedef void (*LogSinkFn)(void *ctx, const char *line, size_t len);
+
+typedef void (*ProcLineFn)(Proc *p, int stream, const char *line, void *ctx);
+
 int cli_parse(int argc, char **argv, CliOptions *opts);
+void cli_free(CliOptions *opts);
 void cli_print_help(void);
 
-int tui_run(CliOptions *opts);
+int tui_run(CliOptions *opts, PipelineCache *cache);
+
+int pipeline_run(CliOptions *opts);
+int pipeline_run_cached(CliOptions *opts, PipelineCache *cache);
+void pipeline_cache_invalidate(PipelineCache *cache);
+void pipeline_cache_free(PipelineCache *cache);
+void pipeline_process_track(AudioTrack *t, const CliOptions *opts);
+void pipeline_convert_track(AudioTrack *t, const CliOptions *opts);
+void pipeline_dedupe(TrackList *list, const CliOptions *opts, LibraryStats *stats);
+void pipeline_plan(TrackList *list, const CliOptions *opts, LibraryStats *stats);
+int pipeline_load(const CliOptions *opts, TrackList *list, LibraryStats *stats);
+int pipeline_convert(TrackList *list, const CliOptions *opts);
+
+int watch_run(const CliOptions *opts);
+int serve_run(const CliOptions *opts, int argc, char **argv);
+
+void progress_attach(ProgressQueue *q);
+int progress_attached(void);
+int progress_push(ProgressQueue *q, const ProgressEvent *ev);
+int progress_pop(ProgressQueue *q, ProgressEvent *ev);
+void progress_cancel(ProgressQueue *q);
+int progress_cancelled(void);
+int progress_finished(ProgressQueue *q, int *rc);
+void progress_stage(PipelineStage stage, size_t total);
+void progress_advance(size_t done, uint64_t bytes);
+void progress_done(int rc);
+void progress_log(LogLevel level, const char *fmt, ...);
+void progress_detail(const char *fmt, ...);
+void progress_estimate(uint64_t bytes, double rate);
+const char *progress_stage_name(PipelineStage stage);
+
+void log_set_output(OutputMode mode);
+int log_json(void);
+void log_flush(void);
+void log_tick(void);
+void log_write(LogLevel level, const char *text);
+void log_track_issue(LogLevel level, const char *filename, const char *message);
+void log_flush_issues(void);
+void log_event_track(const AudioTrack *t);
+void log_event_plan(size_t order, const AudioTrack *t);
+void log_event_stats(const LibraryStats *stats);
+void log_event_stage(PipelineStage stage, size_t total);
+void log_event_progress(size_t done, uint64_t bytes);
+void log_event_estimate(uint64_t bytes, double rate);
+void log_event_result(const char *id, const char *cmd, const char *error, size_t count, double ms);
+void log_set_sink(LogSinkFn fn, void *ctx);
+
+int proc_run(const char *const argv[], int timeout_sec, ProcLineFn fn, void *ctx);
+int proc_capture(const char *const argv[], int timeout_sec, unsigned char *buf, size_t cap, size_t *len);
+#ifndef _WIN32
+int proc_spawn(Proc *p, const char *const argv[]);
+size_t proc_pump(Proc *const *procs, size_t n, int timeout_ms, ProcLineFn fn, void *ctx);
+void proc_kill(Proc *p);
+#endif
+int proc_parse_ffmpeg_line(const char *line, ProcProgress *pp);
+int proc_parse_ytdlp_line(const char *line, ProcProgress *pp);
 
 int fs_scan_audio(const char *root, TrackList *list);
-int fs_copy_file(const char *src, const char *dst);
+int fs_scan_audio_cb(const char *root, FsScanCallback cb, void *ctx);
+int fs_scan_audio_until(const char *root, FsScanCallback cb, FsStopFn stop, void *ctx);
+int fs_scan_roots(ScanRoot *roots, size_t count, FsScanCallback cb, void *ctx);
+int fs_probe_track(const char *full, const char *base, AudioTrack *t);
+int tracklist_push(TrackList *list, const AudioTrack *track);
+void tracklist_free(TrackList *list);
+FILE *fs_open_part(const char *dst, char *part, size_t part_sz);
+int fs_commit_part(FILE *out, const char *part, const char *dst, int rc);
+int fs_sync_parent(const char *path);
+int fs_copy_file(const char *src, const char *dst, uint32_t *crc);
+int fs_copy_file_seq(const char *src, const char *dst, uint32_t *crc);
+int fs_copy_file_block(const char *src, const char *dst, uint32_t *crc, size_t block, int sequential);
+void fs_cache_path(const char *name, char *out, size_t out_sz);
+void fs_preallocate(FILE *f, uint64_t size);
+uint64_t fs_quick_hash(const char *path);
+size_t fs_hash_window(uint64_t size);
+uint64_t fs_hash_sampled(uint64_t size, FsReadFn read, void *ctx);
+int fs_sync_stream(FILE *f);
 int fs_ensure_directory(const char *path);
 
+int devprobe_profile(const char *root, int force, DeviceProfile *dev);
+
+void sched_configure(const CliOptions *opts);
+int sched_workers(int wanted);
+uint64_t sched_mem_budget(void);
+void sched_cpu_acquire(void);
+int sched_cpu_try(void);
+void sched_cpu_release(void);
+int sched_io_acquire(const char *path, SchedUnit unit);
+void sched_io_release(int dev, uint64_t units);
+
 AudioFormat audio_detect_format(const char *path);
 const char *audio_format_name(AudioFormat fmt);
+const char *audio_format_ext(AudioFormat fmt);
 int audio_can_play_car(AudioTrack *t, int car_safe, char *warn, size_t warn_sz);
+int audio_has_ffmpeg(void);
+int audio_probe_file(const char *path, uint64_t size, AudioTrack *t);
+void audio_describe_stream(const AudioTrack *t, char *out, size_t out_sz);
+ConvertAction audio_plan_conversion(AudioTrack *t, const CliOptions *opts, int kbps);
+int audio_estimate_duration(const AudioTrack *t);
+uint64_t audio_estimate_output(const AudioTrack *t);
 int audio_convert_if_needed(AudioTrack *t, const CliOptions *opts, char *warn, size_t warn_sz);
 
+void str_copy(char *dst, size_t dst_sz, const char *src);
+void str_append(char *dst, size_t dst_sz, const char *src);
+void path_join2(char *dst, size_t dst_sz, const char *a, const char *b);
+
 void sanitize_filename(char *name, size_t max_len);
 void sanitize_track(AudioTrack *t, int limit_name);
+size_t sanitize_fold_key(const char *in, char *out, size_t out_sz);
+
+int search_index_sync(SearchIndex *ix, const TrackList *list);
+void search_set_query(SearchIndex *ix, const char *query);
+void search_index_free(SearchIndex *ix);
+
+int select_compile(SelectQuery *q, const char *expr, char *err, size_t err_sz);
+size_t select_apply(const SelectQuery *q, TrackList *list);
+int select_uses_duplicate(const SelectQuery *q);
+void select_free(SelectQuery *q);
+
+int cue_parse(const char *path, CueSheet *cs);
+size_t cue_expand(TrackList *list);
+size_t cue_split(TrackList *list, const CliOptions *opts);
 
 void tags_fix_from_filename(AudioTrack *t);
+void tags_apply_defaults(AudioTrack *t);
 void tags_standardize(AudioTrack *t);
 
+AudioFormat organizer_output_format(const AudioTrack *t);
+void organizer_regroup(AudioTrack *t, AudioFormat from);
 void organizer_plan(TrackList *list, const CliOptions *opts);
+void capacity_plan(TrackList *list, const CliOptions *opts);
 void organizer_apply_prefix(TrackList *list);
 
-void dedupe_mark(TrackList *list, LibraryStats *stats);
+void dedupe_mark(TrackList *list, int prefer_root, LibraryStats *stats);
+void fingerprint_mark(TrackList *list, int prefer_root, LibraryStats *stats);
+void fuzzy_dedupe(TrackList *list, FuzzyMode mode, int threshold, int prefer_root, LibraryStats *stats);
 void simulate_print(const TrackList *list, SimulateMode mode, LibraryStats *stats);
 
 int downloader_is_url(const char *s);
 int downloader_install(char *warn, size_t warn_sz);
 int downloader_fetch_audio(const char *url, const char *out_dir, char *warn, size_t warn_sz);
+int downloader_fetch_batch(const char *const *urls, size_t count, const char *out_dir, int jobs,
+                           TrackList *out, char *warn, size_t warn_sz);
+int downloader_read_url_file(const char *path, char ***urls, size_t *count);
+void downloader_free_urls(char **urls, size_t count);
 
 int exporter_run(const TrackList *list, const CliOptions *opts);
+int manifest_load(Manifest *m, const char *root);
+int manifest_put(Manifest *m, const char *path, uint64_t size, uint32_t crc, int known);
+int manifest_save(const Manifest *m, const char *root);
+void manifest_free(Manifest *m);
+size_t verify_readback(const char *root, Manifest *m, int jobs);
+int verify_export_dir(const char *root, int jobs);
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t n);
+uint64_t hash64(const void *buf, size_t n, uint64_t seed);
 void diagnostics_print(const TrackList *list);
 void stats_print(const LibraryStats *stats);
 
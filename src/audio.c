@@ -5,22 +5,37 @@
 #include <strings.h>
 #include <stdlib.h>
 
-static int has_ffmpeg(void) {
-    int rc = system("ffmpeg -version > /dev/null 2>&1");
-    return rc == 0;
+#define FFMPEG_PROBE_TIMEOUT 15
+#define FFMPEG_CONVERT_TIMEOUT 1800
+#define AUDIO_DEFAULT_KBPS 320
+#define AUDIO_TAG_OVERHEAD 4096
+#define AUDIO_ART_TAG_BYTES 65536
+
+static const int k_mp3_ladder[] = {32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+
+typedef struct {
+    ProcProgress pp;
+    const char *name;
+    int last_pct;
+} ConvertWatch;
+
+int audio_has_ffmpeg(void) {
+    static int cached = -1;
+    const char *argv[] = {"ffmpeg", "-version", NULL};
+    if (cached < 0) cached = proc_run(argv, FFMPEG_PROBE_TIMEOUT, NULL, NULL) == 0;
+    return cached;
 }
 
-static void str_copy(char *dst, size_t dst_sz, const char *src) {
-    size_t n;
-    if (!dst || dst_sz == 0) return;
-    if (!src) {
-        dst[0] = '\0';
-        return;
-    }
-    n = strlen(src);
-    if (n >= dst_sz) n = dst_sz - 1;
-    memcpy(dst, src, n);
-    dst[n] = '\0';
+static void convert_line(Proc *p, int stream, const char *line, void *ctx) {
+    ConvertWatch *cw = (ConvertWatch *)ctx;
+    int pct;
+    (void)p;
+    (void)stream;
+    if (!proc_parse_ffmpeg_line(line, &cw->pp) || cw->pp.total_seconds <= 0.0) return;
+    pct = (int)cw->pp.percent;
+    if (pct == cw->last_pct) return;
+    cw->last_pct = pct;
+    progress_detail("ffmpeg %3d%%  %.1fx  %s", pct, cw->pp.speed, cw->name);
 }
 
 AudioFormat audio_detect_format(const char *path) {
@@ -50,6 +65,19 @@ const char *audio_format_name(AudioFormat fmt) {
     }
 }
 
+const char *audio_format_ext(AudioFormat fmt) {
+    switch (fmt) {
+        case FORMAT_MP3: return ".mp3";
+        case FORMAT_FLAC: return ".flac";
+        case FORMAT_WAV: return ".wav";
+        case FORMAT_AAC: return ".aac";
+        case FORMAT_M4A: return ".m4a";
+        case FORMAT_OGG: return ".ogg";
+        case FORMAT_WMA: return ".wma";
+        default: return "";
+    }
+}
+
 int audio_can_play_car(AudioTrack *t, int car_safe, char *warn, size_t warn_sz) {
     if (car_safe && t->format != FORMAT_MP3) {
         snprintf(warn, warn_sz, "Formato %s pode falhar em player antigo", audio_format_name(t->format));
@@ -59,14 +87,122 @@ int audio_can_play_car(AudioTrack *t, int car_safe, char *warn, size_t warn_sz)
     return 1;
 }
 
+static int standard_rate(int rate) {
+    return rate == 32000 || rate == 44100 || rate == 48000;
+}
+
+static int lossless_format(AudioFormat fmt) {
+    return fmt == FORMAT_FLAC || fmt == FORMAT_WAV;
+}
+
+static int ceiling_kbps(int source_kbps, int target_kbps) {
+    for (size_t i = 0; i < sizeof(k_mp3_ladder) / sizeof(k_mp3_ladder[0]); ++i) {
+        if (k_mp3_ladder[i] >= source_kbps) return k_mp3_ladder[i] < target_kbps ? k_mp3_ladder[i] : target_kbps;
+    }
+    return target_kbps;
+}
+
+static ConvertAction decide(const AudioTrack *t, const CliOptions *opts, int kbps, int *out_kbps, const char **why) {
+    const StreamInfo *si = &t->stream;
+
+    *out_kbps = kbps;
+    if (t->format != FORMAT_MP3) {
+        if (lossless_format(t->format)) {
+            *why = "fonte sem perdas";
+        } else if (si->valid && si->bitrate_kbps > 0) {
+            *out_kbps = ceiling_kbps(si->bitrate_kbps, kbps);
+            *why = "formato nao suportado pelo player";
+        } else {
+            *why = "formato nao suportado pelo player";
+        }
+        return CONV_REENCODE;
+    }
+    if (opts->keep_format) {
+        *why = "--keep-format";
+        return CONV_SKIP;
+    }
+    if (!si->valid) {
+        *why = "cabecalho MP3 nao reconhecido";
+        return CONV_SKIP;
+    }
+    if (si->layer != 3) {
+        if (si->bitrate_kbps > 0) *out_kbps = ceiling_kbps(si->bitrate_kbps, kbps);
+        *why = "MPEG layer nao suportado";
+        return CONV_REENCODE;
+    }
+    if (opts->car_safe && (si->mpeg_version != 10 || !standard_rate(si->sample_rate))) {
+        if (si->bitrate_kbps > 0) *out_kbps = ceiling_kbps(si->bitrate_kbps, kbps);
+        *why = "taxa de amostragem fora do padrao do player";
+        return CONV_REENCODE;
+    }
+    if (si->bitrate_kbps > kbps) {
+        *why = "bitrate acima do alvo";
+        return CONV_REENCODE;
+    }
+    if (opts->car_safe && si->tag_version >= 4) {
+        *why = "ID3v2.4 convertido para ID3v2.3";
+        return CONV_REMUX;
+    }
+    if (opts->strip_art && si->tag_bytes > AUDIO_ART_TAG_BYTES) {
+        *why = "remove capa embutida";
+        return CONV_REMUX;
+    }
+    *why = "ja compativel";
+    return CONV_SKIP;
+}
+
+ConvertAction audio_plan_conversion(AudioTrack *t, const CliOptions *opts, int kbps) {
+    static const char *verbs[3] = {"copiar", "recodificar", "remux"};
+    char desc[64];
+    const char *why = "";
+    int out_kbps = kbps;
+
+    t->convert = CONV_SKIP;
+    t->decision[0] = '\0';
+    if (kbps <= 0) kbps = opts->target_kbps > 0 ? opts->target_kbps : AUDIO_DEFAULT_KBPS;
+    t->target_kbps = kbps;
+    if (t->cue_track && !t->converted) snprintf(t->decision, sizeof(t->decision), "cortar: faixa %02d da folha CUE", t->cue_track);
+    if (t->converted || !(opts->convert_mp3 || opts->car_safe)) return CONV_SKIP;
+
+    t->convert = decide(t, opts, kbps, &out_kbps, &why);
+    if (t->convert == CONV_REENCODE) t->target_kbps = out_kbps;
+    audio_describe_stream(t, desc, sizeof(desc));
+    if (t->convert == CONV_REENCODE) {
+        snprintf(t->decision, sizeof(t->decision), "%s %dk: %s (%s)", verbs[t->convert], t->target_kbps, why, desc);
+    } else {
+        snprintf(t->decision, sizeof(t->decision), "%s: %s (%s)", verbs[t->convert], why, desc);
+    }
+    return t->convert;
+}
+
+int audio_estimate_duration(const AudioTrack *t) {
+    int kbps;
+    if (t->duration_seconds > 0) return t->duration_seconds;
+    switch (t->format) {
+        case FORMAT_WAV: kbps = 1411; break;
+        case FORMAT_FLAC: kbps = 900; break;
+        case FORMAT_OGG: kbps = 160; break;
+        case FORMAT_WMA: kbps = 128; break;
+        default: kbps = 192; break;
+    }
+    return (int)(t->size_bytes * 8 / ((uint64_t)kbps * 1000));
+}
+
+uint64_t audio_estimate_output(const AudioTrack *t) {
+    if (t->convert != CONV_REENCODE || !audio_has_ffmpeg()) return t->size_bytes;
+    return (uint64_t)audio_estimate_duration(t) * (uint64_t)t->target_kbps * 1000 / 8 + AUDIO_TAG_OVERHEAD;
+}
+
 int audio_convert_if_needed(AudioTrack *t, const CliOptions *opts, char *warn, size_t warn_sz) {
-    char cmd[4096];
     char out[CARTAG_PATH_MAX];
     size_t path_len;
+    const char *rate;
+    char kbps[16];
+    ConvertWatch cw;
+    int rc;
 
-    if (!(opts->convert_mp3 || opts->car_safe)) return 0;
-    if (t->format == FORMAT_MP3 && opts->keep_format) return 0;
-    if (!has_ffmpeg()) {
+    if (t->convert == CONV_SKIP || t->converted) return 0;
+    if (!audio_has_ffmpeg()) {
         snprintf(warn, warn_sz, "ffmpeg ausente; conversao ignorada");
         return -1;
     }
@@ -80,18 +216,34 @@ int audio_convert_if_needed(AudioTrack *t, const CliOptions *opts, char *warn, s
     str_copy(out, sizeof(out), t->path);
     strncat(out, ".converted.mp3", sizeof(out) - strlen(out) - 1);
 
-    snprintf(cmd, sizeof(cmd),
-             "ffmpeg -y -i \"%s\" -vn -ar %d -ac 2 -b:a 320k -id3v2_version 3 \"%s\" > /dev/null 2>&1",
-             t->path,
-             opts->car_safe ? 44100 : 48000,
-             out);
-    if (system(cmd) != 0) {
-        snprintf(warn, warn_sz, "ffmpeg falhou ao converter");
+    if (opts->car_safe || !standard_rate(t->stream.sample_rate)) rate = "44100";
+    else rate = t->stream.sample_rate == 48000 ? "48000" : (t->stream.sample_rate == 32000 ? "32000" : "44100");
+    snprintf(kbps, sizeof(kbps), "%dk", t->target_kbps > 0 ? t->target_kbps : AUDIO_DEFAULT_KBPS);
+    memset(&cw, 0, sizeof(cw));
+    cw.name = t->filename;
+    cw.last_pct = -1;
+    if (t->convert == CONV_REMUX) {
+        const char *argv[] = {"ffmpeg", "-nostdin", "-nostats", "-y", "-i", t->path, "-map", opts->strip_art ? "0:a" : "0",
+                              "-c", "copy", "-id3v2_version", "3", "-progress", "pipe:1", out, NULL};
+        rc = proc_run(argv, FFMPEG_CONVERT_TIMEOUT, convert_line, &cw);
+    } else {
+        const char *argv[] = {"ffmpeg", "-nostdin", "-nostats", "-y", "-i", t->path, "-vn", "-ar", rate, "-ac",
+                              t->stream.channels == 1 ? "1" : "2", "-b:a", kbps, "-id3v2_version", "3",
+                              "-progress", "pipe:1", out, NULL};
+        rc = proc_run(argv, FFMPEG_CONVERT_TIMEOUT, convert_line, &cw);
+    }
+    if (rc != 0) {
+        remove(out);
+        if (progress_cancelled()) snprintf(warn, warn_sz, "conversao cancelada");
+        else if (rc < 0) snprintf(warn, warn_sz, "ffmpeg interrompido (tempo limite)");
+        else snprintf(warn, warn_sz, "ffmpeg falhou ao converter");
         return -1;
     }
 
     str_copy(t->path, sizeof(t->path), out);
     t->format = FORMAT_MP3;
-    snprintf(warn, warn_sz, "convertido para MP3");
+    t->converted = 1;
+    if (t->convert == CONV_REMUX) snprintf(warn, warn_sz, "remux sem recodificar");
+    else snprintf(warn, warn_sz, "convertido para MP3 (%s)", kbps);
     return 1;
 }
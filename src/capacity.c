@@ -0,0 +1,232 @@
+#include "cartag.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/statvfs.h>
+#endif
+
+#define CAPACITY_DEFAULT_CLUSTER 32768
+#define CAPACITY_REPORT_OMITTED 20
+
+typedef struct {
+    const char *key;
+    long plays;
+} PlayCount;
+
+typedef struct {
+    PlayCount *items;
+    size_t count;
+    char **lines;
+    size_t line_count;
+} PlayCounts;
+
+typedef struct {
+    size_t index;
+    uint64_t bytes;
+    double value;
+} PlanItem;
+
+static const int k_fallback_kbps[] = {320, 256, 224, 192, 160, 128, 112, 96};
+
+static int cmp_playcount(const void *a, const void *b) {
+    return strcmp(((const PlayCount *)a)->key, ((const PlayCount *)b)->key);
+}
+
+static void playcounts_load(PlayCounts *pc, const char *path) {
+    memset(pc, 0, sizeof(*pc));
+    if (!path[0]) return;
+    if (downloader_read_url_file(path, &pc->lines, &pc->line_count) != 0) {
+        progress_log(LVL_WARN, "nao foi possivel ler contagem de execucoes: %s", path);
+        return;
+    }
+    pc->items = (PlayCount *)malloc((pc->line_count ? pc->line_count : 1) * sizeof(PlayCount));
+    if (!pc->items) return;
+    for (size_t i = 0; i < pc->line_count; ++i) {
+        char *end;
+        long plays = strtol(pc->lines[i], &end, 10);
+        if (end == pc->lines[i] || (*end != '\t' && *end != ' ')) continue;
+        while (*end == '\t' || *end == ' ') ++end;
+        if (*end == '\0') continue;
+        pc->items[pc->count].key = end;
+        pc->items[pc->count++].plays = plays;
+    }
+    qsort(pc->items, pc->count, sizeof(PlayCount), cmp_playcount);
+}
+
+static long playcounts_find(const PlayCounts *pc, const AudioTrack *t) {
+    const char *keys[3];
+    keys[0] = t->rel_path;
+    keys[1] = t->filename;
+    keys[2] = t->path;
+    for (int k = 0; k < 3 && pc->count; ++k) {
+        PlayCount probe;
+        const PlayCount *hit;
+        probe.key = keys[k];
+        hit = (const PlayCount *)bsearch(&probe, pc->items, pc->count, sizeof(PlayCount), cmp_playcount);
+        if (hit) return hit->plays;
+    }
+    return 0;
+}
+
+static void playcounts_free(PlayCounts *pc) {
+    free(pc->items);
+    downloader_free_urls(pc->lines, pc->line_count);
+    memset(pc, 0, sizeof(*pc));
+}
+
+static int capacity_probe(const CliOptions *opts, uint64_t *bytes, uint64_t *cluster) {
+    *cluster = CAPACITY_DEFAULT_CLUSTER;
+    if (opts->capacity_bytes > 0) {
+        *bytes = opts->capacity_bytes;
+        return 0;
+    }
+#ifndef _WIN32
+    {
+        char dir[CARTAG_PATH_MAX];
+        struct statvfs vfs;
+        str_copy(dir, sizeof(dir), opts->export_path[0] ? opts->export_path : ".");
+        while (statvfs(dir, &vfs) != 0) {
+            char *slash = strrchr(dir, '/');
+            if (!slash) {
+                str_copy(dir, sizeof(dir), ".");
+                if (statvfs(dir, &vfs) != 0) return -1;
+                break;
+            }
+            if (slash == dir) slash[1] = '\0';
+            else *slash = '\0';
+        }
+        *bytes = (uint64_t)vfs.f_bavail * (uint64_t)vfs.f_frsize;
+        if (vfs.f_bsize > 0) *cluster = (uint64_t)vfs.f_bsize;
+        return 0;
+    }
+#else
+    return -1;
+#endif
+}
+
+static uint64_t round_cluster(uint64_t n, uint64_t cluster) {
+    if (cluster == 0) return n;
+    return (n + cluster - 1) / cluster * cluster;
+}
+
+static double track_value(const AudioTrack *t, long plays, time_t now) {
+    double v = 1.0;
+    double age_days;
+    if (plays > 0) v += 4.0 * log2(1.0 + (double)plays);
+    v += 2.0 * (double)t->rating;
+    age_days = difftime(now, (time_t)t->mtime) / 86400.0;
+    if (t->mtime > 0 && age_days >= 0.0 && age_days < 365.0) v += 3.0 * (1.0 - age_days / 365.0);
+    return v;
+}
+
+static int cmp_plan_density(const void *a, const void *b) {
+    const PlanItem *ia = (const PlanItem *)a;
+    const PlanItem *ib = (const PlanItem *)b;
+    double da = ia->value / (double)(ia->bytes ? ia->bytes : 1);
+    double db = ib->value / (double)(ib->bytes ? ib->bytes : 1);
+    if (da != db) return da > db ? -1 : 1;
+    return ia->index < ib->index ? -1 : (ia->index > ib->index ? 1 : 0);
+}
+
+static uint64_t plan_estimate(TrackList *list, const CliOptions *opts, PlanItem *items, size_t n, int kbps,
+                              uint64_t cluster) {
+    uint64_t total = 0;
+    for (size_t k = 0; k < n; ++k) {
+        AudioTrack *t = &list->tracks[items[k].index];
+        audio_plan_conversion(t, opts, kbps);
+        items[k].bytes = round_cluster(audio_estimate_output(t), cluster);
+        total += items[k].bytes;
+    }
+    return total;
+}
+
+static void format_size(char *out, size_t out_sz, uint64_t bytes) {
+    double v = (double)bytes;
+    if (v >= 1024.0 * 1024.0 * 1024.0) snprintf(out, out_sz, "%.2f GB", v / (1024.0 * 1024.0 * 1024.0));
+    else snprintf(out, out_sz, "%.1f MB", v / (1024.0 * 1024.0));
+}
+
+void capacity_plan(TrackList *list, const CliOptions *opts) {
+    PlayCounts pc;
+    PlanItem *items;
+    uint64_t capacity = 0;
+    uint64_t cluster = 0;
+    uint64_t budget;
+    uint64_t total = 0;
+    uint64_t used = 0;
+    uint64_t dropped_bytes = 0;
+    size_t n = 0;
+    size_t kept = 0;
+    size_t listed = 0;
+    int kbps = opts->target_kbps > 0 ? opts->target_kbps : 320;
+    int fits = 0;
+    time_t now = time(NULL);
+    char cap_txt[32];
+    char used_txt[32];
+    char drop_txt[32];
+
+    if (!opts->fit || list->count == 0) return;
+    if (capacity_probe(opts, &capacity, &cluster) != 0) {
+        progress_log(LVL_WARN, "capacidade do destino desconhecida; use --capacity <tamanho>");
+        return;
+    }
+    budget = capacity - capacity / 100;
+
+    items = (PlanItem *)malloc(list->count * sizeof(PlanItem));
+    if (!items) return;
+    playcounts_load(&pc, opts->playcounts_file);
+    for (size_t i = 0; i < list->count; ++i) {
+        AudioTrack *t = &list->tracks[i];
+        t->omitted = 0;
+        if (t->duplicate || t->excluded || t->unselected) continue;
+        items[n].index = i;
+        items[n].value = track_value(t, playcounts_find(&pc, t), now);
+        n++;
+    }
+    playcounts_free(&pc);
+
+    total = plan_estimate(list, opts, items, n, kbps, cluster);
+    fits = total <= budget;
+    for (size_t b = 0; !fits && opts->fit_bitrate && b < sizeof(k_fallback_kbps) / sizeof(k_fallback_kbps[0]); ++b) {
+        if (k_fallback_kbps[b] >= kbps) continue;
+        kbps = k_fallback_kbps[b];
+        total = plan_estimate(list, opts, items, n, kbps, cluster);
+        fits = total <= budget;
+    }
+
+    qsort(items, n, sizeof(PlanItem), cmp_plan_density);
+    for (size_t k = 0; k < n; ++k) {
+        AudioTrack *t = &list->tracks[items[k].index];
+        t->est_bytes = items[k].bytes;
+        if (used + items[k].bytes <= budget) {
+            used += items[k].bytes;
+            kept++;
+        } else {
+            t->omitted = 1;
+            dropped_bytes += items[k].bytes;
+        }
+    }
+
+    format_size(cap_txt, sizeof(cap_txt), capacity);
+    format_size(used_txt, sizeof(used_txt), used);
+    format_size(drop_txt, sizeof(drop_txt), dropped_bytes);
+    progress_log(LVL_TEXT, "\nPlano de capacidade (%s disponiveis, bitrate alvo %dk):", cap_txt, kbps);
+    progress_log(LVL_TEXT, "  Incluidas: %zu faixas, %s estimados", kept, used_txt);
+    if (kept < n) {
+        progress_log(LVL_TEXT, "  Omitidas:  %zu faixas, %s", n - kept, drop_txt);
+        for (size_t k = n; k-- > 0 && listed < CAPACITY_REPORT_OMITTED;) {
+            const AudioTrack *t = &list->tracks[items[k].index];
+            if (!t->omitted) continue;
+            progress_log(LVL_TEXT, "    - %s (%.1f MB, prioridade %.1f)", t->rel_path,
+                         (double)items[k].bytes / (1024.0 * 1024.0), items[k].value);
+            listed++;
+        }
+        if (n - kept > listed) progress_log(LVL_TEXT, "    ... e mais %zu", n - kept - listed);
+    }
+    free(items);
+}
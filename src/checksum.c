@@ -0,0 +1,180 @@
+#include "cartag.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_HW 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t g_table[8][256];
+static int g_hw = -1;
+
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        g_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int s = 1; s < 8; ++s) g_table[s][i] = (g_table[s - 1][i] >> 8) ^ g_table[0][g_table[s - 1][i] & 0xFF];
+    }
+#if defined(__x86_64__) && defined(CRC32C_HW)
+    g_hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#elif defined(CRC32C_HW)
+    g_hw = 1;
+#else
+    g_hw = 0;
+#endif
+}
+
+#ifndef _WIN32
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void crc32c_ready(void) {
+#ifndef _WIN32
+    pthread_once(&g_once, crc32c_init);
+#else
+    if (g_hw < 0) crc32c_init();
+#endif
+}
+
+static uint32_t crc32c_soft(uint32_t c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        uint32_t lo = c ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        c = g_table[7][lo & 0xFF] ^ g_table[6][(lo >> 8) & 0xFF] ^ g_table[5][(lo >> 16) & 0xFF] ^ g_table[4][lo >> 24] ^
+            g_table[3][p[4]] ^ g_table[2][p[5]] ^ g_table[1][p[6]] ^ g_table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = (c >> 8) ^ g_table[0][(c ^ *p++) & 0xFF];
+    return c;
+}
+
+#if defined(__x86_64__) && defined(CRC32C_HW)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n) {
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = _mm_crc32_u8((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+#elif defined(CRC32C_HW)
+static uint32_t crc32c_hw(uint32_t c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = __crc32cb(c, *p++);
+    return c;
+}
+#endif
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t n) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t c = ~crc;
+    crc32c_ready();
+#ifdef CRC32C_HW
+    if (g_hw) return ~crc32c_hw(c, p, n);
+#endif
+    return ~crc32c_soft(c, p, n);
+}
+
+#define QH_P1 11400714785074694791ULL
+#define QH_P2 14029467366897019727ULL
+#define QH_P3 1609587929392839161ULL
+#define QH_P4 9650029242287828579ULL
+#define QH_P5 2870177450012600261ULL
+
+static uint64_t qh_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t qh_read64(const unsigned char *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint32_t qh_read32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t qh_round(uint64_t acc, uint64_t input) {
+    acc += input * QH_P2;
+    acc = qh_rotl(acc, 31);
+    return acc * QH_P1;
+}
+
+static uint64_t qh_merge(uint64_t acc, uint64_t val) {
+    acc ^= qh_round(0, val);
+    return acc * QH_P1 + QH_P4;
+}
+
+uint64_t hash64(const void *buf, size_t n, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + n;
+    uint64_t h;
+
+    if (n >= 32) {
+        uint64_t v1 = seed + QH_P1 + QH_P2;
+        uint64_t v2 = seed + QH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - QH_P1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = qh_round(v1, qh_read64(p));
+            v2 = qh_round(v2, qh_read64(p + 8));
+            v3 = qh_round(v3, qh_read64(p + 16));
+            v4 = qh_round(v4, qh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = qh_rotl(v1, 1) + qh_rotl(v2, 7) + qh_rotl(v3, 12) + qh_rotl(v4, 18);
+        h = qh_merge(h, v1);
+        h = qh_merge(h, v2);
+        h = qh_merge(h, v3);
+        h = qh_merge(h, v4);
+    } else {
+        h = seed + QH_P5;
+    }
+    h += (uint64_t)n;
+
+    while (p + 8 <= end) {
+        h ^= qh_round(0, qh_read64(p));
+        h = qh_rotl(h, 27) * QH_P1 + QH_P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)qh_read32(p) * QH_P1;
+        h = qh_rotl(h, 23) * QH_P2 + QH_P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (uint64_t)(*p++) * QH_P5;
+        h = qh_rotl(h, 11) * QH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= QH_P2;
+    h ^= h >> 29;
+    h *= QH_P3;
+    h ^= h >> 32;
+    return h;
+}
@@ -8,11 +8,64 @@ static int is_flag(const char *arg, const char *name) {
     return strcmp(arg, name) == 0;
 }
 
+static uint64_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    double mul = 1.0;
+    if (v <= 0.0) return 0;
+    switch (*end) {
+        case 'k': case 'K': mul = 1024.0; break;
+        case 'm': case 'M': mul = 1024.0 * 1024.0; break;
+        case 'g': case 'G': mul = 1024.0 * 1024.0 * 1024.0; break;
+        case 't': case 'T': mul = 1024.0 * 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+    }
+    return (uint64_t)(v * mul);
+}
+
+static void add_root(CliOptions *opts, const char *path, int io) {
+    if (opts->input[0] == '\0') {
+        snprintf(opts->input, sizeof(opts->input), "%s", path);
+        return;
+    }
+    if (opts->root_count >= CARTAG_MAX_ROOTS) {
+        fprintf(stderr, "Aviso: limite de %d raizes extras atingido; ignorando %s\n", CARTAG_MAX_ROOTS, path);
+        return;
+    }
+    snprintf(opts->roots[opts->root_count], sizeof(opts->roots[0]), "%s", path);
+    opts->root_io[opts->root_count] = io;
+    opts->root_count++;
+}
+
+static void load_roots_file(CliOptions *opts, const char *path) {
+    char **lines = NULL;
+    size_t count = 0;
+
+    if (downloader_read_url_file(path, &lines, &count) != 0) {
+        fprintf(stderr, "Aviso: nao foi possivel ler %s\n", path);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        char *tab = strrchr(lines[i], '\t');
+        int io = 0;
+        if (tab) {
+            *tab = '\0';
+            io = atoi(tab + 1);
+        }
+        if (lines[i][0]) add_root(opts, lines[i], io);
+    }
+    downloader_free_urls(lines, count);
+}
+
 int cli_parse(int argc, char **argv, CliOptions *opts) {
     int i;
     memset(opts, 0, sizeof(*opts));
     opts->organize = ORG_NONE;
     opts->simulate = SIM_NONE;
+    opts->jobs = 3;
+    opts->io_per_root = 2;
+    opts->fuzzy_threshold = 80;
+    opts->target_kbps = 320;
 
     if (argc < 2) {
         opts->interactive_tui = 1;
@@ -26,6 +79,12 @@ int cli_parse(int argc, char **argv, CliOptions *opts) {
             return -1;
         } else if (is_flag(arg, "--tui")) {
             opts->interactive_tui = 1;
+        } else if (is_flag(arg, "--watch")) {
+            opts->watch = 1;
+        } else if (is_flag(arg, "--serve") && i + 1 < argc) {
+            snprintf(opts->serve, sizeof(opts->serve), "%s", argv[++i]);
+        } else if (is_flag(arg, "--resume")) {
+            opts->resume = 1;
         } else if (is_flag(arg, "--keep-format")) {
             opts->keep_format = 1;
         } else if (is_flag(arg, "--convert-mp3")) {
@@ -36,6 +95,15 @@ int cli_parse(int argc, char **argv, CliOptions *opts) {
             opts->fix_tags = 1;
         } else if (is_flag(arg, "--dedupe")) {
             opts->dedupe = 1;
+        } else if (is_flag(arg, "--fingerprint")) {
+            opts->fingerprint = 1;
+        } else if (is_flag(arg, "--fuzzy") && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "review") == 0) opts->fuzzy = FUZZY_REVIEW;
+            else if (strcmp(mode, "longest") == 0) opts->fuzzy = FUZZY_LONGEST;
+            else if (strcmp(mode, "lossless") == 0) opts->fuzzy = FUZZY_LOSSLESS;
+        } else if (is_flag(arg, "--fuzzy-threshold") && i + 1 < argc) {
+            opts->fuzzy_threshold = atoi(argv[++i]);
         } else if (is_flag(arg, "--normalize-volume")) {
             opts->normalize_volume = 1;
         } else if (is_flag(arg, "--strip-art")) {
@@ -51,6 +119,7 @@ int cli_parse(int argc, char **argv, CliOptions *opts) {
             opts->strip_art = 1;
             opts->limit_name = 1;
             opts->prefix = 1;
+            opts->sequential = 1;
             if (opts->organize == ORG_NONE) opts->organize = ORG_ARTIST;
         } else if (is_flag(arg, "--organize") && i + 1 < argc) {
             const char *mode = argv[++i];
@@ -63,12 +132,67 @@ int cli_parse(int argc, char **argv, CliOptions *opts) {
             if (strcmp(mode, "generic") == 0) opts->simulate = SIM_GENERIC;
             else if (strcmp(mode, "fat") == 0) opts->simulate = SIM_FAT;
             else if (strcmp(mode, "filename") == 0) opts->simulate = SIM_FILENAME;
+        } else if ((is_flag(arg, "--output") && i + 1 < argc) || strncmp(arg, "--output=", 9) == 0) {
+            const char *mode = arg[8] == '=' ? arg + 9 : argv[++i];
+            if (strcmp(mode, "json") == 0) opts->output = OUTPUT_JSON;
+            else if (strcmp(mode, "text") == 0) opts->output = OUTPUT_TEXT;
+        } else if (is_flag(arg, "--select") && i + 1 < argc) {
+            char err[256];
+            snprintf(opts->select, sizeof(opts->select), "%s", argv[++i]);
+            select_free(&opts->select_query);
+            if (select_compile(&opts->select_query, opts->select, err, sizeof(err)) != 0) {
+                fprintf(stderr, "Erro: %s\n", err);
+                return -1;
+            }
+        } else if (is_flag(arg, "--batch") && i + 1 < argc) {
+            snprintf(opts->batch_file, sizeof(opts->batch_file), "%s", argv[++i]);
+        } else if (is_flag(arg, "--jobs") && i + 1 < argc) {
+            opts->jobs = atoi(argv[++i]);
+            if (opts->jobs < 1) opts->jobs = 1;
+        } else if (is_flag(arg, "--roots-file") && i + 1 < argc) {
+            load_roots_file(opts, argv[++i]);
+        } else if (is_flag(arg, "--io-per-root") && i + 1 < argc) {
+            opts->io_per_root = atoi(argv[++i]);
+            if (opts->io_per_root < 1) opts->io_per_root = 1;
+        } else if (is_flag(arg, "--prefer-root") && i + 1 < argc) {
+            snprintf(opts->prefer_root, sizeof(opts->prefer_root), "%s", argv[++i]);
+        } else if (is_flag(arg, "--capacity") && i + 1 < argc) {
+            opts->capacity_bytes = parse_size(argv[++i]);
+            opts->fit = opts->capacity_bytes > 0;
+        } else if (is_flag(arg, "--fit")) {
+            opts->fit = 1;
+        } else if (is_flag(arg, "--fit-bitrate")) {
+            opts->fit = 1;
+            opts->fit_bitrate = 1;
+        } else if (is_flag(arg, "--bitrate") && i + 1 < argc) {
+            opts->target_kbps = atoi(argv[++i]);
+            if (opts->target_kbps < 32 || opts->target_kbps > 320) opts->target_kbps = 320;
+        } else if (is_flag(arg, "--playcounts") && i + 1 < argc) {
+            snprintf(opts->playcounts_file, sizeof(opts->playcounts_file), "%s", argv[++i]);
         } else if (is_flag(arg, "--export") && i + 1 < argc) {
-            snprintf(opts->export_path, sizeof(opts->export_path), "%s", argv[++i]);
+            const char *path = argv[++i];
+            if (opts->export_path[0] == '\0') {
+                snprintf(opts->export_path, sizeof(opts->export_path), "%s", path);
+            } else if (opts->target_count >= CARTAG_MAX_TARGETS) {
+                fprintf(stderr, "Aviso: limite de %d destinos extras atingido; ignorando %s\n", CARTAG_MAX_TARGETS, path);
+            } else {
+                snprintf(opts->targets[opts->target_count], sizeof(opts->targets[0]), "%s", path);
+                opts->target_count++;
+            }
+        } else if (is_flag(arg, "--sequential")) {
+            opts->sequential = 1;
+        } else if (is_flag(arg, "--background")) {
+            opts->background = 1;
+        } else if (is_flag(arg, "--reprobe")) {
+            opts->reprobe = 1;
+        } else if (is_flag(arg, "--verify")) {
+            opts->verify = 1;
+        } else if (is_flag(arg, "--reverify") && i + 1 < argc) {
+            snprintf(opts->reverify, sizeof(opts->reverify), "%s", argv[++i]);
         } else if (arg[0] == '-') {
             fprintf(stderr, "Aviso: flag desconhecida: %s\n", arg);
         } else {
-            snprintf(opts->input, sizeof(opts->input), "%s", arg);
+            add_root(opts, arg, 0);
         }
     }
 
@@ -79,21 +203,48 @@ int cli_parse(int argc, char **argv, CliOptions *opts) {
     return 0;
 }
 
+void cli_free(CliOptions *opts) {
+    select_free(&opts->select_query);
+}
+
 void cli_print_help(void) {
     printf("cartag - organizador offline para pendrive automotivo\n\n");
-    printf("Uso: cartag <path-ou-url> [opcoes]\n");
+    printf("Uso: cartag <path-ou-url> [path...] [opcoes]\n");
     printf("  --tui\n");
     printf("  --keep-format\n");
     printf("  --convert-mp3\n");
     printf("  --group-by-format\n");
     printf("  --fix-tags\n");
     printf("  --dedupe\n");
+    printf("  --fingerprint\n");
+    printf("  --fuzzy review|longest|lossless\n");
+    printf("  --fuzzy-threshold <pct>\n");
     printf("  --normalize-volume\n");
     printf("  --strip-art\n");
     printf("  --resize-art <px>\n");
     printf("  --extract-art\n");
     printf("  --organize artist|album|flat|genre-artist\n");
     printf("  --simulate generic|fat|filename\n");
+    printf("  --select <expressao>\n");
+    printf("  --output text|json\n");
     printf("  --car-safe\n");
-    printf("  --export <destino>\n");
+    printf("  --export <destino> (repetivel)\n");
+    printf("  --sequential\n");
+    printf("  --reprobe\n");
+    printf("  --verify\n");
+    printf("  --reverify <destino>\n");
+    printf("  --capacity <tamanho>\n");
+    printf("  --fit\n");
+    printf("  --fit-bitrate\n");
+    printf("  --bitrate <kbps>\n");
+    printf("  --playcounts <arquivo>\n");
+    printf("  --roots-file <arquivo>\n");
+    printf("  --io-per-root <n>\n");
+    printf("  --prefer-root <path|n>\n");
+    printf("  --batch <arquivo-de-urls>\n");
+    printf("  --jobs <n>\n");
+    printf("  --background\n");
+    printf("  --resume\n");
+    printf("  --watch\n");
+    printf("  --serve <socket>\n");
 }
@@ -0,0 +1,549 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#define CUE_MAX_BYTES (64 * 1024)
+#define CUE_MIN_SECONDS 600
+#define CUE_MIN_BYTES ((uint64_t)64 << 20)
+#define CUE_MAX_JOBS 8
+#define CUE_SPLIT_TIMEOUT 3600
+
+typedef struct {
+    size_t first;
+    size_t end;
+    int used;
+    int last_pct;
+    ProcProgress pp;
+    Proc proc;
+} CueJob;
+
+typedef struct {
+    TrackList *list;
+    CueJob *jobs;
+    size_t count;
+} CueWatch;
+
+static int valid_utf8(const unsigned char *s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        size_t len = s[i] < 0x80 ? 1 : (s[i] >> 5) == 0x6 ? 2 : (s[i] >> 4) == 0xE ? 3 : (s[i] >> 3) == 0x1E ? 4 : 0;
+        if (len == 0 || i + len > n) return 0;
+        for (size_t k = 1; k < len; ++k) {
+            if ((s[i + k] & 0xC0) != 0x80) return 0;
+        }
+        i += len;
+    }
+    return 1;
+}
+
+static char *read_sheet(const char *path) {
+    FILE *f = fopen(path, "rb");
+    unsigned char *raw;
+    char *out;
+    size_t n;
+    size_t k = 0;
+
+    if (!f) return NULL;
+    raw = (unsigned char *)malloc(CUE_MAX_BYTES + 1);
+    if (!raw) {
+        fclose(f);
+        return NULL;
+    }
+    n = fread(raw, 1, CUE_MAX_BYTES, f);
+    fclose(f);
+    raw[n] = '\0';
+    if (n >= 3 && raw[0] == 0xEF && raw[1] == 0xBB && raw[2] == 0xBF) {
+        memmove(raw, raw + 3, n - 2);
+        n -= 3;
+    }
+    if (valid_utf8(raw, n)) return (char *)raw;
+
+    out = (char *)malloc(2 * n + 1);
+    if (out) {
+        for (size_t i = 0; i < n; ++i) {
+            if (raw[i] < 0x80) {
+                out[k++] = (char)raw[i];
+            } else {
+                out[k++] = (char)(0xC0 | (raw[i] >> 6));
+                out[k++] = (char)(0x80 | (raw[i] & 0x3F));
+            }
+        }
+        out[k] = '\0';
+    }
+    free(raw);
+    return out;
+}
+
+static const char *cue_value(const char *p, char *out, size_t out_sz) {
+    size_t n = 0;
+    while (*p == ' ' || *p == '\t') ++p;
+    if (*p == '"') {
+        ++p;
+        while (*p && *p != '"') {
+            if (n + 1 < out_sz) out[n++] = *p;
+            ++p;
+        }
+        if (*p == '"') ++p;
+    } else {
+        while (*p && *p != ' ' && *p != '\t') {
+            if (n + 1 < out_sz) out[n++] = *p;
+            ++p;
+        }
+    }
+    out[n] = '\0';
+    return p;
+}
+
+static int keyword(const char **p, const char *kw) {
+    size_t n = strlen(kw);
+    if (strncasecmp(*p, kw, n) != 0 || ((*p)[n] != ' ' && (*p)[n] != '\t')) return 0;
+    *p += n;
+    while (**p == ' ' || **p == '\t') ++*p;
+    return 1;
+}
+
+int cue_parse(const char *path, CueSheet *cs) {
+    char *text = read_sheet(path);
+    char *line;
+    char *next;
+    CueTrack *cur = NULL;
+    int files = 0;
+
+    memset(cs, 0, sizeof(*cs));
+    if (!text) return -1;
+    for (line = text; line; line = next) {
+        const char *p = line;
+        char val[CARTAG_NAME_MAX];
+
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        line[strcspn(line, "\r")] = '\0';
+        while (*p == ' ' || *p == '\t') ++p;
+
+        if (keyword(&p, "FILE")) {
+            if (++files > 1) break;
+            cue_value(p, cs->file, sizeof(cs->file));
+        } else if (keyword(&p, "TRACK")) {
+            if (cs->count >= CUE_MAX_TRACKS) break;
+            cur = &cs->tracks[cs->count++];
+            cur->number = atoi(p);
+            cur->start = UINT32_MAX;
+        } else if (keyword(&p, "INDEX") && cur) {
+            char *end;
+            long idx = strtol(p, &end, 10);
+            int mm = 0, ss = 0, ff = 0;
+            if (sscanf(end, " %d:%d:%d", &mm, &ss, &ff) == 3 && (idx == 1 || cur->start == UINT32_MAX)) {
+                cur->start = (uint32_t)((mm * 60 + ss) * CUE_FRAMES_PER_SECOND + ff);
+            }
+        } else if (keyword(&p, "PERFORMER")) {
+            cue_value(p, val, sizeof(val));
+            str_copy(cur ? cur->performer : cs->performer, sizeof(cs->performer), val);
+        } else if (keyword(&p, "TITLE")) {
+            cue_value(p, val, sizeof(val));
+            str_copy(cur ? cur->title : cs->title, sizeof(cs->title), val);
+        } else if (keyword(&p, "REM") && !cur) {
+            if (keyword(&p, "GENRE")) {
+                cue_value(p, val, sizeof(val));
+                str_copy(cs->genre, sizeof(cs->genre), val);
+            } else if (keyword(&p, "DATE")) {
+                cue_value(p, val, sizeof(val));
+                cs->year = atoi(val);
+            }
+        }
+    }
+    free(text);
+    if (files != 1) return -1;
+    for (size_t i = 0; i < cs->count; ++i) {
+        if (cs->tracks[i].start == UINT32_MAX) return -1;
+        if (i > 0 && cs->tracks[i].start <= cs->tracks[i - 1].start) return -1;
+    }
+    return cs->count >= 2 ? 0 : -1;
+}
+
+static size_t stem_len(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot ? (size_t)(dot - name) : strlen(name);
+}
+
+static int find_sheet(const AudioTrack *t, CueSheet *cs) {
+    char cue[CARTAG_PATH_MAX];
+    const char *ref;
+    size_t stem = stem_len(t->path);
+    struct stat st;
+
+    if (stem + 5 > sizeof(cue)) return -1;
+    memcpy(cue, t->path, stem);
+    memcpy(cue + stem, ".cue", 5);
+    if (stat(cue, &st) != 0) {
+        str_copy(cue, sizeof(cue), t->path);
+        str_append(cue, sizeof(cue), ".cue");
+        if (stat(cue, &st) != 0) return -1;
+    }
+    if (cue_parse(cue, cs) != 0) return -1;
+    ref = strrchr(cs->file, '/');
+    if (!ref) ref = strrchr(cs->file, '\\');
+    ref = ref ? ref + 1 : cs->file;
+    if (stem_len(ref) != stem_len(t->filename) || strncasecmp(ref, t->filename, stem_len(ref)) != 0) return -1;
+    return 0;
+}
+
+static void make_segment(const AudioTrack *album, const CueSheet *cs, size_t k, AudioTrack *t) {
+    const CueTrack *ct = &cs->tracks[k];
+    const char *ext = strrchr(album->filename, '.');
+    const char *slash = strrchr(album->rel_path, '/');
+    uint64_t key[2];
+    int total = album->duration_seconds;
+    int start_s = (int)(ct->start / CUE_FRAMES_PER_SECOND);
+
+    *t = *album;
+    t->cue_track = ct->number > 0 ? ct->number : (int)k + 1;
+    t->cue_start = ct->start;
+    t->cue_end = k + 1 < cs->count ? cs->tracks[k + 1].start : 0;
+    if (t->cue_end) t->duration_seconds = (int)((t->cue_end - t->cue_start) / CUE_FRAMES_PER_SECOND);
+    else t->duration_seconds = total > start_s ? total - start_s : 0;
+    if (total > 0) {
+        t->size_bytes = album->size_bytes * (uint64_t)t->duration_seconds / (uint64_t)total;
+    } else {
+        t->size_bytes = album->size_bytes / cs->count;
+        if (k + 1 == cs->count) t->size_bytes += album->size_bytes % cs->count;
+    }
+    key[0] = t->cue_start;
+    key[1] = t->cue_end;
+    t->quick_hash = hash64(key, sizeof(key), album->quick_hash);
+
+    if (ct->performer[0]) str_copy(t->artist, sizeof(t->artist), ct->performer);
+    else if (cs->performer[0]) str_copy(t->artist, sizeof(t->artist), cs->performer);
+    if (cs->title[0]) str_copy(t->album, sizeof(t->album), cs->title);
+    if (ct->title[0]) str_copy(t->title, sizeof(t->title), ct->title);
+    else snprintf(t->title, sizeof(t->title), "Faixa %02d", t->cue_track);
+    if (cs->genre[0]) str_copy(t->genre, sizeof(t->genre), cs->genre);
+    if (cs->year > 0) t->year = cs->year;
+    t->track_no = t->cue_track;
+    t->has_tags = 1;
+
+    snprintf(t->filename, sizeof(t->filename), "%02d - %s%s", t->cue_track, t->title, ext ? ext : "");
+    if (slash) {
+        snprintf(t->rel_path, sizeof(t->rel_path), "%.*s/%s", (int)(slash - album->rel_path), album->rel_path, t->filename);
+    } else {
+        str_copy(t->rel_path, sizeof(t->rel_path), t->filename);
+    }
+}
+
+size_t cue_expand(TrackList *list) {
+    TrackList out;
+    CueSheet *cs;
+    size_t albums = 0;
+    int ffmpeg = -1;
+
+    cs = (CueSheet *)malloc(sizeof(CueSheet));
+    if (!cs) return 0;
+    memset(&out, 0, sizeof(out));
+    for (size_t i = 0; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        int big = t->duration_seconds >= CUE_MIN_SECONDS || (t->duration_seconds <= 0 && t->size_bytes >= CUE_MIN_BYTES);
+
+        if (!big || t->cue_track || find_sheet(t, cs) != 0) {
+            if (albums && tracklist_push(&out, t) != 0) break;
+            continue;
+        }
+        if (ffmpeg < 0) ffmpeg = audio_has_ffmpeg();
+        if (!ffmpeg) {
+            progress_log(LVL_WARN, "ffmpeg ausente; folhas CUE nao serao divididas");
+            break;
+        }
+        if (!albums) {
+            for (size_t k = 0; k < i; ++k) tracklist_push(&out, &list->tracks[k]);
+        }
+        for (size_t k = 0; k < cs->count; ++k) {
+            AudioTrack seg;
+            make_segment(t, cs, k, &seg);
+            tracklist_push(&out, &seg);
+        }
+        albums++;
+    }
+    free(cs);
+    if (!albums || !ffmpeg) {
+        tracklist_free(&out);
+        return 0;
+    }
+    tracklist_free(list);
+    *list = out;
+    progress_log(LVL_INFO, "CUE: %zu albuns divididos em faixas virtuais", albums);
+    return albums;
+}
+
+static int split_live(const AudioTrack *t) {
+    return t->cue_track && !t->converted && !t->duplicate && !t->excluded && !t->unselected && !t->omitted;
+}
+
+static void split_output(const AudioTrack *t, char *out, size_t out_sz) {
+    const char *ext = t->convert ? ".mp3" : strrchr(t->filename, '.');
+    if (snprintf(out, out_sz, "%s.%02d.converted%s", t->path, t->cue_track, ext ? ext : "") >= (int)out_sz) out[0] = '\0';
+}
+
+static uint64_t frame_sample(uint32_t frame, int rate) {
+    return (uint64_t)frame * (uint64_t)rate / CUE_FRAMES_PER_SECOND;
+}
+
+static void add_trim(char *graph, size_t graph_sz, const AudioTrack *t, size_t k) {
+    char part[160];
+    int rate = t->stream.sample_rate;
+
+    if (rate > 0 && t->cue_end) {
+        snprintf(part, sizeof(part), ";[s%zu]atrim=start_sample=%llu:end_sample=%llu,asetpts=PTS-STARTPTS[o%zu]", k,
+                 (unsigned long long)frame_sample(t->cue_start, rate), (unsigned long long)frame_sample(t->cue_end, rate), k);
+    } else if (rate > 0) {
+        snprintf(part, sizeof(part), ";[s%zu]atrim=start_sample=%llu,asetpts=PTS-STARTPTS[o%zu]", k,
+                 (unsigned long long)frame_sample(t->cue_start, rate), k);
+    } else if (t->cue_end) {
+        snprintf(part, sizeof(part), ";[s%zu]atrim=start=%.6f:end=%.6f,asetpts=PTS-STARTPTS[o%zu]", k,
+                 t->cue_start / (double)CUE_FRAMES_PER_SECOND, t->cue_end / (double)CUE_FRAMES_PER_SECOND, k);
+    } else {
+        snprintf(part, sizeof(part), ";[s%zu]atrim=start=%.6f,asetpts=PTS-STARTPTS[o%zu]", k,
+                 t->cue_start / (double)CUE_FRAMES_PER_SECOND, k);
+    }
+    str_append(graph, graph_sz, part);
+}
+
+typedef struct {
+    const char **argv;
+    char *strings;
+    size_t argc;
+    size_t used;
+    size_t cap;
+} SplitCmd;
+
+static const char *cmd_str(SplitCmd *c, const char *s) {
+    char *dst = c->strings + c->used;
+    size_t n = strlen(s);
+    if (n + 1 > c->cap - c->used) return "";
+    memcpy(dst, s, n + 1);
+    c->used += n + 1;
+    return dst;
+}
+
+static int build_split(const TrackList *list, const CueJob *job, const CliOptions *opts, SplitCmd *c) {
+    size_t n = 0;
+    size_t k = 0;
+    size_t graph_sz;
+    char *graph;
+    const AudioTrack *first = &list->tracks[job->first];
+
+    for (size_t i = job->first; i < job->end; ++i) n += split_live(&list->tracks[i]);
+    graph_sz = 64 + n * 160;
+    c->cap = graph_sz + n * (3 * CARTAG_PATH_MAX + 64);
+    c->argv = (const char **)malloc((24 + n * 24) * sizeof(char *));
+    c->strings = (char *)malloc(c->cap);
+    if (!c->argv || !c->strings) return -1;
+    c->used = 0;
+    c->argc = 0;
+
+    graph = c->strings;
+    c->used = graph_sz;
+    snprintf(graph, graph_sz, "[0:a]asplit=%zu", n);
+    for (k = 0; k < n; ++k) {
+        char label[24];
+        snprintf(label, sizeof(label), "[s%zu]", k);
+        str_append(graph, graph_sz, label);
+    }
+    k = 0;
+    for (size_t i = job->first; i < job->end; ++i) {
+        if (split_live(&list->tracks[i])) add_trim(graph, graph_sz, &list->tracks[i], k++);
+    }
+
+    c->argv[c->argc++] = "ffmpeg";
+    c->argv[c->argc++] = "-nostdin";
+    c->argv[c->argc++] = "-nostats";
+    c->argv[c->argc++] = "-y";
+    c->argv[c->argc++] = "-i";
+    c->argv[c->argc++] = first->path;
+    c->argv[c->argc++] = "-filter_complex";
+    c->argv[c->argc++] = graph;
+    k = 0;
+    for (size_t i = job->first; i < job->end; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        char buf[CARTAG_PATH_MAX];
+        if (!split_live(t)) continue;
+        snprintf(buf, sizeof(buf), "[o%zu]", k++);
+        c->argv[c->argc++] = "-map";
+        c->argv[c->argc++] = cmd_str(c, buf);
+        if (t->convert) {
+            int rate = t->stream.sample_rate;
+            if (opts->car_safe || (rate != 32000 && rate != 48000)) rate = 44100;
+            snprintf(buf, sizeof(buf), "%d", rate);
+            c->argv[c->argc++] = "-ar";
+            c->argv[c->argc++] = cmd_str(c, buf);
+            c->argv[c->argc++] = "-ac";
+            c->argv[c->argc++] = t->stream.channels == 1 ? "1" : "2";
+            snprintf(buf, sizeof(buf), "%dk", t->target_kbps > 0 ? t->target_kbps : opts->target_kbps);
+            c->argv[c->argc++] = "-b:a";
+            c->argv[c->argc++] = cmd_str(c, buf);
+            c->argv[c->argc++] = "-id3v2_version";
+            c->argv[c->argc++] = "3";
+        }
+        snprintf(buf, sizeof(buf), "title=%s", t->title);
+        c->argv[c->argc++] = "-metadata";
+        c->argv[c->argc++] = cmd_str(c, buf);
+        snprintf(buf, sizeof(buf), "artist=%s", t->artist);
+        c->argv[c->argc++] = "-metadata";
+        c->argv[c->argc++] = cmd_str(c, buf);
+        snprintf(buf, sizeof(buf), "album=%s", t->album);
+        c->argv[c->argc++] = "-metadata";
+        c->argv[c->argc++] = cmd_str(c, buf);
+        snprintf(buf, sizeof(buf), "track=%d", t->cue_track);
+        c->argv[c->argc++] = "-metadata";
+        c->argv[c->argc++] = cmd_str(c, buf);
+        split_output(t, buf, sizeof(buf));
+        c->argv[c->argc++] = cmd_str(c, buf);
+    }
+    c->argv[c->argc++] = "-progress";
+    c->argv[c->argc++] = "pipe:1";
+    c->argv[c->argc] = NULL;
+    return 0;
+}
+
+static void split_free(SplitCmd *c) {
+    free((void *)c->argv);
+    free(c->strings);
+    memset(c, 0, sizeof(*c));
+}
+
+static void split_finish(TrackList *list, const CueJob *job, int rc) {
+    for (size_t i = job->first; i < job->end; ++i) {
+        AudioTrack *t = &list->tracks[i];
+        char out[CARTAG_PATH_MAX];
+        struct stat st;
+        if (!split_live(t)) continue;
+        split_output(t, out, sizeof(out));
+        if (rc != 0 || stat(out, &st) != 0) {
+            remove(out);
+            t->excluded = 1;
+            log_track_issue(LVL_WARN, t->filename, progress_cancelled() ? "divisao CUE cancelada" : "falha ao dividir folha CUE");
+            continue;
+        }
+        str_copy(t->path, sizeof(t->path), out);
+        t->size_bytes = (uint64_t)st.st_size;
+        if (t->convert) t->format = FORMAT_MP3;
+        t->converted = 1;
+    }
+}
+
+static size_t next_job(const TrackList *list, size_t from, CueJob *job) {
+    size_t i = from;
+    while (i < list->count && !split_live(&list->tracks[i])) ++i;
+    job->first = job->end = i;
+    if (i >= list->count) return i;
+    while (i < list->count && list->tracks[i].cue_track && strcmp(list->tracks[i].path, list->tracks[job->first].path) == 0) ++i;
+    job->end = i;
+    job->last_pct = -1;
+    memset(&job->pp, 0, sizeof(job->pp));
+    return i;
+}
+
+static void split_line(Proc *p, int stream, const char *line, void *ctx) {
+    CueWatch *cw = (CueWatch *)ctx;
+    (void)stream;
+    for (size_t s = 0; s < cw->count; ++s) {
+        CueJob *job = &cw->jobs[s];
+        int pct;
+        if (&job->proc != p) continue;
+        if (!proc_parse_ffmpeg_line(line, &job->pp) || job->pp.total_seconds <= 0.0) return;
+        pct = (int)job->pp.percent;
+        if (pct == job->last_pct) return;
+        job->last_pct = pct;
+        progress_detail("cue %3d%%  %.1fx  %s", pct, job->pp.speed, cw->list->tracks[job->first].album);
+        return;
+    }
+}
+
+size_t cue_split(TrackList *list, const CliOptions *opts) {
+    CueJob jobs[CUE_MAX_JOBS];
+    CueWatch cw;
+    SplitCmd cmd;
+    size_t next = 0;
+    size_t albums = 0;
+    int slots = sched_workers(opts->jobs > CUE_MAX_JOBS ? CUE_MAX_JOBS : opts->jobs);
+    int held = 0;
+
+    memset(jobs, 0, sizeof(jobs));
+    memset(&cmd, 0, sizeof(cmd));
+    cw.list = list;
+    cw.jobs = jobs;
+    cw.count = (size_t)slots;
+
+#ifdef _WIN32
+    (void)slots;
+    (void)held;
+    while (!progress_cancelled()) {
+        int rc;
+        next = next_job(list, next, &jobs[0]);
+        if (jobs[0].end <= jobs[0].first) break;
+        rc = build_split(list, &jobs[0], opts, &cmd) == 0 ? proc_run(cmd.argv, CUE_SPLIT_TIMEOUT, NULL, NULL) : -1;
+        split_finish(list, &jobs[0], rc);
+        split_free(&cmd);
+        albums++;
+    }
+#else
+    for (;;) {
+        Proc *procs[CUE_MAX_JOBS];
+        int cancelled = progress_cancelled();
+        int active = 0;
+        struct timespec ts;
+        double now;
+
+        for (int s = 0; s < slots && next < list->count && !cancelled; ++s) {
+            if (jobs[s].used) continue;
+            if (!sched_cpu_try()) {
+                if (held > 0) break;
+                sched_cpu_acquire();
+            }
+            next = next_job(list, next, &jobs[s]);
+            if (jobs[s].end <= jobs[s].first) {
+                sched_cpu_release();
+                break;
+            }
+            if (build_split(list, &jobs[s], opts, &cmd) != 0 || proc_spawn(&jobs[s].proc, cmd.argv) != 0) {
+                split_finish(list, &jobs[s], -1);
+                split_free(&cmd);
+                sched_cpu_release();
+                continue;
+            }
+            split_free(&cmd);
+            jobs[s].used = 1;
+            held++;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+        for (int s = 0; s < slots; ++s) {
+            procs[s] = jobs[s].used ? &jobs[s].proc : NULL;
+            if (!jobs[s].used) continue;
+            active++;
+            if (cancelled || now - jobs[s].proc.started > CUE_SPLIT_TIMEOUT) proc_kill(&jobs[s].proc);
+        }
+        if (active == 0) break;
+
+        proc_pump(procs, (size_t)slots, 200, split_line, &cw);
+        for (int s = 0; s < slots; ++s) {
+            Proc *p = &jobs[s].proc;
+            if (!jobs[s].used || p->running || p->out_fd >= 0 || p->err_fd >= 0) continue;
+            jobs[s].used = 0;
+            sched_cpu_release();
+            held--;
+            split_finish(list, &jobs[s], p->killed ? -1 : p->exit_code);
+            albums++;
+        }
+    }
+#endif
+    return albums;
+}
@@ -0,0 +1,269 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
+
+#define DEVPROBE_BYTES ((size_t)4 << 20)
+#define DEVPROBE_MAX_BLOCK ((size_t)4 << 20)
+#define DEVPROBE_MARGIN 1.10
+
+static const size_t k_probe_blocks[] = {64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+
+typedef struct {
+    char path[CARTAG_PATH_MAX];
+    const unsigned char *data;
+    size_t block;
+    size_t bytes;
+    int rc;
+} ProbeFile;
+
+static double now_seconds(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void device_id(const char *root, char *out, size_t out_sz) {
+    struct stat st;
+
+    out[0] = '\0';
+    if (stat(root, &st) != 0) return;
+#ifdef __linux__
+    {
+        DIR *d = opendir("/dev/disk/by-uuid");
+        struct dirent *e;
+        while (d && (e = readdir(d)) != NULL) {
+            char path[CARTAG_PATH_MAX];
+            struct stat bs;
+            if (e->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "/dev/disk/by-uuid/%s", e->d_name);
+            if (stat(path, &bs) == 0 && S_ISBLK(bs.st_mode) && bs.st_rdev == st.st_dev) {
+                snprintf(out, out_sz, "uuid:%.58s", e->d_name);
+                break;
+            }
+        }
+        if (d) closedir(d);
+    }
+#endif
+    if (!out[0]) snprintf(out, out_sz, "dev:%llx", (unsigned long long)st.st_dev);
+}
+
+static int cache_lookup(const char *id, DeviceProfile *dev) {
+    char path[CARTAG_PATH_MAX];
+    char line[256];
+    FILE *f;
+    int found = 0;
+
+    fs_cache_path(DEVPROBE_CACHE_FILE, path, sizeof(path));
+    if (!path[0] || !(f = fopen(path, "r"))) return 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        char key[64];
+        unsigned long block;
+        int writers;
+        double wr, rd;
+        if (sscanf(line, "%63[^\t]\t%lu\t%d\t%lf\t%lf", key, &block, &writers, &wr, &rd) != 5) continue;
+        if (strcmp(key, id) != 0 || block == 0 || writers < 1) continue;
+        dev->block = (size_t)block;
+        dev->writers = writers > DEVPROBE_MAX_WRITERS ? DEVPROBE_MAX_WRITERS : writers;
+        dev->write_rate = wr;
+        dev->read_rate = rd;
+        found = 1;
+    }
+    fclose(f);
+    return found;
+}
+
+static void cache_store(const DeviceProfile *dev) {
+    char path[CARTAG_PATH_MAX];
+    char part[CARTAG_PATH_MAX];
+    char line[256];
+    size_t id_len = strlen(dev->id);
+    FILE *in;
+    FILE *out;
+
+    fs_cache_path(DEVPROBE_CACHE_FILE, path, sizeof(path));
+    if (!path[0] || !(out = fs_open_part(path, part, sizeof(part)))) return;
+    in = fopen(path, "r");
+    while (in && fgets(line, sizeof(line), in)) {
+        if (strncmp(line, dev->id, id_len) == 0 && line[id_len] == '\t') continue;
+        fputs(line, out);
+    }
+    if (in) fclose(in);
+    fprintf(out, "%s\t%lu\t%d\t%.0f\t%.0f\n", dev->id, (unsigned long)dev->block, dev->writers, dev->write_rate,
+            dev->read_rate);
+    fs_commit_part(out, part, path, ferror(out) ? -1 : 0);
+}
+
+static void probe_write(ProbeFile *pf) {
+    FILE *f = fopen(pf->path, "wb");
+    size_t done = 0;
+
+    pf->rc = f ? 0 : -1;
+    if (!f) return;
+    setvbuf(f, NULL, _IONBF, 0);
+    while (pf->rc == 0 && done < pf->bytes) {
+        size_t n = pf->bytes - done < pf->block ? pf->bytes - done : pf->block;
+        if (fwrite(pf->data, 1, n, f) != n) pf->rc = -1;
+        done += n;
+    }
+    if (fs_sync_stream(f) != 0) pf->rc = -1;
+    if (fclose(f) != 0) pf->rc = -1;
+}
+
+static int probe_read(const ProbeFile *pf, unsigned char *buf) {
+    FILE *f = fopen(pf->path, "rb");
+    size_t done = 0;
+    size_t n;
+    int rc = 0;
+
+    if (!f) return -1;
+#ifndef _WIN32
+    posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    setvbuf(f, NULL, _IONBF, 0);
+    while (rc == 0 && (n = fread(buf, 1, pf->block, f)) > 0) {
+        if (memcmp(buf, pf->data, n) != 0) rc = -1;
+        done += n;
+    }
+    if (ferror(f) || done != pf->bytes) rc = -1;
+    fclose(f);
+    return rc;
+}
+
+#ifndef _WIN32
+static void *probe_writer(void *arg) {
+    probe_write((ProbeFile *)arg);
+    return NULL;
+}
+#endif
+
+static int probe_config(const char *root, const unsigned char *data, unsigned char *scratch, size_t block, int writers,
+                        double *write_rate, double *read_rate) {
+    ProbeFile pf[DEVPROBE_MAX_WRITERS];
+    char name[32];
+    double t0;
+    double t1;
+    double t2;
+    int rc = 0;
+
+    for (int k = 0; k < writers; ++k) {
+        snprintf(name, sizeof(name), DEVPROBE_TMP_NAME ".%d", k);
+        path_join2(pf[k].path, sizeof(pf[k].path), root, name);
+        pf[k].data = data;
+        pf[k].block = block;
+        pf[k].bytes = DEVPROBE_BYTES / (size_t)writers;
+        pf[k].rc = 0;
+    }
+
+    t0 = now_seconds();
+#ifndef _WIN32
+    {
+        pthread_t threads[DEVPROBE_MAX_WRITERS];
+        int started[DEVPROBE_MAX_WRITERS];
+        for (int k = 1; k < writers; ++k) started[k] = pthread_create(&threads[k], NULL, probe_writer, &pf[k]) == 0;
+        probe_write(&pf[0]);
+        for (int k = 1; k < writers; ++k) {
+            if (started[k]) pthread_join(threads[k], NULL);
+            else probe_write(&pf[k]);
+        }
+    }
+#else
+    for (int k = 0; k < writers; ++k) probe_write(&pf[k]);
+#endif
+    t1 = now_seconds();
+    for (int k = 0; k < writers; ++k) {
+        if (pf[k].rc != 0) rc = -1;
+    }
+    for (int k = 0; rc == 0 && k < writers; ++k) {
+        if (probe_read(&pf[k], scratch) != 0) rc = -2;
+    }
+    t2 = now_seconds();
+    *write_rate = t1 > t0 ? (double)DEVPROBE_BYTES / (t1 - t0) : 0.0;
+    *read_rate = t2 > t1 ? (double)DEVPROBE_BYTES / (t2 - t1) : 0.0;
+    for (int k = 0; k < writers; ++k) remove(pf[k].path);
+    return rc;
+}
+
+static int probe_device(const char *root, DeviceProfile *dev) {
+    unsigned char *data = (unsigned char *)malloc(DEVPROBE_MAX_BLOCK);
+    unsigned char *scratch = (unsigned char *)malloc(DEVPROBE_MAX_BLOCK);
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    int rc = 0;
+
+    if (!data || !scratch) {
+        free(data);
+        free(scratch);
+        return -1;
+    }
+    for (size_t i = 0; i < DEVPROBE_MAX_BLOCK; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        data[i] = (unsigned char)x;
+    }
+
+    dev->write_rate = 0.0;
+    for (size_t b = 0; rc == 0 && b < sizeof(k_probe_blocks) / sizeof(k_probe_blocks[0]); ++b) {
+        double wr, rd;
+        rc = probe_config(root, data, scratch, k_probe_blocks[b], 1, &wr, &rd);
+        if (rc == 0 && wr > dev->write_rate * DEVPROBE_MARGIN) {
+            dev->block = k_probe_blocks[b];
+            dev->write_rate = wr;
+            dev->read_rate = rd;
+        }
+    }
+#ifndef _WIN32
+    for (int w = 2; rc == 0 && w <= DEVPROBE_MAX_WRITERS; w *= 2) {
+        double wr, rd;
+        rc = probe_config(root, data, scratch, dev->block, w, &wr, &rd);
+        if (rc == 0 && wr > dev->write_rate * DEVPROBE_MARGIN) {
+            dev->writers = w;
+            dev->write_rate = wr;
+            dev->read_rate = rd;
+        }
+    }
+#endif
+    free(data);
+    free(scratch);
+    return rc;
+}
+
+int devprobe_profile(const char *root, int force, DeviceProfile *dev) {
+    int rc;
+
+    memset(dev, 0, sizeof(*dev));
+    dev->writers = 1;
+    device_id(root, dev->id, sizeof(dev->id));
+    if (!dev->id[0]) return -1;
+    if (!force && cache_lookup(dev->id, dev)) {
+        dev->cached = 1;
+        return 0;
+    }
+
+    rc = probe_device(root, dev);
+    if (rc != 0) {
+        if (rc == -2) progress_log(LVL_WARN, "%s: leitura de teste nao confere com o que foi gravado", root);
+        else progress_log(LVL_WARN, "%s: teste de velocidade falhou; usando configuracao padrao", root);
+        dev->block = 0;
+        dev->writers = 1;
+        dev->write_rate = 0.0;
+        return -1;
+    }
+    cache_store(dev);
+    return 0;
+}
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cartag.h"
 
 #include <stdio.h>
@@ -8,13 +10,18 @@
 #include <io.h>
 #define ACCESS _access
 #else
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #define ACCESS access
 #endif
 
-static int cmd_ok(const char *cmd) {
-    return system(cmd) == 0;
-}
+#define DL_FILE_TAG "cartag-file:"
+#define DL_MAX_JOBS PROC_MAX_PUMP
+#define DL_PROBE_TIMEOUT 15
+#define DL_INSTALL_TIMEOUT 300
+#define DL_FETCH_TIMEOUT 3600
+#define YTDLP_RELEASE_URL "https://github.com/yt-dlp/yt-dlp/releases/latest/download/"
 
 int downloader_is_url(const char *s) {
     if (!s) return 0;
@@ -22,7 +29,14 @@ int downloader_is_url(const char *s) {
 }
 
 static int ensure_ytdlp(char *exe, size_t exe_sz, char *warn, size_t warn_sz) {
-    if (cmd_ok("yt-dlp --version > /dev/null 2>&1")) {
+    const char *override = getenv("CARTAG_YTDLP");
+    const char *version_argv[] = {"yt-dlp", "--version", NULL};
+    if (override && override[0]) {
+        snprintf(exe, exe_sz, "%s", override);
+        snprintf(warn, warn_sz, "yt-dlp definido por CARTAG_YTDLP");
+        return 0;
+    }
+    if (proc_run(version_argv, DL_PROBE_TIMEOUT, NULL, NULL) == 0) {
         snprintf(exe, exe_sz, "yt-dlp");
         snprintf(warn, warn_sz, "yt-dlp encontrado no sistema");
         return 0;
@@ -34,9 +48,12 @@ static int ensure_ytdlp(char *exe, size_t exe_sz, char *warn, size_t warn_sz) {
         snprintf(warn, warn_sz, "yt-dlp local ja disponivel");
         return 0;
     }
-    if (!cmd_ok("curl -L --fail https://github.com/yt-dlp/yt-dlp/releases/latest/download/yt-dlp.exe -o yt-dlp.exe > NUL 2>&1")) {
-        snprintf(warn, warn_sz, "falha ao baixar yt-dlp.exe via curl");
-        return -1;
+    {
+        const char *curl_argv[] = {"curl", "-L", "--fail", "-sS", YTDLP_RELEASE_URL "yt-dlp.exe", "-o", "yt-dlp.exe", NULL};
+        if (proc_run(curl_argv, DL_INSTALL_TIMEOUT, NULL, NULL) != 0) {
+            snprintf(warn, warn_sz, "falha ao baixar yt-dlp.exe via curl");
+            return -1;
+        }
     }
 #else
     snprintf(exe, exe_sz, "./yt-dlp");
@@ -44,42 +61,247 @@ static int ensure_ytdlp(char *exe, size_t exe_sz, char *warn, size_t warn_sz) {
         snprintf(warn, warn_sz, "yt-dlp local ja disponivel");
         return 0;
     }
-    if (!cmd_ok("curl -L --fail https://github.com/yt-dlp/yt-dlp/releases/latest/download/yt-dlp -o yt-dlp > /dev/null 2>&1")) {
-        snprintf(warn, warn_sz, "falha ao baixar yt-dlp via curl");
+    {
+        const char *curl_argv[] = {"curl", "-L", "--fail", "-sS", YTDLP_RELEASE_URL "yt-dlp", "-o", "yt-dlp", NULL};
+        if (proc_run(curl_argv, DL_INSTALL_TIMEOUT, NULL, NULL) != 0) {
+            remove("yt-dlp");
+            snprintf(warn, warn_sz, "falha ao baixar yt-dlp via curl");
+            return -1;
+        }
+    }
+    if (chmod("yt-dlp", 0755) != 0) {
+        snprintf(warn, warn_sz, "yt-dlp baixado mas sem permissao de execucao");
         return -1;
     }
-    cmd_ok("chmod +x yt-dlp");
 #endif
 
     snprintf(warn, warn_sz, "yt-dlp instalado no diretorio atual");
     return 0;
 }
 
-int downloader_fetch_audio(const char *url, const char *out_dir, char *warn, size_t warn_sz) {
-    char exe[CARTAG_PATH_MAX];
-    char cmd[4096];
+static int is_playlist_url(const char *url) {
+    return strstr(url, "list=") != NULL || strstr(url, "/playlist") != NULL;
+}
 
-    if (!downloader_is_url(url)) {
-        snprintf(warn, warn_sz, "URL invalida");
-        return -1;
+typedef struct {
+    Proc proc;
+    int used;
+    size_t url_index;
+    size_t produced;
+    int last_pct;
+    ProcProgress pp;
+} DlSlot;
+
+typedef struct {
+    const char *out_dir;
+    const char *const *urls;
+    TrackList *out;
+    DlSlot *single;
+} DlCtx;
+
+typedef struct {
+    const char *argv[16];
+    char tpl[CARTAG_PATH_MAX + 32];
+} DlCommand;
+
+static void build_fetch_argv(DlCommand *c, const char *exe, const char *url, const char *out_dir) {
+    size_t n = 0;
+    snprintf(c->tpl, sizeof(c->tpl), "%s/%%(title)s.%%(ext)s", out_dir);
+    c->argv[n++] = exe;
+    c->argv[n++] = "-x";
+    c->argv[n++] = "--audio-format";
+    c->argv[n++] = "mp3";
+    c->argv[n++] = "--audio-quality";
+    c->argv[n++] = "0";
+    c->argv[n++] = "--embed-metadata";
+    c->argv[n++] = is_playlist_url(url) ? "--yes-playlist" : "--no-playlist";
+    c->argv[n++] = "--newline";
+    c->argv[n++] = "--progress";
+    c->argv[n++] = "--print";
+    c->argv[n++] = "after_move:" DL_FILE_TAG "%(filepath)s";
+    c->argv[n++] = "-o";
+    c->argv[n++] = c->tpl;
+    c->argv[n++] = url;
+    c->argv[n] = NULL;
+}
+
+static void dl_line(Proc *p, int stream, const char *line, void *arg) {
+    DlCtx *ctx = (DlCtx *)arg;
+    DlSlot *slot = ctx->single ? ctx->single : (DlSlot *)p;
+    AudioTrack t;
+    const char *path;
+
+    if (stream != PROC_STDOUT) return;
+    path = strstr(line, DL_FILE_TAG);
+    if (path) {
+        path += strlen(DL_FILE_TAG);
+        if (fs_probe_track(path, ctx->out_dir, &t) == 0 && tracklist_push(ctx->out, &t) == 0) slot->produced++;
+        return;
+    }
+    if (proc_parse_ytdlp_line(line, &slot->pp) && (int)slot->pp.percent != slot->last_pct) {
+        slot->last_pct = (int)slot->pp.percent;
+        progress_detail("yt-dlp %3d%%  %s", slot->last_pct, ctx->urls[slot->url_index]);
     }
+}
 
-    if (ensure_ytdlp(exe, sizeof(exe), warn, warn_sz) != 0) {
+static int dl_result(const DlSlot *slot, int exit_code, const char *const *urls) {
+    if (exit_code != 0 || slot->produced == 0) {
+        progress_log(LVL_WARN, "falha ao baixar audio com yt-dlp: %s", urls[slot->url_index]);
         return -1;
     }
+    return 0;
+}
+
+static void dl_slot_reset(DlSlot *slot, size_t url_index) {
+    memset(slot, 0, sizeof(*slot));
+    slot->url_index = url_index;
+    slot->last_pct = -1;
+}
+
+int downloader_fetch_batch(const char *const *urls, size_t count, const char *out_dir, int jobs,
+                           TrackList *out, char *warn, size_t warn_sz) {
+    char exe[CARTAG_PATH_MAX];
+    DlCommand cmd;
+    DlSlot slots[DL_MAX_JOBS];
+    DlCtx ctx;
+    size_t next = 0;
+    size_t finished = 0;
+    size_t failed = 0;
+    size_t before = out->count;
 
+    if (ensure_ytdlp(exe, sizeof(exe), warn, warn_sz) != 0) return -1;
+    if (jobs < 1) jobs = 1;
+    if (jobs > DL_MAX_JOBS) jobs = DL_MAX_JOBS;
+    memset(slots, 0, sizeof(slots));
     fs_ensure_directory(out_dir);
-    snprintf(cmd, sizeof(cmd),
-             "%s -x --audio-format mp3 --audio-quality 0 --embed-metadata --no-playlist -o \"%s/%%(title)s.%%(ext)s\" \"%s\"",
-             exe,
-             out_dir,
-             url);
+    ctx.out_dir = out_dir;
+    ctx.urls = urls;
+    ctx.out = out;
+    ctx.single = NULL;
 
-    if (system(cmd) != 0) {
+#ifdef _WIN32
+    ctx.single = &slots[0];
+    for (; next < count; ++next) {
+        int rc;
+        if (progress_cancelled()) break;
+        if (!downloader_is_url(urls[next])) {
+            progress_log(LVL_WARN, "URL invalida: %s", urls[next]);
+            failed++;
+            continue;
+        }
+        dl_slot_reset(&slots[0], next);
+        build_fetch_argv(&cmd, exe, urls[next], out_dir);
+        rc = proc_run(cmd.argv, DL_FETCH_TIMEOUT, dl_line, &ctx);
+        if (dl_result(&slots[0], rc, urls) != 0) failed++;
+        progress_advance(++finished, 0);
+    }
+#else
+    for (;;) {
+        Proc *procs[DL_MAX_JOBS];
+        int cancelled = progress_cancelled();
+        int active = 0;
+        struct timespec ts;
+        double now;
+
+        for (int s = 0; s < jobs && next < count && !cancelled; ++s) {
+            if (slots[s].used) continue;
+            while (next < count && !downloader_is_url(urls[next])) {
+                progress_log(LVL_WARN, "URL invalida: %s", urls[next]);
+                failed++;
+                next++;
+            }
+            if (next >= count) break;
+            dl_slot_reset(&slots[s], next++);
+            build_fetch_argv(&cmd, exe, urls[slots[s].url_index], out_dir);
+            if (proc_spawn(&slots[s].proc, cmd.argv) != 0) {
+                dl_result(&slots[s], -1, urls);
+                failed++;
+                continue;
+            }
+            slots[s].used = 1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+        for (int s = 0; s < jobs; ++s) {
+            procs[s] = slots[s].used ? &slots[s].proc : NULL;
+            if (!slots[s].used) continue;
+            active++;
+            if (cancelled || now - slots[s].proc.started > DL_FETCH_TIMEOUT) proc_kill(&slots[s].proc);
+        }
+        if (active == 0) break;
+
+        proc_pump(procs, (size_t)jobs, 200, dl_line, &ctx);
+        for (int s = 0; s < jobs; ++s) {
+            Proc *p = &slots[s].proc;
+            if (!slots[s].used || p->running || p->out_fd >= 0 || p->err_fd >= 0) continue;
+            slots[s].used = 0;
+            if (dl_result(&slots[s], p->exit_code, urls) != 0) failed++;
+            progress_advance(++finished, 0);
+        }
+    }
+#endif
+
+    snprintf(warn, warn_sz, "%zu faixas baixadas de %zu URLs (%zu falhas)", out->count - before, count, failed);
+    return (out->count > before) ? 0 : -1;
+}
+
+int downloader_read_url_file(const char *path, char ***urls, size_t *count) {
+    FILE *f = fopen(path, "r");
+    char line[CARTAG_PATH_MAX];
+    char **list = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+
+    *urls = NULL;
+    *count = 0;
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        char *end;
+        while (*p == ' ' || *p == '\t') ++p;
+        p[strcspn(p, "\r\n")] = '\0';
+        end = p + strlen(p);
+        while (end > p && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+        if (*p == '\0' || *p == '#') continue;
+        if (n >= cap) {
+            size_t new_cap = cap ? cap * 2 : 32;
+            char **mem = (char **)realloc(list, new_cap * sizeof(char *));
+            if (!mem) break;
+            list = mem;
+            cap = new_cap;
+        }
+        list[n] = (char *)malloc(strlen(p) + 1);
+        if (!list[n]) break;
+        memcpy(list[n], p, strlen(p) + 1);
+        n++;
+    }
+    fclose(f);
+    *urls = list;
+    *count = n;
+    return 0;
+}
+
+void downloader_free_urls(char **urls, size_t count) {
+    for (size_t i = 0; i < count; ++i) free(urls[i]);
+    free(urls);
+}
+
+int downloader_fetch_audio(const char *url, const char *out_dir, char *warn, size_t warn_sz) {
+    TrackList fetched;
+    int rc;
+
+    if (!downloader_is_url(url)) {
+        snprintf(warn, warn_sz, "URL invalida");
+        return -1;
+    }
+    memset(&fetched, 0, sizeof(fetched));
+    rc = downloader_fetch_batch(&url, 1, out_dir, 1, &fetched, warn, warn_sz);
+    tracklist_free(&fetched);
+    if (rc != 0) {
         snprintf(warn, warn_sz, "falha ao baixar audio com yt-dlp");
         return -1;
     }
-
     snprintf(warn, warn_sz, "download concluido no diretorio atual");
     return 0;
 }
@@ -1,45 +1,892 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cartag.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define EXPORT_FAIL_LIST 5
+#define EXPORT_MAX_FAILS 3
+#define FANOUT_BLOCK (256 * 1024)
+
+typedef struct {
+    char *out_path;
+    uint64_t src_hash;
+    uint64_t src_size;
+    uint64_t dst_size;
+    uint64_t dst_hash;
+    size_t line;
+    int completed;
+} JournalEntry;
+
+typedef struct {
+    JournalEntry *entries;
+    size_t count;
+    size_t cap;
+} Journal;
+
+typedef struct {
+    const char *root;
+    DeviceProfile dev;
+    Journal done;
+    Manifest man;
+    FILE *jf;
+    unsigned char *skip;
+    size_t jobs;
+    size_t copied;
+    size_t resumed;
+    size_t failed;
+    size_t fails_in_row;
+    size_t since_sync;
+    uint64_t pending;
+    uint64_t bytes;
+    int abandoned;
+    char failures[EXPORT_FAIL_LIST][CARTAG_NAME_MAX];
+} ExportTarget;
 
-static void str_append(char *dst, size_t dst_sz, const char *src) {
-    size_t dlen;
-    size_t slen;
-    size_t n;
-    if (!dst || dst_sz == 0 || !src) return;
-    dlen = strlen(dst);
-    if (dlen >= dst_sz - 1) return;
-    slen = strlen(src);
-    n = dst_sz - dlen - 1;
-    if (slen < n) n = slen;
-    memcpy(dst + dlen, src, n);
-    dst[dlen + n] = '\0';
+static int cmp_journal_entry(const void *a, const void *b) {
+    const JournalEntry *ea = (const JournalEntry *)a;
+    const JournalEntry *eb = (const JournalEntry *)b;
+    int c = strcmp(ea->out_path, eb->out_path);
+    if (c != 0) return c;
+    return ea->line < eb->line ? -1 : (ea->line > eb->line ? 1 : 0);
 }
 
-static void path_join2(char *dst, size_t dst_sz, const char *a, const char *b) {
-    if (dst_sz == 0) return;
-    dst[0] = '\0';
-    str_append(dst, dst_sz, a ? a : "");
-    str_append(dst, dst_sz, "/");
-    str_append(dst, dst_sz, b ? b : "");
+static void journal_free(Journal *j) {
+    for (size_t i = 0; i < j->count; ++i) free(j->entries[i].out_path);
+    free(j->entries);
+    memset(j, 0, sizeof(*j));
 }
 
-int exporter_run(const TrackList *list, const CliOptions *opts) {
-    size_t copied = 0;
-    if (opts->export_path[0] == '\0') return 0;
+static int journal_add(Journal *j, const JournalEntry *e) {
+    if (j->count >= j->cap) {
+        size_t cap = j->cap ? j->cap * 2 : 512;
+        JournalEntry *mem = (JournalEntry *)realloc(j->entries, cap * sizeof(JournalEntry));
+        if (!mem) return -1;
+        j->entries = mem;
+        j->cap = cap;
+    }
+    j->entries[j->count++] = *e;
+    return 0;
+}
+
+static void journal_load(Journal *j, const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[CARTAG_PATH_MAX + 128];
+    size_t lineno = 0;
+    size_t n = 0;
+
+    memset(j, 0, sizeof(*j));
+    if (!f) return;
+
+    while (fgets(line, sizeof(line), f)) {
+        JournalEntry e;
+        unsigned long long src_hash = 0, src_size = 0, dst_size = 0, dst_hash = 0;
+        char kind = 0;
+        unsigned scheme = 0;
+        int off = 0;
+        char *nl = strchr(line, '\n');
+
+        lineno++;
+        if (!nl) continue;
+        *nl = '\0';
+        memset(&e, 0, sizeof(e));
+        if (line[0] == 'C' &&
+            sscanf(line, "%c\tq%u\t%llx\t%llu\t%llu\t%llx\t%n", &kind, &scheme, &src_hash, &src_size, &dst_size, &dst_hash,
+                   &off) == 6) {
+            e.completed = 1;
+        } else if (line[0] == 'P' && sscanf(line, "%c\tq%u\t%llx\t%llu\t%n", &kind, &scheme, &src_hash, &src_size, &off) == 4) {
+            e.completed = 0;
+        } else {
+            continue;
+        }
+        if (scheme != FS_HASH_SCHEME || off <= 0 || line[off] == '\0') continue;
+        e.out_path = (char *)malloc(strlen(line + off) + 1);
+        if (!e.out_path) break;
+        memcpy(e.out_path, line + off, strlen(line + off) + 1);
+        e.src_hash = src_hash;
+        e.src_size = src_size;
+        e.dst_size = dst_size;
+        e.dst_hash = dst_hash;
+        e.line = lineno;
+        if (journal_add(j, &e) != 0) {
+            free(e.out_path);
+            break;
+        }
+    }
+    fclose(f);
+
+    qsort(j->entries, j->count, sizeof(JournalEntry), cmp_journal_entry);
+    for (size_t i = 0; i < j->count;) {
+        size_t end = i + 1;
+        size_t keep = i;
+        while (end < j->count && strcmp(j->entries[end].out_path, j->entries[i].out_path) == 0) end++;
+        for (size_t k = i; k < end; ++k) {
+            if (j->entries[k].completed || !j->entries[keep].completed) keep = k;
+        }
+        for (size_t k = i; k < end; ++k) {
+            if (k != keep) free(j->entries[k].out_path);
+        }
+        j->entries[n++] = j->entries[keep];
+        i = end;
+    }
+    j->count = n;
+}
+
+static const JournalEntry *journal_find(const Journal *j, const char *out_path) {
+    size_t lo = 0;
+    size_t hi = j->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(j->entries[mid].out_path, out_path);
+        if (c == 0) return &j->entries[mid];
+        if (c < 0) lo = mid + 1; else hi = mid;
+    }
+    return NULL;
+}
+
+static int journal_verified(const JournalEntry *e, const AudioTrack *t, const char *dst) {
+    struct stat st;
+    if (!e || !e->completed) return 0;
+    if (e->src_hash != t->quick_hash || e->src_size != t->size_bytes) return 0;
+    if (stat(dst, &st) != 0 || (uint64_t)st.st_size != e->dst_size) return 0;
+    return fs_quick_hash(dst) == e->dst_hash;
+}
+
+static void journal_drop_stale_parts(const Journal *j, const char *root) {
+    char part[CARTAG_PATH_MAX];
+    for (size_t i = 0; i < j->count; ++i) {
+        path_join2(part, sizeof(part), root, j->entries[i].out_path);
+        str_append(part, sizeof(part), FS_PART_SUFFIX);
+        remove(part);
+    }
+}
+
+static const char *track_out_path(const AudioTrack *t) {
+    return t->out_path[0] ? t->out_path : t->filename;
+}
+
+typedef struct {
+    const char *path;
+    size_t index;
+} PlayOrder;
+
+static int play_rank(unsigned char c) {
+    return c == '\0' ? 0 : (c == '/' ? 1 : c + 2);
+}
+
+static int cmp_play_order(const void *a, const void *b) {
+    const unsigned char *pa = (const unsigned char *)((const PlayOrder *)a)->path;
+    const unsigned char *pb = (const unsigned char *)((const PlayOrder *)b)->path;
+    while (*pa && *pa == *pb) {
+        pa++;
+        pb++;
+    }
+    return play_rank(*pa) - play_rank(*pb);
+}
+
+static size_t *export_order(const TrackList *list, int sequential) {
+    size_t *order = (size_t *)malloc((list->count + 1) * sizeof(size_t));
+    PlayOrder *po;
+    if (!order) return NULL;
+    for (size_t i = 0; i < list->count; ++i) order[i] = i;
+    if (!sequential || list->count < 2) return order;
+    po = (PlayOrder *)malloc(list->count * sizeof(PlayOrder));
+    if (!po) return order;
+    for (size_t i = 0; i < list->count; ++i) {
+        po[i].path = track_out_path(&list->tracks[i]);
+        po[i].index = i;
+    }
+    qsort(po, list->count, sizeof(PlayOrder), cmp_play_order);
+    for (size_t i = 0; i < list->count; ++i) order[i] = po[i].index;
+    free(po);
+    return order;
+}
 
+static int export_wanted(const AudioTrack *t) {
+    return !t->duplicate && !t->excluded && !t->unselected && !t->omitted;
+}
+
+static int target_open(ExportTarget *tg, const char *root, const TrackList *list, const CliOptions *opts) {
+    char jpath[CARTAG_PATH_MAX];
+    char jpart[CARTAG_PATH_MAX];
+    FILE *jf;
+
+    memset(tg, 0, sizeof(*tg));
+    tg->root = root;
+    tg->skip = (unsigned char *)calloc(list->count + 1, 1);
+    if (!tg->skip) return -1;
+    fs_ensure_directory(root);
+    devprobe_profile(root, opts->reprobe, &tg->dev);
+    path_join2(jpath, sizeof(jpath), root, EXPORT_JOURNAL_NAME);
+    if (opts->verify) manifest_load(&tg->man, root);
+    if (opts->resume) {
+        journal_load(&tg->done, jpath);
+        journal_drop_stale_parts(&tg->done, root);
+    }
+
+    jf = fs_open_part(jpath, jpart, sizeof(jpart));
     for (size_t i = 0; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        const JournalEntry *e = NULL;
+        char dst[CARTAG_PATH_MAX];
+        struct stat st;
+        if (!export_wanted(t)) {
+            tg->skip[i] = 1;
+            continue;
+        }
+        path_join2(dst, sizeof(dst), root, track_out_path(t));
+        if (opts->resume) e = journal_find(&tg->done, track_out_path(t));
+        if (e && journal_verified(e, t, dst)) {
+            tg->skip[i] = 1;
+            tg->resumed++;
+            if (opts->verify && stat(dst, &st) == 0) manifest_put(&tg->man, track_out_path(t), (uint64_t)st.st_size, 0, 0);
+            if (jf) {
+                fprintf(jf, "C\tq%u\t%llx\t%llu\t%llu\t%llx\t%s\n", FS_HASH_SCHEME, (unsigned long long)e->src_hash,
+                        (unsigned long long)e->src_size, (unsigned long long)e->dst_size,
+                        (unsigned long long)e->dst_hash, e->out_path);
+            }
+        } else {
+            tg->jobs++;
+            tg->pending += t->size_bytes;
+            if (jf) {
+                fprintf(jf, "P\tq%u\t%llx\t%llu\t%s\n", FS_HASH_SCHEME, (unsigned long long)t->quick_hash,
+                        (unsigned long long)t->size_bytes, track_out_path(t));
+            }
+        }
+    }
+    if (jf && fs_commit_part(jf, jpart, jpath, ferror(jf) ? -1 : 0) == 0) tg->jf = fopen(jpath, "a");
+    if (!tg->jf) progress_log(LVL_WARN, "journal indisponivel em %s; exportacao nao sera retomavel", jpath);
+    if (tg->dev.write_rate > 0.0) {
+        progress_log(LVL_INFO, "%s: %.1f MB/s, blocos de %lu KB, %d escrita(s) paralela(s)%s", root,
+                     tg->dev.write_rate / (1024.0 * 1024.0), (unsigned long)(tg->dev.block / 1024), tg->dev.writers,
+                     tg->dev.cached ? " (perfil em cache)" : "");
+    }
+    return 0;
+}
+
+static double target_seconds(const ExportTarget *tg) {
+    return tg->dev.write_rate > 0.0 ? (double)tg->pending / tg->dev.write_rate : 0.0;
+}
+
+static void export_estimate(uint64_t bytes, double seconds) {
+    if (seconds <= 0.0) return;
+    progress_estimate(bytes, (double)bytes / seconds);
+    progress_log(LVL_INFO, "Copia estimada: %.1f MB em ~%d min %02d s", (double)bytes / (1024.0 * 1024.0),
+                 (int)(seconds / 60.0), (int)seconds % 60);
+}
+
+static int target_copy(const ExportTarget *tg, const AudioTrack *t, const char *dst, uint32_t *crc, int sequential) {
+    int dev = sched_io_acquire(tg->root, SCHED_BYTES);
+    int rc;
+    if (!tg->dev.block) rc = sequential ? fs_copy_file_seq(t->path, dst, crc) : fs_copy_file(t->path, dst, crc);
+    else rc = fs_copy_file_block(t->path, dst, crc, tg->dev.block, sequential);
+    sched_io_release(dev, rc == 0 ? t->size_bytes : 0);
+    return rc;
+}
+
+static uint64_t target_dst_hash(const AudioTrack *t, const char *dst) {
+    if (!t->converted && !t->cue_track && t->quick_hash) return t->quick_hash;
+    return fs_quick_hash(dst);
+}
+
+static void target_record(ExportTarget *tg, const AudioTrack *t, const char *dst, uint32_t crc, int verify) {
+    struct stat st;
+    int have_st = stat(dst, &st) == 0;
+
+    tg->copied++;
+    tg->fails_in_row = 0;
+    tg->bytes += t->size_bytes;
+    if (verify && have_st) manifest_put(&tg->man, track_out_path(t), (uint64_t)st.st_size, crc, 1);
+    if (tg->jf && have_st) {
+        fprintf(tg->jf, "C\tq%u\t%llx\t%llu\t%llu\t%llx\t%s\n", FS_HASH_SCHEME, (unsigned long long)t->quick_hash,
+                (unsigned long long)t->size_bytes, (unsigned long long)st.st_size,
+                (unsigned long long)target_dst_hash(t, dst), track_out_path(t));
+        fflush(tg->jf);
+        if (++tg->since_sync >= 32) {
+            fs_sync_stream(tg->jf);
+            tg->since_sync = 0;
+        }
+    }
+}
+
+static void target_fail(ExportTarget *tg, const AudioTrack *t) {
+    if (tg->failed < EXPORT_FAIL_LIST) snprintf(tg->failures[tg->failed], sizeof(tg->failures[0]), "%s", t->filename);
+    tg->failed++;
+    if (++tg->fails_in_row >= EXPORT_MAX_FAILS) tg->abandoned = 1;
+}
+
+static void target_close(ExportTarget *tg, const CliOptions *opts) {
+    size_t listed = tg->failed < EXPORT_FAIL_LIST ? tg->failed : EXPORT_FAIL_LIST;
+
+    if (tg->jf) {
+        fs_sync_stream(tg->jf);
+        fclose(tg->jf);
+    }
+    journal_free(&tg->done);
+    if (opts->verify && !progress_cancelled()) {
+        verify_readback(tg->root, &tg->man, opts->jobs);
+        if (manifest_save(&tg->man, tg->root) != 0) {
+            progress_log(LVL_WARN, "nao foi possivel gravar o manifesto em %s", tg->root);
+        }
+    }
+    manifest_free(&tg->man);
+    free(tg->skip);
+
+    for (size_t k = 0; k < listed; ++k) progress_log(LVL_ERROR, "Falha ao copiar: %s (%s)", tg->failures[k], tg->root);
+    if (tg->failed > listed) progress_log(LVL_ERROR, "... e mais %zu falhas em %s", tg->failed - listed, tg->root);
+    if (tg->abandoned) progress_log(LVL_ERROR, "%s: destino abandonado apos %d falhas seguidas", tg->root, EXPORT_MAX_FAILS);
+    if (tg->resumed) progress_log(LVL_INFO, "Retomada: %zu faixas ja exportadas foram verificadas e mantidas", tg->resumed);
+    progress_log(LVL_TEXT, "Exportadas %zu faixas para %s", tg->copied + tg->resumed, tg->root);
+}
+
+#ifndef _WIN32
+typedef struct {
+    ExportTarget *tg;
+    const TrackList *list;
+    const CliOptions *opts;
+    const size_t *order;
+    pthread_mutex_t lock;
+    size_t next;
+} CopyPool;
+
+static int pool_copy_next(CopyPool *cp) {
+    const AudioTrack *t;
+    char dst[CARTAG_PATH_MAX];
+    uint32_t crc = 0;
+    size_t i;
+    int rc;
+
+    pthread_mutex_lock(&cp->lock);
+    while (cp->next < cp->list->count && cp->tg->skip[cp->order[cp->next]]) cp->next++;
+    if (cp->next >= cp->list->count || cp->tg->abandoned || progress_cancelled()) {
+        pthread_mutex_unlock(&cp->lock);
+        return 0;
+    }
+    i = cp->order[cp->next++];
+    pthread_mutex_unlock(&cp->lock);
+
+    t = &cp->list->tracks[i];
+    path_join2(dst, sizeof(dst), cp->tg->root, track_out_path(t));
+    rc = target_copy(cp->tg, t, dst, &crc, 0);
+    pthread_mutex_lock(&cp->lock);
+    if (rc == 0) target_record(cp->tg, t, dst, crc, cp->opts->verify);
+    else target_fail(cp->tg, t);
+    pthread_mutex_unlock(&cp->lock);
+    return 1;
+}
+
+static void *pool_worker(void *arg) {
+    CopyPool *cp = (CopyPool *)arg;
+    while (pool_copy_next(cp)) continue;
+    return NULL;
+}
+
+static void export_pool(ExportTarget *tg, const TrackList *list, const CliOptions *opts, const size_t *order) {
+    pthread_t threads[DEVPROBE_MAX_WRITERS];
+    int started[DEVPROBE_MAX_WRITERS];
+    CopyPool cp;
+
+    memset(&cp, 0, sizeof(cp));
+    cp.tg = tg;
+    cp.list = list;
+    cp.opts = opts;
+    cp.order = order;
+    pthread_mutex_init(&cp.lock, NULL);
+    for (int k = 1; k < tg->dev.writers && k < DEVPROBE_MAX_WRITERS; ++k) {
+        started[k] = pthread_create(&threads[k], NULL, pool_worker, &cp) == 0;
+    }
+    while (pool_copy_next(&cp)) {
+        size_t done;
+        uint64_t bytes;
+        pthread_mutex_lock(&cp.lock);
+        done = cp.next;
+        bytes = tg->bytes;
+        pthread_mutex_unlock(&cp.lock);
+        progress_advance(done, bytes);
+    }
+    for (int k = 1; k < tg->dev.writers && k < DEVPROBE_MAX_WRITERS; ++k) {
+        if (started[k]) pthread_join(threads[k], NULL);
+    }
+    progress_advance(cp.next, tg->bytes);
+    pthread_mutex_destroy(&cp.lock);
+}
+#endif
+
+static int export_single(const TrackList *list, const CliOptions *opts, const size_t *order, const char *root) {
+    ExportTarget tg;
+
+    if (target_open(&tg, root, list, opts) != 0) return -1;
+    progress_stage(STAGE_EXPORT, list->count);
+    export_estimate(tg.pending, target_seconds(&tg));
+#ifndef _WIN32
+    if (tg.dev.writers > 1 && !opts->sequential) {
+        export_pool(&tg, list, opts, order);
+        target_close(&tg, opts);
+        return 0;
+    }
+#endif
+    for (size_t k = 0; k < list->count; ++k) {
+        size_t i = order[k];
         const AudioTrack *t = &list->tracks[i];
         char dst[CARTAG_PATH_MAX];
-        if (t->duplicate) continue;
-        path_join2(dst, sizeof(dst), opts->export_path, t->out_path[0] ? t->out_path : t->filename);
-        if (fs_copy_file(t->path, dst) == 0) {
-            copied++;
+        uint32_t crc = 0;
+        int rc;
+        if (progress_cancelled() || tg.abandoned) break;
+        if (tg.skip[i]) continue;
+        path_join2(dst, sizeof(dst), root, track_out_path(t));
+        rc = target_copy(&tg, t, dst, &crc, opts->sequential);
+        if (rc == 0) target_record(&tg, t, dst, crc, opts->verify);
+        else target_fail(&tg, t);
+        progress_advance(k + 1, tg.bytes);
+    }
+    target_close(&tg, opts);
+    return 0;
+}
+
+#ifndef _WIN32
+
+typedef struct FanBlock {
+    struct FanBlock *next;
+    size_t refs;
+    size_t len;
+    unsigned char data[FANOUT_BLOCK];
+} FanBlock;
+
+typedef enum {
+    FAN_BEGIN = 0,
+    FAN_DATA,
+    FAN_END,
+    FAN_DROP,
+    FAN_SELF
+} FanMsgType;
+
+typedef struct {
+    FanMsgType type;
+    size_t track;
+    FanBlock *blk;
+    uint32_t crc;
+} FanMsg;
+
+typedef struct Fanout Fanout;
+
+typedef struct {
+    Fanout *fan;
+    ExportTarget tg;
+    pthread_t thread;
+    int started;
+    FanMsg *q;
+    size_t head;
+    size_t count;
+    size_t cap;
+    uint64_t queued;
+    uint64_t written;
+    size_t done;
+    int dead;
+    int streaming;
+    int finished;
+} FanTarget;
+
+struct Fanout {
+    const TrackList *list;
+    const CliOptions *opts;
+    FanTarget *targets;
+    size_t count;
+    FanBlock *free_blocks;
+    uint64_t budget;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t room;
+    int eof;
+    int cancel;
+};
+
+static FanBlock *fan_block(Fanout *fan) {
+    FanBlock *b;
+    pthread_mutex_lock(&fan->lock);
+    b = fan->free_blocks;
+    if (b) fan->free_blocks = b->next;
+    pthread_mutex_unlock(&fan->lock);
+    if (!b) b = (FanBlock *)malloc(sizeof(FanBlock));
+    if (b) {
+        b->next = NULL;
+        b->refs = 1;
+        b->len = 0;
+    }
+    return b;
+}
+
+static void fan_release(Fanout *fan, FanBlock *b) {
+    if (--b->refs > 0) return;
+    b->next = fan->free_blocks;
+    fan->free_blocks = b;
+}
+
+static void fan_push(FanTarget *ft, FanMsgType type, size_t track, FanBlock *blk, uint32_t crc) {
+    FanMsg *m;
+    if (ft->count == ft->cap) {
+        size_t cap = ft->cap ? ft->cap * 2 : 256;
+        FanMsg *q = (FanMsg *)malloc(cap * sizeof(FanMsg));
+        if (!q) {
+            ft->dead = 1;
+            return;
+        }
+        for (size_t k = 0; k < ft->count; ++k) q[k] = ft->q[(ft->head + k) % ft->cap];
+        free(ft->q);
+        ft->q = q;
+        ft->head = 0;
+        ft->cap = cap;
+    }
+    m = &ft->q[(ft->head + ft->count) % ft->cap];
+    m->type = type;
+    m->track = track;
+    m->blk = blk;
+    m->crc = crc;
+    ft->count++;
+    if (blk) {
+        blk->refs++;
+        ft->queued += blk->len;
+    }
+}
+
+static void *fan_writer(void *arg) {
+    FanTarget *ft = (FanTarget *)arg;
+    Fanout *fan = ft->fan;
+    FILE *out = NULL;
+    char part[CARTAG_PATH_MAX];
+    char dst[CARTAG_PATH_MAX];
+    int bad = 0;
+
+    for (;;) {
+        FanMsg m;
+        const AudioTrack *t;
+        int skip_io;
+        int rc = 0;
+        int finished = 0;
+        uint32_t crc = 0;
+
+        pthread_mutex_lock(&fan->lock);
+        while (ft->count == 0 && !fan->eof) pthread_cond_wait(&fan->work, &fan->lock);
+        if (ft->count == 0) {
+            ft->finished = 1;
+            pthread_cond_broadcast(&fan->room);
+            pthread_mutex_unlock(&fan->lock);
+            break;
+        }
+        m = ft->q[ft->head];
+        ft->head = (ft->head + 1) % ft->cap;
+        ft->count--;
+        skip_io = ft->dead || fan->cancel;
+        pthread_mutex_unlock(&fan->lock);
+
+        t = &fan->list->tracks[m.track];
+        if (skip_io && out) {
+            fclose(out);
+            remove(part);
+            out = NULL;
+            bad = 1;
+        }
+        switch (m.type) {
+            case FAN_BEGIN:
+                out = NULL;
+                bad = skip_io;
+                if (!bad) {
+                    path_join2(dst, sizeof(dst), ft->tg.root, track_out_path(t));
+                    out = fs_open_part(dst, part, sizeof(part));
+                    bad = out == NULL;
+                }
+                if (out && fan->opts->sequential) {
+                    struct stat st;
+                    setvbuf(out, NULL, _IONBF, 0);
+                    if (stat(t->path, &st) == 0) fs_preallocate(out, (uint64_t)st.st_size);
+                }
+                break;
+            case FAN_DATA:
+                if (out && !bad && fwrite(m.blk->data, 1, m.blk->len, out) != m.blk->len) bad = 1;
+                break;
+            case FAN_DROP:
+                if (out) {
+                    fclose(out);
+                    remove(part);
+                    out = NULL;
+                }
+                break;
+            case FAN_END:
+                rc = out ? fs_commit_part(out, part, dst, bad ? -1 : 0) : -1;
+                out = NULL;
+                crc = m.crc;
+                finished = 1;
+                break;
+            case FAN_SELF:
+                if (!skip_io) {
+                    path_join2(dst, sizeof(dst), ft->tg.root, track_out_path(t));
+                    rc = target_copy(&ft->tg, t, dst, &crc, fan->opts->sequential);
+                }
+                finished = 1;
+                break;
+        }
+        if (finished && !skip_io) {
+            if (rc == 0) target_record(&ft->tg, t, dst, crc, fan->opts->verify);
+            else target_fail(&ft->tg, t);
+        }
+
+        pthread_mutex_lock(&fan->lock);
+        if (m.blk) {
+            ft->queued -= m.blk->len;
+            fan_release(fan, m.blk);
+        }
+        if (finished) {
+            ft->done++;
+            if (!skip_io && rc == 0) ft->written += t->size_bytes;
+            if (ft->tg.abandoned) ft->dead = 1;
+        }
+        pthread_cond_broadcast(&fan->room);
+        pthread_mutex_unlock(&fan->lock);
+    }
+    if (out) {
+        fclose(out);
+        remove(part);
+    }
+    return NULL;
+}
+
+static int fan_has_room(const Fanout *fan) {
+    int streaming = 0;
+    for (size_t k = 0; k < fan->count; ++k) {
+        const FanTarget *ft = &fan->targets[k];
+        if (!ft->streaming || ft->dead) continue;
+        streaming = 1;
+        if (ft->queued + FANOUT_BLOCK <= fan->budget) return 1;
+    }
+    return !streaming;
+}
+
+static void fan_progress(Fanout *fan) {
+    char detail[200];
+    size_t len = 0;
+    size_t min_done = (size_t)-1;
+    uint64_t bytes = 0;
+
+    detail[0] = '\0';
+    pthread_mutex_lock(&fan->lock);
+    for (size_t k = 0; k < fan->count; ++k) {
+        const FanTarget *ft = &fan->targets[k];
+        const char *name = strrchr(ft->tg.root, '/');
+        int n;
+        name = name && name[1] ? name + 1 : ft->tg.root;
+        if (!ft->dead && ft->done < min_done) min_done = ft->done;
+        bytes += ft->written;
+        n = snprintf(detail + len, sizeof(detail) - len, "%s%s %zu/%zu%s", len ? " | " : "", name, ft->done,
+                     ft->tg.jobs, ft->dead ? " (abandonado)" : "");
+        if (n < 0 || (size_t)n >= sizeof(detail) - len) break;
+        len += (size_t)n;
+    }
+    pthread_mutex_unlock(&fan->lock);
+    progress_advance(min_done == (size_t)-1 ? 0 : min_done, bytes);
+    progress_detail("%s", detail);
+}
+
+static void fan_read_track(Fanout *fan, size_t i) {
+    const AudioTrack *t = &fan->list->tracks[i];
+    FILE *in;
+    uint32_t crc = 0;
+    int ok;
+    int any = 0;
+
+    pthread_mutex_lock(&fan->lock);
+    for (size_t k = 0; k < fan->count; ++k) {
+        FanTarget *ft = &fan->targets[k];
+        ft->streaming = !ft->dead && !ft->tg.skip[i];
+        if (ft->streaming) {
+            fan_push(ft, FAN_BEGIN, i, NULL, 0);
+            any = 1;
+        }
+    }
+    pthread_cond_broadcast(&fan->work);
+    pthread_mutex_unlock(&fan->lock);
+    if (!any) return;
+
+    in = fopen(t->path, "rb");
+    ok = in != NULL;
+    while (ok && !progress_cancelled()) {
+        FanBlock *b = fan_block(fan);
+        size_t got;
+        int live = 0;
+        if (!b) {
+            ok = 0;
+            break;
+        }
+        got = b->len = fread(b->data, 1, sizeof(b->data), in);
+        if (got > 0) crc = crc32c_update(crc, b->data, got);
+
+        pthread_mutex_lock(&fan->lock);
+        while (got > 0 && !fan_has_room(fan)) pthread_cond_wait(&fan->room, &fan->lock);
+        for (size_t k = 0; got > 0 && k < fan->count; ++k) {
+            FanTarget *ft = &fan->targets[k];
+            if (!ft->streaming) continue;
+            if (ft->dead) {
+                ft->streaming = 0;
+            } else if (ft->queued + got <= fan->budget) {
+                fan_push(ft, FAN_DATA, i, b, 0);
+                live = 1;
+            } else {
+                fan_push(ft, FAN_DROP, i, NULL, 0);
+                fan_push(ft, FAN_SELF, i, NULL, 0);
+                ft->streaming = 0;
+            }
+        }
+        fan_release(fan, b);
+        pthread_cond_broadcast(&fan->work);
+        pthread_mutex_unlock(&fan->lock);
+
+        if (got < FANOUT_BLOCK || !live) break;
+        fan_progress(fan);
+    }
+    if (in) {
+        if (ferror(in)) ok = 0;
+        fclose(in);
+    }
+
+    pthread_mutex_lock(&fan->lock);
+    for (size_t k = 0; k < fan->count; ++k) {
+        FanTarget *ft = &fan->targets[k];
+        if (!ft->streaming) continue;
+        if (ok && !progress_cancelled()) {
+            fan_push(ft, FAN_END, i, NULL, crc);
         } else {
-            fprintf(stderr, "Falha ao copiar: %s\n", t->filename);
+            fan_push(ft, FAN_DROP, i, NULL, 0);
+            if (!progress_cancelled()) fan_push(ft, FAN_SELF, i, NULL, 0);
+        }
+        ft->streaming = 0;
+    }
+    pthread_cond_broadcast(&fan->work);
+    pthread_mutex_unlock(&fan->lock);
+}
+
+static int export_fanout(const TrackList *list, const CliOptions *opts, const size_t *order, const char *const *roots,
+                         size_t n) {
+    Fanout fan;
+    size_t jobs = 0;
+    uint64_t pending = 0;
+    double seconds = 0.0;
+    int running = 1;
+
+    memset(&fan, 0, sizeof(fan));
+    fan.list = list;
+    fan.opts = opts;
+    fan.targets = (FanTarget *)calloc(n, sizeof(FanTarget));
+    if (!fan.targets) return -1;
+    pthread_mutex_init(&fan.lock, NULL);
+    pthread_cond_init(&fan.work, NULL);
+    pthread_cond_init(&fan.room, NULL);
+
+    for (size_t k = 0; k < n; ++k) {
+        FanTarget *ft = &fan.targets[fan.count];
+        if (target_open(&ft->tg, roots[k], list, opts) != 0) {
+            progress_log(LVL_ERROR, "%s: destino ignorado (memoria insuficiente)", roots[k]);
+            continue;
+        }
+        ft->fan = &fan;
+        if (ft->tg.jobs > jobs) jobs = ft->tg.jobs;
+        fan.count++;
+    }
+    for (size_t k = 0; k < fan.count; ++k) {
+        FanTarget *ft = &fan.targets[k];
+        ft->started = pthread_create(&ft->thread, NULL, fan_writer, ft) == 0;
+        if (!ft->started) {
+            ft->dead = 1;
+            ft->finished = 1;
+            progress_log(LVL_ERROR, "%s: falha ao iniciar escrita", ft->tg.root);
+        }
+    }
+
+    fan.budget = fan.count ? sched_mem_budget() / fan.count : 0;
+    if (fan.budget < 2 * FANOUT_BLOCK) fan.budget = 2 * FANOUT_BLOCK;
+    progress_stage(STAGE_EXPORT, jobs);
+    for (size_t k = 0; k < fan.count; ++k) {
+        pending += fan.targets[k].tg.pending;
+        if (target_seconds(&fan.targets[k].tg) > seconds) seconds = target_seconds(&fan.targets[k].tg);
+    }
+    export_estimate(pending, seconds);
+    for (size_t k = 0; k < list->count && !progress_cancelled(); ++k) {
+        fan_read_track(&fan, order[k]);
+        fan_progress(&fan);
+    }
+
+    pthread_mutex_lock(&fan.lock);
+    fan.eof = 1;
+    fan.cancel = progress_cancelled();
+    pthread_cond_broadcast(&fan.work);
+    pthread_mutex_unlock(&fan.lock);
+    while (running) {
+        struct timespec ts;
+        running = 0;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 200000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&fan.lock);
+        for (size_t k = 0; k < fan.count; ++k) {
+            if (!fan.targets[k].finished) running = 1;
         }
+        if (running) pthread_cond_timedwait(&fan.room, &fan.lock, &ts);
+        if (progress_cancelled() && !fan.cancel) {
+            fan.cancel = 1;
+            pthread_cond_broadcast(&fan.work);
+        }
+        pthread_mutex_unlock(&fan.lock);
+        fan_progress(&fan);
+    }
+
+    for (size_t k = 0; k < fan.count; ++k) {
+        FanTarget *ft = &fan.targets[k];
+        if (ft->started) pthread_join(ft->thread, NULL);
+        free(ft->q);
+        target_close(&ft->tg, opts);
     }
-    printf("Exportadas %zu faixas para %s\n", copied, opts->export_path);
+    while (fan.free_blocks) {
+        FanBlock *b = fan.free_blocks;
+        fan.free_blocks = b->next;
+        free(b);
+    }
+    pthread_cond_destroy(&fan.room);
+    pthread_cond_destroy(&fan.work);
+    pthread_mutex_destroy(&fan.lock);
+    free(fan.targets);
     return 0;
 }
+
+#endif
+
+int exporter_run(const TrackList *list, const CliOptions *opts) {
+    const char *roots[CARTAG_MAX_TARGETS + 1];
+    size_t *order;
+    size_t n = 0;
+    int rc = 0;
+
+    if (opts->export_path[0] == '\0') return 0;
+    order = export_order(list, opts->sequential);
+    if (!order) return -1;
+    roots[n++] = opts->export_path;
+    for (size_t k = 0; k < opts->target_count && k < CARTAG_MAX_TARGETS; ++k) roots[n++] = opts->targets[k];
+    if (n == 1) {
+        rc = export_single(list, opts, order, roots[0]);
+    } else {
+#ifndef _WIN32
+        rc = export_fanout(list, opts, order, roots, n);
+#else
+        for (size_t k = 0; k < n && !progress_cancelled(); ++k) export_single(list, opts, order, roots[k]);
+#endif
+    }
+    free(order);
+    return rc;
+}
@@ -1,3 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "cartag.h"
 
 #include <stdio.h>
@@ -5,56 +10,107 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #include <direct.h>
 #define MKDIR(path) _mkdir(path)
 #else
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #define MKDIR(path) mkdir(path, 0755)
 #endif
 
-static void str_copy(char *dst, size_t dst_sz, const char *src) {
-    size_t n;
-    if (!dst || dst_sz == 0) return;
-    if (!src) {
-        dst[0] = '\0';
-        return;
+#define SCAN_MAX_DEPTH 16
+#define SCAN_MAX_IO 16
+#define FS_SEQ_BLOCK (1024 * 1024)
+
+size_t fs_hash_window(uint64_t size) {
+    if (size < ((uint64_t)1 << 20)) return 4096;
+    if (size < ((uint64_t)16 << 20)) return 8192;
+    return FS_HASH_MAX_WINDOW;
+}
+
+uint64_t fs_hash_sampled(uint64_t size, FsReadFn read, void *ctx) {
+    size_t w = fs_hash_window(size);
+    uint64_t offs[3];
+    uint64_t h = size;
+    const unsigned char *p;
+
+    if (size <= 3 * (uint64_t)w) {
+        p = read(ctx, 0, (size_t)size);
+        return p || size == 0 ? hash64(p, (size_t)size, h) : 0;
     }
-    n = strlen(src);
-    if (n >= dst_sz) n = dst_sz - 1;
-    memcpy(dst, src, n);
-    dst[n] = '\0';
+    offs[0] = 0;
+    offs[1] = size / 2 - w / 2;
+    offs[2] = size - w;
+    for (int k = 0; k < 3; ++k) {
+        p = read(ctx, offs[k], w);
+        if (!p) return 0;
+        h = hash64(p, w, h);
+    }
+    return h;
+}
+
+typedef struct {
+    FILE *f;
+    unsigned char buf[3 * 4096 > FS_HASH_MAX_WINDOW ? 3 * 4096 : FS_HASH_MAX_WINDOW];
+} HashReader;
+
+static const unsigned char *hash_read_file(void *ctx, uint64_t off, size_t len) {
+    HashReader *hr = (HashReader *)ctx;
+    if (len > sizeof(hr->buf) || fseek(hr->f, (long)off, SEEK_SET) != 0) return NULL;
+    return fread(hr->buf, 1, len, hr->f) == len ? hr->buf : NULL;
 }
 
 static uint64_t hash_file_quick(const char *path) {
-    FILE *f = fopen(path, "rb");
-    uint64_t h = 1469598103934665603ULL;
-    unsigned char buf[4096];
-    size_t n;
-    if (!f) return 0;
-    n = fread(buf, 1, sizeof(buf), f);
-    for (size_t i = 0; i < n; ++i) {
-        h ^= buf[i];
-        h *= 1099511628211ULL;
-    }
-    if (fseek(f, -((long)sizeof(buf)), SEEK_END) == 0) {
-        n = fread(buf, 1, sizeof(buf), f);
-        for (size_t i = 0; i < n; ++i) {
-            h ^= buf[i];
-            h *= 1099511628211ULL;
-        }
-    }
-    fclose(f);
+    HashReader hr;
+    struct stat st;
+    uint64_t h;
+    if (stat(path, &st) != 0) return 0;
+    hr.f = fopen(path, "rb");
+    if (!hr.f) return 0;
+    h = fs_hash_sampled((uint64_t)st.st_size, hash_read_file, &hr);
+    fclose(hr.f);
     return h;
 }
 
 static int is_audio_ext(const char *name) {
     AudioFormat f = audio_detect_format(name);
+    if (strstr(name, ".converted.")) return 0;
     return f != FORMAT_UNKNOWN;
 }
 
-static int tracklist_push(TrackList *list, const AudioTrack *track) {
+static void fill_track(AudioTrack *t, const char *full, const char *base, const char *name, const struct stat *st) {
+    memset(t, 0, sizeof(*t));
+    str_copy(t->path, sizeof(t->path), full);
+    if (strncmp(full, base, strlen(base)) == 0 && full[strlen(base)] == '/') {
+        str_copy(t->rel_path, sizeof(t->rel_path), full + strlen(base) + 1);
+    } else {
+        str_copy(t->rel_path, sizeof(t->rel_path), name);
+    }
+    str_copy(t->filename, sizeof(t->filename), name);
+    t->format = audio_detect_format(name);
+    t->size_bytes = (uint64_t)st->st_size;
+    t->mtime = (int64_t)st->st_mtime;
+    audio_probe_file(full, t->size_bytes, t);
+    if (t->has_tags) tags_apply_defaults(t);
+    else tags_fix_from_filename(t);
+    tags_standardize(t);
+}
+
+int fs_probe_track(const char *full, const char *base, AudioTrack *t) {
+    struct stat st;
+    const char *name = strrchr(full, '/');
+    name = name ? name + 1 : full;
+    if (!is_audio_ext(name)) return -1;
+    if (stat(full, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    fill_track(t, full, base, name, &st);
+    return 0;
+}
+
+int tracklist_push(TrackList *list, const AudioTrack *track) {
     AudioTrack *new_mem;
     if (list->count >= list->capacity) {
         size_t new_cap = list->capacity ? list->capacity * 2 : 512;
@@ -67,42 +123,47 @@ static int tracklist_push(TrackList *list, const AudioTrack *track) {
     return 0;
 }
 
-static int scan_recursive(const char *root, const char *base, TrackList *list, int depth) {
+void tracklist_free(TrackList *list) {
+    free(list->tracks);
+    memset(list, 0, sizeof(*list));
+}
+
+static int scan_push_cb(void *ctx, const AudioTrack *track) {
+    tracklist_push((TrackList *)ctx, track);
+    return 0;
+}
+
+static int scan_recursive(const char *root, const char *base, FsScanCallback cb, FsStopFn stop, void *ctx, int depth) {
     DIR *dir;
     struct dirent *ent;
     char full[CARTAG_PATH_MAX];
-    char rel[CARTAG_PATH_MAX];
 
-    if (depth > 16) return 0;
+    if (depth > SCAN_MAX_DEPTH) return 0;
 
     dir = opendir(root);
     if (!dir) return -1;
 
     while ((ent = readdir(dir)) != NULL) {
         struct stat st;
+        int rc = 0;
+        if (stop && stop(ctx)) {
+            closedir(dir);
+            return 1;
+        }
         if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
         snprintf(full, sizeof(full), "%s/%s", root, ent->d_name);
         if (stat(full, &st) != 0) continue;
 
         if (S_ISDIR(st.st_mode)) {
-            scan_recursive(full, base, list, depth + 1);
+            rc = scan_recursive(full, base, cb, stop, ctx, depth + 1);
         } else if (S_ISREG(st.st_mode) && is_audio_ext(ent->d_name)) {
             AudioTrack t;
-            memset(&t, 0, sizeof(t));
-            str_copy(t.path, sizeof(t.path), full);
-            if (strncmp(full, base, strlen(base)) == 0) {
-                str_copy(rel, sizeof(rel), full + strlen(base) + 1);
-            } else {
-                str_copy(rel, sizeof(rel), ent->d_name);
-            }
-            str_copy(t.rel_path, sizeof(t.rel_path), rel);
-            str_copy(t.filename, sizeof(t.filename), ent->d_name);
-            t.format = audio_detect_format(ent->d_name);
-            t.size_bytes = (uint64_t)st.st_size;
-            t.quick_hash = hash_file_quick(full);
-            tags_fix_from_filename(&t);
-            tags_standardize(&t);
-            tracklist_push(list, &t);
+            fill_track(&t, full, base, ent->d_name, &st);
+            rc = cb(ctx, &t);
+        }
+        if (rc > 0) {
+            closedir(dir);
+            return rc;
         }
     }
 
@@ -110,9 +171,244 @@ static int scan_recursive(const char *root, const char *base, TrackList *list, i
     return 0;
 }
 
+int fs_scan_audio_cb(const char *root, FsScanCallback cb, void *ctx) {
+    return scan_recursive(root, root, cb, NULL, ctx, 0);
+}
+
+int fs_scan_audio_until(const char *root, FsScanCallback cb, FsStopFn stop, void *ctx) {
+    return scan_recursive(root, root, cb, stop, ctx, 0);
+}
+
+typedef struct {
+    FsScanCallback cb;
+    void *ctx;
+    int root_index;
+} RootTagCtx;
+
+static int root_tag_cb(void *ctx, const AudioTrack *track) {
+    RootTagCtx *rt = (RootTagCtx *)ctx;
+    AudioTrack t = *track;
+    t.root_index = rt->root_index;
+    return rt->cb(rt->ctx, &t);
+}
+
+#ifdef _WIN32
+
+int fs_scan_roots(ScanRoot *roots, size_t count, FsScanCallback cb, void *ctx) {
+    for (size_t i = 0; i < count; ++i) {
+        RootTagCtx rt;
+        int rc;
+        rt.cb = cb;
+        rt.ctx = ctx;
+        rt.root_index = (int)i;
+        rc = scan_recursive(roots[i].path, roots[i].path, root_tag_cb, NULL, &rt, 0);
+        roots[i].status = rc < 0 ? -1 : 0;
+        if (rc > 0) return rc;
+    }
+    return 0;
+}
+
+#else
+
+typedef struct {
+    char *path;
+    int depth;
+} ScanDir;
+
+typedef struct RootScan RootScan;
+
+typedef struct {
+    pthread_mutex_t cb_lock;
+    RootTagCtx tag;
+    RootScan *roots;
+    size_t count;
+    int stop;
+} ScanShared;
+
+struct RootScan {
+    ScanShared *shared;
+    ScanRoot *root;
+    int index;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ScanDir *dirs;
+    size_t dir_count;
+    size_t dir_cap;
+    size_t busy;
+    int stop;
+};
+
+static int root_push_dir(RootScan *rs, const char *path, int depth) {
+    ScanDir d;
+    size_t len = strlen(path);
+    d.path = (char *)malloc(len + 1);
+    if (!d.path) return -1;
+    memcpy(d.path, path, len + 1);
+    d.depth = depth;
+
+    pthread_mutex_lock(&rs->lock);
+    if (rs->dir_count >= rs->dir_cap) {
+        size_t cap = rs->dir_cap ? rs->dir_cap * 2 : 64;
+        ScanDir *mem = (ScanDir *)realloc(rs->dirs, cap * sizeof(ScanDir));
+        if (!mem) {
+            pthread_mutex_unlock(&rs->lock);
+            free(d.path);
+            return -1;
+        }
+        rs->dirs = mem;
+        rs->dir_cap = cap;
+    }
+    rs->dirs[rs->dir_count++] = d;
+    pthread_cond_signal(&rs->cond);
+    pthread_mutex_unlock(&rs->lock);
+    return 0;
+}
+
+static void scan_stop_all(ScanShared *sh) {
+    sh->stop = 1;
+    for (size_t i = 0; i < sh->count; ++i) {
+        pthread_mutex_lock(&sh->roots[i].lock);
+        sh->roots[i].stop = 1;
+        pthread_cond_broadcast(&sh->roots[i].cond);
+        pthread_mutex_unlock(&sh->roots[i].lock);
+    }
+}
+
+static int scan_emit(RootScan *rs, const AudioTrack *t) {
+    ScanShared *sh = rs->shared;
+    int rc = 0;
+    pthread_mutex_lock(&sh->cb_lock);
+    if (sh->stop) {
+        rc = 1;
+    } else {
+        RootTagCtx rt = sh->tag;
+        rt.root_index = rs->index;
+        rc = root_tag_cb(&rt, t);
+        if (rc > 0) scan_stop_all(sh);
+    }
+    pthread_mutex_unlock(&sh->cb_lock);
+    return rc;
+}
+
+static void scan_one_dir(RootScan *rs, const ScanDir *d) {
+    int dev = sched_io_acquire(d->path, SCHED_ENTRIES);
+    DIR *dir = opendir(d->path);
+    struct dirent *ent;
+    char full[CARTAG_PATH_MAX];
+    uint64_t entries = 0;
+
+    if (!dir) {
+        sched_io_release(dev, 0);
+        if (d->depth == 0) rs->root->status = -1;
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        struct stat st;
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        snprintf(full, sizeof(full), "%s/%s", d->path, ent->d_name);
+        entries++;
+        if (stat(full, &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (d->depth < SCAN_MAX_DEPTH) root_push_dir(rs, full, d->depth + 1);
+        } else if (S_ISREG(st.st_mode) && is_audio_ext(ent->d_name)) {
+            AudioTrack t;
+            fill_track(&t, full, rs->root->path, ent->d_name, &st);
+            if (scan_emit(rs, &t) > 0) break;
+        }
+    }
+    closedir(dir);
+    sched_io_release(dev, entries);
+}
+
+static void *root_worker(void *arg) {
+    RootScan *rs = (RootScan *)arg;
+    for (;;) {
+        ScanDir d;
+        pthread_mutex_lock(&rs->lock);
+        while (!rs->stop && rs->dir_count == 0 && rs->busy > 0) pthread_cond_wait(&rs->cond, &rs->lock);
+        if (rs->stop || rs->dir_count == 0) {
+            pthread_cond_broadcast(&rs->cond);
+            pthread_mutex_unlock(&rs->lock);
+            break;
+        }
+        d = rs->dirs[--rs->dir_count];
+        rs->busy++;
+        pthread_mutex_unlock(&rs->lock);
+
+        scan_one_dir(rs, &d);
+        free(d.path);
+
+        pthread_mutex_lock(&rs->lock);
+        rs->busy--;
+        if (rs->busy == 0 && rs->dir_count == 0) pthread_cond_broadcast(&rs->cond);
+        pthread_mutex_unlock(&rs->lock);
+    }
+    return NULL;
+}
+
+int fs_scan_roots(ScanRoot *roots, size_t count, FsScanCallback cb, void *ctx) {
+    ScanShared sh;
+    RootScan *rs;
+    pthread_t *threads;
+    size_t total = 0;
+    size_t started = 0;
+
+    if (count == 0) return 0;
+    rs = (RootScan *)calloc(count, sizeof(RootScan));
+    if (!rs) return -1;
+    for (size_t i = 0; i < count; ++i) {
+        if (roots[i].io_limit < 1) roots[i].io_limit = 1;
+        if (roots[i].io_limit > SCAN_MAX_IO) roots[i].io_limit = SCAN_MAX_IO;
+        total += (size_t)roots[i].io_limit;
+    }
+    threads = (pthread_t *)calloc(total, sizeof(pthread_t));
+    if (!threads) {
+        free(rs);
+        return -1;
+    }
+
+    memset(&sh, 0, sizeof(sh));
+    pthread_mutex_init(&sh.cb_lock, NULL);
+    sh.tag.cb = cb;
+    sh.tag.ctx = ctx;
+    sh.roots = rs;
+    sh.count = count;
+    for (size_t i = 0; i < count; ++i) {
+        rs[i].shared = &sh;
+        rs[i].root = &roots[i];
+        rs[i].index = (int)i;
+        roots[i].status = 0;
+        pthread_mutex_init(&rs[i].lock, NULL);
+        pthread_cond_init(&rs[i].cond, NULL);
+        if (root_push_dir(&rs[i], roots[i].path, 0) != 0) roots[i].status = -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        for (int k = 0; k < roots[i].io_limit; ++k) {
+            if (pthread_create(&threads[started], NULL, root_worker, &rs[i]) == 0) started++;
+            else if (k == 0) root_worker(&rs[i]);
+        }
+    }
+    for (size_t i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t k = 0; k < rs[i].dir_count; ++k) free(rs[i].dirs[k].path);
+        free(rs[i].dirs);
+        pthread_cond_destroy(&rs[i].cond);
+        pthread_mutex_destroy(&rs[i].lock);
+    }
+    pthread_mutex_destroy(&sh.cb_lock);
+    free(threads);
+    free(rs);
+    return sh.stop ? 1 : 0;
+}
+
+#endif
+
 int fs_scan_audio(const char *root, TrackList *list) {
     memset(list, 0, sizeof(*list));
-    return scan_recursive(root, root, list, 0);
+    return fs_scan_audio_cb(root, scan_push_cb, list);
 }
 
 int fs_ensure_directory(const char *path) {
@@ -132,14 +428,11 @@ int fs_ensure_directory(const char *path) {
     return MKDIR(tmp);
 }
 
-int fs_copy_file(const char *src, const char *dst) {
-    FILE *in = fopen(src, "rb");
-    FILE *out;
-    char buf[8192];
-    size_t n;
+FILE *fs_open_part(const char *dst, char *part, size_t part_sz) {
     char parent[CARTAG_PATH_MAX];
 
-    if (!in) return -1;
+    if (strlen(dst) + sizeof(FS_PART_SUFFIX) > part_sz) return NULL;
+    snprintf(part, part_sz, "%s%s", dst, FS_PART_SUFFIX);
 
     str_copy(parent, sizeof(parent), dst);
     for (int i = (int)strlen(parent) - 1; i >= 0; --i) {
@@ -149,22 +442,149 @@ int fs_copy_file(const char *src, const char *dst) {
             break;
         }
     }
+    return fopen(part, "wb");
+}
 
-    out = fopen(dst, "wb");
+int fs_commit_part(FILE *out, const char *part, const char *dst, int rc) {
+    if (fflush(out) != 0) rc = -1;
+#ifndef _WIN32
+    if (rc == 0 && fsync(fileno(out)) != 0) rc = -1;
+#endif
+    if (fclose(out) != 0) rc = -1;
+
+#ifdef _WIN32
+    if (rc == 0) remove(dst);
+#endif
+    if (rc == 0 && rename(part, dst) != 0) rc = -1;
+    if (rc != 0) remove(part);
+    else if (fs_sync_parent(dst) != 0) rc = -1;
+    return rc;
+}
+
+int fs_sync_parent(const char *path) {
+#ifndef _WIN32
+    char parent[CARTAG_PATH_MAX];
+    char *slash;
+    int fd;
+    int rc;
+
+    str_copy(parent, sizeof(parent), path);
+    slash = strrchr(parent, '/');
+    if (!slash) str_copy(parent, sizeof(parent), ".");
+    else if (slash == parent) parent[1] = '\0';
+    else *slash = '\0';
+    fd = open(parent, O_RDONLY);
+    if (fd < 0) return -1;
+    rc = fsync(fd);
+    if (rc != 0 && errno == EINVAL) rc = 0;
+    close(fd);
+    return rc == 0 ? 0 : -1;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+void fs_preallocate(FILE *f, uint64_t size) {
+#ifdef __linux__
+    if (size > 0) (void)fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+    (void)f;
+    (void)size;
+#endif
+}
+
+static int copy_file(const char *src, const char *dst, uint32_t *crc, size_t block, int sequential) {
+    FILE *in = fopen(src, "rb");
+    FILE *out;
+    char small[8192];
+    char *buf = small;
+    size_t cap = sizeof(small);
+    size_t n;
+    int rc = 0;
+    char part[CARTAG_PATH_MAX];
+
+    if (!in) return -1;
+    out = fs_open_part(dst, part, sizeof(part));
     if (!out) {
         fclose(in);
         return -1;
     }
+    if (block > sizeof(small)) {
+        char *big = (char *)malloc(block);
+        if (big) {
+            buf = big;
+            cap = block;
+            setvbuf(in, NULL, _IONBF, 0);
+            setvbuf(out, NULL, _IONBF, 0);
+        }
+    }
+    if (sequential) {
+        struct stat st;
+#ifndef _WIN32
+        if (fstat(fileno(in), &st) == 0) fs_preallocate(out, (uint64_t)st.st_size);
+        posix_fadvise(fileno(in), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+        if (stat(src, &st) == 0) fs_preallocate(out, (uint64_t)st.st_size);
+#endif
+    }
 
-    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    if (crc) *crc = 0;
+    while ((n = fread(buf, 1, cap, in)) > 0) {
+        if (crc) *crc = crc32c_update(*crc, buf, n);
         if (fwrite(buf, 1, n, out) != n) {
-            fclose(in);
-            fclose(out);
-            return -1;
+            rc = -1;
+            break;
         }
     }
-
+    if (ferror(in)) rc = -1;
     fclose(in);
-    fclose(out);
+    if (buf != small) free(buf);
+    return fs_commit_part(out, part, dst, rc);
+}
+
+int fs_copy_file(const char *src, const char *dst, uint32_t *crc) {
+    return copy_file(src, dst, crc, 0, 0);
+}
+
+int fs_copy_file_seq(const char *src, const char *dst, uint32_t *crc) {
+    return copy_file(src, dst, crc, FS_SEQ_BLOCK, 1);
+}
+
+int fs_copy_file_block(const char *src, const char *dst, uint32_t *crc, size_t block, int sequential) {
+    return copy_file(src, dst, crc, block, sequential);
+}
+
+void fs_cache_path(const char *name, char *out, size_t out_sz) {
+    const char *dir = getenv("CARTAG_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    out[0] = '\0';
+    if (dir && dir[0]) {
+        str_copy(out, out_sz, dir);
+    } else if (xdg && xdg[0]) {
+        str_copy(out, out_sz, xdg);
+        str_append(out, out_sz, "/cartag");
+    } else if (home && home[0]) {
+        str_copy(out, out_sz, home);
+        str_append(out, out_sz, "/.cache/cartag");
+    } else {
+        return;
+    }
+    fs_ensure_directory(out);
+    str_append(out, out_sz, "/");
+    str_append(out, out_sz, name);
+}
+
+int fs_sync_stream(FILE *f) {
+    if (fflush(f) != 0) return -1;
+#ifndef _WIN32
+    if (fsync(fileno(f)) != 0) return -1;
+#endif
     return 0;
 }
+
+uint64_t fs_quick_hash(const char *path) {
+    return hash_file_quick(path);
+}
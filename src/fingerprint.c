@@ -0,0 +1,477 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define FP_RATE 11025
+#define FP_SECONDS 30
+#define FP_FRAME 2048
+#define FP_HOP 1024
+#define FP_SEGMENTS 16
+#define FP_MAX_DISTANCE 40
+#define FP_LSH_TABLES 8
+#define FP_LSH_BITS 16
+#define FP_LSH_WINDOW 64
+#define FP_DECODE_TIMEOUT 120
+#define FP_MAX_WORKERS 16
+#define FP_PCM_BYTES ((size_t)FP_RATE * FP_SECONDS * 2)
+#define FP_CACHE_FILE "fingerprints"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+    uint64_t hash;
+    uint64_t size;
+    Fingerprint fp;
+} FpCacheEntry;
+
+typedef struct {
+    FpCacheEntry *entries;
+    size_t count;
+    size_t cap;
+} FpCache;
+
+typedef struct {
+    float tw_re[FP_FRAME];
+    float tw_im[FP_FRAME];
+    unsigned short rev[FP_FRAME];
+    float window[FP_FRAME];
+    signed char chroma_bin[FP_FRAME / 2];
+} FftTables;
+
+typedef struct {
+    TrackList *list;
+    size_t *todo;
+    size_t todo_count;
+    Fingerprint *fps;
+    size_t next;
+    size_t done;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} FpJob;
+
+static FftTables g_fft;
+
+static int popcount64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    int n = 0;
+    while (v) {
+        v &= v - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static void fft_init(void) {
+    unsigned bits = 0;
+    while ((1u << bits) < FP_FRAME) bits++;
+    for (unsigned i = 0; i < FP_FRAME; ++i) {
+        unsigned r = 0;
+        for (unsigned b = 0; b < bits; ++b) {
+            if (i & (1u << b)) r |= 1u << (bits - 1 - b);
+        }
+        g_fft.rev[i] = (unsigned short)r;
+        g_fft.window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / (FP_FRAME - 1)));
+    }
+    for (size_t half = 1; half < FP_FRAME; half <<= 1) {
+        for (size_t k = 0; k < half; ++k) {
+            double a = -M_PI * (double)k / (double)half;
+            g_fft.tw_re[half - 1 + k] = (float)cos(a);
+            g_fft.tw_im[half - 1 + k] = (float)sin(a);
+        }
+    }
+    for (size_t k = 0; k < FP_FRAME / 2; ++k) {
+        double freq = (double)k * FP_RATE / FP_FRAME;
+        g_fft.chroma_bin[k] = -1;
+        if (freq >= 80.0 && freq <= 5000.0) {
+            long note = lround(12.0 * log2(freq / 440.0)) + 69;
+            g_fft.chroma_bin[k] = (signed char)(note % 12);
+        }
+    }
+}
+
+static void fft_butterflies(float *restrict re, float *restrict im, const float *restrict wr, const float *restrict wi,
+                            size_t half) {
+    for (size_t k = 0; k < half; ++k) {
+        float xr = re[half + k] * wr[k] - im[half + k] * wi[k];
+        float xi = re[half + k] * wi[k] + im[half + k] * wr[k];
+        re[half + k] = re[k] - xr;
+        im[half + k] = im[k] - xi;
+        re[k] += xr;
+        im[k] += xi;
+    }
+}
+
+static void fft_run(float *re, float *im) {
+    for (size_t i = 0; i < FP_FRAME; ++i) {
+        size_t j = g_fft.rev[i];
+        if (j > i) {
+            float t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+    for (size_t half = 1; half < FP_FRAME; half <<= 1) {
+        for (size_t i = 0; i < FP_FRAME; i += 2 * half) {
+            fft_butterflies(re + i, im + i, g_fft.tw_re + half - 1, g_fft.tw_im + half - 1, half);
+        }
+    }
+}
+
+static int fingerprint_pcm(const unsigned char *pcm, size_t bytes, Fingerprint *fp, float *re, float *im) {
+    size_t samples = bytes / 2;
+    size_t frames;
+    double seg[FP_SEGMENTS][12];
+    size_t voiced = 0;
+
+    memset(fp, 0, sizeof(*fp));
+    if (samples < FP_FRAME) return -1;
+    frames = (samples - FP_FRAME) / FP_HOP + 1;
+    if (frames < FP_SEGMENTS) return -1;
+    memset(seg, 0, sizeof(seg));
+
+    for (size_t f = 0; f < frames; ++f) {
+        const unsigned char *p = pcm + f * FP_HOP * 2;
+        double chroma[12] = {0};
+        double sum = 0.0;
+        size_t s = f * FP_SEGMENTS / frames;
+
+        for (size_t i = 0; i < FP_FRAME; ++i) {
+            short v = (short)(p[2 * i] | (p[2 * i + 1] << 8));
+            re[i] = g_fft.window[i] * (float)v * (1.0f / 32768.0f);
+            im[i] = 0.0f;
+        }
+        fft_run(re, im);
+        for (size_t k = 1; k < FP_FRAME / 2; ++k) {
+            int c = g_fft.chroma_bin[k];
+            if (c < 0) continue;
+            chroma[c] += sqrt((double)re[k] * re[k] + (double)im[k] * im[k]);
+        }
+        for (int c = 0; c < 12; ++c) sum += chroma[c];
+        if (sum < 1e-3) continue;
+        for (int c = 0; c < 12; ++c) seg[s][c] += chroma[c] / sum;
+        voiced++;
+    }
+    if (voiced < frames / 4) return -1;
+
+    for (size_t s = 0; s < FP_SEGMENTS; ++s) {
+        size_t bit = s * 16;
+        for (int c = 0; c < 12; ++c, ++bit) {
+            if (seg[s][c] > seg[s][(c + 1) % 12]) fp->bits[bit / 64] |= 1ULL << (bit % 64);
+        }
+        for (int c = 0; c < 4; ++c, ++bit) {
+            if (seg[s][c] > seg[s][c + 6]) fp->bits[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+    fp->valid = 1;
+    return 0;
+}
+
+static int fingerprint_file(const AudioTrack *t, unsigned char *pcm, float *re, float *im, Fingerprint *fp) {
+    char start[24];
+    const char *argv[] = {"ffmpeg", "-nostdin", "-v", "error", "-ss", start, "-t", "30", "-i", t->path, "-vn", "-ac", "1",
+                          "-ar", "11025", "-f", "s16le", "pipe:1", NULL};
+    size_t len = 0;
+    snprintf(start, sizeof(start), "%.3f", t->cue_start / (double)CUE_FRAMES_PER_SECOND);
+    if (proc_capture(argv, FP_DECODE_TIMEOUT, pcm, FP_PCM_BYTES, &len) != 0 && len < FP_PCM_BYTES) return -1;
+    return fingerprint_pcm(pcm, len, fp, re, im);
+}
+
+static int cmp_cache_entry(const void *a, const void *b) {
+    const FpCacheEntry *ea = (const FpCacheEntry *)a;
+    const FpCacheEntry *eb = (const FpCacheEntry *)b;
+    if (ea->hash != eb->hash) return ea->hash < eb->hash ? -1 : 1;
+    if (ea->size != eb->size) return ea->size < eb->size ? -1 : 1;
+    return 0;
+}
+
+static void cache_load(FpCache *c, const char *path) {
+    FILE *f;
+    char line[256];
+
+    memset(c, 0, sizeof(*c));
+    if (!path[0] || !(f = fopen(path, "r"))) return;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long h, sz, b0, b1, b2, b3;
+        unsigned scheme;
+        FpCacheEntry *e;
+        if (sscanf(line, "q%u %llx %llu %llx %llx %llx %llx", &scheme, &h, &sz, &b0, &b1, &b2, &b3) != 7) continue;
+        if (scheme != FS_HASH_SCHEME) continue;
+        if (c->count >= c->cap) {
+            size_t cap = c->cap ? c->cap * 2 : 1024;
+            FpCacheEntry *mem = (FpCacheEntry *)realloc(c->entries, cap * sizeof(FpCacheEntry));
+            if (!mem) break;
+            c->entries = mem;
+            c->cap = cap;
+        }
+        e = &c->entries[c->count++];
+        e->hash = h;
+        e->size = sz;
+        e->fp.bits[0] = b0;
+        e->fp.bits[1] = b1;
+        e->fp.bits[2] = b2;
+        e->fp.bits[3] = b3;
+        e->fp.valid = 1;
+    }
+    fclose(f);
+    qsort(c->entries, c->count, sizeof(FpCacheEntry), cmp_cache_entry);
+}
+
+static const Fingerprint *cache_find(const FpCache *c, uint64_t hash, uint64_t size) {
+    FpCacheEntry key;
+    const FpCacheEntry *e;
+    if (c->count == 0) return NULL;
+    key.hash = hash;
+    key.size = size;
+    e = (const FpCacheEntry *)bsearch(&key, c->entries, c->count, sizeof(FpCacheEntry), cmp_cache_entry);
+    return e ? &e->fp : NULL;
+}
+
+static void fp_job_step(FpJob *job, float *re, float *im, unsigned char *pcm) {
+    for (;;) {
+        size_t i;
+        AudioTrack *t;
+#ifndef _WIN32
+        pthread_mutex_lock(&job->lock);
+#endif
+        i = job->next < job->todo_count && !progress_cancelled() ? job->todo[job->next++] : (size_t)-1;
+#ifndef _WIN32
+        pthread_mutex_unlock(&job->lock);
+#endif
+        if (i == (size_t)-1) break;
+        t = &job->list->tracks[i];
+        sched_cpu_acquire();
+        fingerprint_file(t, pcm, re, im, &job->fps[i]);
+        sched_cpu_release();
+#ifndef _WIN32
+        pthread_mutex_lock(&job->lock);
+#endif
+        progress_advance(++job->done, 0);
+#ifndef _WIN32
+        pthread_mutex_unlock(&job->lock);
+#endif
+    }
+}
+
+static void *fp_worker(void *arg) {
+    FpJob *job = (FpJob *)arg;
+    float *re = (float *)malloc(FP_FRAME * sizeof(float));
+    float *im = (float *)malloc(FP_FRAME * sizeof(float));
+    unsigned char *pcm = (unsigned char *)malloc(FP_PCM_BYTES);
+    if (re && im && pcm) fp_job_step(job, re, im, pcm);
+    free(re);
+    free(im);
+    free(pcm);
+    return NULL;
+}
+
+static void fp_run_workers(FpJob *job) {
+#ifndef _WIN32
+    pthread_t threads[FP_MAX_WORKERS];
+    int workers = sched_workers(FP_MAX_WORKERS);
+    int started = 0;
+
+    if ((size_t)workers > job->todo_count) workers = (int)job->todo_count;
+    pthread_mutex_init(&job->lock, NULL);
+    for (int w = 0; w < workers; ++w) {
+        if (pthread_create(&threads[started], NULL, fp_worker, job) == 0) started++;
+    }
+    if (started == 0) fp_worker(job);
+    for (int w = 0; w < started; ++w) pthread_join(threads[w], NULL);
+    pthread_mutex_destroy(&job->lock);
+#else
+    fp_worker(job);
+#endif
+}
+
+static size_t uf_find(size_t *parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static int fp_distance(const Fingerprint *a, const Fingerprint *b) {
+    int d = 0;
+    for (int w = 0; w < FP_WORDS; ++w) d += popcount64(a->bits[w] ^ b->bits[w]);
+    return d;
+}
+
+typedef struct {
+    uint32_t key;
+    size_t index;
+} LshEntry;
+
+static int cmp_lsh_entry(const void *a, const void *b) {
+    const LshEntry *ea = (const LshEntry *)a;
+    const LshEntry *eb = (const LshEntry *)b;
+    if (ea->key != eb->key) return ea->key < eb->key ? -1 : 1;
+    return ea->index < eb->index ? -1 : (ea->index > eb->index ? 1 : 0);
+}
+
+static void lsh_link(const Fingerprint *fps, const size_t *cand, size_t n, size_t *parent) {
+    LshEntry *ent = (LshEntry *)malloc(n * sizeof(LshEntry));
+    uint32_t seed = 0x9e3779b9u;
+    if (!ent) return;
+
+    for (int table = 0; table < FP_LSH_TABLES; ++table) {
+        unsigned pos[FP_LSH_BITS];
+        for (int b = 0; b < FP_LSH_BITS; ++b) {
+            seed = seed * 1664525u + 1013904223u;
+            pos[b] = (seed >> 8) % (FP_WORDS * 64);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const Fingerprint *fp = &fps[cand[i]];
+            uint32_t key = 0;
+            for (int b = 0; b < FP_LSH_BITS; ++b) {
+                key = (key << 1) | (uint32_t)((fp->bits[pos[b] / 64] >> (pos[b] % 64)) & 1u);
+            }
+            ent[i].key = key;
+            ent[i].index = cand[i];
+        }
+        qsort(ent, n, sizeof(LshEntry), cmp_lsh_entry);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i + 1; j < n && j <= i + FP_LSH_WINDOW && ent[j].key == ent[i].key; ++j) {
+                size_t a = uf_find(parent, ent[i].index);
+                size_t b = uf_find(parent, ent[j].index);
+                if (a == b) continue;
+                if (fp_distance(&fps[ent[i].index], &fps[ent[j].index]) > FP_MAX_DISTANCE) continue;
+                if (a < b) parent[b] = a; else parent[a] = b;
+            }
+        }
+    }
+    free(ent);
+}
+
+static int keeper_better(const AudioTrack *a, const AudioTrack *b, int prefer_root) {
+    int la = a->format == FORMAT_FLAC || a->format == FORMAT_WAV;
+    int lb = b->format == FORMAT_FLAC || b->format == FORMAT_WAV;
+    if ((a->root_index == prefer_root) != (b->root_index == prefer_root)) return a->root_index == prefer_root;
+    if (la != lb) return la;
+    return a->size_bytes > b->size_bytes;
+}
+
+static size_t fingerprint_collect(TrackList *list, FpJob *job) {
+    FpCache cache;
+    char cpath[CARTAG_PATH_MAX];
+    size_t cached = 0;
+    FILE *cf;
+
+    fs_cache_path(FP_CACHE_FILE, cpath, sizeof(cpath));
+    cache_load(&cache, cpath);
+    for (size_t i = 0; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        const Fingerprint *hit;
+        if (t->duplicate || t->excluded) continue;
+        hit = cache_find(&cache, t->quick_hash, t->size_bytes);
+        if (hit) {
+            job->fps[i] = *hit;
+            cached++;
+        } else {
+            job->todo[job->todo_count++] = i;
+        }
+    }
+    free(cache.entries);
+
+    if (job->todo_count > 0 && !audio_has_ffmpeg()) {
+        progress_log(LVL_WARN, "ffmpeg ausente; impressao digital acustica usara apenas o cache");
+        job->todo_count = 0;
+    }
+    if (job->todo_count == 0) return cached;
+
+    fft_init();
+    progress_stage(STAGE_DEDUPE, job->todo_count);
+    fp_run_workers(job);
+    cf = cpath[0] ? fopen(cpath, "a") : NULL;
+    if (!cf) return cached;
+    for (size_t k = 0; k < job->todo_count; ++k) {
+        const AudioTrack *t = &list->tracks[job->todo[k]];
+        const Fingerprint *fp = &job->fps[job->todo[k]];
+        if (!fp->valid) continue;
+        fprintf(cf, "q%u %016llx %llu %016llx %016llx %016llx %016llx\n", FS_HASH_SCHEME, (unsigned long long)t->quick_hash,
+                (unsigned long long)t->size_bytes, (unsigned long long)fp->bits[0], (unsigned long long)fp->bits[1],
+                (unsigned long long)fp->bits[2], (unsigned long long)fp->bits[3]);
+    }
+    fclose(cf);
+    return cached;
+}
+
+static size_t fingerprint_group(TrackList *list, const Fingerprint *fps, int prefer_root, size_t *ncand_out,
+                                LibraryStats *stats) {
+    size_t *cand = (size_t *)malloc(list->count * sizeof(size_t));
+    size_t *parent = (size_t *)malloc(list->count * sizeof(size_t));
+    size_t *keeper = (size_t *)malloc(list->count * sizeof(size_t));
+    size_t ncand = 0;
+    size_t found = 0;
+
+    if (cand && parent && keeper) {
+        for (size_t i = 0; i < list->count; ++i) {
+            parent[i] = i;
+            keeper[i] = (size_t)-1;
+            if (fps[i].valid) cand[ncand++] = i;
+        }
+        lsh_link(fps, cand, ncand, parent);
+        for (size_t k = 0; k < ncand; ++k) {
+            size_t i = cand[k];
+            size_t r = uf_find(parent, i);
+            if (keeper[r] == (size_t)-1 || keeper_better(&list->tracks[i], &list->tracks[keeper[r]], prefer_root)) {
+                keeper[r] = i;
+            }
+        }
+        for (size_t k = 0; k < ncand; ++k) {
+            size_t i = cand[k];
+            size_t keep = keeper[uf_find(parent, i)];
+            if (keep == i) continue;
+            list->tracks[i].duplicate = 1;
+            stats->removed_duplicates++;
+            found++;
+            progress_log(LVL_INFO, "duplicata acustica: %s ~ %s", list->tracks[i].filename, list->tracks[keep].filename);
+        }
+    }
+    free(cand);
+    free(parent);
+    free(keeper);
+    *ncand_out = ncand;
+    return found;
+}
+
+void fingerprint_mark(TrackList *list, int prefer_root, LibraryStats *stats) {
+    FpJob job;
+    size_t cached;
+    size_t ncand = 0;
+    size_t found;
+
+    if (list->count == 0) return;
+    memset(&job, 0, sizeof(job));
+    job.list = list;
+    job.fps = (Fingerprint *)calloc(list->count, sizeof(Fingerprint));
+    job.todo = (size_t *)malloc(list->count * sizeof(size_t));
+    if (job.fps && job.todo) {
+        cached = fingerprint_collect(list, &job);
+        if (!progress_cancelled()) {
+            found = fingerprint_group(list, job.fps, prefer_root, &ncand, stats);
+            progress_log(LVL_INFO, "Impressao digital: %zu faixas (%zu do cache), %zu duplicatas acusticas", ncand,
+                         cached, found);
+        }
+    }
+    free(job.fps);
+    free(job.todo);
+}
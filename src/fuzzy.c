@@ -0,0 +1,386 @@
+#include "cartag.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZY_KEY_MAX 320
+
+typedef struct {
+    size_t track;
+    size_t first;
+    size_t n;
+} FuzzyRec;
+
+typedef struct {
+    uint32_t gram;
+    size_t count;
+} GramFreq;
+
+typedef struct {
+    uint32_t rec;
+    uint32_t pos;
+} FuzzyPosting;
+
+static const char *const k_noise_words[] = {
+    "remastered", "remaster", "remasterizado", "remasterizada", "hd", "hq", "4k", "official", "oficial",
+    "video", "clipe", "clip", "audio", "lyrics", "lyric", "letra", "legendado", "explicit", "mp3",
+    "feat", "ft", "featuring", "version", "versao", "edit", "radio", "full", NULL,
+};
+
+static int is_alnum_ascii(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+static int is_noise(const char *w, size_t len) {
+    if (len == 4 && (strncmp(w, "19", 2) == 0 || strncmp(w, "20", 2) == 0) && w[2] >= '0' && w[2] <= '9' &&
+        w[3] >= '0' && w[3] <= '9') {
+        return 1;
+    }
+    for (size_t i = 0; k_noise_words[i]; ++i) {
+        if (strlen(k_noise_words[i]) == len && strncmp(k_noise_words[i], w, len) == 0) return 1;
+    }
+    return 0;
+}
+
+static size_t key_words(const char *text, char *out, size_t out_sz, size_t o) {
+    char plain[FUZZY_KEY_MAX];
+    char folded[FUZZY_KEY_MAX];
+    size_t j = 0;
+    int depth = 0;
+
+    for (size_t i = 0; text[i] && j + 1 < sizeof(plain); ++i) {
+        char c = text[i];
+        if (c == '(' || c == '[' || c == '{') depth++;
+        else if ((c == ')' || c == ']' || c == '}') && depth > 0) depth--;
+        else if (depth == 0) plain[j++] = c;
+    }
+    plain[j] = '\0';
+    sanitize_fold_key(plain, folded, sizeof(folded));
+
+    for (size_t i = 0; folded[i];) {
+        size_t start;
+        while (folded[i] && !is_alnum_ascii(folded[i])) ++i;
+        start = i;
+        while (is_alnum_ascii(folded[i])) ++i;
+        if (i == start || is_noise(folded + start, i - start)) continue;
+        if (o > 0 && o + 1 < out_sz) out[o++] = ' ';
+        for (size_t k = start; k < i && o + 1 < out_sz; ++k) out[o++] = folded[k];
+    }
+    return o;
+}
+
+static size_t fuzzy_key(const AudioTrack *t, char *out, size_t out_sz) {
+    size_t o = key_words(t->artist, out, out_sz, 0);
+    size_t title = o;
+
+    o = key_words(t->title, out, out_sz, o);
+    if (o == title) o = 0;
+    out[o] = '\0';
+    return o;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static int cmp_gram_freq(const void *a, const void *b) {
+    const GramFreq *ga = (const GramFreq *)a;
+    const GramFreq *gb = (const GramFreq *)b;
+    if (ga->count != gb->count) return ga->count < gb->count ? -1 : 1;
+    return ga->gram < gb->gram ? -1 : (ga->gram > gb->gram ? 1 : 0);
+}
+
+static int cmp_rec_len(const void *a, const void *b) {
+    const FuzzyRec *ra = (const FuzzyRec *)a;
+    const FuzzyRec *rb = (const FuzzyRec *)b;
+    if (ra->n != rb->n) return ra->n < rb->n ? -1 : 1;
+    return ra->track < rb->track ? -1 : (ra->track > rb->track ? 1 : 0);
+}
+
+static size_t uf_find(size_t *parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void uf_union(size_t *parent, size_t a, size_t b) {
+    a = uf_find(parent, a);
+    b = uf_find(parent, b);
+    if (a == b) return;
+    if (a < b) parent[b] = a; else parent[a] = b;
+}
+
+static size_t overlap(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, size_t need) {
+    size_t i = 0, j = 0, n = 0;
+    while (i < na && j < nb) {
+        size_t left = na - i < nb - j ? na - i : nb - j;
+        if (n + left < need) return 0;
+        if (a[i] == b[j]) {
+            n++;
+            i++;
+            j++;
+        } else if (a[i] < b[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return n;
+}
+
+static size_t prefix_len(size_t n, double t) {
+    size_t keep = (size_t)ceil(t * (double)n);
+    if (keep > n) keep = n;
+    return n - keep + 1;
+}
+
+static size_t build_records(const TrackList *list, FuzzyRec *recs, uint32_t **pool_io, size_t *used_io) {
+    uint32_t *pool = NULL;
+    size_t cap = 0;
+    size_t nrec = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        char key[FUZZY_KEY_MAX + 2];
+        size_t len;
+        size_t n = 0;
+
+        if (t->duplicate || t->excluded) continue;
+        key[0] = ' ';
+        len = fuzzy_key(t, key + 1, FUZZY_KEY_MAX);
+        if (len < 2) continue;
+        key[len + 1] = ' ';
+        key[len + 2] = '\0';
+        if (used + len + 2 > cap) {
+            size_t new_cap = cap ? cap * 2 : 16384;
+            uint32_t *mem;
+            while (new_cap < used + len + 2) new_cap *= 2;
+            mem = (uint32_t *)realloc(pool, new_cap * sizeof(uint32_t));
+            if (!mem) break;
+            pool = mem;
+            cap = new_cap;
+        }
+        for (size_t k = 0; k < len; ++k) {
+            pool[used + n++] = ((uint32_t)(unsigned char)key[k] << 16) | ((uint32_t)(unsigned char)key[k + 1] << 8) |
+                               (uint32_t)(unsigned char)key[k + 2];
+        }
+        qsort(pool + used, n, sizeof(uint32_t), cmp_u32);
+        recs[nrec].n = 0;
+        for (size_t k = 0; k < n; ++k) {
+            if (k == 0 || pool[used + k] != pool[used + k - 1]) pool[used + recs[nrec].n++] = pool[used + k];
+        }
+        recs[nrec].track = i;
+        recs[nrec].first = used;
+        used += recs[nrec].n;
+        nrec++;
+    }
+    *pool_io = pool;
+    *used_io = used;
+    return nrec;
+}
+
+static size_t rank_grams(FuzzyRec *recs, size_t nrec, uint32_t *pool, size_t used) {
+    uint32_t *sorted = (uint32_t *)malloc(used * sizeof(uint32_t));
+    GramFreq *freq = (GramFreq *)malloc(used * sizeof(GramFreq));
+    uint32_t *uniq = (uint32_t *)malloc(used * sizeof(uint32_t));
+    uint32_t *rank = (uint32_t *)malloc(used * sizeof(uint32_t));
+    size_t nu = 0;
+
+    if (!sorted || !freq || !uniq || !rank) {
+        nu = 0;
+    } else {
+        memcpy(sorted, pool, used * sizeof(uint32_t));
+        qsort(sorted, used, sizeof(uint32_t), cmp_u32);
+        for (size_t i = 0; i < used; ++i) {
+            if (nu == 0 || freq[nu - 1].gram != sorted[i]) {
+                freq[nu].gram = sorted[i];
+                freq[nu++].count = 0;
+            }
+            freq[nu - 1].count++;
+        }
+        for (size_t i = 0; i < nu; ++i) uniq[i] = freq[i].gram;
+        qsort(freq, nu, sizeof(GramFreq), cmp_gram_freq);
+        for (size_t r = 0; r < nu; ++r) {
+            uint32_t *hit = (uint32_t *)bsearch(&freq[r].gram, uniq, nu, sizeof(uint32_t), cmp_u32);
+            rank[hit - uniq] = (uint32_t)r;
+        }
+        for (size_t i = 0; i < nrec; ++i) {
+            uint32_t *g = pool + recs[i].first;
+            for (size_t k = 0; k < recs[i].n; ++k) {
+                uint32_t *hit = (uint32_t *)bsearch(&g[k], uniq, nu, sizeof(uint32_t), cmp_u32);
+                g[k] = rank[hit - uniq];
+            }
+            qsort(g, recs[i].n, sizeof(uint32_t), cmp_u32);
+        }
+    }
+    free(sorted);
+    free(freq);
+    free(uniq);
+    free(rank);
+    return nu;
+}
+
+static void similarity_join(FuzzyRec *recs, size_t nrec, const uint32_t *pool, size_t ngrams, double t,
+                            size_t *parent) {
+    size_t *offs = (size_t *)calloc(ngrams + 1, sizeof(size_t));
+    size_t *fill = (size_t *)malloc((ngrams + 1) * sizeof(size_t));
+    size_t *head = (size_t *)malloc((ngrams + 1) * sizeof(size_t));
+    int *acc = (int *)calloc(nrec ? nrec : 1, sizeof(int));
+    size_t *cands = (size_t *)malloc((nrec ? nrec : 1) * sizeof(size_t));
+    FuzzyPosting *post = NULL;
+
+    if (offs && fill && head && acc && cands) {
+        for (size_t x = 0; x < nrec; ++x) {
+            size_t p = prefix_len(recs[x].n, t);
+            for (size_t k = 0; k < p; ++k) offs[pool[recs[x].first + k] + 1]++;
+        }
+        for (size_t g = 0; g < ngrams; ++g) offs[g + 1] += offs[g];
+        memcpy(fill, offs, (ngrams + 1) * sizeof(size_t));
+        memcpy(head, offs, (ngrams + 1) * sizeof(size_t));
+        post = (FuzzyPosting *)malloc((offs[ngrams] ? offs[ngrams] : 1) * sizeof(FuzzyPosting));
+    }
+
+    for (size_t x = 0; post && x < nrec; ++x) {
+        const uint32_t *gx = pool + recs[x].first;
+        size_t nx = recs[x].n;
+        size_t p = prefix_len(nx, t);
+        double min_len = t * (double)nx;
+        size_t ncand = 0;
+
+        for (size_t i = 0; i < p; ++i) {
+            uint32_t g = gx[i];
+            while (head[g] < fill[g] && (double)recs[post[head[g]].rec].n < min_len) head[g]++;
+            for (size_t q = head[g]; q < fill[g]; ++q) {
+                size_t y = post[q].rec;
+                size_t ny = recs[y].n;
+                size_t rest_x = nx - i - 1;
+                size_t rest_y = ny - post[q].pos - 1;
+                double need;
+                if (acc[y] < 0) continue;
+                need = ceil(t / (1.0 + t) * (double)(nx + ny));
+                if (acc[y] == 0) cands[ncand++] = y;
+                if ((double)acc[y] + 1.0 + (double)(rest_x < rest_y ? rest_x : rest_y) >= need) acc[y]++;
+                else acc[y] = -1;
+            }
+        }
+        for (size_t c = 0; c < ncand; ++c) {
+            size_t y = cands[c];
+            if (acc[y] > 0) {
+                size_t need = (size_t)ceil(t / (1.0 + t) * (double)(nx + recs[y].n));
+                size_t inter = overlap(gx, nx, pool + recs[y].first, recs[y].n, need);
+                if (inter >= need && (double)inter >= t * (double)(nx + recs[y].n - inter)) {
+                    uf_union(parent, recs[x].track, recs[y].track);
+                }
+            }
+            acc[y] = 0;
+        }
+        for (size_t k = 0; k < p; ++k) {
+            FuzzyPosting *e = &post[fill[gx[k]]++];
+            e->rec = (uint32_t)x;
+            e->pos = (uint32_t)k;
+        }
+    }
+    free(offs);
+    free(fill);
+    free(head);
+    free(acc);
+    free(cands);
+    free(post);
+}
+
+static int lossless(const AudioTrack *t) {
+    return t->format == FORMAT_FLAC || t->format == FORMAT_WAV;
+}
+
+static int fuzzy_better(const AudioTrack *a, const AudioTrack *b, FuzzyMode mode, int prefer_root) {
+    if ((a->root_index == prefer_root) != (b->root_index == prefer_root)) return a->root_index == prefer_root;
+    if (mode == FUZZY_LOSSLESS && lossless(a) != lossless(b)) return lossless(a);
+    if (a->duration_seconds != b->duration_seconds) return a->duration_seconds > b->duration_seconds;
+    if (mode == FUZZY_LONGEST && lossless(a) != lossless(b)) return lossless(a);
+    return a->size_bytes > b->size_bytes;
+}
+
+static void report_groups(TrackList *list, size_t *parent, FuzzyMode mode, int prefer_root, LibraryStats *stats) {
+    size_t *best = (size_t *)malloc(list->count * sizeof(size_t));
+    size_t *offs = (size_t *)calloc(list->count + 1, sizeof(size_t));
+    size_t *order = (size_t *)malloc(list->count * sizeof(size_t));
+    size_t groups = 0;
+    size_t marked = 0;
+
+    if (!best || !offs || !order) {
+        free(best);
+        free(offs);
+        free(order);
+        return;
+    }
+    for (size_t i = 0; i < list->count; ++i) best[i] = (size_t)-1;
+    for (size_t i = 0; i < list->count; ++i) {
+        size_t r = uf_find(parent, i);
+        offs[r + 1]++;
+        if (best[r] == (size_t)-1 || fuzzy_better(&list->tracks[i], &list->tracks[best[r]], mode, prefer_root)) best[r] = i;
+    }
+    for (size_t r = 0; r < list->count; ++r) offs[r + 1] += offs[r];
+    for (size_t i = 0; i < list->count; ++i) order[offs[uf_find(parent, i)]++] = i;
+
+    for (size_t r = 0, start = 0; r < list->count; ++r) {
+        size_t end = offs[r];
+        if (end - start >= 2) {
+            groups++;
+            if (groups == 1) progress_log(LVL_TEXT, "\nPossiveis duplicatas por metadados:");
+            progress_log(LVL_TEXT, "Grupo %zu:", groups);
+            for (size_t k = start; k < end; ++k) {
+                AudioTrack *t = &list->tracks[order[k]];
+                int keep = best[r] == order[k];
+                progress_log(LVL_TEXT, "  %s %-4s %6.1f MB %3d:%02d  %s", mode == FUZZY_REVIEW ? " " : (keep ? "+" : "-"),
+                             audio_format_name(t->format), (double)t->size_bytes / (1024.0 * 1024.0),
+                             t->duration_seconds / 60, t->duration_seconds % 60, t->rel_path);
+                if (mode != FUZZY_REVIEW && !keep) {
+                    t->duplicate = 1;
+                    stats->removed_duplicates++;
+                    marked++;
+                }
+            }
+        }
+        start = end;
+    }
+    if (groups && mode == FUZZY_REVIEW) progress_log(LVL_INFO, "%zu grupos para revisao; nada foi removido", groups);
+    else if (groups) progress_log(LVL_INFO, "%zu grupos; %zu faixas removidas por metadados", groups, marked);
+    free(best);
+    free(offs);
+    free(order);
+}
+
+void fuzzy_dedupe(TrackList *list, FuzzyMode mode, int threshold, int prefer_root, LibraryStats *stats) {
+    FuzzyRec *recs;
+    uint32_t *pool = NULL;
+    size_t *parent;
+    size_t nrec;
+    size_t used = 0;
+    size_t ngrams;
+    double t;
+
+    if (mode == FUZZY_OFF || list->count < 2) return;
+    if (threshold < 1 || threshold > 100) threshold = 80;
+    t = (double)threshold / 100.0;
+    recs = (FuzzyRec *)malloc(list->count * sizeof(FuzzyRec));
+    parent = (size_t *)malloc(list->count * sizeof(size_t));
+    if (recs && parent) {
+        for (size_t i = 0; i < list->count; ++i) parent[i] = i;
+        nrec = build_records(list, recs, &pool, &used);
+        ngrams = used ? rank_grams(recs, nrec, pool, used) : 0;
+        if (ngrams > 0) {
+            qsort(recs, nrec, sizeof(FuzzyRec), cmp_rec_len);
+            similarity_join(recs, nrec, pool, ngrams, t, parent);
+            report_groups(list, parent, mode, prefer_root, stats);
+        }
+    }
+    free(recs);
+    free(pool);
+    free(parent);
+}
@@ -0,0 +1,389 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define LOG_BUF_SIZE (64 * 1024)
+#define LOG_FLUSH_MS 250
+#define LOG_MAX_GROUPS 128
+
+typedef struct {
+    uint64_t key;
+    LogLevel level;
+    size_t count;
+    char message[200];
+    char example[CARTAG_NAME_MAX];
+} IssueGroup;
+
+typedef struct {
+    char *p;
+    size_t len;
+    size_t cap;
+} JsonLine;
+
+static OutputMode g_mode = OUTPUT_TEXT;
+static char g_buf[LOG_BUF_SIZE];
+static size_t g_len;
+static double g_last_flush;
+static IssueGroup g_groups[LOG_MAX_GROUPS];
+static size_t g_group_count;
+static int g_registered;
+static LogSinkFn g_sink;
+static void *g_sink_ctx;
+static double g_last_progress;
+
+#ifndef _WIN32
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOG_LOCK() pthread_mutex_lock(&g_lock)
+#define LOG_UNLOCK() pthread_mutex_unlock(&g_lock)
+#else
+#define LOG_LOCK() ((void)0)
+#define LOG_UNLOCK() ((void)0)
+#endif
+
+static double now_ms(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#else
+    return (double)clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+static void flush_locked(void) {
+    if (g_len) fwrite(g_buf, 1, g_len, stdout);
+    g_len = 0;
+    fflush(stdout);
+    g_last_flush = now_ms();
+}
+
+static void register_locked(void) {
+    if (g_registered) return;
+    g_registered = 1;
+    g_last_flush = now_ms();
+    atexit(log_flush);
+}
+
+static void append_locked(const char *s, size_t n) {
+    register_locked();
+    if (g_len + n > sizeof(g_buf)) flush_locked();
+    if (n > sizeof(g_buf)) {
+        fwrite(s, 1, n, stdout);
+        return;
+    }
+    memcpy(g_buf + g_len, s, n);
+    g_len += n;
+    if (now_ms() - g_last_flush >= LOG_FLUSH_MS) flush_locked();
+}
+
+static void emit(const char *s, size_t n) {
+    LOG_LOCK();
+    register_locked();
+    if (g_sink) g_sink(g_sink_ctx, s, n);
+    else append_locked(s, n);
+    LOG_UNLOCK();
+}
+
+static const char *level_name(LogLevel level) {
+    switch (level) {
+        case LVL_INFO: return "info";
+        case LVL_WARN: return "warn";
+        case LVL_ERROR: return "error";
+        default: return "text";
+    }
+}
+
+static void json_put(JsonLine *j, const char *s, size_t n) {
+    if (j->len + n >= j->cap) {
+        size_t cap = j->cap ? j->cap : 512;
+        char *mem;
+        while (cap <= j->len + n) cap *= 2;
+        mem = (char *)realloc(j->p, cap);
+        if (!mem) return;
+        j->p = mem;
+        j->cap = cap;
+    }
+    memcpy(j->p + j->len, s, n);
+    j->len += n;
+}
+
+static void json_key(JsonLine *j, const char *key) {
+    json_put(j, j->len > 1 ? ",\"" : "\"", j->len > 1 ? 2 : 1);
+    json_put(j, key, strlen(key));
+    json_put(j, "\":", 2);
+}
+
+static void json_str(JsonLine *j, const char *key, const char *val) {
+    const unsigned char *s = (const unsigned char *)val;
+    size_t run = 0;
+
+    json_key(j, key);
+    json_put(j, "\"", 1);
+    for (size_t i = 0; s[i]; ++i) {
+        char esc[8];
+        if (s[i] >= 0x20 && s[i] != '"' && s[i] != '\\') {
+            run++;
+            continue;
+        }
+        json_put(j, (const char *)s + i - run, run);
+        run = 0;
+        if (s[i] == '"' || s[i] == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)s[i];
+            json_put(j, esc, 2);
+        } else {
+            snprintf(esc, sizeof(esc), "\\u%04x", s[i]);
+            json_put(j, esc, 6);
+        }
+    }
+    json_put(j, (const char *)s + strlen(val) - run, run);
+    json_put(j, "\"", 1);
+}
+
+static void json_u64(JsonLine *j, const char *key, uint64_t val) {
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%llu", (unsigned long long)val);
+    json_key(j, key);
+    json_put(j, num, (size_t)n);
+}
+
+static void json_bool(JsonLine *j, const char *key, int val) {
+    json_key(j, key);
+    json_put(j, val ? "true" : "false", val ? 4 : 5);
+}
+
+static void json_begin(JsonLine *j, const char *event) {
+    memset(j, 0, sizeof(*j));
+    json_put(j, "{", 1);
+    json_str(j, "event", event);
+}
+
+static void json_end(JsonLine *j) {
+    json_put(j, "}\n", 2);
+    if (j->p) emit(j->p, j->len);
+    free(j->p);
+}
+
+void log_set_output(OutputMode mode) {
+    g_mode = mode;
+}
+
+void log_set_sink(LogSinkFn fn, void *ctx) {
+    LOG_LOCK();
+    flush_locked();
+    g_sink = fn;
+    g_sink_ctx = ctx;
+    LOG_UNLOCK();
+}
+
+int log_json(void) {
+    return g_mode == OUTPUT_JSON && !progress_attached();
+}
+
+void log_flush(void) {
+    LOG_LOCK();
+    flush_locked();
+    LOG_UNLOCK();
+}
+
+void log_tick(void) {
+    LOG_LOCK();
+    if (g_len && now_ms() - g_last_flush >= LOG_FLUSH_MS) flush_locked();
+    LOG_UNLOCK();
+}
+
+void log_write(LogLevel level, const char *text) {
+    JsonLine j;
+    const char *prefix = level == LVL_WARN ? "[WARN] " : (level == LVL_INFO ? "[INFO] " : "");
+
+    if (g_mode == OUTPUT_JSON) {
+        json_begin(&j, "log");
+        json_str(&j, "level", level_name(level));
+        json_str(&j, "message", text);
+        json_end(&j);
+        return;
+    }
+    if (level == LVL_ERROR && !g_sink) {
+        log_flush();
+        fprintf(stderr, "%s\n", text);
+        return;
+    }
+    LOG_LOCK();
+    if (g_sink) {
+        g_sink(g_sink_ctx, prefix, strlen(prefix));
+        g_sink(g_sink_ctx, text, strlen(text));
+        g_sink(g_sink_ctx, "\n", 1);
+    } else {
+        append_locked(prefix, strlen(prefix));
+        append_locked(text, strlen(text));
+        append_locked("\n", 1);
+    }
+    LOG_UNLOCK();
+}
+
+void log_track_issue(LogLevel level, const char *filename, const char *message) {
+    uint64_t key = hash64(message, strlen(message), (uint64_t)level);
+    IssueGroup *g = NULL;
+
+    if (log_json()) {
+        JsonLine j;
+        json_begin(&j, "warning");
+        json_str(&j, "level", level_name(level));
+        json_str(&j, "file", filename);
+        json_str(&j, "message", message);
+        json_end(&j);
+    }
+    LOG_LOCK();
+    for (size_t i = 0; i < g_group_count; ++i) {
+        if (g_groups[i].key == key && g_groups[i].level == level && strcmp(g_groups[i].message, message) == 0) {
+            g = &g_groups[i];
+            break;
+        }
+    }
+    if (!g && g_group_count < LOG_MAX_GROUPS) {
+        g = &g_groups[g_group_count++];
+        g->key = key;
+        g->level = level;
+        g->count = 0;
+        snprintf(g->message, sizeof(g->message), "%s", message);
+        snprintf(g->example, sizeof(g->example), "%s", filename);
+    }
+    if (g) g->count++;
+    LOG_UNLOCK();
+    if (!g && !log_json()) progress_log(level, "%s: %s", filename, message);
+}
+
+void log_flush_issues(void) {
+    IssueGroup groups[LOG_MAX_GROUPS];
+    size_t n;
+
+    LOG_LOCK();
+    n = g_group_count;
+    memcpy(groups, g_groups, n * sizeof(IssueGroup));
+    g_group_count = 0;
+    LOG_UNLOCK();
+
+    for (size_t i = 0; i < n; ++i) {
+        const IssueGroup *g = &groups[i];
+        if (log_json()) {
+            JsonLine j;
+            json_begin(&j, "warning_summary");
+            json_str(&j, "level", level_name(g->level));
+            json_str(&j, "message", g->message);
+            json_u64(&j, "count", g->count);
+            json_str(&j, "example", g->example);
+            json_end(&j);
+        } else if (g->count == 1) {
+            progress_log(g->level, "%s: %s", g->example, g->message);
+        } else {
+            progress_log(g->level, "%zu faixas: %s (ex.: %s)", g->count, g->message, g->example);
+        }
+    }
+}
+
+static const char *action_name(ConvertAction a) {
+    switch (a) {
+        case CONV_REENCODE: return "reencode";
+        case CONV_REMUX: return "remux";
+        default: return "copy";
+    }
+}
+
+void log_event_track(const AudioTrack *t) {
+    JsonLine j;
+    json_begin(&j, "track");
+    json_str(&j, "path", t->path);
+    json_str(&j, "out", t->out_path);
+    json_str(&j, "format", audio_format_name(t->format));
+    json_str(&j, "artist", t->artist);
+    json_str(&j, "album", t->album);
+    json_str(&j, "title", t->title);
+    json_u64(&j, "duration", (uint64_t)(t->duration_seconds > 0 ? t->duration_seconds : 0));
+    json_u64(&j, "size", t->size_bytes);
+    json_str(&j, "action", action_name(t->convert));
+    json_str(&j, "decision", t->decision);
+    json_bool(&j, "duplicate", t->duplicate);
+    json_bool(&j, "excluded", t->excluded);
+    json_bool(&j, "unselected", t->unselected);
+    json_bool(&j, "omitted", t->omitted);
+    json_end(&j);
+}
+
+void log_event_plan(size_t order, const AudioTrack *t) {
+    JsonLine j;
+    json_begin(&j, "plan");
+    json_u64(&j, "order", order);
+    json_str(&j, "artist", t->artist);
+    json_str(&j, "title", t->title);
+    json_str(&j, "out", t->out_path[0] ? t->out_path : t->filename);
+    json_str(&j, "action", action_name(t->convert));
+    json_end(&j);
+}
+
+void log_event_stats(const LibraryStats *stats) {
+    static const AudioFormat formats[] = {FORMAT_MP3, FORMAT_FLAC, FORMAT_WAV, FORMAT_AAC,
+                                          FORMAT_M4A, FORMAT_OGG,  FORMAT_WMA};
+    JsonLine j;
+    json_begin(&j, "stats");
+    json_u64(&j, "tracks", stats->total_tracks);
+    json_u64(&j, "duration", stats->total_duration);
+    json_u64(&j, "duplicates", stats->removed_duplicates);
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        json_u64(&j, audio_format_name(formats[i]), stats->format_count[formats[i]]);
+    }
+    json_end(&j);
+}
+
+void log_event_stage(PipelineStage stage, size_t total) {
+    JsonLine j;
+    json_begin(&j, "stage");
+    json_str(&j, "stage", progress_stage_name(stage));
+    json_u64(&j, "total", total);
+    json_end(&j);
+}
+
+void log_event_progress(size_t done, uint64_t bytes) {
+    JsonLine j;
+    double now = now_ms();
+
+    LOG_LOCK();
+    if (now - g_last_progress < LOG_FLUSH_MS) {
+        LOG_UNLOCK();
+        return;
+    }
+    g_last_progress = now;
+    LOG_UNLOCK();
+    json_begin(&j, "progress");
+    json_u64(&j, "done", done);
+    json_u64(&j, "bytes", bytes);
+    json_end(&j);
+}
+
+void log_event_estimate(uint64_t bytes, double rate) {
+    JsonLine j;
+    json_begin(&j, "estimate");
+    json_u64(&j, "bytes", bytes);
+    json_u64(&j, "rate", (uint64_t)rate);
+    json_u64(&j, "seconds", rate > 0.0 ? (uint64_t)((double)bytes / rate + 0.5) : 0);
+    json_end(&j);
+}
+
+void log_event_result(const char *id, const char *cmd, const char *error, size_t count, double ms) {
+    JsonLine j;
+    json_begin(&j, error ? "error" : "result");
+    if (id) json_str(&j, "id", id);
+    json_str(&j, "cmd", cmd);
+    if (error) json_str(&j, "message", error);
+    json_u64(&j, "count", count);
+    json_u64(&j, "us", (uint64_t)(ms * 1000.0));
+    json_end(&j);
+}
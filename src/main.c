@@ -21,91 +21,50 @@ static void pause_for_results_if_tty(void) {
 #endif
 }
 
-static int run_pipeline(CliOptions *opts) {
-    TrackList list;
-    LibraryStats stats;
-
-    memset(&list, 0, sizeof(list));
-    memset(&stats, 0, sizeof(stats));
+int main(int argc, char **argv) {
+    CliOptions opts;
+    PipelineCache cache;
 
-    if (downloader_is_url(opts->input)) {
-        char warn[256];
-        const char *download_dir = ".";
-        if (downloader_fetch_audio(opts->input, download_dir, warn, sizeof(warn)) != 0) {
-            fprintf(stderr, "Erro download: %s\n", warn);
-            return 2;
-        }
-        printf("[INFO] %s\n", warn);
-        snprintf(opts->input, sizeof(opts->input), "%s", download_dir);
+    if (cli_parse(argc, argv, &opts) != 0) {
+        cli_print_help();
+        return 1;
     }
+    log_set_output(opts.output);
+    sched_configure(&opts);
 
-    if (fs_scan_audio(opts->input, &list) != 0) {
-        fprintf(stderr, "Falha ao escanear entrada: %s\n", opts->input);
-        return 3;
+    if (opts.reverify[0]) {
+        return verify_export_dir(opts.reverify, opts.jobs) == 0 ? 0 : 1;
     }
 
-    for (size_t i = 0; i < list.count; ++i) {
-        AudioTrack *t = &list.tracks[i];
-        char warn[256];
-
-        sanitize_track(t, opts->limit_name || opts->car_safe);
-        if (opts->fix_tags || opts->car_safe) {
-            tags_fix_from_filename(t);
-            tags_standardize(t);
-        }
-
-        audio_can_play_car(t, opts->car_safe, warn, sizeof(warn));
-        if (warn[0]) printf("[WARN] %s: %s\n", t->filename, warn);
-
-        warn[0] = '\0';
-        audio_convert_if_needed(t, opts, warn, sizeof(warn));
-        if (warn[0]) printf("[INFO] %s: %s\n", t->filename, warn);
-
-        stats.total_tracks++;
-        stats.total_duration += (uint64_t)t->duration_seconds;
-        stats.format_count[t->format]++;
+    if (opts.serve[0]) {
+        return serve_run(&opts, argc, argv);
     }
 
-    if (opts->dedupe || opts->car_safe) dedupe_mark(&list, &stats);
-
-    organizer_plan(&list, opts);
-    if (opts->prefix || opts->car_safe) organizer_apply_prefix(&list);
-
-    diagnostics_print(&list);
-    simulate_print(&list, opts->simulate, &stats);
-    exporter_run(&list, opts);
-    stats_print(&stats);
-
-    free(list.tracks);
-    return 0;
-}
-
-int main(int argc, char **argv) {
-    CliOptions opts;
-
-    if (cli_parse(argc, argv, &opts) != 0) {
-        cli_print_help();
-        return 1;
+    if (opts.watch) {
+        return watch_run(&opts);
     }
 
     if (!opts.interactive_tui) {
-        return run_pipeline(&opts);
+        return pipeline_run(&opts);
     }
 
+    memset(&cache, 0, sizeof(cache));
     for (;;) {
-        int ui_rc = tui_run(&opts);
+        int ui_rc = tui_run(&opts, &cache);
         int pipe_rc;
 
         if (ui_rc != 0) {
+            pipeline_cache_free(&cache);
             return 0;
         }
 
-        pipe_rc = run_pipeline(&opts);
+        pipe_rc = pipeline_run_cached(&opts, &cache);
         if (pipe_rc != 0) {
-            printf("[WARN] pipeline terminou com erro (%d).\n", pipe_rc);
+            progress_log(LVL_WARN, "pipeline terminou com erro (%d).", pipe_rc);
         } else {
-            printf("[INFO] pipeline concluido. Lista sera atualizada na UI.\n");
+            progress_log(LVL_INFO, "pipeline concluido. Lista sera atualizada na UI.");
         }
+        log_flush();
         pause_for_results_if_tty();
     }
 }
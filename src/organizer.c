@@ -3,44 +3,18 @@
 #include <stdio.h>
 #include <string.h>
 
-static void str_copy(char *dst, size_t dst_sz, const char *src) {
-    size_t n;
-    if (!dst || dst_sz == 0) return;
-    if (!src) {
-        dst[0] = '\0';
-        return;
-    }
-    n = strlen(src);
-    if (n >= dst_sz) n = dst_sz - 1;
-    memcpy(dst, src, n);
-    dst[n] = '\0';
-}
-
-static void str_append(char *dst, size_t dst_sz, const char *src) {
-    size_t dlen;
-    size_t slen;
-    size_t n;
-    if (!dst || dst_sz == 0 || !src) return;
-    dlen = strlen(dst);
-    if (dlen >= dst_sz - 1) return;
-    slen = strlen(src);
-    n = dst_sz - dlen - 1;
-    if (slen < n) n = slen;
-    memcpy(dst + dlen, src, n);
-    dst[dlen + n] = '\0';
-}
-
-static void path_join2(char *dst, size_t dst_sz, const char *a, const char *b) {
-    str_copy(dst, dst_sz, a ? a : "");
-    str_append(dst, dst_sz, "/");
-    str_append(dst, dst_sz, b ? b : "");
+AudioFormat organizer_output_format(const AudioTrack *t) {
+    if (t->convert != CONV_SKIP || (t->converted && t->format == FORMAT_MP3)) return FORMAT_MP3;
+    return t->format;
 }
 
 void organizer_plan(TrackList *list, const CliOptions *opts) {
     for (size_t i = 0; i < list->count; ++i) {
         AudioTrack *t = &list->tracks[i];
+        AudioFormat out = organizer_output_format(t);
         const char *ext = strrchr(t->filename, '.');
-        if (!ext) ext = ".mp3";
+        if (!ext || t->convert) ext = ".mp3";
+        else if (out != FORMAT_UNKNOWN && audio_detect_format(t->filename) != out) ext = audio_format_ext(out);
 
         if (opts->organize == ORG_ARTIST) {
             snprintf(t->out_path, sizeof(t->out_path), "%s/%s%s", t->artist, t->title, ext);
@@ -60,17 +34,32 @@ void organizer_plan(TrackList *list, const CliOptions *opts) {
 
         if (opts->group_by_format) {
             char tmp[CARTAG_PATH_MAX];
-            path_join2(tmp, sizeof(tmp), audio_format_name(t->format), t->out_path);
+            path_join2(tmp, sizeof(tmp), audio_format_name(out), t->out_path);
             str_copy(t->out_path, sizeof(t->out_path), tmp);
         }
     }
 }
 
+void organizer_regroup(AudioTrack *t, AudioFormat from) {
+    const char *old = audio_format_name(from);
+    size_t n = strlen(old);
+    char *p = t->out_path;
+    char tmp[CARTAG_PATH_MAX];
+
+    if (strncmp(p, old, n) != 0 || p[n] != '/') {
+        p = strchr(t->out_path, '_');
+        if (!p || strncmp(++p, old, n) != 0 || p[n] != '/') return;
+    }
+    snprintf(tmp, sizeof(tmp), "%.*s%s%s", (int)(p - t->out_path), t->out_path,
+             audio_format_name(organizer_output_format(t)), p + n);
+    str_copy(t->out_path, sizeof(t->out_path), tmp);
+}
+
 void organizer_apply_prefix(TrackList *list) {
     for (size_t i = 0; i < list->count; ++i) {
         AudioTrack *t = &list->tracks[i];
         char tmp[CARTAG_PATH_MAX];
-        int nw = snprintf(tmp, sizeof(tmp), "%03zu_", i + 1);
+        int nw = snprintf(tmp, sizeof(tmp), "%03zu_", t->slot ? t->slot : i + 1);
         size_t off = (nw > 0) ? (size_t)nw : 0;
         if (off >= sizeof(tmp)) off = sizeof(tmp) - 1;
         tmp[off] = '\0';
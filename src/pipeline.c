@@ -0,0 +1,527 @@
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define CONVERT_MAX_WORKERS 16
+
+typedef struct {
+    TrackList *list;
+    int cancelled;
+} ScanProgress;
+
+typedef struct {
+    TrackList *list;
+    const CliOptions *opts;
+    size_t next;
+    size_t done;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} ConvertPool;
+
+static int scan_progress_push(void *ctx, const AudioTrack *track) {
+    ScanProgress *sp = (ScanProgress *)ctx;
+    if (progress_cancelled()) {
+        sp->cancelled = 1;
+        return 1;
+    }
+    if (tracklist_push(sp->list, track) != 0) return 0;
+    if ((sp->list->count & 63) == 0) progress_advance(sp->list->count, 0);
+    return 0;
+}
+
+void pipeline_process_track(AudioTrack *t, const CliOptions *opts) {
+    char warn[256];
+
+    sanitize_track(t, opts->limit_name || opts->car_safe);
+    if ((opts->fix_tags || opts->car_safe) && !t->has_tags) {
+        tags_fix_from_filename(t);
+        tags_standardize(t);
+    }
+    if (t->format != FORMAT_UNKNOWN && audio_detect_format(t->filename) != t->format) {
+        snprintf(warn, sizeof(warn), "conteudo e %s, extensao nao corresponde", audio_format_name(t->format));
+        log_track_issue(LVL_WARN, t->filename, warn);
+    }
+
+    audio_can_play_car(t, opts->car_safe, warn, sizeof(warn));
+    if (warn[0]) log_track_issue(LVL_WARN, t->filename, warn);
+}
+
+void pipeline_convert_track(AudioTrack *t, const CliOptions *opts) {
+    char warn[256];
+
+    warn[0] = '\0';
+    if (audio_convert_if_needed(t, opts, warn, sizeof(warn)) < 0 && t->convert) {
+        const char *src_ext = strrchr(t->filename, '.');
+        char *out_ext = strrchr(t->out_path, '.');
+        t->convert = CONV_SKIP;
+        snprintf(t->decision, sizeof(t->decision), "copiar: %s", warn);
+        if (src_ext && out_ext && (size_t)(out_ext - t->out_path) + strlen(src_ext) < sizeof(t->out_path)) {
+            memcpy(out_ext, src_ext, strlen(src_ext) + 1);
+        }
+        if (opts->group_by_format) organizer_regroup(t, FORMAT_MP3);
+    }
+    if (warn[0]) log_track_issue(LVL_INFO, t->filename, warn);
+}
+
+static int pipeline_prefer_root(const CliOptions *opts) {
+    const char *p = opts->prefer_root;
+    char *end;
+    long n;
+
+    if (p[0] == '\0') return -1;
+    if (strcmp(p, opts->input) == 0) return 0;
+    for (size_t i = 0; i < opts->root_count; ++i) {
+        if (strcmp(p, opts->roots[i]) == 0) return (int)i + 1;
+    }
+    n = strtol(p, &end, 10);
+    if (*end == '\0' && n >= 1 && (size_t)n <= opts->root_count + 1) return (int)n - 1;
+    return -1;
+}
+
+static int cmp_root_order(const void *a, const void *b) {
+    const AudioTrack *ta = (const AudioTrack *)a;
+    const AudioTrack *tb = (const AudioTrack *)b;
+    if (ta->root_index != tb->root_index) return ta->root_index < tb->root_index ? -1 : 1;
+    return strcmp(ta->rel_path, tb->rel_path);
+}
+
+static int pipeline_scan(const CliOptions *opts, TrackList *list) {
+    ScanRoot roots[CARTAG_MAX_ROOTS + 1];
+    ScanProgress sp;
+    size_t n = 0;
+    size_t ok = 0;
+    int rc;
+
+    roots[n].path = opts->input;
+    roots[n++].io_limit = opts->io_per_root;
+    for (size_t i = 0; i < opts->root_count && i < CARTAG_MAX_ROOTS; ++i) {
+        roots[n].path = opts->roots[i];
+        roots[n++].io_limit = opts->root_io[i] > 0 ? opts->root_io[i] : opts->io_per_root;
+    }
+
+    progress_stage(STAGE_SCAN, 0);
+    sp.list = list;
+    sp.cancelled = 0;
+    rc = fs_scan_roots(roots, n, scan_progress_push, &sp);
+    if (rc < 0) {
+        progress_log(LVL_ERROR, "Falha ao escanear entrada: %s", opts->input);
+        return 3;
+    }
+    if (sp.cancelled) return 4;
+    for (size_t i = 0; i < n; ++i) {
+        if (roots[i].status == 0) ok++;
+        else progress_log(LVL_ERROR, "Falha ao escanear entrada: %s", roots[i].path);
+    }
+    if (ok == 0) return 3;
+    if (list->count > 1) qsort(list->tracks, list->count, sizeof(AudioTrack), cmp_root_order);
+    cue_expand(list);
+    progress_advance(list->count, 0);
+    return 0;
+}
+
+static void pipeline_select(TrackList *list, const CliOptions *opts) {
+    size_t selected = select_apply(&opts->select_query, list);
+    progress_log(LVL_INFO, "Selecao: %zu de %zu faixas", selected, list->count);
+}
+
+void pipeline_dedupe(TrackList *list, const CliOptions *opts, LibraryStats *stats) {
+    if (opts->dedupe || opts->car_safe || opts->fingerprint || select_uses_duplicate(&opts->select_query)) {
+        dedupe_mark(list, pipeline_prefer_root(opts), stats);
+    }
+    if (opts->fingerprint) fingerprint_mark(list, pipeline_prefer_root(opts), stats);
+    if (opts->fuzzy != FUZZY_OFF) fuzzy_dedupe(list, opts->fuzzy, opts->fuzzy_threshold, pipeline_prefer_root(opts), stats);
+    if (opts->select_query.count) pipeline_select(list, opts);
+}
+
+static void pipeline_organize(TrackList *list, const CliOptions *opts) {
+    organizer_plan(list, opts);
+    if (opts->prefix || opts->car_safe) organizer_apply_prefix(list);
+}
+
+void pipeline_plan(TrackList *list, const CliOptions *opts, LibraryStats *stats) {
+    pipeline_dedupe(list, opts, stats);
+
+    for (size_t i = 0; i < list->count; ++i) audio_plan_conversion(&list->tracks[i], opts, opts->target_kbps);
+    capacity_plan(list, opts);
+
+    progress_stage(STAGE_PLAN, list->count);
+    pipeline_organize(list, opts);
+}
+
+static int pipeline_download(const CliOptions *opts, TrackList *list) {
+    char **urls = NULL;
+    size_t count = 0;
+    const char **all;
+    size_t n = 0;
+    char warn[256];
+    int rc;
+
+    if (opts->batch_file[0] && downloader_read_url_file(opts->batch_file, &urls, &count) != 0) {
+        progress_log(LVL_ERROR, "Erro download: nao foi possivel ler %s", opts->batch_file);
+        return 2;
+    }
+    all = (const char **)malloc((count + 1) * sizeof(char *));
+    if (!all) {
+        downloader_free_urls(urls, count);
+        return 2;
+    }
+    if (downloader_is_url(opts->input)) all[n++] = opts->input;
+    for (size_t i = 0; i < count; ++i) all[n++] = urls[i];
+
+    progress_stage(STAGE_DOWNLOAD, n);
+    rc = downloader_fetch_batch(all, n, ".", opts->jobs, list, warn, sizeof(warn));
+    free(all);
+    downloader_free_urls(urls, count);
+    if (rc != 0) {
+        progress_log(LVL_ERROR, "Erro download: %s", warn);
+        return 2;
+    }
+    progress_log(LVL_INFO, "%s", warn);
+    return 0;
+}
+
+int pipeline_load(const CliOptions *opts, TrackList *list, LibraryStats *stats) {
+    uint64_t bytes = 0;
+
+    if (opts->batch_file[0] || downloader_is_url(opts->input)) {
+        int rc = pipeline_download(opts, list);
+        if (rc != 0) return rc;
+        if (progress_cancelled()) return 4;
+    } else {
+        int rc = pipeline_scan(opts, list);
+        if (rc != 0) return rc;
+    }
+
+    progress_stage(STAGE_PROCESS, list->count);
+    for (size_t i = 0; i < list->count; ++i) {
+        AudioTrack *t = &list->tracks[i];
+
+        if (progress_cancelled()) return 4;
+        pipeline_process_track(t, opts);
+
+        stats->total_tracks++;
+        stats->total_duration += (uint64_t)t->duration_seconds;
+        stats->format_count[t->format]++;
+        bytes += t->size_bytes;
+        progress_advance(i + 1, bytes);
+    }
+    return 0;
+}
+
+static int convert_live(const AudioTrack *t) {
+    return t->convert && !t->duplicate && !t->excluded && !t->unselected && !t->omitted;
+}
+
+static void *convert_worker(void *arg) {
+    ConvertPool *cp = (ConvertPool *)arg;
+    for (;;) {
+        size_t i;
+#ifndef _WIN32
+        pthread_mutex_lock(&cp->lock);
+#endif
+        while (cp->next < cp->list->count && !convert_live(&cp->list->tracks[cp->next])) {
+            cp->next++;
+            cp->done++;
+        }
+        i = cp->next < cp->list->count && !progress_cancelled() ? cp->next++ : (size_t)-1;
+#ifndef _WIN32
+        pthread_mutex_unlock(&cp->lock);
+#endif
+        if (i == (size_t)-1) break;
+        sched_cpu_acquire();
+        pipeline_convert_track(&cp->list->tracks[i], cp->opts);
+        sched_cpu_release();
+#ifndef _WIN32
+        pthread_mutex_lock(&cp->lock);
+#endif
+        progress_advance(++cp->done, 0);
+#ifndef _WIN32
+        pthread_mutex_unlock(&cp->lock);
+#endif
+    }
+    return NULL;
+}
+
+int pipeline_convert(TrackList *list, const CliOptions *opts) {
+    ConvertPool cp;
+    size_t todo = 0;
+#ifndef _WIN32
+    pthread_t threads[CONVERT_MAX_WORKERS];
+    int workers = sched_workers(opts->jobs > CONVERT_MAX_WORKERS ? CONVERT_MAX_WORKERS : opts->jobs);
+    int started = 0;
+#endif
+
+    progress_stage(STAGE_CONVERT, list->count);
+    cue_split(list, opts);
+    for (size_t i = 0; i < list->count; ++i) todo += convert_live(&list->tracks[i]) != 0;
+    if (todo > 0) audio_has_ffmpeg();
+
+    memset(&cp, 0, sizeof(cp));
+    cp.list = list;
+    cp.opts = opts;
+#ifndef _WIN32
+    if ((size_t)workers > todo) workers = todo > 0 ? (int)todo : 1;
+    pthread_mutex_init(&cp.lock, NULL);
+    for (int w = 1; w < workers; ++w) {
+        if (pthread_create(&threads[started], NULL, convert_worker, &cp) == 0) started++;
+    }
+    convert_worker(&cp);
+    for (int w = 0; w < started; ++w) pthread_join(threads[w], NULL);
+    pthread_mutex_destroy(&cp.lock);
+#else
+    convert_worker(&cp);
+#endif
+    if (progress_cancelled()) return 4;
+    progress_advance(list->count, 0);
+    return 0;
+}
+
+static int pipeline_report(const TrackList *list, const CliOptions *opts, LibraryStats *stats) {
+    log_flush_issues();
+    if (log_json()) {
+        for (size_t i = 0; i < list->count; ++i) log_event_track(&list->tracks[i]);
+    }
+    diagnostics_print(list);
+    simulate_print(list, opts->simulate, stats);
+    exporter_run(list, opts);
+    stats_print(stats);
+    return progress_cancelled() ? 4 : 0;
+}
+
+static int pipeline_body(CliOptions *opts, TrackList *list, LibraryStats *stats) {
+    int rc = pipeline_load(opts, list, stats);
+    if (rc != 0) return rc;
+
+    progress_stage(STAGE_DEDUPE, list->count);
+    pipeline_plan(list, opts, stats);
+
+    rc = pipeline_convert(list, opts);
+    if (rc != 0) return rc;
+    return pipeline_report(list, opts, stats);
+}
+
+int pipeline_run(CliOptions *opts) {
+    TrackList list;
+    LibraryStats stats;
+    int rc;
+
+    memset(&list, 0, sizeof(list));
+    memset(&stats, 0, sizeof(stats));
+
+    rc = pipeline_body(opts, &list, &stats);
+    log_flush_issues();
+    tracklist_free(&list);
+    progress_done(rc);
+    log_flush();
+    return rc;
+}
+
+static uint64_t sig_int(uint64_t h, int v) {
+    return hash64(&v, sizeof(v), h);
+}
+
+static uint64_t sig_str(uint64_t h, const char *s) {
+    return hash64(s, strlen(s) + 1, h);
+}
+
+static void pipeline_signatures(const CliOptions *opts, uint64_t *sig) {
+    uint64_t h = sig_str(0, opts->input);
+    for (size_t i = 0; i < opts->root_count; ++i) h = sig_int(sig_str(h, opts->roots[i]), opts->root_io[i]);
+    h = sig_int(h, opts->io_per_root);
+    h = sig_str(h, opts->batch_file);
+    h = sig_int(h, opts->fix_tags);
+    h = sig_int(h, opts->limit_name);
+    sig[PCACHE_LOAD] = sig_int(h, opts->car_safe);
+
+    h = sig_int(0, opts->dedupe);
+    h = sig_int(h, opts->fingerprint);
+    h = sig_int(h, (int)opts->fuzzy);
+    h = sig_int(h, opts->fuzzy_threshold);
+    h = sig_str(h, opts->prefer_root);
+    h = sig_str(h, opts->select);
+    sig[PCACHE_DEDUPE] = sig_int(h, opts->car_safe);
+
+    h = sig_int(0, opts->convert_mp3);
+    h = sig_int(h, opts->keep_format);
+    h = sig_int(h, opts->target_kbps);
+    h = sig_int(h, opts->strip_art);
+    h = sig_int(h, opts->fit);
+    h = sig_int(h, opts->fit_bitrate);
+    h = hash64(&opts->capacity_bytes, sizeof(opts->capacity_bytes), h);
+    h = sig_str(h, opts->playcounts_file);
+    h = sig_str(h, opts->export_path);
+    sig[PCACHE_PLAN] = sig_int(h, opts->car_safe);
+
+    h = sig_int(0, (int)opts->organize);
+    h = sig_int(h, opts->group_by_format);
+    h = sig_int(h, opts->prefix);
+    sig[PCACHE_ORGANIZE] = sig_int(h, opts->car_safe);
+}
+
+static int cache_fresh(const TrackList *base) {
+    struct stat st;
+    for (size_t i = 0; i < base->count; ++i) {
+        const AudioTrack *t = &base->tracks[i];
+        if (stat(t->path, &st) != 0 || (int64_t)st.st_mtime != t->mtime) return 0;
+        if (!t->cue_track && (uint64_t)st.st_size != t->size_bytes) return 0;
+    }
+    return 1;
+}
+
+static uint64_t conv_key(const AudioTrack *orig, const AudioTrack *t, const CliOptions *opts) {
+    uint64_t h = sig_str(0, orig->path);
+    h = hash64(&orig->mtime, sizeof(orig->mtime), h);
+    h = sig_int(h, orig->cue_track);
+    h = sig_int(h, (int)t->convert);
+    h = sig_int(h, t->target_kbps);
+    h = sig_int(h, opts->strip_art);
+    return sig_int(h, opts->car_safe) | 1;
+}
+
+static int tracklist_copy(TrackList *dst, const TrackList *src) {
+    memset(dst, 0, sizeof(*dst));
+    if (src->count == 0) return 0;
+    dst->tracks = (AudioTrack *)malloc(src->count * sizeof(AudioTrack));
+    if (!dst->tracks) return -1;
+    memcpy(dst->tracks, src->tracks, src->count * sizeof(AudioTrack));
+    dst->count = src->count;
+    dst->capacity = src->count;
+    return 0;
+}
+
+static size_t cache_reuse_conversions(PipelineCache *c, TrackList *next, const CliOptions *opts) {
+    struct stat st;
+    size_t reused = 0;
+
+    if (!c->conv_key || c->work.count != next->count) return 0;
+    for (size_t i = 0; i < next->count; ++i) {
+        AudioTrack *t = &next->tracks[i];
+        const AudioTrack *prev = &c->work.tracks[i];
+        if (!c->conv_key[i] || t->duplicate || t->unselected || t->omitted) continue;
+        if (t->convert != prev->convert || t->cue_track != prev->cue_track) continue;
+        if (conv_key(&c->base.tracks[i], t, opts) != c->conv_key[i] || stat(prev->path, &st) != 0) continue;
+        str_copy(t->path, sizeof(t->path), prev->path);
+        t->format = prev->format;
+        t->size_bytes = prev->size_bytes;
+        t->converted = 1;
+        reused++;
+    }
+    return reused;
+}
+
+static void cache_commit_work(PipelineCache *c, TrackList *next, const CliOptions *opts) {
+    uint64_t *keys = NULL;
+
+    if (next->count) keys = (uint64_t *)malloc(next->count * sizeof(uint64_t));
+    for (size_t i = 0; keys && i < next->count; ++i) {
+        const AudioTrack *t = &next->tracks[i];
+        keys[i] = t->converted ? conv_key(&c->base.tracks[i], t, opts) : 0;
+    }
+    tracklist_free(&c->work);
+    free(c->conv_key);
+    c->work = *next;
+    c->conv_key = keys;
+}
+
+static int pipeline_cached_body(CliOptions *opts, PipelineCache *c, LibraryStats *stats) {
+    static const char *names[PCACHE_STAGES] = {"carga", "dedupe", "plano", "organizacao"};
+    uint64_t sig[PCACHE_STAGES];
+    TrackList next;
+    size_t reused;
+    int from = 0;
+    int rc;
+
+    pipeline_signatures(opts, sig);
+    while (from < c->level && c->sig[from] == sig[from]) from++;
+    if (opts->batch_file[0] || downloader_is_url(opts->input) || (from > PCACHE_LOAD && !cache_fresh(&c->base))) from = PCACHE_LOAD;
+    c->level = from;
+    if (from == PCACHE_STAGES) progress_log(LVL_INFO, "Cache: opcoes inalteradas; reaproveitando todas as etapas");
+    else if (from > PCACHE_LOAD) progress_log(LVL_INFO, "Cache: reaproveitando ate %s; refazendo a partir de %s", names[from - 1], names[from]);
+
+    if (from == PCACHE_LOAD) {
+        tracklist_free(&c->base);
+        memset(&c->base_stats, 0, sizeof(c->base_stats));
+        rc = pipeline_load(opts, &c->base, &c->base_stats);
+        if (rc != 0) {
+            tracklist_free(&c->base);
+            return rc;
+        }
+        free(c->flags);
+        c->flags = NULL;
+        if (c->base.count) c->flags = (unsigned char *)calloc(c->base.count, 1);
+        if (c->base.count && !c->flags) return 1;
+        c->sig[PCACHE_LOAD] = sig[PCACHE_LOAD];
+        c->level = PCACHE_DEDUPE;
+    }
+
+    progress_stage(STAGE_DEDUPE, c->base.count);
+    if (from <= PCACHE_PLAN) {
+        if (tracklist_copy(&next, &c->base) != 0) return 1;
+        if (from <= PCACHE_DEDUPE) {
+            c->stats = c->base_stats;
+            pipeline_dedupe(&next, opts, &c->stats);
+            for (size_t i = 0; i < next.count; ++i) c->flags[i] = (unsigned char)((next.tracks[i].duplicate ? 1 : 0) | (next.tracks[i].unselected ? 2 : 0));
+            c->sig[PCACHE_DEDUPE] = sig[PCACHE_DEDUPE];
+            c->level = PCACHE_PLAN;
+        } else {
+            for (size_t i = 0; i < next.count; ++i) {
+                next.tracks[i].duplicate = c->flags[i] & 1;
+                next.tracks[i].unselected = (c->flags[i] & 2) != 0;
+            }
+        }
+
+        for (size_t i = 0; i < next.count; ++i) audio_plan_conversion(&next.tracks[i], opts, opts->target_kbps);
+        capacity_plan(&next, opts);
+        progress_stage(STAGE_PLAN, next.count);
+        pipeline_organize(&next, opts);
+
+        reused = cache_reuse_conversions(c, &next, opts);
+        if (reused) progress_log(LVL_INFO, "Cache: %zu conversoes reaproveitadas", reused);
+        rc = pipeline_convert(&next, opts);
+        cache_commit_work(c, &next, opts);
+        if (rc != 0) return rc;
+        c->sig[PCACHE_PLAN] = sig[PCACHE_PLAN];
+        c->sig[PCACHE_ORGANIZE] = sig[PCACHE_ORGANIZE];
+        c->level = PCACHE_STAGES;
+    } else if (from == PCACHE_ORGANIZE) {
+        progress_stage(STAGE_PLAN, c->work.count);
+        pipeline_organize(&c->work, opts);
+        c->sig[PCACHE_ORGANIZE] = sig[PCACHE_ORGANIZE];
+        c->level = PCACHE_STAGES;
+    }
+
+    *stats = c->stats;
+    return pipeline_report(&c->work, opts, stats);
+}
+
+int pipeline_run_cached(CliOptions *opts, PipelineCache *cache) {
+    LibraryStats stats;
+    int rc;
+
+    memset(&stats, 0, sizeof(stats));
+    rc = pipeline_cached_body(opts, cache, &stats);
+    log_flush_issues();
+    progress_done(rc);
+    log_flush();
+    return rc;
+}
+
+void pipeline_cache_invalidate(PipelineCache *cache) {
+    cache->level = 0;
+}
+
+void pipeline_cache_free(PipelineCache *cache) {
+    tracklist_free(&cache->base);
+    tracklist_free(&cache->work);
+    free(cache->flags);
+    free(cache->conv_key);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,933 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define PROBE_HEAD_BYTES 32768
+#define PROBE_TAIL_BYTES 16384
+#define PROBE_EXTRA_BYTES 65536
+#define PROBE_SYNC_WINDOW 8192
+#define PROBE_SYNC_CONFIRM 3
+#define PROBE_TAG_FRAME_MAX 1024
+#define PROBE_GENRES 80
+
+typedef struct {
+    unsigned char head[PROBE_HEAD_BYTES];
+    unsigned char tail[PROBE_TAIL_BYTES];
+    unsigned char extra[PROBE_EXTRA_BYTES];
+} ProbeBuffer;
+
+typedef struct {
+#ifdef _WIN32
+    FILE *f;
+#else
+    int fd;
+#endif
+    uint64_t size;
+    ProbeBuffer *buf;
+    size_t head_len;
+    uint64_t tail_off;
+    size_t tail_len;
+} ProbeFile;
+
+typedef struct {
+    int version;
+    int layer;
+    int kbps;
+    int rate;
+    int mode;
+    int padding;
+    int samples;
+    size_t length;
+} Mp3Frame;
+
+enum { TAG_NONE = 0, TAG_TITLE, TAG_ARTIST, TAG_ALBUM, TAG_GENRE, TAG_TRACK, TAG_YEAR };
+
+static const int k_mp3_kbps[2][3][15] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    },
+};
+
+static const int k_mp3_rates[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000},
+};
+
+static const unsigned char k_asf_guid[16] = {0x30, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11,
+                                             0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C};
+
+static const char *const k_genres[PROBE_GENRES] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal",
+    "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+    "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal",
+    "Jazz+Funk", "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel",
+    "Noise", "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock",
+    "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle",
+    "Native American", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+    "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+};
+
+static uint32_t rd_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint32_t rd_be24(const unsigned char *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+}
+
+static unsigned rd_be16(const unsigned char *p) {
+    return ((unsigned)p[0] << 8) | (unsigned)p[1];
+}
+
+static uint32_t rd_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+}
+
+static unsigned rd_le16(const unsigned char *p) {
+    return (unsigned)p[0] | ((unsigned)p[1] << 8);
+}
+
+static uint64_t rd_le64(const unsigned char *p) {
+    return ((uint64_t)rd_le32(p + 4) << 32) | (uint64_t)rd_le32(p);
+}
+
+static uint32_t rd_syncsafe(const unsigned char *p) {
+    return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) |
+           (uint32_t)(p[3] & 0x7F);
+}
+
+#ifdef _WIN32
+static ProbeBuffer *probe_buffer(void) {
+    static ProbeBuffer *buf;
+    if (!buf) buf = (ProbeBuffer *)malloc(sizeof(ProbeBuffer));
+    return buf;
+}
+#else
+static pthread_key_t g_probe_key;
+static pthread_once_t g_probe_once = PTHREAD_ONCE_INIT;
+
+static void probe_key_init(void) {
+    pthread_key_create(&g_probe_key, free);
+}
+
+static ProbeBuffer *probe_buffer(void) {
+    ProbeBuffer *buf;
+    pthread_once(&g_probe_once, probe_key_init);
+    buf = (ProbeBuffer *)pthread_getspecific(g_probe_key);
+    if (!buf) {
+        buf = (ProbeBuffer *)malloc(sizeof(ProbeBuffer));
+        if (buf && pthread_setspecific(g_probe_key, buf) != 0) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    return buf;
+}
+#endif
+
+static size_t file_read(ProbeFile *pf, uint64_t off, unsigned char *dst, size_t n) {
+#ifdef _WIN32
+    if (fseek(pf->f, (long)off, SEEK_SET) != 0) return 0;
+    return fread(dst, 1, n, pf->f);
+#else
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = pread(pf->fd, dst + got, n - got, (off_t)(off + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    return got;
+#endif
+}
+
+static int probe_open(ProbeFile *pf, const char *path, uint64_t size) {
+    memset(pf, 0, sizeof(*pf));
+    pf->buf = probe_buffer();
+#ifdef _WIN32
+    if (!pf->buf) return -1;
+    pf->f = fopen(path, "rb");
+    if (!pf->f) return -1;
+#else
+    pf->fd = -1;
+    if (!pf->buf) return -1;
+    pf->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pf->fd < 0) return -1;
+#endif
+    pf->size = size;
+    pf->head_len = file_read(pf, 0, pf->buf->head, size < PROBE_HEAD_BYTES ? (size_t)size : PROBE_HEAD_BYTES);
+    if (size > pf->head_len) {
+        pf->tail_off = size > PROBE_TAIL_BYTES ? size - PROBE_TAIL_BYTES : 0;
+        pf->tail_len = file_read(pf, pf->tail_off, pf->buf->tail, (size_t)(size - pf->tail_off));
+    }
+    return 0;
+}
+
+static void probe_close(ProbeFile *pf) {
+#ifdef _WIN32
+    if (pf->f) fclose(pf->f);
+#else
+    if (pf->fd >= 0) close(pf->fd);
+#endif
+}
+
+static const unsigned char *probe_at(ProbeFile *pf, uint64_t off, size_t len, size_t *got) {
+    *got = 0;
+    if (off >= pf->size) return NULL;
+    if (len > pf->size - off) len = (size_t)(pf->size - off);
+    if (off + len <= pf->head_len) {
+        *got = len;
+        return pf->buf->head + off;
+    }
+    if (pf->tail_len && off >= pf->tail_off && off + len <= pf->tail_off + pf->tail_len) {
+        *got = len;
+        return pf->buf->tail + (off - pf->tail_off);
+    }
+    if (len > PROBE_EXTRA_BYTES) len = PROBE_EXTRA_BYTES;
+    *got = file_read(pf, off, pf->buf->extra, len);
+    return *got ? pf->buf->extra : NULL;
+}
+
+static uint32_t id3v2_size(const unsigned char *p, size_t n, int *version) {
+    if (n < 10 || memcmp(p, "ID3", 3) != 0) return 0;
+    if ((p[6] | p[7] | p[8] | p[9]) & 0x80) return 0;
+    *version = p[3];
+    return rd_syncsafe(p + 6) + 10 + ((p[5] & 0x10) ? 10 : 0);
+}
+
+static int mp3_header(const unsigned char *p, Mp3Frame *fr) {
+    int ver_bits;
+    int layer_bits;
+    int br_idx;
+    int sr_idx;
+    int vi;
+
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return 0;
+    ver_bits = (p[1] >> 3) & 3;
+    layer_bits = (p[1] >> 1) & 3;
+    br_idx = (p[2] >> 4) & 15;
+    sr_idx = (p[2] >> 2) & 3;
+    if (ver_bits == 1 || layer_bits == 0 || br_idx == 0 || br_idx == 15 || sr_idx == 3) return 0;
+
+    fr->version = ver_bits == 3 ? 10 : (ver_bits == 2 ? 20 : 25);
+    fr->layer = 4 - layer_bits;
+    vi = fr->version == 10 ? 0 : 1;
+    fr->kbps = k_mp3_kbps[vi][fr->layer - 1][br_idx];
+    fr->rate = k_mp3_rates[fr->version == 10 ? 0 : (fr->version == 20 ? 1 : 2)][sr_idx];
+    fr->padding = (p[2] >> 1) & 1;
+    fr->mode = (p[3] >> 6) & 3;
+    if (fr->layer == 1) {
+        fr->samples = 384;
+        fr->length = (size_t)((12 * fr->kbps * 1000 / fr->rate + fr->padding) * 4);
+    } else {
+        fr->samples = (fr->layer == 3 && fr->version != 10) ? 576 : 1152;
+        fr->length = (size_t)(fr->samples / 8 * fr->kbps * 1000 / fr->rate + fr->padding);
+    }
+    return fr->length >= 4;
+}
+
+static size_t mp3_find_frame(const unsigned char *buf, size_t n, Mp3Frame *fr) {
+    for (size_t i = 0; i + 4 <= n; ++i) {
+        size_t pos = i;
+        int seen = 0;
+        Mp3Frame first;
+        Mp3Frame next;
+        if (!mp3_header(buf + i, &first)) continue;
+        next = first;
+        while (seen < PROBE_SYNC_CONFIRM && pos + 4 <= n && mp3_header(buf + pos, &next) &&
+               next.version == first.version && next.layer == first.layer && next.rate == first.rate) {
+            seen++;
+            pos += next.length;
+        }
+        if (seen >= PROBE_SYNC_CONFIRM || (seen >= 1 && pos + 4 > n)) {
+            *fr = first;
+            return i;
+        }
+    }
+    return (size_t)-1;
+}
+
+static void put_utf8(char *dst, size_t dst_sz, size_t *len, unsigned cp) {
+    unsigned char tmp[4];
+    size_t n;
+    if (cp < 0x80) {
+        tmp[0] = (unsigned char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        tmp[0] = (unsigned char)(0xC0 | (cp >> 6));
+        tmp[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        tmp[0] = (unsigned char)(0xE0 | (cp >> 12));
+        tmp[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        tmp[2] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        tmp[0] = (unsigned char)(0xF0 | (cp >> 18));
+        tmp[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+        tmp[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        tmp[3] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    if (*len + n >= dst_sz) return;
+    memcpy(dst + *len, tmp, n);
+    *len += n;
+    dst[*len] = '\0';
+}
+
+static void text_utf8(char *dst, size_t dst_sz, const unsigned char *p, size_t n, int enc) {
+    size_t len = 0;
+    int be = enc == 2;
+
+    dst[0] = '\0';
+    if (enc == 1 && n >= 2) {
+        if (p[0] == 0xFF && p[1] == 0xFE) be = 0;
+        else if (p[0] == 0xFE && p[1] == 0xFF) be = 1;
+        if ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF)) {
+            p += 2;
+            n -= 2;
+        }
+    }
+    if (enc == 1 || enc == 2) {
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            unsigned cp = be ? rd_be16(p + i) : rd_le16(p + i);
+            if (cp == 0) break;
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 3 < n) {
+                unsigned lo = be ? rd_be16(p + i + 2) : rd_le16(p + i + 2);
+                if (lo >= 0xDC00 && lo < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    i += 2;
+                }
+            }
+            put_utf8(dst, dst_sz, &len, cp);
+        }
+    } else {
+        for (size_t i = 0; i < n && p[i]; ++i) {
+            if (enc == 3 && len + 1 < dst_sz) {
+                dst[len++] = (char)p[i];
+                dst[len] = '\0';
+            } else if (enc != 3) {
+                put_utf8(dst, dst_sz, &len, p[i]);
+            }
+        }
+    }
+    while (len > 0 && (dst[len - 1] == ' ' || dst[len - 1] == '\t')) dst[--len] = '\0';
+}
+
+static void set_text(char *dst, size_t dst_sz, const char *val) {
+    size_t n;
+    if (dst[0] || !val[0]) return;
+    n = strlen(val);
+    if (n >= dst_sz) n = dst_sz - 1;
+    memcpy(dst, val, n);
+    dst[n] = '\0';
+}
+
+static void set_genre(AudioTrack *t, const char *val) {
+    const char *p = val;
+    char *end;
+    long idx;
+    if (t->genre[0]) return;
+    if (*p == '(') ++p;
+    idx = strtol(p, &end, 10);
+    if (end != p && (*end == '\0' || *end == ')')) {
+        if (*end == ')' && end[1]) {
+            set_text(t->genre, sizeof(t->genre), end + 1);
+        } else if (idx >= 0 && idx < PROBE_GENRES) {
+            set_text(t->genre, sizeof(t->genre), k_genres[idx]);
+        }
+        return;
+    }
+    set_text(t->genre, sizeof(t->genre), val);
+}
+
+static void apply_tag(AudioTrack *t, int field, const char *val) {
+    switch (field) {
+        case TAG_TITLE: set_text(t->title, sizeof(t->title), val); break;
+        case TAG_ARTIST: set_text(t->artist, sizeof(t->artist), val); break;
+        case TAG_ALBUM: set_text(t->album, sizeof(t->album), val); break;
+        case TAG_GENRE: set_genre(t, val); break;
+        case TAG_TRACK:
+            if (t->track_no == 0) t->track_no = atoi(val);
+            break;
+        case TAG_YEAR:
+            if (t->year == 0) t->year = atoi(val);
+            break;
+        default: break;
+    }
+}
+
+static int popm_stars(unsigned char r) {
+    if (r == 0) return 0;
+    if (r < 32) return 1;
+    if (r < 96) return 2;
+    if (r < 160) return 3;
+    if (r < 224) return 4;
+    return 5;
+}
+
+static int id3_field(const char *id) {
+    static const struct {
+        const char *id;
+        int field;
+    } map[] = {
+        {"TIT2", TAG_TITLE}, {"TT2", TAG_TITLE},  {"TPE1", TAG_ARTIST}, {"TP1", TAG_ARTIST},
+        {"TALB", TAG_ALBUM}, {"TAL", TAG_ALBUM},  {"TCON", TAG_GENRE},  {"TCO", TAG_GENRE},
+        {"TRCK", TAG_TRACK}, {"TRK", TAG_TRACK},  {"TYER", TAG_YEAR},   {"TYE", TAG_YEAR},
+        {"TDRC", TAG_YEAR},
+    };
+    for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); ++i) {
+        if (strcmp(map[i].id, id) == 0) return map[i].field;
+    }
+    return TAG_NONE;
+}
+
+static void read_id3v2(ProbeFile *pf, AudioTrack *t) {
+    unsigned char hdr[10];
+    const unsigned char *p;
+    size_t got;
+    uint64_t off = 10;
+    uint64_t end;
+    size_t hlen;
+    int ver;
+
+    p = probe_at(pf, 0, 10, &got);
+    if (!p || got < 10 || memcmp(p, "ID3", 3) != 0) return;
+    memcpy(hdr, p, 10);
+    ver = hdr[3];
+    if (ver < 2 || ver > 4) return;
+    end = 10 + (uint64_t)rd_syncsafe(hdr + 6);
+    hlen = ver == 2 ? 6 : 10;
+    if ((hdr[5] & 0x40) && ver >= 3) {
+        p = probe_at(pf, off, 4, &got);
+        if (!p || got < 4) return;
+        off += ver == 4 ? rd_syncsafe(p) : 4 + rd_be32(p);
+    }
+
+    while (off + hlen <= end) {
+        unsigned char fh[10];
+        char id[5];
+        uint64_t fsize;
+        unsigned flags = 0;
+        int field;
+
+        p = probe_at(pf, off, hlen, &got);
+        if (!p || got < hlen || p[0] == 0) break;
+        memcpy(fh, p, hlen);
+        if (ver == 2) {
+            memcpy(id, fh, 3);
+            id[3] = '\0';
+            fsize = rd_be24(fh + 3);
+        } else {
+            memcpy(id, fh, 4);
+            id[4] = '\0';
+            fsize = ver == 4 ? rd_syncsafe(fh + 4) : rd_be32(fh + 4);
+            flags = rd_be16(fh + 8);
+        }
+        if (fsize == 0 || off + hlen + fsize > end) break;
+
+        field = id3_field(id);
+        if ((field != TAG_NONE || strcmp(id, "POPM") == 0 || strcmp(id, "POP") == 0) &&
+            !(ver == 3 && (flags & 0x00C0)) && !(ver == 4 && (flags & 0x000E))) {
+            uint64_t body = off + hlen;
+            size_t want;
+            if (ver == 4 && (flags & 0x0001)) body += 4;
+            want = off + hlen + fsize - body > PROBE_TAG_FRAME_MAX ? PROBE_TAG_FRAME_MAX : (size_t)(off + hlen + fsize - body);
+            p = probe_at(pf, body, want, &got);
+            if (p && got > 1 && field != TAG_NONE) {
+                char val[256];
+                text_utf8(val, sizeof(val), p + 1, got - 1, p[0]);
+                apply_tag(t, field, val);
+            } else if (p && got > 1 && t->rating == 0) {
+                size_t i = 0;
+                while (i < got && p[i]) ++i;
+                if (i + 1 < got) t->rating = popm_stars(p[i + 1]);
+            }
+        }
+        off += hlen + fsize;
+    }
+}
+
+static void read_id3v1(ProbeFile *pf, AudioTrack *t) {
+    unsigned char tag[128];
+    const unsigned char *p;
+    size_t got;
+    char val[64];
+
+    if (pf->size < 128) return;
+    p = probe_at(pf, pf->size - 128, 128, &got);
+    if (!p || got < 128 || memcmp(p, "TAG", 3) != 0) return;
+    memcpy(tag, p, 128);
+    text_utf8(val, sizeof(val), tag + 3, 30, 0);
+    apply_tag(t, TAG_TITLE, val);
+    text_utf8(val, sizeof(val), tag + 33, 30, 0);
+    apply_tag(t, TAG_ARTIST, val);
+    text_utf8(val, sizeof(val), tag + 63, 30, 0);
+    apply_tag(t, TAG_ALBUM, val);
+    text_utf8(val, sizeof(val), tag + 93, 4, 0);
+    apply_tag(t, TAG_YEAR, val);
+    if (tag[125] == 0 && tag[126] != 0 && t->track_no == 0) t->track_no = tag[126];
+    if (tag[127] < PROBE_GENRES && !t->genre[0]) set_text(t->genre, sizeof(t->genre), k_genres[tag[127]]);
+}
+
+static void read_vorbis_comments(AudioTrack *t, const unsigned char *p, size_t n) {
+    static const struct {
+        const char *key;
+        int field;
+    } map[] = {
+        {"TITLE", TAG_TITLE}, {"ARTIST", TAG_ARTIST}, {"ALBUM", TAG_ALBUM},
+        {"GENRE", TAG_GENRE}, {"DATE", TAG_YEAR},     {"TRACKNUMBER", TAG_TRACK},
+    };
+    size_t off;
+    uint32_t count;
+
+    if (n < 8 || rd_le32(p) > n - 8) return;
+    off = 4 + rd_le32(p);
+    count = rd_le32(p + off);
+    off += 4;
+    for (uint32_t i = 0; i < count && off + 4 <= n; ++i) {
+        uint32_t len = rd_le32(p + off);
+        const char *kv = (const char *)p + off + 4;
+        const char *eq;
+        off += 4;
+        if (len > n - off) break;
+        eq = (const char *)memchr(kv, '=', len);
+        off += len;
+        if (!eq) continue;
+        for (size_t k = 0; k < sizeof(map) / sizeof(map[0]); ++k) {
+            char val[256];
+            size_t vlen = len - (size_t)(eq + 1 - kv);
+            if (strlen(map[k].key) != (size_t)(eq - kv) || strncasecmp(kv, map[k].key, (size_t)(eq - kv)) != 0) continue;
+            if (vlen >= sizeof(val)) vlen = sizeof(val) - 1;
+            memcpy(val, eq + 1, vlen);
+            val[vlen] = '\0';
+            apply_tag(t, map[k].field, val);
+        }
+    }
+}
+
+static AudioFormat sniff_format(ProbeFile *pf, uint64_t *start, int *tag_version) {
+    const unsigned char *p;
+    size_t got;
+    Mp3Frame fr;
+
+    *start = 0;
+    p = probe_at(pf, 0, 10, &got);
+    if (p) *start = id3v2_size(p, got, tag_version);
+    p = probe_at(pf, *start, 16, &got);
+    if (!p || got < 4) return FORMAT_UNKNOWN;
+    if (memcmp(p, "fLaC", 4) == 0) return FORMAT_FLAC;
+    if (memcmp(p, "OggS", 4) == 0) return FORMAT_OGG;
+    if (got >= 12 && memcmp(p, "RIFF", 4) == 0 && memcmp(p + 8, "WAVE", 4) == 0) return FORMAT_WAV;
+    if (got >= 8 && memcmp(p + 4, "ftyp", 4) == 0) return FORMAT_M4A;
+    if (got >= 16 && memcmp(p, k_asf_guid, 16) == 0) return FORMAT_WMA;
+    if (p[0] == 0xFF && (p[1] & 0xF6) == 0xF0) return FORMAT_AAC;
+    if (mp3_header(p, &fr)) return FORMAT_MP3;
+    return FORMAT_UNKNOWN;
+}
+
+static int probe_mp3(ProbeFile *pf, uint64_t start, StreamInfo *si) {
+    const unsigned char *buf;
+    uint64_t audio_bytes;
+    size_t n;
+    size_t at;
+    size_t side;
+    uint32_t frames = 0;
+    Mp3Frame fr;
+
+    si->tag_bytes = (uint32_t)start;
+    buf = probe_at(pf, start, PROBE_SYNC_WINDOW, &n);
+    if (!buf) return -1;
+    at = mp3_find_frame(buf, n, &fr);
+    if (at == (size_t)-1) return -1;
+
+    si->mpeg_version = fr.version;
+    si->layer = fr.layer;
+    si->sample_rate = fr.rate;
+    si->channel_mode = fr.mode;
+    si->channels = fr.mode == 3 ? 1 : 2;
+    si->bitrate_kbps = fr.kbps;
+    audio_bytes = pf->size - start - at;
+
+    if (fr.version == 10) side = fr.mode == 3 ? 17 : 32;
+    else side = fr.mode == 3 ? 9 : 17;
+    if (at + 4 + side + 12 <= n &&
+        (memcmp(buf + at + 4 + side, "Xing", 4) == 0 || memcmp(buf + at + 4 + side, "Info", 4) == 0)) {
+        const unsigned char *x = buf + at + 4 + side;
+        si->vbr = memcmp(x, "Xing", 4) == 0;
+        if (rd_be32(x + 4) & 1) frames = rd_be32(x + 8);
+        if ((rd_be32(x + 4) & 2) && at + 4 + side + 16 <= n) {
+            uint32_t bytes = rd_be32(x + (rd_be32(x + 4) & 1 ? 12 : 8));
+            if (bytes > 0 && bytes <= audio_bytes) audio_bytes = bytes;
+        }
+    } else if (at + 4 + 32 + 18 <= n && memcmp(buf + at + 4 + 32, "VBRI", 4) == 0) {
+        const unsigned char *v = buf + at + 4 + 32;
+        si->vbr = 1;
+        if (rd_be32(v + 10) > 0 && rd_be32(v + 10) <= audio_bytes) audio_bytes = rd_be32(v + 10);
+        frames = rd_be32(v + 14);
+    }
+
+    if (frames > 0) {
+        double secs = (double)frames * fr.samples / fr.rate;
+        si->duration_seconds = (int)(secs + 0.5);
+        if (secs > 0.0) si->bitrate_kbps = (int)((double)audio_bytes * 8.0 / secs / 1000.0 + 0.5);
+    } else if (fr.kbps > 0) {
+        si->duration_seconds = (int)(audio_bytes * 8 / ((uint64_t)fr.kbps * 1000));
+    }
+    return 0;
+}
+
+static int probe_wav(ProbeFile *pf, uint64_t start, StreamInfo *si) {
+    const unsigned char *p;
+    size_t got;
+    uint64_t off = start + 12;
+    unsigned byte_rate = 0;
+
+    while (off + 8 <= pf->size) {
+        unsigned char hdr[8];
+        uint32_t len;
+        p = probe_at(pf, off, 8, &got);
+        if (!p || got < 8) break;
+        memcpy(hdr, p, 8);
+        len = rd_le32(hdr + 4);
+        if (memcmp(hdr, "fmt ", 4) == 0 && len >= 16) {
+            p = probe_at(pf, off + 8, 16, &got);
+            if (!p || got < 16) break;
+            si->channels = (int)rd_le16(p + 2);
+            si->sample_rate = (int)rd_le32(p + 4);
+            byte_rate = rd_le32(p + 8);
+            si->bits_per_sample = (int)rd_le16(p + 14);
+            si->bitrate_kbps = (int)(byte_rate * 8u / 1000u);
+        } else if (memcmp(hdr, "data", 4) == 0) {
+            uint64_t data = len;
+            if (data == 0 || data == 0xFFFFFFFFu || data > pf->size - off - 8) data = pf->size - off - 8;
+            if (byte_rate > 0) si->duration_seconds = (int)(data / byte_rate);
+            break;
+        }
+        off += 8 + (uint64_t)len + (len & 1);
+    }
+    return si->sample_rate > 0 ? 0 : -1;
+}
+
+static int probe_flac(ProbeFile *pf, uint64_t start, StreamInfo *si, AudioTrack *t) {
+    const unsigned char *p;
+    size_t got;
+    uint64_t samples;
+    uint64_t off = start + 4;
+    int last = 0;
+
+    p = probe_at(pf, start, 42, &got);
+    if (!p || got < 42 || (p[4] & 0x7F) != 0) return -1;
+    si->sample_rate = (int)(((uint32_t)p[18] << 12) | ((uint32_t)p[19] << 4) | ((uint32_t)p[20] >> 4));
+    si->channels = ((p[20] >> 1) & 7) + 1;
+    si->bits_per_sample = (((p[20] & 1) << 4) | (p[21] >> 4)) + 1;
+    samples = ((uint64_t)(p[21] & 0x0F) << 32) | rd_be32(p + 22);
+    if (si->sample_rate <= 0) return -1;
+    if (samples > 0) {
+        si->duration_seconds = (int)(samples / (uint64_t)si->sample_rate);
+        if (si->duration_seconds > 0) si->bitrate_kbps = (int)(pf->size * 8 / (uint64_t)si->duration_seconds / 1000);
+    }
+
+    while (!last && off + 4 <= pf->size) {
+        unsigned char hdr[4];
+        uint32_t len;
+        p = probe_at(pf, off, 4, &got);
+        if (!p || got < 4) break;
+        memcpy(hdr, p, 4);
+        last = hdr[0] & 0x80;
+        len = rd_be24(hdr + 1);
+        if ((hdr[0] & 0x7F) == 4) {
+            p = probe_at(pf, off + 4, len, &got);
+            if (p) read_vorbis_comments(t, p, got);
+            break;
+        }
+        off += 4 + (uint64_t)len;
+    }
+    return 0;
+}
+
+static const unsigned char *find_bytes(const unsigned char *hay, size_t n, const char *needle, size_t len) {
+    for (size_t i = 0; i + len <= n; ++i) {
+        if (hay[i] == (unsigned char)needle[0] && memcmp(hay + i, needle, len) == 0) return hay + i;
+    }
+    return NULL;
+}
+
+static int probe_ogg(ProbeFile *pf, uint64_t start, StreamInfo *si, AudioTrack *t) {
+    const unsigned char *p;
+    const unsigned char *tags;
+    size_t got;
+    size_t seg_count;
+    size_t magic = 7;
+    uint64_t granule_rate;
+
+    p = probe_at(pf, start, 64, &got);
+    if (!p || got < 28) return -1;
+    seg_count = p[26];
+    if (27 + seg_count + 19 > got) return -1;
+    p += 27 + seg_count;
+    if (memcmp(p, "\x01vorbis", 7) == 0 && 27 + seg_count + 28 <= got) {
+        si->channels = p[11];
+        si->sample_rate = (int)rd_le32(p + 12);
+        si->bitrate_kbps = (int)(rd_le32(p + 20) / 1000u);
+        granule_rate = (uint64_t)si->sample_rate;
+    } else if (memcmp(p, "OpusHead", 8) == 0) {
+        si->channels = p[9];
+        si->sample_rate = (int)rd_le32(p + 12);
+        granule_rate = 48000;
+        magic = 8;
+    } else {
+        return -1;
+    }
+
+    tags = find_bytes(pf->buf->head, pf->head_len, magic == 7 ? "\x03vorbis" : "OpusTags", magic);
+    if (tags) read_vorbis_comments(t, tags + magic, pf->head_len - (size_t)(tags + magic - pf->buf->head));
+
+    p = probe_at(pf, pf->size > PROBE_TAIL_BYTES ? pf->size - PROBE_TAIL_BYTES : 0,
+                 pf->size > PROBE_TAIL_BYTES ? PROBE_TAIL_BYTES : (size_t)pf->size, &got);
+    for (size_t i = got >= 14 ? got - 14 + 1 : 0; p && i-- > 0;) {
+        uint64_t granule;
+        if (memcmp(p + i, "OggS", 4) != 0) continue;
+        granule = rd_le64(p + i + 6);
+        if (granule_rate > 0 && granule != (uint64_t)-1) si->duration_seconds = (int)(granule / granule_rate);
+        break;
+    }
+    if (si->duration_seconds > 0 && si->bitrate_kbps <= 0) {
+        si->bitrate_kbps = (int)(pf->size * 8 / (uint64_t)si->duration_seconds / 1000);
+    }
+    return si->sample_rate > 0 ? 0 : -1;
+}
+
+static int probe_adts(ProbeFile *pf, uint64_t start, StreamInfo *si) {
+    static const int rates[13] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+    const unsigned char *buf;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    size_t n;
+    size_t pos = 0;
+    int idx;
+
+    buf = probe_at(pf, start, PROBE_SYNC_WINDOW, &n);
+    if (!buf || n < 7 || buf[0] != 0xFF || (buf[1] & 0xF6) != 0xF0) return -1;
+    idx = (buf[2] >> 2) & 15;
+    if (idx >= 13) return -1;
+    si->sample_rate = rates[idx];
+    si->channels = ((buf[2] & 1) << 2) | (buf[3] >> 6);
+    while (pos + 7 <= n && buf[pos] == 0xFF && (buf[pos + 1] & 0xF6) == 0xF0) {
+        size_t len = ((size_t)(buf[pos + 3] & 3) << 11) | ((size_t)buf[pos + 4] << 3) | (buf[pos + 5] >> 5);
+        if (len < 7) break;
+        frames++;
+        bytes += len;
+        pos += len;
+    }
+    if (frames > 0) {
+        double kbps = (double)bytes * 8.0 * si->sample_rate / (1024.0 * (double)frames) / 1000.0;
+        si->bitrate_kbps = (int)(kbps + 0.5);
+        if (si->bitrate_kbps > 0) {
+            si->duration_seconds = (int)((pf->size - start) * 8 / ((uint64_t)si->bitrate_kbps * 1000));
+        }
+    }
+    return 0;
+}
+
+static int atom_next(ProbeFile *pf, uint64_t off, uint64_t end, char type[5], uint64_t *body, uint64_t *next) {
+    unsigned char h[16];
+    const unsigned char *p;
+    size_t got;
+    uint64_t sz;
+    size_t hl = 8;
+
+    if (off + 8 > end) return 0;
+    p = probe_at(pf, off, 16, &got);
+    if (!p || got < 8) return 0;
+    memcpy(h, p, got < 16 ? got : 16);
+    sz = rd_be32(h);
+    if (sz == 1) {
+        if (got < 16) return 0;
+        sz = ((uint64_t)rd_be32(h + 8) << 32) | rd_be32(h + 12);
+        hl = 16;
+    } else if (sz == 0) {
+        sz = end - off;
+    }
+    if (sz < hl || sz > end - off) return 0;
+    memcpy(type, h + 4, 4);
+    type[4] = '\0';
+    *body = off + hl;
+    *next = off + sz;
+    return 1;
+}
+
+static int atom_find(ProbeFile *pf, uint64_t off, uint64_t end, const char *type, uint64_t *body, uint64_t *body_end) {
+    char cur[5];
+    uint64_t next;
+    while (atom_next(pf, off, end, cur, body, &next)) {
+        if (memcmp(cur, type, 4) == 0) {
+            *body_end = next;
+            return 1;
+        }
+        off = next;
+    }
+    return 0;
+}
+
+static void read_ilst(ProbeFile *pf, uint64_t off, uint64_t end, AudioTrack *t) {
+    static const struct {
+        const char *type;
+        int field;
+    } map[] = {
+        {"\xa9nam", TAG_TITLE}, {"\xa9" "ART", TAG_ARTIST}, {"\xa9" "alb", TAG_ALBUM},
+        {"\xa9gen", TAG_GENRE}, {"\xa9" "day", TAG_YEAR},
+    };
+    char type[5];
+    uint64_t body;
+    uint64_t next;
+
+    while (atom_next(pf, off, end, type, &body, &next)) {
+        uint64_t data;
+        uint64_t data_end;
+        const unsigned char *p;
+        size_t got;
+        off = next;
+        if (!atom_find(pf, body, next, "data", &data, &data_end) || data_end - data < 8) continue;
+        p = probe_at(pf, data + 8, (size_t)(data_end - data - 8 > 255 ? 255 : data_end - data - 8), &got);
+        if (!p) continue;
+        if (strcmp(type, "trkn") == 0 && got >= 4) {
+            if (t->track_no == 0) t->track_no = (int)rd_be16(p + 2);
+        } else if (strcmp(type, "gnre") == 0 && got >= 2) {
+            unsigned g = rd_be16(p);
+            if (g > 0 && g <= PROBE_GENRES) set_text(t->genre, sizeof(t->genre), k_genres[g - 1]);
+        } else {
+            for (size_t k = 0; k < sizeof(map) / sizeof(map[0]); ++k) {
+                char val[256];
+                if (memcmp(type, map[k].type, 4) != 0) continue;
+                memcpy(val, p, got);
+                val[got] = '\0';
+                apply_tag(t, map[k].field, val);
+            }
+        }
+    }
+}
+
+static int probe_m4a(ProbeFile *pf, StreamInfo *si, AudioTrack *t) {
+    uint64_t moov, moov_end;
+    uint64_t body, body_end;
+    const unsigned char *p;
+    size_t got;
+
+    if (!atom_find(pf, 0, pf->size, "moov", &moov, &moov_end)) return -1;
+    if (atom_find(pf, moov, moov_end, "mvhd", &body, &body_end)) {
+        p = probe_at(pf, body, 32, &got);
+        if (p && got >= 32) {
+            uint64_t scale = p[0] == 1 ? rd_be32(p + 20) : rd_be32(p + 12);
+            uint64_t dur = p[0] == 1 ? (((uint64_t)rd_be32(p + 24) << 32) | rd_be32(p + 28)) : rd_be32(p + 16);
+            if (scale > 0) si->duration_seconds = (int)(dur / scale);
+        }
+    }
+    if (atom_find(pf, moov, moov_end, "trak", &body, &body_end) &&
+        atom_find(pf, body, body_end, "mdia", &body, &body_end) &&
+        atom_find(pf, body, body_end, "minf", &body, &body_end) &&
+        atom_find(pf, body, body_end, "stbl", &body, &body_end) &&
+        atom_find(pf, body, body_end, "stsd", &body, &body_end)) {
+        p = probe_at(pf, body, 44, &got);
+        if (p && got >= 44) {
+            si->channels = (int)rd_be16(p + 32);
+            si->sample_rate = (int)rd_be16(p + 40);
+        }
+    }
+    if (si->duration_seconds > 0) si->bitrate_kbps = (int)(pf->size * 8 / (uint64_t)si->duration_seconds / 1000);
+    if (atom_find(pf, moov, moov_end, "udta", &body, &body_end) &&
+        atom_find(pf, body, body_end, "meta", &body, &body_end) &&
+        atom_find(pf, body + 4, body_end, "ilst", &body, &body_end)) {
+        read_ilst(pf, body, body_end, t);
+    }
+    return si->sample_rate > 0 || si->duration_seconds > 0 ? 0 : -1;
+}
+
+static const unsigned char *probe_hash_read(void *ctx, uint64_t off, size_t len) {
+    size_t got;
+    const unsigned char *p = probe_at((ProbeFile *)ctx, off, len, &got);
+    return got == len ? p : NULL;
+}
+
+int audio_probe_file(const char *path, uint64_t size, AudioTrack *t) {
+    ProbeFile pf;
+    StreamInfo *si = &t->stream;
+    uint64_t start = 0;
+    AudioFormat sniffed;
+    int rc = -1;
+
+    memset(si, 0, sizeof(*si));
+    if (probe_open(&pf, path, size) != 0) {
+        probe_close(&pf);
+        return -1;
+    }
+
+    t->quick_hash = fs_hash_sampled(size, probe_hash_read, &pf);
+
+    sniffed = sniff_format(&pf, &start, &si->tag_version);
+    if (sniffed != FORMAT_UNKNOWN) t->format = sniffed;
+
+    read_id3v2(&pf, t);
+    switch (t->format) {
+        case FORMAT_MP3: rc = probe_mp3(&pf, start, si); break;
+        case FORMAT_WAV: rc = probe_wav(&pf, start, si); break;
+        case FORMAT_FLAC: rc = probe_flac(&pf, start, si, t); break;
+        case FORMAT_OGG: rc = probe_ogg(&pf, start, si, t); break;
+        case FORMAT_AAC: rc = probe_adts(&pf, start, si); break;
+        case FORMAT_M4A: rc = probe_m4a(&pf, si, t); break;
+        default: break;
+    }
+    if (t->format == FORMAT_MP3 || t->format == FORMAT_AAC) read_id3v1(&pf, t);
+    probe_close(&pf);
+
+    si->valid = rc == 0;
+    if (si->valid) t->duration_seconds = si->duration_seconds;
+    t->has_tags = t->artist[0] && t->title[0];
+    return 0;
+}
+
+void audio_describe_stream(const AudioTrack *t, char *out, size_t out_sz) {
+    const StreamInfo *si = &t->stream;
+    static const char *modes[4] = {"estereo", "joint", "dual", "mono"};
+    char rate[16];
+    int n;
+
+    if (!si->valid) {
+        snprintf(out, out_sz, "%s", audio_format_name(t->format));
+        return;
+    }
+    if (si->sample_rate % 1000) snprintf(rate, sizeof(rate), "%gkHz", si->sample_rate / 1000.0);
+    else snprintf(rate, sizeof(rate), "%dkHz", si->sample_rate / 1000);
+    if (t->format == FORMAT_MP3) {
+        n = snprintf(out, out_sz, "MPEG%s L%d %dk %s %s %s", si->mpeg_version == 10 ? "1" : (si->mpeg_version == 20 ? "2" : "2.5"),
+                     si->layer, si->bitrate_kbps, si->vbr ? "VBR" : "CBR", rate, modes[si->channel_mode & 3]);
+        if (n > 0 && (size_t)n < out_sz && si->tag_version > 0) {
+            snprintf(out + n, out_sz - (size_t)n, " ID3v2.%d", si->tag_version);
+        }
+    } else if (si->bits_per_sample > 0) {
+        snprintf(out, out_sz, "%s %s %dbit %dch", audio_format_name(t->format), rate, si->bits_per_sample, si->channels);
+    } else {
+        snprintf(out, out_sz, "%s ~%dk %s %dch", audio_format_name(t->format), si->bitrate_kbps, rate, si->channels);
+    }
+}
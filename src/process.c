@@ -0,0 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int set_flags(int fd, int nonblock) {
+    int fl = fcntl(fd, F_GETFD);
+    if (fl < 0 || fcntl(fd, F_SETFD, fl | FD_CLOEXEC) < 0) return -1;
+    if (!nonblock) return 0;
+    fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+    return 0;
+}
+
+int proc_spawn(Proc *p, const char *const argv[]) {
+    posix_spawn_file_actions_t fa;
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    pid_t pid;
+    int rc;
+
+    memset(p, 0, sizeof(*p));
+    p->out_fd = -1;
+    p->err_fd = -1;
+    if (pipe(out_pipe) != 0) return -1;
+    if (pipe(err_pipe) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return -1;
+    }
+    set_flags(out_pipe[0], 1);
+    set_flags(out_pipe[1], 0);
+    set_flags(err_pipe[0], 1);
+    set_flags(err_pipe[1], 0);
+
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&fa, out_pipe[1], 1);
+    posix_spawn_file_actions_adddup2(&fa, err_pipe[1], 2);
+    rc = posix_spawnp(&pid, argv[0], &fa, NULL, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    if (rc != 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return -1;
+    }
+    p->pid = (long)pid;
+    p->out_fd = out_pipe[0];
+    p->err_fd = err_pipe[0];
+    p->running = 1;
+    p->started = now_seconds();
+    return 0;
+}
+
+static void proc_flush_line(Proc *p, int stream, ProcLineFn fn, void *ctx) {
+    ProcLineBuf *lb = &p->lines[stream];
+    if (lb->len == 0) return;
+    lb->buf[lb->len] = '\0';
+    lb->len = 0;
+    if (fn) fn(p, stream, lb->buf, ctx);
+}
+
+static void proc_feed(Proc *p, int stream, const char *data, size_t n, ProcLineFn fn, void *ctx) {
+    ProcLineBuf *lb = &p->lines[stream];
+    for (size_t i = 0; i < n; ++i) {
+        if (data[i] == '\n' || data[i] == '\r') {
+            proc_flush_line(p, stream, fn, ctx);
+            continue;
+        }
+        if (lb->len + 1 < sizeof(lb->buf)) lb->buf[lb->len++] = data[i];
+    }
+}
+
+static void proc_reap(Proc *p) {
+    int status = 0;
+    if (!p->running) return;
+    while (waitpid((pid_t)p->pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    p->running = 0;
+    if (p->killed) p->exit_code = -1;
+    else if (WIFEXITED(status)) p->exit_code = WEXITSTATUS(status);
+    else p->exit_code = -1;
+}
+
+void proc_kill(Proc *p) {
+    double deadline;
+    int status;
+    if (!p->running) return;
+    p->killed = 1;
+    kill((pid_t)p->pid, SIGTERM);
+    deadline = now_seconds() + 2.0;
+    while (now_seconds() < deadline) {
+        if (waitpid((pid_t)p->pid, &status, WNOHANG) == (pid_t)p->pid) {
+            p->running = 0;
+            p->exit_code = -1;
+            break;
+        }
+        poll(NULL, 0, 20);
+    }
+    if (p->running) {
+        kill((pid_t)p->pid, SIGKILL);
+        proc_reap(p);
+    }
+    if (p->out_fd >= 0) close(p->out_fd);
+    if (p->err_fd >= 0) close(p->err_fd);
+    p->out_fd = -1;
+    p->err_fd = -1;
+}
+
+static int proc_open(const Proc *p) {
+    return p->out_fd >= 0 || p->err_fd >= 0;
+}
+
+size_t proc_pump(Proc *const *procs, size_t n, int timeout_ms, ProcLineFn fn, void *ctx) {
+    struct pollfd pfds[2 * PROC_MAX_PUMP];
+    Proc *owner[2 * PROC_MAX_PUMP];
+    int stream[2 * PROC_MAX_PUMP];
+    nfds_t count = 0;
+    size_t running = 0;
+    int rc;
+
+    for (size_t i = 0; i < n && i < PROC_MAX_PUMP; ++i) {
+        Proc *p = procs[i];
+        if (!p) continue;
+        if (p->out_fd >= 0) {
+            pfds[count].fd = p->out_fd;
+            pfds[count].events = POLLIN;
+            owner[count] = p;
+            stream[count++] = PROC_STDOUT;
+        }
+        if (p->err_fd >= 0) {
+            pfds[count].fd = p->err_fd;
+            pfds[count].events = POLLIN;
+            owner[count] = p;
+            stream[count++] = PROC_STDERR;
+        }
+    }
+    if (count == 0) return 0;
+
+    rc = poll(pfds, count, timeout_ms);
+    for (nfds_t k = 0; rc > 0 && k < count; ++k) {
+        Proc *p = owner[k];
+        char buf[4096];
+        ssize_t got;
+        if (!(pfds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        while ((got = read(pfds[k].fd, buf, sizeof(buf))) > 0) {
+            proc_feed(p, stream[k], buf, (size_t)got, fn, ctx);
+        }
+        if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            proc_flush_line(p, stream[k], fn, ctx);
+            close(pfds[k].fd);
+            if (stream[k] == PROC_STDOUT) p->out_fd = -1; else p->err_fd = -1;
+        }
+    }
+
+    for (size_t i = 0; i < n && i < PROC_MAX_PUMP; ++i) {
+        Proc *p = procs[i];
+        if (!p) continue;
+        if (!proc_open(p)) proc_reap(p);
+        if (proc_open(p) || p->running) running++;
+    }
+    return running;
+}
+
+int proc_run(const char *const argv[], int timeout_sec, ProcLineFn fn, void *ctx) {
+    Proc p;
+    Proc *list[1];
+
+    if (proc_spawn(&p, argv) != 0) return -1;
+    list[0] = &p;
+    while (proc_pump(list, 1, 200, fn, ctx) > 0) {
+        if (progress_cancelled() || (timeout_sec > 0 && now_seconds() - p.started > timeout_sec)) {
+            proc_kill(&p);
+            return -1;
+        }
+    }
+    return p.exit_code;
+}
+
+int proc_capture(const char *const argv[], int timeout_sec, unsigned char *buf, size_t cap, size_t *len) {
+    Proc p;
+    struct pollfd pfds[2];
+
+    *len = 0;
+    if (proc_spawn(&p, argv) != 0) return -1;
+    while (p.out_fd >= 0 || p.err_fd >= 0) {
+        nfds_t n = 0;
+        int out_idx = -1;
+        if (progress_cancelled() || (timeout_sec > 0 && now_seconds() - p.started > timeout_sec)) {
+            proc_kill(&p);
+            return -1;
+        }
+        if (p.out_fd >= 0) {
+            out_idx = (int)n;
+            pfds[n].fd = p.out_fd;
+            pfds[n++].events = POLLIN;
+        }
+        if (p.err_fd >= 0) {
+            pfds[n].fd = p.err_fd;
+            pfds[n++].events = POLLIN;
+        }
+        if (poll(pfds, n, 200) <= 0) continue;
+        for (nfds_t k = 0; k < n; ++k) {
+            char sink[4096];
+            ssize_t got;
+            int is_out = (int)k == out_idx;
+            if (!(pfds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            do {
+                if (is_out) got = read(pfds[k].fd, buf + *len, cap - *len);
+                else got = read(pfds[k].fd, sink, sizeof(sink));
+                if (got > 0 && is_out) *len += (size_t)got;
+            } while (got > 0 && (!is_out || *len < cap));
+            if (is_out && *len >= cap) {
+                proc_kill(&p);
+                return 0;
+            }
+            if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                close(pfds[k].fd);
+                if (is_out) p.out_fd = -1; else p.err_fd = -1;
+            }
+        }
+    }
+    proc_reap(&p);
+    return p.exit_code;
+}
+
+#else
+
+static void build_cmdline(char *cmd, size_t cmd_sz, const char *const argv[], const char *redirect) {
+    size_t j = 0;
+    for (size_t i = 0; argv[i] && j + 4 < cmd_sz; ++i) {
+        if (i) cmd[j++] = ' ';
+        cmd[j++] = '"';
+        for (const char *c = argv[i]; *c && j + 4 < cmd_sz; ++c) {
+            if (*c != '"') cmd[j++] = *c;
+        }
+        cmd[j++] = '"';
+    }
+    cmd[j] = '\0';
+    if (j + strlen(redirect) + 1 <= cmd_sz) memcpy(cmd + j, redirect, strlen(redirect) + 1);
+}
+
+int proc_capture(const char *const argv[], int timeout_sec, unsigned char *buf, size_t cap, size_t *len) {
+    char cmd[8192];
+    FILE *fp;
+    size_t n;
+    int rc;
+
+    (void)timeout_sec;
+    *len = 0;
+    build_cmdline(cmd, sizeof(cmd), argv, " 2>NUL");
+    fp = _popen(cmd, "rb");
+    if (!fp) return -1;
+    while (*len < cap && (n = fread(buf + *len, 1, cap - *len, fp)) > 0) *len += n;
+    rc = _pclose(fp);
+    return *len >= cap ? 0 : rc;
+}
+
+int proc_run(const char *const argv[], int timeout_sec, ProcLineFn fn, void *ctx) {
+    char cmd[8192];
+    char line[1024];
+    Proc p;
+    FILE *fp;
+    int rc;
+
+    (void)timeout_sec;
+    build_cmdline(cmd, sizeof(cmd), argv, " 2>&1");
+
+    memset(&p, 0, sizeof(p));
+    p.out_fd = -1;
+    p.err_fd = -1;
+    p.running = 1;
+    fp = _popen(cmd, "r");
+    if (!fp) return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (fn && line[0]) fn(&p, PROC_STDOUT, line, ctx);
+    }
+    rc = _pclose(fp);
+    p.running = 0;
+    return rc;
+}
+
+#endif
+
+static double parse_clock(const char *s) {
+    int h = 0, m = 0;
+    double sec = 0.0;
+    if (sscanf(s, "%d:%d:%lf", &h, &m, &sec) != 3) return -1.0;
+    return h * 3600.0 + m * 60.0 + sec;
+}
+
+int proc_parse_ffmpeg_line(const char *line, ProcProgress *pp) {
+    const char *d;
+    long long us;
+
+    if ((d = strstr(line, "Duration: ")) != NULL) {
+        double total = parse_clock(d + 10);
+        if (total > 0.0) pp->total_seconds = total;
+        return 0;
+    }
+    if (sscanf(line, "out_time_us=%lld", &us) == 1 || sscanf(line, "out_time_ms=%lld", &us) == 1) {
+        if (us < 0) return 0;
+        pp->done_seconds = (double)us / 1e6;
+        if (pp->total_seconds > 0.0) {
+            pp->percent = 100.0 * pp->done_seconds / pp->total_seconds;
+            if (pp->percent > 100.0) pp->percent = 100.0;
+        }
+        return 1;
+    }
+    if (strncmp(line, "speed=", 6) == 0) {
+        pp->speed = atof(line + 6);
+        return 0;
+    }
+    if (strcmp(line, "progress=end") == 0) {
+        pp->percent = 100.0;
+        pp->finished = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int proc_parse_ytdlp_line(const char *line, ProcProgress *pp) {
+    double pct;
+    const char *p = strstr(line, "[download]");
+    if (!p) return 0;
+    p += 10;
+    while (*p == ' ') ++p;
+    if (sscanf(p, "%lf%%", &pct) != 1) return 0;
+    pp->percent = pct;
+    if (pct >= 100.0) pp->finished = 1;
+    return 1;
+}
@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__)
+#define LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQ(p) (*(volatile size_t *)(p))
+#define STORE_REL(p, v) (*(volatile size_t *)(p) = (v))
+#endif
+
+static ProgressQueue *g_queue;
+#ifndef _WIN32
+static pthread_mutex_t g_post_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void short_sleep(void) {
+#ifndef _WIN32
+    struct timespec ts = {0, 1000000L};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void progress_attach(ProgressQueue *q) {
+    g_queue = q;
+}
+
+int progress_attached(void) {
+    return g_queue != NULL;
+}
+
+int progress_push(ProgressQueue *q, const ProgressEvent *ev) {
+    size_t tail = q->tail;
+    size_t head = LOAD_ACQ(&q->head);
+    if (tail - head >= PROGRESS_QUEUE_CAP) return -1;
+    q->slots[tail % PROGRESS_QUEUE_CAP] = *ev;
+    STORE_REL(&q->tail, tail + 1);
+    return 0;
+}
+
+int progress_pop(ProgressQueue *q, ProgressEvent *ev) {
+    size_t head = q->head;
+    size_t tail = LOAD_ACQ(&q->tail);
+    if (head == tail) return 0;
+    *ev = q->slots[head % PROGRESS_QUEUE_CAP];
+    STORE_REL(&q->head, head + 1);
+    return 1;
+}
+
+static void post(const ProgressEvent *ev, int may_drop) {
+#ifndef _WIN32
+    pthread_mutex_lock(&g_post_lock);
+#endif
+    while (progress_push(g_queue, ev) != 0) {
+        if (may_drop || LOAD_ACQ(&g_queue->cancel)) break;
+        short_sleep();
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&g_post_lock);
+#endif
+}
+
+void progress_cancel(ProgressQueue *q) {
+    STORE_REL(&q->cancel, (size_t)1);
+}
+
+int progress_cancelled(void) {
+    return g_queue && LOAD_ACQ(&g_queue->cancel) != 0;
+}
+
+int progress_finished(ProgressQueue *q, int *rc) {
+    if (LOAD_ACQ(&q->finished) == 0) return 0;
+    if (rc) *rc = q->rc;
+    return 1;
+}
+
+void progress_stage(PipelineStage stage, size_t total) {
+    ProgressEvent ev;
+    if (!g_queue) {
+        if (log_json()) log_event_stage(stage, total);
+        log_flush();
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_STAGE;
+    ev.stage = stage;
+    ev.total = total;
+    post(&ev, 0);
+}
+
+void progress_advance(size_t done, uint64_t bytes) {
+    ProgressEvent ev;
+    if (!g_queue) {
+        if (log_json()) log_event_progress(done, bytes);
+        log_tick();
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_PROGRESS;
+    ev.done = done;
+    ev.bytes = bytes;
+    post(&ev, 1);
+}
+
+void progress_done(int rc) {
+    ProgressEvent ev;
+    if (!g_queue) return;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_DONE;
+    ev.stage = STAGE_DONE;
+    ev.rc = rc;
+    g_queue->rc = rc;
+    STORE_REL(&g_queue->finished, (size_t)1);
+    post(&ev, 0);
+}
+
+void progress_log(LogLevel level, const char *fmt, ...) {
+    ProgressEvent ev;
+    va_list ap;
+
+    if (!g_queue) {
+        char text[CARTAG_PATH_MAX + 256];
+        va_start(ap, fmt);
+        vsnprintf(text, sizeof(text), fmt, ap);
+        va_end(ap);
+        log_write(level, text);
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_LOG;
+    ev.level = level;
+    va_start(ap, fmt);
+    vsnprintf(ev.text, sizeof(ev.text), fmt, ap);
+    va_end(ap);
+    post(&ev, 0);
+}
+
+void progress_detail(const char *fmt, ...) {
+    ProgressEvent ev;
+    va_list ap;
+    if (!g_queue) {
+        log_tick();
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_DETAIL;
+    va_start(ap, fmt);
+    vsnprintf(ev.text, sizeof(ev.text), fmt, ap);
+    va_end(ap);
+    post(&ev, 1);
+}
+
+void progress_estimate(uint64_t bytes, double rate) {
+    ProgressEvent ev;
+    if (!g_queue) {
+        if (log_json()) log_event_estimate(bytes, rate);
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PEV_ESTIMATE;
+    ev.bytes = bytes;
+    ev.rate = rate;
+    post(&ev, 1);
+}
+
+const char *progress_stage_name(PipelineStage stage) {
+    switch (stage) {
+        case STAGE_DOWNLOAD: return "Download";
+        case STAGE_SCAN: return "Scan";
+        case STAGE_PROCESS: return "Tags";
+        case STAGE_DEDUPE: return "Dedupe";
+        case STAGE_PLAN: return "Plan";
+        case STAGE_CONVERT: return "Convert";
+        case STAGE_EXPORT: return "Export";
+        case STAGE_VERIFY: return "Verify";
+        case STAGE_DONE: return "Done";
+        default: return "Idle";
+    }
+}
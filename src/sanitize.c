@@ -64,6 +64,24 @@ void sanitize_filename(char *name, size_t max_len) {
     snprintf(name, max_len, "%s", out);
 }
 
+size_t sanitize_fold_key(const char *in, char *out, size_t out_sz) {
+    size_t j = 0;
+    if (out_sz == 0) return 0;
+    for (size_t i = 0; in[i] && j + 1 < out_sz; ++i) {
+        unsigned char c = (unsigned char)in[i];
+        if (c == 0xC3 && in[i + 1]) {
+            char f = fold_utf8_c3((unsigned char)in[i + 1]);
+            if (f) out[j++] = (char)tolower((unsigned char)f);
+            ++i;
+            continue;
+        }
+        if (c >= 128 || c < 32) continue;
+        out[j++] = (char)tolower(c);
+    }
+    out[j] = '\0';
+    return j;
+}
+
 void sanitize_track(AudioTrack *t, int limit_name) {
     sanitize_filename(t->filename, sizeof(t->filename));
     sanitize_filename(t->artist, sizeof(t->artist));
@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define SCHED_MAX_DEVICES 16
+#define SCHED_IO_START 2
+#define SCHED_WINDOW_SECONDS 0.5
+#define SCHED_GAIN 1.05
+#define SCHED_IO_SLOTS 8
+#define SCHED_MEM_BUDGET ((uint64_t)64 << 20)
+
+typedef struct {
+    uint64_t dev;
+    SchedUnit unit;
+    int limit;
+    int active;
+    int waiting;
+    int step;
+    double window_start;
+    uint64_t window_units;
+    double last_rate;
+} SchedDevice;
+
+typedef struct {
+    int cpu_slots;
+    int cpu_active;
+    int io_max;
+    uint64_t mem_budget;
+    size_t device_count;
+} Scheduler;
+
+static Scheduler g_sched = {1, 0, SCHED_IO_SLOTS, SCHED_MEM_BUDGET, 0};
+static SchedDevice g_devices[SCHED_MAX_DEVICES];
+#ifndef _WIN32
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+static double now_seconds(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static int online_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void lower_priority(void) {
+#ifdef _WIN32
+    SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN);
+#else
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0) progress_log(LVL_WARN, "nao foi possivel reduzir a prioridade de CPU");
+#ifdef __linux__
+    if (syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0) progress_log(LVL_WARN, "nao foi possivel reduzir a prioridade de E/S");
+#endif
+#endif
+}
+
+void sched_configure(const CliOptions *opts) {
+    int cpus = online_cpus();
+
+    g_sched.cpu_slots = cpus;
+    g_sched.io_max = SCHED_IO_SLOTS;
+    g_sched.mem_budget = SCHED_MEM_BUDGET;
+    if (opts->background) {
+        g_sched.cpu_slots = cpus > 3 ? cpus / 4 : 1;
+        g_sched.io_max = 1;
+        g_sched.mem_budget = SCHED_MEM_BUDGET / 4;
+        lower_priority();
+        progress_log(LVL_INFO, "Modo background: prioridade baixa, %d CPU, %d E/S por dispositivo", g_sched.cpu_slots,
+                     g_sched.io_max);
+    }
+}
+
+int sched_workers(int wanted) {
+    if (wanted < 1) wanted = 1;
+    return wanted < g_sched.cpu_slots ? wanted : g_sched.cpu_slots;
+}
+
+uint64_t sched_mem_budget(void) {
+    return g_sched.mem_budget;
+}
+
+void sched_cpu_acquire(void) {
+#ifndef _WIN32
+    pthread_mutex_lock(&g_lock);
+    while (g_sched.cpu_active >= g_sched.cpu_slots) pthread_cond_wait(&g_cond, &g_lock);
+    g_sched.cpu_active++;
+    pthread_mutex_unlock(&g_lock);
+#endif
+}
+
+int sched_cpu_try(void) {
+    int ok = 1;
+#ifndef _WIN32
+    pthread_mutex_lock(&g_lock);
+    ok = g_sched.cpu_active < g_sched.cpu_slots;
+    if (ok) g_sched.cpu_active++;
+    pthread_mutex_unlock(&g_lock);
+#endif
+    return ok;
+}
+
+void sched_cpu_release(void) {
+#ifndef _WIN32
+    pthread_mutex_lock(&g_lock);
+    if (g_sched.cpu_active > 0) g_sched.cpu_active--;
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+#endif
+}
+
+static int device_index(uint64_t dev, SchedUnit unit) {
+    SchedDevice *d;
+    for (size_t i = 0; i < g_sched.device_count; ++i) {
+        if (g_devices[i].dev == dev && g_devices[i].unit == unit) return (int)i;
+    }
+    if (g_sched.device_count >= SCHED_MAX_DEVICES) return -1;
+    d = &g_devices[g_sched.device_count];
+    memset(d, 0, sizeof(*d));
+    d->dev = dev;
+    d->unit = unit;
+    d->limit = SCHED_IO_START < g_sched.io_max ? SCHED_IO_START : g_sched.io_max;
+    d->step = 1;
+    d->window_start = now_seconds();
+    return (int)g_sched.device_count++;
+}
+
+int sched_io_acquire(const char *path, SchedUnit unit) {
+    struct stat st;
+    int idx;
+#ifndef _WIN32
+    SchedDevice *d;
+#endif
+
+    if (stat(path, &st) != 0) return -1;
+#ifndef _WIN32
+    pthread_mutex_lock(&g_lock);
+    idx = device_index((uint64_t)st.st_dev, unit);
+    if (idx >= 0) {
+        d = &g_devices[idx];
+        d->waiting++;
+        while (d->active >= d->limit) pthread_cond_wait(&g_cond, &g_lock);
+        d->waiting--;
+        d->active++;
+    }
+    pthread_mutex_unlock(&g_lock);
+#else
+    (void)unit;
+    idx = -1;
+#endif
+    return idx;
+}
+
+static void device_adapt(SchedDevice *d, double now) {
+    double rate = (double)d->window_units / (now - d->window_start);
+
+    if (d->waiting > 0) {
+        if (d->step > 0 && rate < d->last_rate * SCHED_GAIN) d->step = -1;
+        else if (d->step < 0 && rate * SCHED_GAIN < d->last_rate) d->step = 1;
+        d->limit += d->step;
+        if (d->limit < 1) {
+            d->limit = 1;
+            d->step = 1;
+        }
+        if (d->limit > g_sched.io_max) {
+            d->limit = g_sched.io_max;
+            d->step = -1;
+        }
+    }
+    d->last_rate = rate;
+    d->window_start = now;
+    d->window_units = 0;
+}
+
+void sched_io_release(int idx, uint64_t units) {
+#ifndef _WIN32
+    SchedDevice *d;
+    double now;
+    if (idx < 0) return;
+    pthread_mutex_lock(&g_lock);
+    d = &g_devices[idx];
+    if (d->active > 0) d->active--;
+    d->window_units += units;
+    now = now_seconds();
+    if (now - d->window_start >= SCHED_WINDOW_SECONDS) device_adapt(d, now);
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+#else
+    (void)idx;
+    (void)units;
+#endif
+}
@@ -0,0 +1,141 @@
+#include "cartag.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int hay_reserve(SearchIndex *ix, size_t extra) {
+    char *mem;
+    size_t cap = ix->hay_cap ? ix->hay_cap : 65536;
+    if (ix->hay_len + extra + 1 <= ix->hay_cap) return 0;
+    while (cap < ix->hay_len + extra + 1) cap *= 2;
+    mem = (char *)realloc(ix->hay, cap);
+    if (!mem) return -1;
+    ix->hay = mem;
+    ix->hay_cap = cap;
+    return 0;
+}
+
+static int entries_reserve(SearchIndex *ix, size_t n) {
+    size_t *offs;
+    size_t *view;
+    size_t cap = ix->cap ? ix->cap : 1024;
+    if (n <= ix->cap) return 0;
+    while (cap < n) cap *= 2;
+    offs = (size_t *)realloc(ix->offs, cap * sizeof(size_t));
+    if (!offs) return -1;
+    ix->offs = offs;
+    view = (size_t *)realloc(ix->view, cap * sizeof(size_t));
+    if (!view) return -1;
+    ix->view = view;
+    ix->cap = cap;
+    return 0;
+}
+
+static void hay_add_field(SearchIndex *ix, const char *field) {
+    ix->hay_len += sanitize_fold_key(field, ix->hay + ix->hay_len, ix->hay_cap - ix->hay_len);
+    ix->hay[ix->hay_len++] = '\t';
+}
+
+static size_t entry_len(const SearchIndex *ix, size_t i) {
+    size_t end = (i + 1 < ix->count) ? ix->offs[i + 1] : ix->hay_len;
+    return end - ix->offs[i];
+}
+
+static int entry_contains(const SearchIndex *ix, size_t i, const char *q, size_t qlen) {
+    const char *p = ix->hay + ix->offs[i];
+    const char *end = p + entry_len(ix, i);
+    while ((size_t)(end - p) >= qlen) {
+        p = (const char *)memchr(p, q[0], (size_t)(end - p) - qlen + 1);
+        if (!p) return 0;
+        if (memcmp(p, q, qlen) == 0) return 1;
+        ++p;
+    }
+    return 0;
+}
+
+static size_t entry_at(const SearchIndex *ix, size_t pos) {
+    size_t lo = 0;
+    size_t hi = ix->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->offs[mid] <= pos) lo = mid; else hi = mid;
+    }
+    return lo;
+}
+
+static void filter_full(SearchIndex *ix) {
+    size_t qlen = strlen(ix->query);
+    const char *p = ix->hay;
+
+    ix->view_count = 0;
+    if (qlen == 0) {
+        for (size_t i = 0; i < ix->count; ++i) ix->view[ix->view_count++] = i;
+        return;
+    }
+    while ((p = strstr(p, ix->query)) != NULL) {
+        size_t e = entry_at(ix, (size_t)(p - ix->hay));
+        ix->view[ix->view_count++] = e;
+        if (e + 1 >= ix->count) break;
+        p = ix->hay + ix->offs[e + 1];
+    }
+}
+
+static void filter_narrow(SearchIndex *ix) {
+    size_t qlen = strlen(ix->query);
+    size_t n = 0;
+    for (size_t k = 0; k < ix->view_count; ++k) {
+        size_t e = ix->view[k];
+        if (entry_contains(ix, e, ix->query, qlen)) ix->view[n++] = e;
+    }
+    ix->view_count = n;
+}
+
+int search_index_sync(SearchIndex *ix, const TrackList *list) {
+    size_t first = ix->count;
+    size_t qlen = strlen(ix->query);
+
+    if (list->count < ix->count) {
+        char query[sizeof(ix->query)];
+        memcpy(query, ix->query, sizeof(query));
+        search_index_free(ix);
+        memcpy(ix->query, query, sizeof(query));
+        first = 0;
+    }
+    if (list->count == first) return 0;
+    if (entries_reserve(ix, list->count) != 0) return -1;
+
+    for (size_t i = first; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        if (hay_reserve(ix, strlen(t->filename) + strlen(t->artist) + strlen(t->album) + strlen(t->title) + 5) != 0) return -1;
+        ix->offs[i] = ix->hay_len;
+        hay_add_field(ix, t->filename);
+        hay_add_field(ix, t->artist);
+        hay_add_field(ix, t->album);
+        hay_add_field(ix, t->title);
+        ix->hay[ix->hay_len - 1] = '\n';
+        ix->hay[ix->hay_len] = '\0';
+        ix->count = i + 1;
+        if (qlen == 0 || entry_contains(ix, i, ix->query, qlen)) ix->view[ix->view_count++] = i;
+    }
+    return 0;
+}
+
+void search_set_query(SearchIndex *ix, const char *query) {
+    char folded[sizeof(ix->query)];
+    size_t old_len = strlen(ix->query);
+    int narrows;
+
+    sanitize_fold_key(query, folded, sizeof(folded));
+    narrows = old_len > 0 && strncmp(folded, ix->query, old_len) == 0;
+    if (strcmp(folded, ix->query) == 0) return;
+    memcpy(ix->query, folded, sizeof(folded));
+    if (!ix->hay) return;
+    if (narrows) filter_narrow(ix); else filter_full(ix);
+}
+
+void search_index_free(SearchIndex *ix) {
+    free(ix->hay);
+    free(ix->offs);
+    free(ix->view);
+    memset(ix, 0, sizeof(*ix));
+}
@@ -0,0 +1,592 @@
+#include "cartag.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    SF_YEAR = 0,
+    SF_DURATION,
+    SF_SIZE,
+    SF_BITRATE,
+    SF_RATING,
+    SF_TRACK,
+    SF_FORMAT,
+    SF_GENRE,
+    SF_ARTIST,
+    SF_ALBUM,
+    SF_TITLE,
+    SF_DUPLICATE,
+    SF_TAGGED,
+    SF_LOSSLESS,
+    SF_COUNT
+};
+
+#define SF_FIRST_CAT SF_FORMAT
+#define SF_FIRST_FLAG SF_DUPLICATE
+#define SF_NUMERIC(f) ((f) < SF_FIRST_CAT)
+#define SF_CATEGORY(f) ((f) >= SF_FIRST_CAT && (f) < SF_FIRST_FLAG)
+#define SF_DICT(f) ((f) > SF_FORMAT && (f) < SF_FIRST_FLAG)
+
+enum { CMP_EQ = 0, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_CONTAINS };
+
+static const char *const k_fields[SF_COUNT] = {"year",  "duration", "size",   "bitrate", "rating",
+                                               "track", "format",   "genre",  "artist",  "album",
+                                               "title", "duplicate", "tagged", "lossless"};
+
+typedef enum { TOK_END = 0, TOK_WORD, TOK_STRING, TOK_OP, TOK_LPAREN, TOK_RPAREN, TOK_COMMA } TokKind;
+
+typedef struct {
+    const char *src;
+    size_t pos;
+    TokKind kind;
+    char text[256];
+    SelectQuery *q;
+    size_t stack;
+    char *err;
+    size_t err_sz;
+    int failed;
+} Parser;
+
+typedef struct {
+    const char **keys;
+    size_t count;
+    size_t cap;
+    uint32_t *slots;
+    size_t slot_cap;
+    uint32_t *ids;
+} SelDict;
+
+typedef struct {
+    size_t n;
+    int64_t *num[SF_FIRST_CAT];
+    uint8_t *format;
+    uint8_t *flag[SF_COUNT - SF_FIRST_FLAG];
+    SelDict dict[SF_FIRST_FLAG - SF_FORMAT - 1];
+} SelColumns;
+
+static void fail(Parser *p, const char *msg) {
+    if (p->failed) return;
+    p->failed = 1;
+    snprintf(p->err, p->err_sz, "selecao invalida perto de '%s': %s", p->text[0] ? p->text : "fim", msg);
+}
+
+static int is_word_char(int c) {
+    return isalnum(c) || c == '_' || c == '.' || c == '-' || c == ':' || c == '&' || c == '\'' || c >= 128;
+}
+
+static void next_token(Parser *p) {
+    const char *s = p->src;
+    size_t n = 0;
+
+    while (s[p->pos] && isspace((unsigned char)s[p->pos])) p->pos++;
+    p->text[0] = '\0';
+    if (!s[p->pos]) {
+        p->kind = TOK_END;
+        return;
+    }
+    if (s[p->pos] == '(' || s[p->pos] == ')' || s[p->pos] == ',') {
+        p->kind = s[p->pos] == '(' ? TOK_LPAREN : (s[p->pos] == ')' ? TOK_RPAREN : TOK_COMMA);
+        p->text[0] = s[p->pos++];
+        p->text[1] = '\0';
+        return;
+    }
+    if (s[p->pos] == '"') {
+        p->pos++;
+        while (s[p->pos] && s[p->pos] != '"') {
+            if (n + 1 < sizeof(p->text)) p->text[n++] = s[p->pos];
+            p->pos++;
+        }
+        p->text[n] = '\0';
+        if (s[p->pos] != '"') fail(p, "aspas sem fechamento");
+        else p->pos++;
+        p->kind = TOK_STRING;
+        return;
+    }
+    if (strchr("=!<>~", s[p->pos])) {
+        p->text[n++] = s[p->pos++];
+        if (s[p->pos] == '=') p->text[n++] = s[p->pos++];
+        p->text[n] = '\0';
+        p->kind = TOK_OP;
+        return;
+    }
+    if (!is_word_char((unsigned char)s[p->pos])) {
+        p->text[0] = s[p->pos++];
+        p->text[1] = '\0';
+        p->kind = TOK_OP;
+        fail(p, "caractere inesperado");
+        return;
+    }
+    while (s[p->pos] && is_word_char((unsigned char)s[p->pos])) {
+        if (n + 1 < sizeof(p->text)) p->text[n++] = s[p->pos];
+        p->pos++;
+    }
+    p->text[n] = '\0';
+    p->kind = TOK_WORD;
+}
+
+static int is_keyword(const Parser *p, const char *kw) {
+    const char *a = p->text;
+    if (p->kind != TOK_WORD) return 0;
+    while (*a && *kw && tolower((unsigned char)*a) == *kw) {
+        a++;
+        kw++;
+    }
+    return *a == '\0' && *kw == '\0';
+}
+
+static SelectOp *emit(Parser *p, SelectOpKind kind) {
+    SelectOp *op;
+    SelectQuery *q = p->q;
+    if (q->count >= q->cap) {
+        size_t cap = q->cap ? q->cap * 2 : 16;
+        SelectOp *mem = (SelectOp *)realloc(q->ops, cap * sizeof(SelectOp));
+        if (!mem) {
+            fail(p, "memoria insuficiente");
+            return NULL;
+        }
+        q->ops = mem;
+        q->cap = cap;
+    }
+    op = &q->ops[q->count++];
+    memset(op, 0, sizeof(*op));
+    op->kind = kind;
+    if (kind == SEL_LEAF) {
+        if (++p->stack > q->depth) q->depth = p->stack;
+    } else if (kind != SEL_NOT) {
+        p->stack--;
+    }
+    return op;
+}
+
+static int parse_number(int field, const char *s, int64_t *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s) return -1;
+    if (field == SF_DURATION && *end == ':') {
+        char *end2;
+        long sec = strtol(end + 1, &end2, 10);
+        if (end2 == end + 1 || sec < 0 || sec >= 60) return -1;
+        v = v * 60.0 + (double)sec;
+        end = end2;
+    } else if (field == SF_SIZE && *end) {
+        switch (tolower((unsigned char)*end)) {
+            case 'k': v *= 1024.0; break;
+            case 'm': v *= 1024.0 * 1024.0; break;
+            case 'g': v *= 1024.0 * 1024.0 * 1024.0; break;
+            default: return -1;
+        }
+        end++;
+        if (tolower((unsigned char)*end) == 'b') end++;
+    } else if (field == SF_BITRATE && tolower((unsigned char)*end) == 'k') {
+        end++;
+    }
+    if (*end) return -1;
+    *out = (int64_t)v;
+    return 0;
+}
+
+static char *append_value(char *list, size_t *len, const char *value) {
+    char key[256];
+    size_t n = sanitize_fold_key(value, key, sizeof(key));
+    char *mem = (char *)realloc(list, *len + n + 2);
+    if (!mem) {
+        free(list);
+        return NULL;
+    }
+    memcpy(mem + *len, key, n + 1);
+    *len += n + 1;
+    mem[*len] = '\0';
+    return mem;
+}
+
+static int parse_values(Parser *p, int field, int cmp, int multi) {
+    char *values = NULL;
+    size_t len = 0;
+    size_t nvals = 0;
+
+    do {
+        char item[256];
+        size_t n = 0;
+        next_token(p);
+        if (p->kind != TOK_WORD && p->kind != TOK_STRING) {
+            fail(p, "valor esperado");
+            free(values);
+            return -1;
+        }
+        item[0] = '\0';
+        while (p->kind == TOK_WORD || p->kind == TOK_STRING) {
+            size_t tl = strlen(p->text);
+            if (n && n + 1 < sizeof(item)) item[n++] = ' ';
+            if (n + tl >= sizeof(item)) tl = sizeof(item) - n - 1;
+            memcpy(item + n, p->text, tl);
+            n += tl;
+            item[n] = '\0';
+            next_token(p);
+            if (!multi) break;
+        }
+        if (SF_NUMERIC(field)) {
+            int64_t v;
+            SelectOp *op;
+            if (parse_number(field, item, &v) != 0) {
+                snprintf(p->text, sizeof(p->text), "%s", item);
+                fail(p, "numero invalido");
+                free(values);
+                return -1;
+            }
+            op = emit(p, SEL_LEAF);
+            if (!op) return -1;
+            op->field = field;
+            op->cmp = cmp;
+            op->value = v;
+            if (nvals++ && !emit(p, SEL_OR)) return -1;
+        } else {
+            values = append_value(values, &len, item);
+            if (!values) {
+                fail(p, "memoria insuficiente");
+                return -1;
+            }
+            nvals++;
+        }
+    } while (multi && p->kind == TOK_COMMA);
+
+    if (multi) {
+        if (p->kind != TOK_RPAREN) {
+            fail(p, "')' esperado");
+            free(values);
+            return -1;
+        }
+        next_token(p);
+    }
+    if (!SF_NUMERIC(field)) {
+        SelectOp *op = emit(p, SEL_LEAF);
+        if (!op) {
+            free(values);
+            return -1;
+        }
+        op->field = field;
+        op->cmp = cmp;
+        op->values = values;
+    }
+    return 0;
+}
+
+static int parse_or(Parser *p);
+
+static int parse_primary(Parser *p) {
+    int field = -1;
+    int cmp;
+
+    if (p->kind == TOK_LPAREN) {
+        next_token(p);
+        if (parse_or(p) != 0) return -1;
+        if (p->kind != TOK_RPAREN) {
+            fail(p, "')' esperado");
+            return -1;
+        }
+        next_token(p);
+        return 0;
+    }
+    for (int f = 0; f < SF_COUNT; ++f) {
+        if (is_keyword(p, k_fields[f])) field = f;
+    }
+    if (field < 0) {
+        fail(p, "campo desconhecido");
+        return -1;
+    }
+    next_token(p);
+    if (field >= SF_FIRST_FLAG) {
+        SelectOp *op = emit(p, SEL_LEAF);
+        if (!op) return -1;
+        op->field = field;
+        return 0;
+    }
+    if (is_keyword(p, "in")) {
+        next_token(p);
+        if (p->kind != TOK_LPAREN) {
+            fail(p, "'(' esperado");
+            return -1;
+        }
+        return parse_values(p, field, CMP_EQ, 1);
+    }
+    if (p->kind != TOK_OP) {
+        fail(p, "operador esperado");
+        return -1;
+    }
+    if (strcmp(p->text, "=") == 0 || strcmp(p->text, "==") == 0) cmp = CMP_EQ;
+    else if (strcmp(p->text, "!=") == 0) cmp = CMP_NE;
+    else if (strcmp(p->text, "<") == 0) cmp = CMP_LT;
+    else if (strcmp(p->text, "<=") == 0) cmp = CMP_LE;
+    else if (strcmp(p->text, ">") == 0) cmp = CMP_GT;
+    else if (strcmp(p->text, ">=") == 0) cmp = CMP_GE;
+    else if (strcmp(p->text, "~") == 0) cmp = CMP_CONTAINS;
+    else {
+        fail(p, "operador desconhecido");
+        return -1;
+    }
+    if (SF_NUMERIC(field) ? cmp == CMP_CONTAINS : (cmp != CMP_EQ && cmp != CMP_NE && cmp != CMP_CONTAINS)) {
+        fail(p, "operador nao se aplica ao campo");
+        return -1;
+    }
+    return parse_values(p, field, cmp, 0);
+}
+
+static int parse_not(Parser *p) {
+    if (is_keyword(p, "not")) {
+        next_token(p);
+        if (parse_not(p) != 0) return -1;
+        return emit(p, SEL_NOT) ? 0 : -1;
+    }
+    return parse_primary(p);
+}
+
+static int parse_and(Parser *p) {
+    if (parse_not(p) != 0) return -1;
+    while (is_keyword(p, "and")) {
+        next_token(p);
+        if (parse_not(p) != 0 || !emit(p, SEL_AND)) return -1;
+    }
+    return 0;
+}
+
+static int parse_or(Parser *p) {
+    if (parse_and(p) != 0) return -1;
+    while (is_keyword(p, "or")) {
+        next_token(p);
+        if (parse_and(p) != 0 || !emit(p, SEL_OR)) return -1;
+    }
+    return 0;
+}
+
+int select_compile(SelectQuery *q, const char *expr, char *err, size_t err_sz) {
+    Parser p;
+
+    memset(q, 0, sizeof(*q));
+    memset(&p, 0, sizeof(p));
+    p.src = expr;
+    p.q = q;
+    p.err = err;
+    p.err_sz = err_sz;
+    if (err_sz) err[0] = '\0';
+    next_token(&p);
+    if (parse_or(&p) == 0 && p.kind != TOK_END) fail(&p, "expressao incompleta");
+    if (p.failed || q->count == 0) {
+        if (!p.failed) fail(&p, "expressao vazia");
+        select_free(q);
+        return -1;
+    }
+    for (size_t i = 0; i < q->count; ++i) {
+        if (q->ops[i].kind == SEL_LEAF) q->fields |= 1u << q->ops[i].field;
+    }
+    return 0;
+}
+
+int select_uses_duplicate(const SelectQuery *q) {
+    return (q->fields & (1u << SF_DUPLICATE)) != 0;
+}
+
+void select_free(SelectQuery *q) {
+    for (size_t i = 0; i < q->count; ++i) free(q->ops[i].values);
+    free(q->ops);
+    memset(q, 0, sizeof(*q));
+}
+
+static uint32_t dict_intern(SelDict *d, const char *key) {
+    size_t mask;
+    size_t slot;
+
+    if (d->count * 2 >= d->slot_cap) {
+        size_t cap = d->slot_cap ? d->slot_cap * 2 : 1024;
+        uint32_t *slots = (uint32_t *)malloc(cap * sizeof(uint32_t));
+        const char **keys = (const char **)realloc(d->keys, (cap / 2) * sizeof(char *));
+        if (!slots || !keys) {
+            free(slots);
+            if (keys) d->keys = keys;
+            return 0;
+        }
+        d->keys = keys;
+        d->cap = cap / 2;
+        memset(slots, 0xFF, cap * sizeof(uint32_t));
+        for (size_t i = 0; i < d->count; ++i) {
+            slot = (size_t)hash64(d->keys[i], strlen(d->keys[i]), 0) & (cap - 1);
+            while (slots[slot] != UINT32_MAX) slot = (slot + 1) & (cap - 1);
+            slots[slot] = (uint32_t)i;
+        }
+        free(d->slots);
+        d->slots = slots;
+        d->slot_cap = cap;
+    }
+    mask = d->slot_cap - 1;
+    slot = (size_t)hash64(key, strlen(key), 0) & mask;
+    while (d->slots[slot] != UINT32_MAX) {
+        if (strcmp(d->keys[d->slots[slot]], key) == 0) return d->slots[slot];
+        slot = (slot + 1) & mask;
+    }
+    d->keys[d->count] = key;
+    d->slots[slot] = (uint32_t)d->count;
+    return (uint32_t)d->count++;
+}
+
+static const char *dict_field(const AudioTrack *t, int field) {
+    switch (field) {
+        case SF_GENRE: return t->genre;
+        case SF_ARTIST: return t->artist;
+        case SF_ALBUM: return t->album;
+        default: return t->title;
+    }
+}
+
+static int64_t numeric_field(const AudioTrack *t, int field) {
+    switch (field) {
+        case SF_YEAR: return t->year;
+        case SF_DURATION: return t->duration_seconds;
+        case SF_SIZE: return (int64_t)t->size_bytes;
+        case SF_BITRATE: return t->stream.bitrate_kbps;
+        case SF_RATING: return t->rating;
+        default: return t->track_no;
+    }
+}
+
+static void columns_free(SelColumns *c) {
+    for (int f = 0; f < SF_FIRST_CAT; ++f) free(c->num[f]);
+    for (int f = 0; f < SF_COUNT - SF_FIRST_FLAG; ++f) free(c->flag[f]);
+    for (int f = 0; f < SF_FIRST_FLAG - SF_FORMAT - 1; ++f) {
+        free(c->dict[f].keys);
+        free(c->dict[f].slots);
+        free(c->dict[f].ids);
+    }
+    free(c->format);
+}
+
+static int columns_build(SelColumns *c, const TrackList *list, unsigned fields) {
+    size_t n = list->count;
+
+    c->n = n;
+    for (int f = 0; f < SF_COUNT; ++f) {
+        if (!(fields & (1u << f))) continue;
+        if (SF_NUMERIC(f)) {
+            if (!(c->num[f] = (int64_t *)malloc((n + 1) * sizeof(int64_t)))) return -1;
+        } else if (f == SF_FORMAT) {
+            if (!(c->format = (uint8_t *)malloc(n + 1))) return -1;
+        } else if (SF_DICT(f)) {
+            if (!(c->dict[f - SF_FORMAT - 1].ids = (uint32_t *)malloc((n + 1) * sizeof(uint32_t)))) return -1;
+        } else if (!(c->flag[f - SF_FIRST_FLAG] = (uint8_t *)malloc(n + 1))) {
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        for (int f = 0; f < SF_FIRST_CAT; ++f) {
+            if (c->num[f]) c->num[f][i] = numeric_field(t, f);
+        }
+        if (c->format) c->format[i] = (uint8_t)t->format;
+        for (int f = SF_FORMAT + 1; f < SF_FIRST_FLAG; ++f) {
+            SelDict *d = &c->dict[f - SF_FORMAT - 1];
+            if (!d->ids) continue;
+            d->ids[i] = dict_intern(d, dict_field(t, f));
+            if (!d->keys) return -1;
+        }
+        if (c->flag[0]) c->flag[0][i] = (uint8_t)(t->duplicate != 0);
+        if (c->flag[1]) c->flag[1][i] = (uint8_t)(t->artist[0] && t->title[0]);
+        if (c->flag[2]) c->flag[2][i] = (uint8_t)(t->format == FORMAT_FLAC || t->format == FORMAT_WAV);
+    }
+    return 0;
+}
+
+static uint8_t key_matches(const char *key, const char *values, int cmp) {
+    char folded[256];
+    sanitize_fold_key(key, folded, sizeof(folded));
+    for (const char *v = values; v && *v; v += strlen(v) + 1) {
+        if (cmp == CMP_CONTAINS ? strstr(folded, v) != NULL : strcmp(folded, v) == 0) return 1;
+    }
+    return 0;
+}
+
+static void eval_category(const SelColumns *c, const SelectOp *op, uint8_t *m) {
+    uint8_t flip = op->cmp == CMP_NE;
+    uint8_t fmt_hit[16];
+    uint8_t *hit;
+    size_t nkeys;
+
+    if (op->field == SF_FORMAT) {
+        for (int k = 0; k < 16; ++k) fmt_hit[k] = key_matches(audio_format_name((AudioFormat)k), op->values, op->cmp) ^ flip;
+        for (size_t i = 0; i < c->n; ++i) m[i] = fmt_hit[c->format[i] & 15];
+        return;
+    }
+    nkeys = c->dict[op->field - SF_FORMAT - 1].count;
+    hit = (uint8_t *)malloc(nkeys + 1);
+    if (!hit) {
+        memset(m, 0, c->n);
+        return;
+    }
+    for (size_t k = 0; k < nkeys; ++k) hit[k] = key_matches(c->dict[op->field - SF_FORMAT - 1].keys[k], op->values, op->cmp) ^ flip;
+    {
+        const uint32_t *ids = c->dict[op->field - SF_FORMAT - 1].ids;
+        for (size_t i = 0; i < c->n; ++i) m[i] = hit[ids[i]];
+    }
+    free(hit);
+}
+
+static void eval_numeric(const SelColumns *c, const SelectOp *op, uint8_t *m) {
+    const int64_t *col = c->num[op->field];
+    const int64_t v = op->value;
+    size_t n = c->n;
+    switch (op->cmp) {
+        case CMP_EQ: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] == v); break;
+        case CMP_NE: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] != v); break;
+        case CMP_LT: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] < v); break;
+        case CMP_LE: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] <= v); break;
+        case CMP_GT: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] > v); break;
+        default: for (size_t i = 0; i < n; ++i) m[i] = (uint8_t)(col[i] >= v); break;
+    }
+}
+
+size_t select_apply(const SelectQuery *q, TrackList *list) {
+    SelColumns cols;
+    uint8_t *stack;
+    size_t n = list->count;
+    size_t sp = 0;
+    size_t selected = 0;
+
+    if (n == 0 || q->count == 0) return n;
+    memset(&cols, 0, sizeof(cols));
+    stack = (uint8_t *)malloc(q->depth * n);
+    if (!stack || columns_build(&cols, list, q->fields) != 0) {
+        free(stack);
+        columns_free(&cols);
+        return n;
+    }
+    for (size_t k = 0; k < q->count; ++k) {
+        const SelectOp *op = &q->ops[k];
+        uint8_t *last = sp ? stack + (sp - 1) * n : NULL;
+        uint8_t *prev = sp > 1 ? last - n : NULL;
+        switch (op->kind) {
+            case SEL_LEAF:
+                last = stack + sp++ * n;
+                if (SF_NUMERIC(op->field)) eval_numeric(&cols, op, last);
+                else if (SF_CATEGORY(op->field)) eval_category(&cols, op, last);
+                else memcpy(last, cols.flag[op->field - SF_FIRST_FLAG], n);
+                break;
+            case SEL_NOT:
+                for (size_t i = 0; i < n; ++i) last[i] ^= 1;
+                break;
+            case SEL_AND:
+                for (size_t i = 0; i < n; ++i) prev[i] &= last[i];
+                sp--;
+                break;
+            case SEL_OR:
+                for (size_t i = 0; i < n; ++i) prev[i] |= last[i];
+                sp--;
+                break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        list->tracks[i].unselected = !stack[i];
+        selected += stack[i];
+    }
+    free(stack);
+    columns_free(&cols);
+    return selected;
+}
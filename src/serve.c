@@ -0,0 +1,691 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVE_MAX_CLIENTS 32
+#define SERVE_LINE_MAX 8192
+#define SERVE_MAX_FIELDS 24
+#define SERVE_MAX_ARGS 256
+#define SERVE_WRITE_TIMEOUT_MS 5000
+
+typedef struct {
+    int fd;
+    int subscribed;
+    int dead;
+    size_t len;
+    char buf[SERVE_LINE_MAX];
+} ServeClient;
+
+typedef struct {
+    char *key;
+    char *val;
+    int truth;
+} ServeField;
+
+typedef struct {
+    ServeClient *client;
+    char cmd[16];
+    char id[128];
+    int has_id;
+    CliOptions opts;
+    TrackList list;
+    LibraryStats stats;
+    size_t count;
+    int rc;
+    char err[256];
+    double start;
+} ServeJob;
+
+typedef struct {
+    const CliOptions *opts;
+    int argc;
+    char **argv;
+    int listen_fd;
+    TrackList list;
+    LibraryStats stats;
+    ServeClient *clients[SERVE_MAX_CLIENTS];
+    size_t client_count;
+    pthread_mutex_t clients_lock;
+    ServeClient *current;
+    pthread_t main_thread;
+    pthread_t job_thread;
+    int job_running;
+    int job_pipe[2];
+    ServeJob job;
+    int quit;
+} ServeState;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void write_all(ServeClient *c, const char *s, size_t n) {
+    while (n > 0 && !c->dead) {
+        ssize_t w = write(c->fd, s, n);
+        if (w > 0) {
+            s += w;
+            n -= (size_t)w;
+        } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd;
+            pfd.fd = c->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, SERVE_WRITE_TIMEOUT_MS) <= 0) c->dead = 1;
+        } else if (w < 0 && errno == EINTR) {
+            continue;
+        } else {
+            c->dead = 1;
+        }
+    }
+}
+
+static int is_stream_event(const char *line, size_t len) {
+    static const char *const names[] = {"stage\"", "progress\"", "estimate\"", "log\"", "warning\"", "warning_summary\""};
+    if (len < 11 || strncmp(line, "{\"event\":\"", 10) != 0) return 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strncmp(line + 10, names[i], strlen(names[i])) == 0) return 1;
+    }
+    return 0;
+}
+
+static void serve_sink(void *ctx, const char *line, size_t len) {
+    ServeState *ss = (ServeState *)ctx;
+    int stream = is_stream_event(line, len);
+    ServeClient *target = pthread_equal(pthread_self(), ss->main_thread) ? ss->current : ss->job.client;
+
+    if (target) write_all(target, line, len);
+    if (!stream) return;
+    pthread_mutex_lock(&ss->clients_lock);
+    for (size_t i = 0; i < ss->client_count; ++i) {
+        ServeClient *c = ss->clients[i];
+        ssize_t w;
+        if (c == target || !c->subscribed || c->dead) continue;
+        w = write(c->fd, line, len);
+        if (w >= 0 && (size_t)w != len) c->dead = 1;
+        else if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) c->dead = 1;
+    }
+    pthread_mutex_unlock(&ss->clients_lock);
+}
+
+static void skip_ws(char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n') (*p)++;
+}
+
+static size_t put_utf8(char *out, unsigned cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+static char *parse_string(char **p) {
+    char *out;
+    char *start;
+
+    if (**p != '"') return NULL;
+    start = out = ++(*p);
+    while (**p && **p != '"') {
+        char ch = *(*p)++;
+        if (ch != '\\') {
+            *out++ = ch;
+            continue;
+        }
+        ch = *(*p)++;
+        switch (ch) {
+            case 'n': *out++ = '\n'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'u': {
+                char hex[5];
+                unsigned cp;
+                memcpy(hex, *p, 4);
+                hex[4] = '\0';
+                if (strlen(hex) < 4 || sscanf(hex, "%4x", &cp) != 1) return NULL;
+                *p += 4;
+                out += put_utf8(out, cp);
+                break;
+            }
+            case '\0': return NULL;
+            default: *out++ = ch; break;
+        }
+    }
+    if (**p != '"') return NULL;
+    (*p)++;
+    *out = '\0';
+    return start;
+}
+
+static int parse_request(char *line, ServeField *fields, size_t cap, size_t *count) {
+    char *p = line;
+    size_t n = 0;
+
+    skip_ws(&p);
+    if (*p++ != '{') return -1;
+    skip_ws(&p);
+    if (*p == '}') {
+        *count = 0;
+        return 0;
+    }
+    for (;;) {
+        ServeField f;
+        char *end = NULL;
+        char delim;
+
+        skip_ws(&p);
+        f.key = parse_string(&p);
+        if (!f.key) return -1;
+        skip_ws(&p);
+        if (*p++ != ':') return -1;
+        skip_ws(&p);
+        f.truth = 0;
+        if (*p == '"') {
+            f.val = parse_string(&p);
+            if (!f.val) return -1;
+        } else {
+            f.val = p;
+            while (*p && !strchr(",} \t\r\n", *p)) p++;
+            end = p;
+        }
+        skip_ws(&p);
+        if (*p != ',' && *p != '}') return -1;
+        delim = *p++;
+        if (end) {
+            *end = '\0';
+            if (strcmp(f.val, "true") == 0) f.truth = 1;
+            else if (strcmp(f.val, "false") == 0 || strcmp(f.val, "null") == 0) f.truth = -1;
+        }
+        if (n < cap) fields[n++] = f;
+        if (delim == '}') break;
+    }
+    *count = n;
+    return 0;
+}
+
+static const char *field_get(const ServeField *fields, size_t n, const char *key) {
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(fields[i].key, key) == 0) return fields[i].val;
+    }
+    return NULL;
+}
+
+static int request_options(const ServeState *ss, const ServeField *fields, size_t n, CliOptions *out, char *err,
+                           size_t err_sz) {
+    char *argv[SERVE_MAX_ARGS];
+    char flags[SERVE_MAX_FIELDS][64];
+    const char *select = NULL;
+    int argc = 0;
+
+    memset(out, 0, sizeof(*out));
+    if ((size_t)ss->argc + 2 * n >= SERVE_MAX_ARGS) {
+        snprintf(err, err_sz, "opcoes demais na requisicao");
+        return -1;
+    }
+    for (int i = 0; i < ss->argc; ++i) {
+        int own_export = strcmp(ss->argv[i], "--export") == 0 && field_get(fields, n, "export");
+        if ((own_export || strcmp(ss->argv[i], "--serve") == 0) && i + 1 < ss->argc) {
+            ++i;
+            continue;
+        }
+        argv[argc++] = ss->argv[i];
+    }
+    for (size_t i = 0; i < n && i < SERVE_MAX_FIELDS; ++i) {
+        const ServeField *f = &fields[i];
+        if (strcmp(f->key, "cmd") == 0 || strcmp(f->key, "id") == 0 || strcmp(f->key, "limit") == 0) continue;
+        if (f->truth < 0) continue;
+        if (strcmp(f->key, "select") == 0) {
+            select = f->val;
+            continue;
+        }
+        snprintf(flags[i], sizeof(flags[i]), "--%s", f->key);
+        argv[argc++] = flags[i];
+        if (!f->truth) argv[argc++] = f->val;
+    }
+    if (cli_parse(argc, argv, out) != 0) {
+        cli_free(out);
+        snprintf(err, err_sz, "opcoes invalidas");
+        return -1;
+    }
+    if (select) {
+        select_free(&out->select_query);
+        snprintf(out->select, sizeof(out->select), "%s", select);
+        if (select_compile(&out->select_query, out->select, err, err_sz) != 0) {
+            out->select[0] = '\0';
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void reset_plan(TrackList *list) {
+    for (size_t i = 0; i < list->count; ++i) {
+        AudioTrack *t = &list->tracks[i];
+        t->duplicate = 0;
+        t->omitted = 0;
+        t->unselected = 0;
+    }
+}
+
+static size_t live_count(const TrackList *list) {
+    size_t n = 0;
+    for (size_t i = 0; i < list->count; ++i) {
+        const AudioTrack *t = &list->tracks[i];
+        if (!t->duplicate && !t->excluded && !t->unselected && !t->omitted) n++;
+    }
+    return n;
+}
+
+static void cmd_query(ServeState *ss, const CliOptions *ro, const char *limit_s, size_t *count) {
+    long limit = limit_s ? strtol(limit_s, NULL, 10) : -1;
+    LibraryStats stats = ss->stats;
+    size_t sent = 0;
+
+    reset_plan(&ss->list);
+    pipeline_dedupe(&ss->list, ro, &stats);
+    *count = 0;
+    for (size_t i = 0; i < ss->list.count; ++i) {
+        const AudioTrack *t = &ss->list.tracks[i];
+        if (t->duplicate || t->excluded || t->unselected) continue;
+        (*count)++;
+        if (limit < 0 || sent < (size_t)limit) {
+            log_event_track(t);
+            sent++;
+        }
+    }
+}
+
+static void cmd_plan(ServeState *ss, const CliOptions *ro, int diagnostics, size_t *count) {
+    LibraryStats stats = ss->stats;
+
+    reset_plan(&ss->list);
+    progress_stage(STAGE_DEDUPE, ss->list.count);
+    pipeline_plan(&ss->list, ro, &stats);
+    if (diagnostics) diagnostics_print(&ss->list);
+    simulate_print(&ss->list, ro->simulate != SIM_NONE ? ro->simulate : SIM_GENERIC, &stats);
+    stats_print(&stats);
+    *count = live_count(&ss->list);
+}
+
+static int copy_index(const ServeState *ss, ServeJob *job, char *err, size_t err_sz) {
+    if (ss->list.count) {
+        job->list.tracks = (AudioTrack *)malloc(ss->list.count * sizeof(AudioTrack));
+        if (!job->list.tracks) {
+            snprintf(err, err_sz, "memoria insuficiente");
+            return -1;
+        }
+        memcpy(job->list.tracks, ss->list.tracks, ss->list.count * sizeof(AudioTrack));
+        job->list.count = job->list.capacity = ss->list.count;
+    }
+    job->stats = ss->stats;
+    return 0;
+}
+
+static void job_export(ServeJob *job) {
+    reset_plan(&job->list);
+    progress_stage(STAGE_DEDUPE, job->list.count);
+    pipeline_plan(&job->list, &job->opts, &job->stats);
+    pipeline_convert(&job->list, &job->opts);
+    log_flush_issues();
+    exporter_run(&job->list, &job->opts);
+    stats_print(&job->stats);
+    job->count = live_count(&job->list);
+}
+
+static int load_list(const CliOptions *opts, TrackList *list, LibraryStats *stats) {
+    int rc;
+    memset(list, 0, sizeof(*list));
+    memset(stats, 0, sizeof(*stats));
+    rc = pipeline_load(opts, list, stats);
+    log_flush_issues();
+    if (rc != 0) tracklist_free(list);
+    return rc;
+}
+
+static void *job_worker(void *arg) {
+    ServeState *ss = (ServeState *)arg;
+    ServeJob *job = &ss->job;
+
+    if (strcmp(job->cmd, "reload") == 0) {
+        job->rc = load_list(ss->opts, &job->list, &job->stats);
+        if (job->rc != 0) snprintf(job->err, sizeof(job->err), "falha ao reindexar (%d)", job->rc);
+        job->count = job->list.count;
+    } else {
+        job_export(job);
+    }
+    log_event_result(job->has_id ? job->id : NULL, job->cmd, job->rc != 0 ? job->err : NULL, job->count,
+                     now_ms() - job->start);
+    while (write(ss->job_pipe[1], "", 1) < 0 && errno == EINTR) continue;
+    return NULL;
+}
+
+static int job_start(ServeState *ss, ServeClient *c, const char *cmd, const char *id, CliOptions *ro, char *err,
+                     size_t err_sz) {
+    ServeJob *job = &ss->job;
+
+    if (ss->job_running) {
+        snprintf(err, err_sz, "ocupado: %s em andamento", job->cmd);
+        return -1;
+    }
+    memset(job, 0, sizeof(*job));
+    if (ro) {
+        if (ro->export_path[0] == '\0') {
+            snprintf(err, err_sz, "export requer \"export\": \"<destino>\"");
+            return -1;
+        }
+        if (copy_index(ss, job, err, err_sz) != 0) return -1;
+        job->opts = *ro;
+        memset(ro, 0, sizeof(*ro));
+    }
+    job->client = c;
+    job->start = now_ms();
+    snprintf(job->cmd, sizeof(job->cmd), "%s", cmd);
+    if (id) {
+        snprintf(job->id, sizeof(job->id), "%s", id);
+        job->has_id = 1;
+    }
+    if (pthread_create(&ss->job_thread, NULL, job_worker, ss) != 0) {
+        snprintf(err, err_sz, "falha ao iniciar %s", cmd);
+        tracklist_free(&job->list);
+        cli_free(&job->opts);
+        job->client = NULL;
+        return -1;
+    }
+    ss->job_running = 1;
+    return 0;
+}
+
+static void job_finish(ServeState *ss) {
+    ServeJob *job = &ss->job;
+    char drain[16];
+
+    if (!ss->job_running) return;
+    pthread_join(ss->job_thread, NULL);
+    while (read(ss->job_pipe[0], drain, sizeof(drain)) > 0) continue;
+    ss->job_running = 0;
+    if (strcmp(job->cmd, "reload") == 0 && job->rc == 0) {
+        tracklist_free(&ss->list);
+        ss->list = job->list;
+        ss->stats = job->stats;
+    } else {
+        tracklist_free(&job->list);
+    }
+    memset(&job->list, 0, sizeof(job->list));
+    cli_free(&job->opts);
+    job->client = NULL;
+}
+
+static void handle_line(ServeState *ss, ServeClient *c, char *line) {
+    ServeField fields[SERVE_MAX_FIELDS];
+    size_t n = 0;
+    size_t count = 0;
+    const char *cmd;
+    const char *id;
+    char err[256];
+    CliOptions ro;
+    double start = now_ms();
+    int rc = 0;
+
+    ss->current = c;
+    err[0] = '\0';
+    if (parse_request(line, fields, SERVE_MAX_FIELDS, &n) != 0) {
+        log_event_result(NULL, "", "requisicao JSON invalida", 0, now_ms() - start);
+        ss->current = NULL;
+        return;
+    }
+    cmd = field_get(fields, n, "cmd");
+    id = field_get(fields, n, "id");
+    if (!cmd) cmd = "";
+
+    if (strcmp(cmd, "ping") == 0) {
+        count = ss->list.count;
+    } else if (strcmp(cmd, "subscribe") == 0) {
+        c->subscribed = 1;
+    } else if (strcmp(cmd, "unsubscribe") == 0) {
+        c->subscribed = 0;
+    } else if (strcmp(cmd, "stats") == 0) {
+        stats_print(&ss->stats);
+        count = ss->list.count;
+    } else if (strcmp(cmd, "reload") == 0) {
+        rc = job_start(ss, c, cmd, id, NULL, err, sizeof(err));
+        if (rc == 0) {
+            ss->current = NULL;
+            return;
+        }
+    } else if (strcmp(cmd, "shutdown") == 0) {
+        ss->quit = 1;
+    } else if (strcmp(cmd, "query") == 0 || strcmp(cmd, "plan") == 0 || strcmp(cmd, "simulate") == 0 ||
+               strcmp(cmd, "export") == 0) {
+        rc = request_options(ss, fields, n, &ro, err, sizeof(err));
+        if (rc == 0 && strcmp(cmd, "export") == 0) {
+            rc = job_start(ss, c, cmd, id, &ro, err, sizeof(err));
+            if (rc == 0) {
+                ss->current = NULL;
+                return;
+            }
+        } else if (rc == 0 && strcmp(cmd, "query") == 0) {
+            cmd_query(ss, &ro, field_get(fields, n, "limit"), &count);
+        } else if (rc == 0) {
+            cmd_plan(ss, &ro, strcmp(cmd, "simulate") == 0, &count);
+        }
+        cli_free(&ro);
+    } else {
+        snprintf(err, sizeof(err), "comando desconhecido: %s", cmd);
+        rc = -1;
+    }
+    log_event_result(id, cmd, rc != 0 ? err : NULL, count, now_ms() - start);
+    ss->current = NULL;
+}
+
+static void client_read(ServeState *ss, ServeClient *c) {
+    ssize_t got = read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+    char *line;
+    char *nl;
+
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        c->dead = 1;
+        return;
+    }
+    if (got < 0) return;
+    c->len += (size_t)got;
+    c->buf[c->len] = '\0';
+    line = c->buf;
+    while (!c->dead && !ss->quit && (nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        if (line[0] && line[0] != '\r') handle_line(ss, c, line);
+        line = nl + 1;
+    }
+    c->len -= (size_t)(line - c->buf);
+    memmove(c->buf, line, c->len);
+    if (c->len == sizeof(c->buf) - 1) {
+        ss->current = c;
+        log_event_result(NULL, "", "requisicao longa demais", 0, 0.0);
+        ss->current = NULL;
+        c->len = 0;
+    }
+}
+
+static void accept_client(ServeState *ss) {
+    int fd = accept(ss->listen_fd, NULL, NULL);
+    ServeClient *c;
+
+    if (fd < 0) return;
+    if (ss->client_count >= SERVE_MAX_CLIENTS || (c = (ServeClient *)calloc(1, sizeof(ServeClient))) == NULL) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    c->fd = fd;
+    pthread_mutex_lock(&ss->clients_lock);
+    ss->clients[ss->client_count++] = c;
+    pthread_mutex_unlock(&ss->clients_lock);
+}
+
+static void reap_clients(ServeState *ss) {
+    size_t n = 0;
+    pthread_mutex_lock(&ss->clients_lock);
+    for (size_t i = 0; i < ss->client_count; ++i) {
+        ServeClient *c = ss->clients[i];
+        if (c->dead && c != ss->job.client) {
+            close(c->fd);
+            free(c);
+            continue;
+        }
+        ss->clients[n++] = c;
+    }
+    ss->client_count = n;
+    pthread_mutex_unlock(&ss->clients_lock);
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        progress_log(LVL_ERROR, "serve: caminho de socket longo demais: %s", path);
+        return -1;
+    }
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            progress_log(LVL_ERROR, "serve: %s existe e nao e um socket", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path, 0600) != 0 || listen(fd, 16) != 0) {
+        progress_log(LVL_ERROR, "serve: falha ao abrir %s (%s)", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+int serve_run(const CliOptions *opts, int argc, char **argv) {
+    ServeState ss;
+    struct sigaction sa;
+    double start = now_ms();
+    int rc;
+
+    memset(&ss, 0, sizeof(ss));
+    ss.opts = opts;
+    ss.argc = argc;
+    ss.argv = argv;
+    ss.main_thread = pthread_self();
+    log_set_output(OUTPUT_JSON);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    ss.listen_fd = open_socket(opts->serve);
+    if (ss.listen_fd < 0) return 5;
+    rc = load_list(opts, &ss.list, &ss.stats);
+    if (rc == 0 && pipe(ss.job_pipe) != 0) rc = 5;
+    if (rc != 0) {
+        tracklist_free(&ss.list);
+        close(ss.listen_fd);
+        unlink(opts->serve);
+        return rc;
+    }
+    fcntl(ss.job_pipe[0], F_SETFL, fcntl(ss.job_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(ss.job_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ss.job_pipe[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&ss.clients_lock, NULL);
+    progress_log(LVL_INFO, "serve: %zu faixas indexadas em %.0f ms; escutando em %s", ss.list.count, now_ms() - start,
+                 opts->serve);
+    log_flush();
+    log_set_sink(serve_sink, &ss);
+
+    while (!g_stop && !ss.quit) {
+        struct pollfd pfds[SERVE_MAX_CLIENTS + 2];
+        size_t n = ss.client_count;
+        int prc;
+
+        pfds[0].fd = ss.listen_fd;
+        pfds[1].fd = ss.job_pipe[0];
+        for (size_t i = 0; i < n; ++i) pfds[i + 2].fd = ss.clients[i]->fd;
+        for (size_t i = 0; i < n + 2; ++i) {
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        prc = poll(pfds, n + 2, 1000);
+        if (prc < 0 && errno != EINTR) break;
+        if (prc <= 0) continue;
+        if (pfds[1].revents & POLLIN) job_finish(&ss);
+        for (size_t i = 0; i < n && !ss.quit; ++i) {
+            if (pfds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) client_read(&ss, ss.clients[i]);
+        }
+        if (pfds[0].revents & POLLIN) accept_client(&ss);
+        reap_clients(&ss);
+    }
+
+    job_finish(&ss);
+    log_set_sink(NULL, NULL);
+    for (size_t i = 0; i < ss.client_count; ++i) ss.clients[i]->dead = 1;
+    reap_clients(&ss);
+    pthread_mutex_destroy(&ss.clients_lock);
+    close(ss.job_pipe[0]);
+    close(ss.job_pipe[1]);
+    close(ss.listen_fd);
+    unlink(opts->serve);
+    tracklist_free(&ss.list);
+    progress_log(LVL_INFO, "serve: encerrado");
+    return 0;
+}
+
+#else
+
+int serve_run(const CliOptions *opts, int argc, char **argv) {
+    (void)opts;
+    (void)argc;
+    (void)argv;
+    progress_log(LVL_ERROR, "serve: modo --serve requer sockets Unix");
+    return 5;
+}
+
+#endif
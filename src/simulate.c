@@ -18,23 +18,55 @@ static int cmp_generic(const void *a, const void *b) {
     return strcmp(ta->title, tb->title);
 }
 
-void dedupe_mark(TrackList *list, LibraryStats *stats) {
+typedef struct {
+    uint64_t hash;
+    uint64_t size;
+    int rank;
+    size_t index;
+} DedupeKey;
+
+static int cmp_dedupe_key(const void *a, const void *b) {
+    const DedupeKey *ka = (const DedupeKey *)a;
+    const DedupeKey *kb = (const DedupeKey *)b;
+    if (ka->hash != kb->hash) return ka->hash < kb->hash ? -1 : 1;
+    if (ka->size != kb->size) return ka->size < kb->size ? -1 : 1;
+    if (ka->rank != kb->rank) return ka->rank < kb->rank ? -1 : 1;
+    if (ka->index != kb->index) return ka->index < kb->index ? -1 : 1;
+    return 0;
+}
+
+void dedupe_mark(TrackList *list, int prefer_root, LibraryStats *stats) {
+    DedupeKey *keys;
+    size_t n = 0;
+
+    if (list->count == 0) return;
+    keys = (DedupeKey *)malloc(list->count * sizeof(DedupeKey));
+    if (!keys) return;
     for (size_t i = 0; i < list->count; ++i) {
-        AudioTrack *a = &list->tracks[i];
-        if (a->duplicate) continue;
-        for (size_t j = i + 1; j < list->count; ++j) {
-            AudioTrack *b = &list->tracks[j];
-            if (a->quick_hash == b->quick_hash && a->size_bytes == b->size_bytes) {
-                b->duplicate = 1;
-                stats->removed_duplicates++;
-            }
-        }
+        const AudioTrack *t = &list->tracks[i];
+        if (t->excluded) continue;
+        keys[n].hash = t->quick_hash;
+        keys[n].size = t->size_bytes;
+        keys[n].rank = t->root_index == prefer_root ? -1 : t->root_index;
+        keys[n].index = i;
+        n++;
     }
+    qsort(keys, n, sizeof(DedupeKey), cmp_dedupe_key);
+
+    for (size_t i = 1; i < n; ++i) {
+        AudioTrack *t = &list->tracks[keys[i].index];
+        if (keys[i].hash != keys[i - 1].hash || keys[i].size != keys[i - 1].size) continue;
+        if (t->duplicate) continue;
+        t->duplicate = 1;
+        stats->removed_duplicates++;
+    }
+    free(keys);
 }
 
 void simulate_print(const TrackList *list, SimulateMode mode, LibraryStats *stats) {
     AudioTrack *tmp;
     size_t out_idx = 0;
+    size_t actions[3] = {0, 0, 0};
     if (mode == SIM_NONE) return;
 
     tmp = (AudioTrack *)malloc(list->count * sizeof(AudioTrack));
@@ -47,13 +79,30 @@ void simulate_print(const TrackList *list, SimulateMode mode, LibraryStats *stat
         qsort(tmp, list->count, sizeof(AudioTrack), cmp_generic);
     }
 
-    printf("\nSimulacao de ordem (%s):\n", mode == SIM_GENERIC ? "generic" : (mode == SIM_FAT ? "fat" : "filename"));
+    if (log_json()) {
+        for (size_t i = 0; i < list->count; ++i) {
+            if (!tmp[i].duplicate && !tmp[i].excluded && !tmp[i].unselected && !tmp[i].omitted) log_event_plan(++out_idx, &tmp[i]);
+        }
+        free(tmp);
+        return;
+    }
+
+    progress_log(LVL_TEXT, "\nSimulacao de ordem (%s):", mode == SIM_GENERIC ? "generic" : (mode == SIM_FAT ? "fat" : "filename"));
     for (size_t i = 0; i < list->count; ++i) {
-        if (tmp[i].duplicate) continue;
-        printf("%03zu | %s - %s\n", ++out_idx, tmp[i].artist, tmp[i].title);
+        if (tmp[i].duplicate || tmp[i].excluded || tmp[i].unselected || tmp[i].omitted) continue;
+        if (tmp[i].decision[0]) {
+            progress_log(LVL_TEXT, "%03zu | %s - %s  [%s]", ++out_idx, tmp[i].artist, tmp[i].title, tmp[i].decision);
+            actions[tmp[i].convert]++;
+        } else {
+            progress_log(LVL_TEXT, "%03zu | %s - %s", ++out_idx, tmp[i].artist, tmp[i].title);
+        }
     }
-    printf("Total de faixas: %zu\n", out_idx);
-    printf("Duracao total (estimada): %llus\n", (unsigned long long)stats->total_duration);
+    progress_log(LVL_TEXT, "Total de faixas: %zu", out_idx);
+    if (actions[CONV_SKIP] + actions[CONV_REENCODE] + actions[CONV_REMUX] > 0) {
+        progress_log(LVL_TEXT, "Conversao: %zu copiar, %zu remux, %zu recodificar", actions[CONV_SKIP],
+                     actions[CONV_REMUX], actions[CONV_REENCODE]);
+    }
+    progress_log(LVL_TEXT, "Duracao total (estimada): %llus", (unsigned long long)stats->total_duration);
 
     free(tmp);
 }
@@ -61,24 +110,23 @@ void simulate_print(const TrackList *list, SimulateMode mode, LibraryStats *stat
 void diagnostics_print(const TrackList *list) {
     for (size_t i = 0; i < list->count; ++i) {
         const AudioTrack *t = &list->tracks[i];
-        if (t->duplicate) continue;
-        if (strlen(t->filename) > 64) {
-            printf("[WARN] nome longo: %s\n", t->filename);
-        }
-        if (strpbrk(t->filename, "<>:\\|?*\"")) {
-            printf("[WARN] caracteres invalidos: %s\n", t->filename);
-        }
-        if (t->artist[0] == '\0' || t->title[0] == '\0') {
-            printf("[WARN] tags ausentes: %s\n", t->filename);
-        }
+        if (t->duplicate || t->excluded || t->unselected || t->omitted) continue;
+        if (strlen(t->filename) > 64) log_track_issue(LVL_WARN, t->filename, "nome longo");
+        if (strpbrk(t->filename, "<>:\\|?*\"")) log_track_issue(LVL_WARN, t->filename, "caracteres invalidos");
+        if (t->artist[0] == '\0' || t->title[0] == '\0') log_track_issue(LVL_WARN, t->filename, "tags ausentes");
     }
+    log_flush_issues();
 }
 
 void stats_print(const LibraryStats *stats) {
-    printf("\nEstatisticas:\n");
-    printf("Tracks: %zu\n", stats->total_tracks);
-    printf("Duration: %llus\n", (unsigned long long)stats->total_duration);
-    printf("Formats: MP3(%zu) FLAC(%zu) WAV(%zu) AAC(%zu) M4A(%zu) OGG(%zu) WMA(%zu)\n",
+    if (log_json()) {
+        log_event_stats(stats);
+        return;
+    }
+    progress_log(LVL_TEXT, "\nEstatisticas:");
+    progress_log(LVL_TEXT, "Tracks: %zu", stats->total_tracks);
+    progress_log(LVL_TEXT, "Duration: %llus", (unsigned long long)stats->total_duration);
+    progress_log(LVL_TEXT, "Formats: MP3(%zu) FLAC(%zu) WAV(%zu) AAC(%zu) M4A(%zu) OGG(%zu) WMA(%zu)",
            stats->format_count[FORMAT_MP3],
            stats->format_count[FORMAT_FLAC],
            stats->format_count[FORMAT_WAV],
@@ -86,5 +134,5 @@ void stats_print(const LibraryStats *stats) {
            stats->format_count[FORMAT_M4A],
            stats->format_count[FORMAT_OGG],
            stats->format_count[FORMAT_WMA]);
-    printf("Duplicates removed: %zu\n", stats->removed_duplicates);
+    progress_log(LVL_TEXT, "Duplicates removed: %zu", stats->removed_duplicates);
 }
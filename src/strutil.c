@@ -0,0 +1,46 @@
+#include "cartag.h"
+
+#include <string.h>
+
+void str_copy(char *dst, size_t dst_sz, const char *src) {
+    size_t n;
+    if (!dst || dst_sz == 0) return;
+    if (!src) {
+        dst[0] = '\0';
+        return;
+    }
+    n = strlen(src);
+    if (n >= dst_sz) n = dst_sz - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+void str_append(char *dst, size_t dst_sz, const char *src) {
+    size_t dlen;
+    size_t slen;
+    size_t n;
+    if (!dst || dst_sz == 0 || !src) return;
+    dlen = strlen(dst);
+    if (dlen >= dst_sz - 1) return;
+    slen = strlen(src);
+    n = dst_sz - dlen - 1;
+    if (slen < n) n = slen;
+    memcpy(dst + dlen, src, n);
+    dst[dlen + n] = '\0';
+}
+
+void path_join2(char *dst, size_t dst_sz, const char *a, const char *b) {
+    size_t la;
+    size_t lb;
+    if (!dst || dst_sz == 0) return;
+    if (!a) a = "";
+    if (!b) b = "";
+    la = strlen(a);
+    if (la >= dst_sz) la = dst_sz - 1;
+    memcpy(dst, a, la);
+    if (la + 1 < dst_sz) dst[la++] = '/';
+    lb = strlen(b);
+    if (lb > dst_sz - 1 - la) lb = dst_sz - 1 - la;
+    memcpy(dst + la, b, lb);
+    dst[la + lb] = '\0';
+}
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cartag.h"
 
 #include <stdio.h>
@@ -7,17 +9,77 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <pthread.h>
 #include <ncurses.h>
 #endif
 
 #ifndef _WIN32
 
+#define TUI_POLL_MS 100
+#define TUI_RUN_POLL_MS 50
+#define TUI_IDLE_POLL_MS 1000
+#define RUN_LOG_LINES 256
+
+typedef struct {
+    pthread_mutex_t lock;
+    TrackList pending;
+    char root[CARTAG_PATH_MAX];
+    size_t found;
+    int cancel;
+    int done;
+    int rc;
+    int refs;
+} ScanJob;
+
 typedef struct {
     TrackList list;
     size_t selected;
     size_t scroll;
+    ScanJob *job;
+    double scan_started;
+    double scan_rate;
+    SearchIndex search;
+    int search_mode;
+    char search_buf[128];
+    unsigned generation;
 } PreviewState;
 
+typedef struct {
+    pthread_t thread;
+    ProgressQueue *queue;
+    PipelineCache *cache;
+    CliOptions opts;
+    int active;
+    int visible;
+    int cancelling;
+    int rc;
+    PipelineStage stage;
+    size_t done;
+    size_t total;
+    uint64_t bytes;
+    uint64_t est_bytes;
+    double est_rate;
+    double stage_started;
+    double now;
+    char detail[200];
+    char log[RUN_LOG_LINES][200];
+    LogLevel log_level[RUN_LOG_LINES];
+    size_t log_count;
+} RunState;
+
+typedef enum { PANEL_MENU = 0, PANEL_FILES, PANEL_UTILS, PANEL_STATUS, PANEL_COUNT } UiPanel;
+
+typedef struct {
+    WINDOW *win[PANEL_COUNT];
+    uint64_t sig[PANEL_COUNT];
+    int lines;
+    int cols;
+    int files_h;
+    int util_h;
+    long minute;
+    char clock[8];
+} Screen;
+
 typedef enum { FOCUS_FILES = 0, FOCUS_UTILS = 1 } UiFocus;
 typedef enum { TAB_FILE = 0, TAB_OPTIONS, TAB_VIEW, TAB_TREE, TAB_HELP, TAB_COUNT } UiTab;
 
@@ -79,19 +141,127 @@ static const ActionId k_tab_actions[TAB_COUNT][8] = {
     {ACT_SET_URL, ACT_INSTALL_YTDLP, ACT_DOWNLOAD_URL, ACT_COUNT, ACT_COUNT, ACT_COUNT, ACT_COUNT, ACT_COUNT}
 };
 
-static void str_copy(char *dst, size_t dst_sz, const char *src) {
-    size_t n;
-    if (!dst || dst_sz == 0) return;
-    if (!src) { dst[0] = '\0'; return; }
-    n = strlen(src);
-    if (n >= dst_sz) n = dst_sz - 1;
-    memcpy(dst, src, n);
-    dst[n] = '\0';
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void scan_job_release(ScanJob *job) {
+    int last;
+    pthread_mutex_lock(&job->lock);
+    last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last) return;
+    tracklist_free(&job->pending);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+static int scan_job_push(void *ctx, const AudioTrack *track) {
+    ScanJob *job = (ScanJob *)ctx;
+    int cancel;
+    pthread_mutex_lock(&job->lock);
+    cancel = job->cancel;
+    if (!cancel && tracklist_push(&job->pending, track) == 0) job->found++;
+    pthread_mutex_unlock(&job->lock);
+    return cancel;
+}
+
+static int scan_job_cancelled(void *ctx) {
+    ScanJob *job = (ScanJob *)ctx;
+    int cancel;
+    pthread_mutex_lock(&job->lock);
+    cancel = job->cancel;
+    pthread_mutex_unlock(&job->lock);
+    return cancel;
+}
+
+static void *scan_job_main(void *arg) {
+    ScanJob *job = (ScanJob *)arg;
+    int rc = fs_scan_audio_until(job->root, scan_job_push, scan_job_cancelled, job);
+    pthread_mutex_lock(&job->lock);
+    job->rc = rc;
+    job->done = 1;
+    pthread_mutex_unlock(&job->lock);
+    scan_job_release(job);
+    return NULL;
+}
+
+static void preview_cancel_scan(PreviewState *pv) {
+    if (!pv->job) return;
+    pthread_mutex_lock(&pv->job->lock);
+    pv->job->cancel = 1;
+    pthread_mutex_unlock(&pv->job->lock);
+    scan_job_release(pv->job);
+    pv->job = NULL;
 }
 
 static void preview_free(PreviewState *pv) {
+    unsigned generation = pv->generation + 1;
+    preview_cancel_scan(pv);
+    search_index_free(&pv->search);
     free(pv->list.tracks);
     memset(pv, 0, sizeof(*pv));
+    pv->generation = generation;
+}
+
+static int preview_scanning(const PreviewState *pv) {
+    return pv->job != NULL;
+}
+
+static void preview_scan_start(const CliOptions *opts, PreviewState *pv) {
+    ScanJob *job;
+    pthread_t th;
+
+    preview_free(pv);
+    if (opts->input[0] == '\0' || downloader_is_url(opts->input)) return;
+
+    job = (ScanJob *)calloc(1, sizeof(*job));
+    if (!job) return;
+    pthread_mutex_init(&job->lock, NULL);
+    str_copy(job->root, sizeof(job->root), opts->input);
+    job->refs = 2;
+    if (pthread_create(&th, NULL, scan_job_main, job) != 0) {
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+        return;
+    }
+    pthread_detach(th);
+    pv->job = job;
+    pv->scan_started = now_seconds();
+}
+
+static int preview_poll_scan(PreviewState *pv, char *msg, size_t msg_sz) {
+    TrackList batch;
+    double elapsed;
+    int done;
+    int rc;
+
+    if (!pv->job) return 0;
+    pthread_mutex_lock(&pv->job->lock);
+    batch = pv->job->pending;
+    memset(&pv->job->pending, 0, sizeof(pv->job->pending));
+    done = pv->job->done;
+    rc = pv->job->rc;
+    pthread_mutex_unlock(&pv->job->lock);
+
+    for (size_t i = 0; i < batch.count; ++i) tracklist_push(&pv->list, &batch.tracks[i]);
+    tracklist_free(&batch);
+    search_index_sync(&pv->search, &pv->list);
+
+    elapsed = now_seconds() - pv->scan_started;
+    pv->scan_rate = elapsed > 0.0 ? (double)pv->list.count / elapsed : 0.0;
+
+    if (done) {
+        scan_job_release(pv->job);
+        pv->job = NULL;
+        if (rc != 0) snprintf(msg, msg_sz, "Falha ao escanear: %s", pv->list.count ? "parcial" : "entrada invalida");
+        else snprintf(msg, msg_sz, "Lista atualizada: %zu faixas em %.1fs.", pv->list.count, elapsed);
+    } else {
+        snprintf(msg, msg_sz, "Escaneando... %zu faixas (%.0f arq/s)  ESC cancela", pv->list.count, pv->scan_rate);
+    }
+    return 1;
 }
 
 static void preview_load(const CliOptions *opts, PreviewState *pv) {
@@ -112,6 +282,59 @@ static void preview_load(const CliOptions *opts, PreviewState *pv) {
     pv->scroll = 0;
 }
 
+static void preview_set_query(PreviewState *pv) {
+    search_set_query(&pv->search, pv->search_buf);
+    pv->selected = 0;
+    pv->scroll = 0;
+}
+
+static int files_visible_rows(WINDOW *win) {
+    int rows = win ? getmaxy(win) - 3 : 1;
+    return rows > 0 ? rows : 1;
+}
+
+static void preview_move(PreviewState *pv, WINDOW *win, long delta) {
+    size_t n = pv->search.view_count;
+    size_t rows = (size_t)files_visible_rows(win);
+    if (n == 0) {
+        pv->selected = 0;
+        pv->scroll = 0;
+        return;
+    }
+    if (delta < 0 && (size_t)(-delta) > pv->selected) pv->selected = 0;
+    else if (delta > 0 && pv->selected + (size_t)delta >= n) pv->selected = n - 1;
+    else pv->selected = (size_t)((long)pv->selected + delta);
+    if (pv->selected >= n) pv->selected = n - 1;
+    if (pv->selected < pv->scroll) pv->scroll = pv->selected;
+    if (pv->selected >= pv->scroll + rows) pv->scroll = pv->selected - rows + 1;
+}
+
+static int preview_search_key(PreviewState *pv, int ch) {
+    size_t len = strlen(pv->search_buf);
+    if (ch == 27) {
+        pv->search_mode = 0;
+        pv->search_buf[0] = '\0';
+        preview_set_query(pv);
+        return 1;
+    }
+    if (ch == 10 || ch == KEY_ENTER) {
+        pv->search_mode = 0;
+        return 1;
+    }
+    if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+        if (len > 0) pv->search_buf[len - 1] = '\0';
+        preview_set_query(pv);
+        return 1;
+    }
+    if (ch >= 32 && ch < 256 && len + 1 < sizeof(pv->search_buf)) {
+        pv->search_buf[len] = (char)ch;
+        pv->search_buf[len + 1] = '\0';
+        preview_set_query(pv);
+        return 1;
+    }
+    return 0;
+}
+
 static void init_colors_if_possible(void) {
     if (!has_colors()) return;
     start_color();
@@ -123,17 +346,18 @@ static void init_colors_if_possible(void) {
     init_pair(5, COLOR_YELLOW, -1);
 }
 
-static int prompt_line(const char *label, char *out, size_t out_sz) {
-    int y = LINES - 2;
+static int prompt_line(WINDOW *win, const char *label, char *out, size_t out_sz) {
     int rc;
-    move(y, 0);
-    clrtoeol();
-    attron(COLOR_PAIR(3));
-    mvprintw(y, 0, "%s", label);
-    attroff(COLOR_PAIR(3));
+    if (!win) return -1;
+    wmove(win, 0, 0);
+    wclrtoeol(win);
+    wattron(win, COLOR_PAIR(3));
+    mvwprintw(win, 0, 0, "%s", label);
+    wattroff(win, COLOR_PAIR(3));
     echo();
     curs_set(1);
-    rc = getnstr(out, (int)out_sz - 1);
+    wtimeout(win, -1);
+    rc = wgetnstr(win, out, (int)out_sz - 1);
     noecho();
     curs_set(0);
     return rc == ERR ? -1 : 0;
@@ -161,153 +385,459 @@ static const char *organize_name(OrganizeMode m) {
     }
 }
 
-static void draw_ui(const CliOptions *opts,
-                    const PreviewState *pv,
-                    UiFocus focus,
-                    UiTab tab_sel,
-                    int util_sel,
-                    const char *msg) {
-    int w = COLS;
-    int h = LINES;
-    int files_top = 4;
-    int files_h = (h >= 28) ? 12 : 9;
-    int util_top = files_top + files_h;
-    int util_h = h - util_top - 2;
-    int left_w = w / 2;
-    int right_w = w - left_w;
-    int file_rows = files_h - 3;
-    int util_rows = util_h - 2;
-    int util_count = get_tab_item_count(tab_sel);
-    int i;
+static uint64_t sig_mix(uint64_t h, const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t sig_str(uint64_t h, const char *s) {
+    return sig_mix(h, s, strlen(s) + 1);
+}
+
+static void screen_destroy(Screen *scr) {
+    for (int i = 0; i < PANEL_COUNT; ++i) {
+        if (scr->win[i]) delwin(scr->win[i]);
+        scr->win[i] = NULL;
+        scr->sig[i] = 0;
+    }
+}
+
+static void screen_layout(Screen *scr) {
+    int files_h = (LINES >= 28) ? 12 : 9;
+    int util_top = 4 + files_h;
+    int util_h = LINES - util_top - 2;
+
+    screen_destroy(scr);
+    scr->lines = LINES;
+    scr->cols = COLS;
+    scr->files_h = files_h;
+    scr->util_h = util_h;
+    scr->win[PANEL_MENU] = newwin(4, COLS, 0, 0);
+    scr->win[PANEL_FILES] = newwin(files_h, COLS, 4, 0);
+    scr->win[PANEL_UTILS] = util_h > 2 ? newwin(util_h, COLS, util_top, 0) : NULL;
+    scr->win[PANEL_STATUS] = newwin(2, COLS, LINES - 2, 0);
+    if (scr->win[PANEL_STATUS]) keypad(scr->win[PANEL_STATUS], TRUE);
+}
+
+static void draw_menu(WINDOW *win, const CliOptions *opts, UiFocus focus, UiTab tab_sel) {
+    int w = getmaxx(win);
     char line[256];
-    char timebuf[16];
-    time_t now = time(NULL);
-    struct tm *tmv = localtime(&now);
-
-    erase();
-
-    attron(COLOR_PAIR(1));
-    mvhline(0, 0, ' ', w);
-    mvprintw(0, 1, "%s  %s  %s  %s  %s",
-             tab_sel == TAB_FILE ? "[File]" : k_tabs[TAB_FILE],
-             tab_sel == TAB_OPTIONS ? "[Options]" : k_tabs[TAB_OPTIONS],
-             tab_sel == TAB_VIEW ? "[View]" : k_tabs[TAB_VIEW],
-             tab_sel == TAB_TREE ? "[Tree]" : k_tabs[TAB_TREE],
-             tab_sel == TAB_HELP ? "[Help]" : k_tabs[TAB_HELP]);
-    mvprintw(0, w - 16, "MS-DOS Shell");
-    attroff(COLOR_PAIR(1));
-
-    attron(COLOR_PAIR(2));
-    mvhline(1, 0, ' ', w);
-    mvprintw(1, 1, "Drives: [A:] [B:] [C:] [D:] [E:] [F:] [G:]");
-    mvprintw(1, w - 11, "Cartag UI");
-    mvhline(2, 0, ' ', w);
-    mvprintw(2, 1, "%s", k_submenus[(int)tab_sel]);
-    attroff(COLOR_PAIR(2));
-
-    mvhline(3, 0, ACS_HLINE, w);
-    mvprintw(3, 2, "Directory Tree");
+
+    werase(win);
+    wattron(win, COLOR_PAIR(1));
+    mvwhline(win, 0, 0, ' ', w);
+    mvwprintw(win, 0, 1, "%s  %s  %s  %s  %s",
+              tab_sel == TAB_FILE ? "[File]" : k_tabs[TAB_FILE],
+              tab_sel == TAB_OPTIONS ? "[Options]" : k_tabs[TAB_OPTIONS],
+              tab_sel == TAB_VIEW ? "[View]" : k_tabs[TAB_VIEW],
+              tab_sel == TAB_TREE ? "[Tree]" : k_tabs[TAB_TREE],
+              tab_sel == TAB_HELP ? "[Help]" : k_tabs[TAB_HELP]);
+    mvwprintw(win, 0, w - 16, "MS-DOS Shell");
+    wattroff(win, COLOR_PAIR(1));
+
+    wattron(win, COLOR_PAIR(2));
+    mvwhline(win, 1, 0, ' ', w);
+    mvwprintw(win, 1, 1, "Drives: [A:] [B:] [C:] [D:] [E:] [F:] [G:]");
+    mvwprintw(win, 1, w - 11, "Cartag UI");
+    mvwhline(win, 2, 0, ' ', w);
+    mvwprintw(win, 2, 1, "%s", k_submenus[(int)tab_sel]);
+    wattroff(win, COLOR_PAIR(2));
+
+    mvwhline(win, 3, 0, ACS_HLINE, w);
+    mvwprintw(win, 3, 2, "Directory Tree");
     snprintf(line, sizeof(line), "input=%-.21s export=%-.14s org=%s focus=%s",
              opts->input[0] ? opts->input : "(not set)",
              opts->export_path[0] ? opts->export_path : "(not set)",
              organize_name(opts->organize),
              k_focus_name[(int)focus]);
-    mvprintw(3, left_w + 2, "%s", line);
+    mvwprintw(win, 3, w / 2 + 2, "%s", line);
+}
 
-    mvaddch(files_top, 0, ACS_ULCORNER);
-    mvhline(files_top, 1, ACS_HLINE, left_w - 1);
-    mvaddch(files_top, left_w, ACS_TTEE);
-    mvhline(files_top, left_w + 1, ACS_HLINE, right_w - 2);
-    mvaddch(files_top, w - 1, ACS_URCORNER);
+static void draw_files(WINDOW *win, const CliOptions *opts, const PreviewState *pv, UiFocus focus) {
+    int w = getmaxx(win);
+    int files_h = getmaxy(win);
+    int left_w = w / 2;
+    int right_w = w - left_w;
+    int file_rows = files_h - 3;
+    int i;
+    char line[256];
+
+    werase(win);
+    mvwaddch(win, 0, 0, ACS_ULCORNER);
+    mvwhline(win, 0, 1, ACS_HLINE, left_w - 1);
+    mvwaddch(win, 0, left_w, ACS_TTEE);
+    mvwhline(win, 0, left_w + 1, ACS_HLINE, right_w - 2);
+    mvwaddch(win, 0, w - 1, ACS_URCORNER);
 
     for (i = 1; i < files_h - 1; ++i) {
-        mvaddch(files_top + i, 0, ACS_VLINE);
-        mvaddch(files_top + i, left_w, ACS_VLINE);
-        mvaddch(files_top + i, w - 1, ACS_VLINE);
+        mvwaddch(win, i, 0, ACS_VLINE);
+        mvwaddch(win, i, left_w, ACS_VLINE);
+        mvwaddch(win, i, w - 1, ACS_VLINE);
     }
 
-    mvaddch(files_top + files_h - 1, 0, ACS_LLCORNER);
-    mvhline(files_top + files_h - 1, 1, ACS_HLINE, left_w - 1);
-    mvaddch(files_top + files_h - 1, left_w, ACS_BTEE);
-    mvhline(files_top + files_h - 1, left_w + 1, ACS_HLINE, right_w - 2);
-    mvaddch(files_top + files_h - 1, w - 1, ACS_LRCORNER);
+    mvwaddch(win, files_h - 1, 0, ACS_LLCORNER);
+    mvwhline(win, files_h - 1, 1, ACS_HLINE, left_w - 1);
+    mvwaddch(win, files_h - 1, left_w, ACS_BTEE);
+    mvwhline(win, files_h - 1, left_w + 1, ACS_HLINE, right_w - 2);
+    mvwaddch(win, files_h - 1, w - 1, ACS_LRCORNER);
 
-    mvprintw(files_top + 1, 2, "> C:\\");
-    mvprintw(files_top + 2, 4, "%s", opts->organize == ORG_GENRE_ARTIST ? "GENRE" : "ARTIST");
-    mvprintw(files_top + 3, 4, "ALBUM");
+    mvwprintw(win, 1, 2, "> C:\\");
+    mvwprintw(win, 2, 4, "%s", opts->organize == ORG_GENRE_ARTIST ? "GENRE" : "ARTIST");
+    mvwprintw(win, 3, 4, "ALBUM");
+
+    if (pv->search_mode || pv->search_buf[0]) {
+        snprintf(line, sizeof(line), " /%s%s (%zu/%zu) ",
+                 pv->search_buf, pv->search_mode ? "_" : "", pv->search.view_count, pv->list.count);
+        mvwprintw(win, 0, left_w + 2, "%-.*s", right_w - 4, line);
+    }
 
     for (i = 0; i < file_rows; ++i) {
-        size_t idx = pv->scroll + (size_t)i;
-        int y = files_top + 1 + i;
-        if (idx < pv->list.count) {
+        size_t row = pv->scroll + (size_t)i;
+        if (row < pv->search.view_count) {
+            size_t idx = pv->search.view[row];
             const AudioTrack *t = &pv->list.tracks[idx];
             snprintf(line, sizeof(line), "%c %03zu %-24.24s %-4s %8llu",
-                     idx == pv->selected ? '>' : ' ', idx + 1, t->filename,
+                     row == pv->selected ? '>' : ' ', idx + 1, t->filename,
                      audio_format_name(t->format), (unsigned long long)t->size_bytes);
-            if (focus == FOCUS_FILES && idx == pv->selected) attron(A_REVERSE);
-            mvprintw(y, left_w + 2, "%-*.*s", right_w - 4, right_w - 4, line);
-            if (focus == FOCUS_FILES && idx == pv->selected) attroff(A_REVERSE);
+            if (focus == FOCUS_FILES && row == pv->selected) wattron(win, A_REVERSE);
+            mvwprintw(win, 1 + i, left_w + 2, "%-*.*s", right_w - 4, right_w - 4, line);
+            if (focus == FOCUS_FILES && row == pv->selected) wattroff(win, A_REVERSE);
         }
     }
+}
 
-    mvaddch(util_top, 0, ACS_ULCORNER);
-    mvhline(util_top, 1, ACS_HLINE, w - 2);
-    mvaddch(util_top, w - 1, ACS_URCORNER);
-    mvprintw(util_top, 2, "Command Menu");
+static void draw_box(WINDOW *win, const char *title) {
+    int w = getmaxx(win);
+    int h = getmaxy(win);
 
-    for (i = 1; i < util_h - 1; ++i) {
-        mvaddch(util_top + i, 0, ACS_VLINE);
-        mvaddch(util_top + i, w - 1, ACS_VLINE);
+    werase(win);
+    mvwaddch(win, 0, 0, ACS_ULCORNER);
+    mvwhline(win, 0, 1, ACS_HLINE, w - 2);
+    mvwaddch(win, 0, w - 1, ACS_URCORNER);
+    mvwprintw(win, 0, 2, "%s", title);
+    for (int i = 1; i < h - 1; ++i) {
+        mvwaddch(win, i, 0, ACS_VLINE);
+        mvwaddch(win, i, w - 1, ACS_VLINE);
     }
+    mvwaddch(win, h - 1, 0, ACS_LLCORNER);
+    mvwhline(win, h - 1, 1, ACS_HLINE, w - 2);
+    mvwaddch(win, h - 1, w - 1, ACS_LRCORNER);
+}
 
-    mvaddch(util_top + util_h - 1, 0, ACS_LLCORNER);
-    mvhline(util_top + util_h - 1, 1, ACS_HLINE, w - 2);
-    mvaddch(util_top + util_h - 1, w - 1, ACS_LRCORNER);
+static void draw_utils(WINDOW *win, UiFocus focus, UiTab tab_sel, int util_sel) {
+    int w = getmaxx(win);
+    int util_rows = getmaxy(win) - 2;
+    int util_count = get_tab_item_count(tab_sel);
 
-    for (i = 0; i < util_rows && i < util_count; ++i) {
+    draw_box(win, "Command Menu");
+    for (int i = 0; i < util_rows && i < util_count; ++i) {
         ActionId aid = get_tab_action(tab_sel, i);
-        int y = util_top + 1 + i;
-        if (focus == FOCUS_UTILS && i == util_sel) attron(A_REVERSE);
-        mvprintw(y, 2, "%c %-*.*s", i == util_sel ? '>' : ' ', w - 6, w - 6, k_action_labels[(int)aid]);
-        if (focus == FOCUS_UTILS && i == util_sel) attroff(A_REVERSE);
+        if (focus == FOCUS_UTILS && i == util_sel) wattron(win, A_REVERSE);
+        mvwprintw(win, 1 + i, 2, "%c %-*.*s", i == util_sel ? '>' : ' ', w - 6, w - 6, k_action_labels[(int)aid]);
+        if (focus == FOCUS_UTILS && i == util_sel) wattroff(win, A_REVERSE);
+    }
+}
+
+static void format_clock(char *out, size_t out_sz, double seconds) {
+    int s = seconds > 0.0 ? (seconds < 359999.0 ? (int)seconds : 359999) : 0;
+    if (s >= 3600) snprintf(out, out_sz, "%d:%02d:%02d", s / 3600, (s / 60) % 60, s % 60);
+    else snprintf(out, out_sz, "%02d:%02d", s / 60, s % 60);
+}
+
+static void draw_progress(WINDOW *win, const RunState *run) {
+    int w = getmaxx(win);
+    int rows = getmaxy(win) - 2;
+    int bar_w = w - 6;
+    int filled = 0;
+    int log_rows = rows - 4;
+    double elapsed = run->now - run->stage_started;
+    double mbps = elapsed > 0.0 ? (double)run->bytes / (1024.0 * 1024.0) / elapsed : 0.0;
+    char eta[32];
+    char line[256];
+
+    if (run->active && run->est_bytes > run->bytes && run->est_rate > 0.0) {
+        double rate = elapsed >= 3.0 && run->bytes > 0 ? (double)run->bytes / elapsed : run->est_rate;
+        format_clock(eta, sizeof(eta), (double)(run->est_bytes - run->bytes) / rate);
+    } else if (run->active && run->total > 0 && run->done > 0 && run->done < run->total) {
+        format_clock(eta, sizeof(eta), elapsed * (double)(run->total - run->done) / (double)run->done);
+    } else {
+        str_copy(eta, sizeof(eta), "--:--");
     }
 
-    attron(COLOR_PAIR(2));
-    mvhline(h - 1, 0, ' ', w);
-    if (tmv) strftime(timebuf, sizeof(timebuf), "%H:%M", tmv); else str_copy(timebuf, sizeof(timebuf), "--:--");
-    mvprintw(h - 1, 1, "F10=Actions  Shift+F9=Command Prompt  TAB=Switch  ESC=Exit");
-    mvprintw(h - 1, w - 6, "%5s", timebuf);
-    attroff(COLOR_PAIR(2));
+    if (run->active) draw_box(win, run->cancelling ? "Pipeline (cancelando...)" : "Pipeline  ESC=Cancelar");
+    else draw_box(win, run->rc == 0 ? "Pipeline concluido  (tecla fecha)" : "Pipeline com erro  (tecla fecha)");
 
-    attron(COLOR_PAIR(5));
-    mvhline(h - 2, 0, ' ', w);
-    mvprintw(h - 2, 0, "C:\\CARTAG> %-*.*s", w - 12, w - 12, msg ? msg : "");
-    attroff(COLOR_PAIR(5));
+    if (run->total > 0) {
+        snprintf(line, sizeof(line), "Etapa: %-12s %zu/%zu faixas   %.1f MB/s   ETA %s",
+                 progress_stage_name(run->stage), run->done, run->total, mbps, eta);
+    } else {
+        snprintf(line, sizeof(line), "Etapa: %-12s %zu faixas   %.1f MB/s",
+                 progress_stage_name(run->stage), run->done, mbps);
+    }
+    mvwprintw(win, 1, 2, "%-*.*s", w - 4, w - 4, line);
 
-    refresh();
+    if (run->total > 0 && bar_w > 0) filled = (int)((double)bar_w * (double)run->done / (double)run->total);
+    if (filled > bar_w) filled = bar_w;
+    if (bar_w > 0) {
+        mvwaddch(win, 2, 2, '[');
+        wattron(win, COLOR_PAIR(4));
+        if (filled > 0) mvwhline(win, 2, 3, ' ', filled);
+        wattroff(win, COLOR_PAIR(4));
+        mvwaddch(win, 2, 3 + bar_w, ']');
+    }
+
+    mvwprintw(win, 3, 2, "%-*.*s", w - 4, w - 4, run->detail);
+
+    if (log_rows <= 0) return;
+    for (int i = 0; i < log_rows; ++i) {
+        size_t n = run->log_count < (size_t)log_rows ? run->log_count : (size_t)log_rows;
+        size_t first = run->log_count - n;
+        size_t idx;
+        if ((size_t)i >= n) break;
+        idx = (first + (size_t)i) % RUN_LOG_LINES;
+        if (run->log_level[idx] == LVL_WARN) wattron(win, COLOR_PAIR(5));
+        if (run->log_level[idx] == LVL_ERROR) wattron(win, A_BOLD);
+        mvwprintw(win, 4 + i, 2, "%-*.*s", w - 4, w - 4, run->log[idx]);
+        wattroff(win, COLOR_PAIR(5) | A_BOLD);
+    }
+}
+
+static void draw_status(WINDOW *win, const char *clock_text, const char *msg) {
+    int w = getmaxx(win);
+
+    werase(win);
+    wattron(win, COLOR_PAIR(5));
+    mvwhline(win, 0, 0, ' ', w);
+    mvwprintw(win, 0, 0, "C:\\CARTAG> %-*.*s", w - 12, w - 12, msg ? msg : "");
+    wattroff(win, COLOR_PAIR(5));
+
+    wattron(win, COLOR_PAIR(2));
+    mvwhline(win, 1, 0, ' ', w);
+    mvwprintw(win, 1, 1, "F10=Actions  Shift+F9=Command Prompt  TAB=Switch  /=Search  ESC=Exit");
+    mvwprintw(win, 1, w - 6, "%5s", clock_text);
+    wattroff(win, COLOR_PAIR(2));
+}
+
+static void screen_tick_clock(Screen *scr) {
+    time_t now = time(NULL);
+    long minute = (long)(now / 60);
+    struct tm tmv;
+    if (minute == scr->minute) return;
+    scr->minute = minute;
+    if (localtime_r(&now, &tmv)) strftime(scr->clock, sizeof(scr->clock), "%H:%M", &tmv);
+    else str_copy(scr->clock, sizeof(scr->clock), "--:--");
+}
+
+static void draw_ui(Screen *scr,
+                    const CliOptions *opts,
+                    const PreviewState *pv,
+                    const RunState *run,
+                    UiFocus focus,
+                    UiTab tab_sel,
+                    int util_sel,
+                    const char *msg) {
+    uint64_t sig[PANEL_COUNT];
+    uint64_t base = 1469598103934665603ULL;
+    int any = 0;
+
+    if (scr->lines != LINES || scr->cols != COLS) {
+        screen_layout(scr);
+        clearok(curscr, TRUE);
+    }
+    screen_tick_clock(scr);
+
+    sig[PANEL_MENU] = sig_mix(base, &tab_sel, sizeof(tab_sel));
+    sig[PANEL_MENU] = sig_mix(sig[PANEL_MENU], &focus, sizeof(focus));
+    sig[PANEL_MENU] = sig_mix(sig[PANEL_MENU], &opts->organize, sizeof(opts->organize));
+    sig[PANEL_MENU] = sig_str(sig[PANEL_MENU], opts->input);
+    sig[PANEL_MENU] = sig_str(sig[PANEL_MENU], opts->export_path);
+
+    sig[PANEL_FILES] = sig_mix(base, &pv->generation, sizeof(pv->generation));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &pv->list.count, sizeof(pv->list.count));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &pv->search.view_count, sizeof(pv->search.view_count));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &pv->selected, sizeof(pv->selected));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &pv->scroll, sizeof(pv->scroll));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &pv->search_mode, sizeof(pv->search_mode));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &focus, sizeof(focus));
+    sig[PANEL_FILES] = sig_mix(sig[PANEL_FILES], &opts->organize, sizeof(opts->organize));
+    sig[PANEL_FILES] = sig_str(sig[PANEL_FILES], pv->search_buf);
+
+    if (run->visible) {
+        long second = (long)run->now;
+        sig[PANEL_UTILS] = sig_mix(base ^ 1, &run->stage, sizeof(run->stage));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &run->done, sizeof(run->done));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &run->total, sizeof(run->total));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &run->log_count, sizeof(run->log_count));
+        sig[PANEL_UTILS] = sig_str(sig[PANEL_UTILS], run->detail);
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &run->active, sizeof(run->active));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &run->cancelling, sizeof(run->cancelling));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &second, sizeof(second));
+    } else {
+        sig[PANEL_UTILS] = sig_mix(base, &tab_sel, sizeof(tab_sel));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &util_sel, sizeof(util_sel));
+        sig[PANEL_UTILS] = sig_mix(sig[PANEL_UTILS], &focus, sizeof(focus));
+    }
+
+    sig[PANEL_STATUS] = sig_str(base, msg ? msg : "");
+    sig[PANEL_STATUS] = sig_str(sig[PANEL_STATUS], scr->clock);
+
+    for (int p = 0; p < PANEL_COUNT; ++p) {
+        WINDOW *win = scr->win[p];
+        if (!win || scr->sig[p] == sig[p]) continue;
+        switch ((UiPanel)p) {
+            case PANEL_MENU: draw_menu(win, opts, focus, tab_sel); break;
+            case PANEL_FILES: draw_files(win, opts, pv, focus); break;
+            case PANEL_UTILS:
+                if (run->visible) draw_progress(win, run);
+                else draw_utils(win, focus, tab_sel, util_sel);
+                break;
+            case PANEL_STATUS: draw_status(win, scr->clock, msg); break;
+            default: break;
+        }
+        wnoutrefresh(win);
+        scr->sig[p] = sig[p];
+        any = 1;
+    }
+    if (any) doupdate();
+}
+
+static void *run_main(void *arg) {
+    RunState *run = (RunState *)arg;
+    pipeline_run_cached(&run->opts, run->cache);
+    return NULL;
+}
+
+static void run_log_push(RunState *run, LogLevel level, const char *text) {
+    size_t idx = run->log_count % RUN_LOG_LINES;
+    while (*text == '\n') ++text;
+    str_copy(run->log[idx], sizeof(run->log[idx]), text);
+    run->log_level[idx] = level;
+    run->log_count++;
 }
 
-static int execute_action(ActionId aid, CliOptions *opts, PreviewState *pv, char *msg, size_t msg_sz) {
+static int run_start(RunState *run, const CliOptions *opts) {
+    if (run->active) return -1;
+    run->queue = (ProgressQueue *)calloc(1, sizeof(*run->queue));
+    if (!run->queue) return -1;
+    run->opts = *opts;
+    run->stage = STAGE_IDLE;
+    run->done = 0;
+    run->total = 0;
+    run->bytes = 0;
+    run->est_bytes = 0;
+    run->est_rate = 0.0;
+    run->rc = 0;
+    run->cancelling = 0;
+    run->log_count = 0;
+    run->detail[0] = '\0';
+    run->now = now_seconds();
+    run->stage_started = run->now;
+    progress_attach(run->queue);
+    if (pthread_create(&run->thread, NULL, run_main, run) != 0) {
+        progress_attach(NULL);
+        free(run->queue);
+        run->queue = NULL;
+        return -1;
+    }
+    run->active = 1;
+    run->visible = 1;
+    return 0;
+}
+
+static void run_finish(RunState *run) {
+    pthread_join(run->thread, NULL);
+    progress_finished(run->queue, &run->rc);
+    run->detail[0] = '\0';
+    run->stage = STAGE_DONE;
+    progress_attach(NULL);
+    free(run->queue);
+    run->queue = NULL;
+    run->active = 0;
+}
+
+static int run_poll(RunState *run, CliOptions *opts, char *msg, size_t msg_sz) {
+    ProgressEvent ev;
+    int finished = 0;
+    int exited;
+
+    if (!run->active) return 0;
+    run->now = now_seconds();
+    exited = progress_finished(run->queue, NULL);
+    while (!finished && progress_pop(run->queue, &ev)) {
+        switch (ev.type) {
+            case PEV_STAGE:
+                run->stage = ev.stage;
+                run->total = ev.total;
+                run->done = 0;
+                run->bytes = 0;
+                run->est_bytes = 0;
+                run->stage_started = run->now;
+                run->detail[0] = '\0';
+                break;
+            case PEV_PROGRESS:
+                run->done = ev.done;
+                run->bytes = ev.bytes;
+                break;
+            case PEV_LOG:
+                run_log_push(run, ev.level, ev.text);
+                break;
+            case PEV_DETAIL:
+                str_copy(run->detail, sizeof(run->detail), ev.text);
+                break;
+            case PEV_ESTIMATE:
+                run->est_bytes = ev.bytes;
+                run->est_rate = ev.rate;
+                break;
+            case PEV_DONE:
+                finished = 1;
+                break;
+        }
+    }
+    if (!finished) {
+        if (!exited) return 0;
+        progress_cancel(run->queue);
+    }
+
+    run_finish(run);
+    if (!downloader_is_url(run->opts.input)) str_copy(opts->input, sizeof(opts->input), run->opts.input);
+    if (run->rc == 0) snprintf(msg, msg_sz, "Pipeline concluido.");
+    else if (run->rc == 4) snprintf(msg, msg_sz, "Pipeline cancelado.");
+    else snprintf(msg, msg_sz, "Pipeline terminou com erro (%d).", run->rc);
+    return 1;
+}
+
+static void run_abort(RunState *run) {
+    if (!run->active) return;
+    progress_cancel(run->queue);
+    run_finish(run);
+}
+
+static int execute_action(ActionId aid, CliOptions *opts, PreviewState *pv, WINDOW *prompt_win, char *msg, size_t msg_sz) {
     char buf[CARTAG_PATH_MAX];
     char warn[256];
 
     switch (aid) {
         case ACT_SET_INPUT:
-            if (prompt_line("Input path/drive: ", buf, sizeof(buf)) == 0 && buf[0]) {
+            if (prompt_line(prompt_win, "Input path/drive: ", buf, sizeof(buf)) == 0 && buf[0]) {
                 str_copy(opts->input, sizeof(opts->input), buf);
-                preview_load(opts, pv);
+                preview_scan_start(opts, pv);
                 str_copy(msg, msg_sz, "Input atualizado.");
             }
             break;
         case ACT_SET_EXPORT:
-            if (prompt_line("Export path: ", buf, sizeof(buf)) == 0 && buf[0]) {
+            if (prompt_line(prompt_win, "Export path: ", buf, sizeof(buf)) == 0 && buf[0]) {
                 str_copy(opts->export_path, sizeof(opts->export_path), buf);
                 str_copy(msg, msg_sz, "Export atualizado.");
             }
             break;
         case ACT_SET_URL:
-            if (prompt_line("YouTube URL: ", buf, sizeof(buf)) == 0 && buf[0]) {
+            if (prompt_line(prompt_win, "YouTube URL: ", buf, sizeof(buf)) == 0 && buf[0]) {
                 str_copy(opts->input, sizeof(opts->input), buf);
+                preview_cancel_scan(pv);
                 str_copy(msg, msg_sz, "URL setada como input.");
             }
             break;
@@ -316,7 +846,7 @@ static int execute_action(ActionId aid, CliOptions *opts, PreviewState *pv, char
             str_copy(msg, msg_sz, warn);
             break;
         case ACT_DOWNLOAD_URL:
-            if (prompt_line("YouTube URL para download: ", buf, sizeof(buf)) != 0 || !buf[0]) {
+            if (prompt_line(prompt_win, "YouTube URL para download: ", buf, sizeof(buf)) != 0 || !buf[0]) {
                 str_copy(msg, msg_sz, "URL nao informada.");
                 break;
             }
@@ -326,15 +856,15 @@ static int execute_action(ActionId aid, CliOptions *opts, PreviewState *pv, char
             }
             if (downloader_fetch_audio(buf, ".", warn, sizeof(warn)) == 0) {
                 str_copy(opts->input, sizeof(opts->input), ".");
-                preview_load(opts, pv);
+                preview_scan_start(opts, pv);
                 str_copy(msg, msg_sz, "Download concluido no diretorio atual.");
             } else {
                 str_copy(msg, msg_sz, warn);
             }
             break;
         case ACT_REFRESH_LIST:
-            preview_load(opts, pv);
-            str_copy(msg, msg_sz, "Lista atualizada.");
+            preview_scan_start(opts, pv);
+            str_copy(msg, msg_sz, "Escaneando...");
             break;
         case ACT_TOGGLE_CARSAFE:
             opts->car_safe = !opts->car_safe;
@@ -387,7 +917,7 @@ static int execute_action(ActionId aid, CliOptions *opts, PreviewState *pv, char
     return 0;
 }
 
-static int tui_run_fallback(CliOptions *opts) {
+static int tui_run_fallback(CliOptions *opts, PipelineCache *cache) {
     char cmd[64], buf[CARTAG_PATH_MAX], msg[128];
     PreviewState pv;
     memset(&pv, 0, sizeof(pv));
@@ -411,8 +941,9 @@ static int tui_run_fallback(CliOptions *opts) {
             printf("URL: ");
             if (fgets(buf, sizeof(buf), stdin)) { buf[strcspn(buf, "\r\n")] = '\0'; str_copy(opts->input, sizeof(opts->input), buf); }
         } else if (cmd[0] == 'i') {
-            execute_action(ACT_INSTALL_YTDLP, opts, &pv, msg, sizeof(msg));
+            execute_action(ACT_INSTALL_YTDLP, opts, &pv, NULL, msg, sizeof(msg));
         } else if (cmd[0] == 'l') {
+            pipeline_cache_invalidate(cache);
             preview_load(opts, &pv);
             printf("Eligible tracks: %zu\n", pv.list.count);
         } else if (cmd[0] == 'r') {
@@ -425,16 +956,24 @@ static int tui_run_fallback(CliOptions *opts) {
     return -1;
 }
 
-int tui_run(CliOptions *opts) {
+int tui_run(CliOptions *opts, PipelineCache *cache) {
     PreviewState pv;
+    RunState *run;
+    Screen scr;
     UiFocus focus = FOCUS_UTILS;
     UiTab tab_sel = TAB_FILE;
     int util_sel = 0;
+    int quit = 0;
     char msg[128];
 
-    if (!isatty(0)) return tui_run_fallback(opts);
+    if (!isatty(0)) return tui_run_fallback(opts, cache);
 
+    run = (RunState *)calloc(1, sizeof(*run));
+    if (!run) return tui_run_fallback(opts, cache);
+    run->cache = cache;
     memset(&pv, 0, sizeof(pv));
+    memset(&scr, 0, sizeof(scr));
+    scr.minute = -1;
     str_copy(msg, sizeof(msg), "DOSSHELL: TAB troca foco, <-/-> menus, ENTER executa.");
 
     initscr();
@@ -443,25 +982,50 @@ int tui_run(CliOptions *opts) {
     noecho();
     curs_set(0);
     init_colors_if_possible();
+    refresh();
+    screen_layout(&scr);
 
-    preview_load(opts, &pv);
+    preview_scan_start(opts, &pv);
 
-    for (;;) {
+    while (!quit) {
+        WINDOW *input = scr.win[PANEL_STATUS] ? scr.win[PANEL_STATUS] : stdscr;
         int ch;
         int rc;
         int util_count;
 
+        if (run_poll(run, opts, msg, sizeof(msg))) preview_scan_start(opts, &pv);
+        preview_poll_scan(&pv, msg, sizeof(msg));
         util_count = get_tab_item_count(tab_sel);
         if (util_sel >= util_count) util_sel = util_count > 0 ? util_count - 1 : 0;
 
-        draw_ui(opts, &pv, focus, tab_sel, util_sel, msg);
-        ch = getch();
+        draw_ui(&scr, opts, &pv, run, focus, tab_sel, util_sel, msg);
+        if (run->active) wtimeout(input, TUI_RUN_POLL_MS);
+        else if (preview_scanning(&pv)) wtimeout(input, TUI_POLL_MS);
+        else wtimeout(input, TUI_IDLE_POLL_MS);
+        ch = wgetch(input);
 
-        if (ch == 27) {
-            endwin();
-            preview_free(&pv);
-            return -1;
+        if (ch == ERR) continue;
+        if (ch == KEY_RESIZE) {
+            scr.lines = 0;
+            continue;
+        }
+        if (run->visible && !run->active) {
+            run->visible = 0;
+            continue;
         }
+        if (focus == FOCUS_FILES && pv.search_mode && preview_search_key(&pv, ch)) continue;
+        if (ch == 27 && run->active) {
+            progress_cancel(run->queue);
+            run->cancelling = 1;
+            str_copy(msg, sizeof(msg), "Cancelando pipeline...");
+            continue;
+        }
+        if (ch == 27 && preview_scanning(&pv)) {
+            preview_cancel_scan(&pv);
+            snprintf(msg, sizeof(msg), "Varredura cancelada: %zu faixas parciais.", pv.list.count);
+            continue;
+        }
+        if (ch == 27) break;
         if (ch == '\t') {
             focus = (focus == FOCUS_FILES) ? FOCUS_UTILS : FOCUS_FILES;
             continue;
@@ -475,65 +1039,55 @@ int tui_run(CliOptions *opts) {
             continue;
         }
 
+        rc = 0;
         if (focus == FOCUS_FILES) {
-            if (ch == KEY_UP && pv.selected > 0) pv.selected--;
-            if (ch == KEY_DOWN && pv.selected + 1 < pv.list.count) pv.selected++;
-            if (pv.selected < pv.scroll) pv.scroll = pv.selected;
-            if (pv.selected >= pv.scroll + 8) pv.scroll = pv.selected - 7;
-            if (ch == 'r' || ch == 'R') {
-                rc = execute_action(ACT_RUN_PIPELINE, opts, &pv, msg, sizeof(msg));
-                if (rc == 1) {
-                    endwin();
-                    preview_free(&pv);
-                    return 0;
-                }
+            WINDOW *fw = scr.win[PANEL_FILES];
+            if (ch == KEY_UP) preview_move(&pv, fw, -1);
+            if (ch == KEY_DOWN) preview_move(&pv, fw, 1);
+            if (ch == KEY_PPAGE) preview_move(&pv, fw, -files_visible_rows(fw));
+            if (ch == KEY_NPAGE) preview_move(&pv, fw, files_visible_rows(fw));
+            if (ch == KEY_HOME) preview_move(&pv, fw, -(long)pv.selected);
+            if (ch == KEY_END) preview_move(&pv, fw, (long)pv.search.view_count);
+            if (ch == '/') {
+                pv.search_mode = 1;
+                continue;
             }
+            if (ch == 'r' || ch == 'R') rc = 1;
         } else {
             if (ch == KEY_UP && util_sel > 0) util_sel--;
             if (ch == KEY_DOWN && util_sel + 1 < util_count) util_sel++;
-            if (ch == 10 || ch == KEY_ENTER) {
+            if (ch == 'q' || ch == 'Q') break;
+            if (ch == 'r' || ch == 'R') rc = 1;
+            if ((ch == 10 || ch == KEY_ENTER) && run->active) {
+                str_copy(msg, sizeof(msg), "Pipeline em execucao; aguarde ou ESC para cancelar.");
+            } else if (ch == 10 || ch == KEY_ENTER) {
                 ActionId aid = get_tab_action(tab_sel, util_sel);
-                rc = execute_action(aid, opts, &pv, msg, sizeof(msg));
-                if (rc == 1) {
-                    endwin();
-                    preview_free(&pv);
-                    return 0;
-                }
-                if (rc < 0) {
-                    endwin();
-                    preview_free(&pv);
-                    return -1;
-                }
-            }
-            if (ch == 'q' || ch == 'Q') {
-                endwin();
-                preview_free(&pv);
-                return -1;
-            }
-            if (ch == 'r' || ch == 'R') {
-                rc = execute_action(ACT_RUN_PIPELINE, opts, &pv, msg, sizeof(msg));
-                if (rc == 1) {
-                    endwin();
-                    preview_free(&pv);
-                    return 0;
-                }
+                if (aid == ACT_REFRESH_LIST) pipeline_cache_invalidate(cache);
+                rc = execute_action(aid, opts, &pv, scr.win[PANEL_STATUS], msg, sizeof(msg));
+                scr.sig[PANEL_STATUS] = 0;
+                if (rc < 0) break;
             }
         }
+
+        if (rc == 1 && run->active) {
+            str_copy(msg, sizeof(msg), "Pipeline ja em execucao.");
+        } else if (rc == 1) {
+            if (opts->input[0] == '\0') str_copy(opts->input, sizeof(opts->input), ".");
+            if (run_start(run, opts) == 0) str_copy(msg, sizeof(msg), "Pipeline iniciado.");
+            else str_copy(msg, sizeof(msg), "Falha ao iniciar pipeline.");
+        }
     }
-}
 
-#else
-static void win_str_copy(char *dst, size_t dst_sz, const char *src) {
-    size_t n;
-    if (!dst || dst_sz == 0) return;
-    if (!src) { dst[0] = '\0'; return; }
-    n = strlen(src);
-    if (n >= dst_sz) n = dst_sz - 1;
-    memcpy(dst, src, n);
-    dst[n] = '\0';
+    run_abort(run);
+    free(run);
+    preview_free(&pv);
+    screen_destroy(&scr);
+    endwin();
+    return -1;
 }
 
-int tui_run(CliOptions *opts) {
+#else
+int tui_run(CliOptions *opts, PipelineCache *cache) {
     char cmd[64];
     char buf[CARTAG_PATH_MAX];
     char warn[256];
@@ -552,19 +1106,19 @@ int tui_run(CliOptions *opts) {
             printf("Input path: ");
             if (fgets(buf, sizeof(buf), stdin)) {
                 buf[strcspn(buf, "\r\n")] = '\0';
-                if (buf[0]) win_str_copy(opts->input, sizeof(opts->input), buf);
+                if (buf[0]) str_copy(opts->input, sizeof(opts->input), buf);
             }
         } else if (cmd[0] == 'e' || cmd[0] == 'E') {
             printf("Export path: ");
             if (fgets(buf, sizeof(buf), stdin)) {
                 buf[strcspn(buf, "\r\n")] = '\0';
-                if (buf[0]) win_str_copy(opts->export_path, sizeof(opts->export_path), buf);
+                if (buf[0]) str_copy(opts->export_path, sizeof(opts->export_path), buf);
             }
         } else if (cmd[0] == 'y' || cmd[0] == 'Y') {
             printf("YouTube URL: ");
             if (fgets(buf, sizeof(buf), stdin)) {
                 buf[strcspn(buf, "\r\n")] = '\0';
-                if (buf[0]) win_str_copy(opts->input, sizeof(opts->input), buf);
+                if (buf[0]) str_copy(opts->input, sizeof(opts->input), buf);
             }
         } else if (cmd[0] == 'i' || cmd[0] == 'I') {
             if (downloader_install(warn, sizeof(warn)) == 0) printf("[OK] %s\n", warn);
@@ -572,7 +1126,8 @@ int tui_run(CliOptions *opts) {
         } else if (cmd[0] == 'l' || cmd[0] == 'L') {
             TrackList list;
             memset(&list, 0, sizeof(list));
-            if (opts->input[0] == '\0') win_str_copy(opts->input, sizeof(opts->input), ".");
+            pipeline_cache_invalidate(cache);
+            if (opts->input[0] == '\0') str_copy(opts->input, sizeof(opts->input), ".");
             if (fs_scan_audio(opts->input, &list) == 0) {
                 printf("Eligible tracks: %zu\n", list.count);
             } else {
@@ -583,7 +1138,7 @@ int tui_run(CliOptions *opts) {
             opts->organize = (opts->organize == ORG_GENRE_ARTIST) ? ORG_ARTIST : ORG_GENRE_ARTIST;
             printf("Organize mode: %s\n", opts->organize == ORG_GENRE_ARTIST ? "genre/artist" : "artist");
         } else if (cmd[0] == 'r' || cmd[0] == 'R') {
-            if (opts->input[0] == '\0') win_str_copy(opts->input, sizeof(opts->input), ".");
+            if (opts->input[0] == '\0') str_copy(opts->input, sizeof(opts->input), ".");
             return 0;
         }
     }
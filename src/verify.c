@@ -0,0 +1,353 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define VERIFY_BUF_BYTES (1024 * 1024)
+#define VERIFY_MAX_JOBS 16
+#define MANIFEST_HEADER "# cartag manifest v1 crc32c"
+
+typedef struct {
+    const char *root;
+    Manifest *m;
+    size_t next;
+    size_t done;
+    size_t total;
+    uint64_t bytes;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} VerifyPool;
+
+static int cmp_entry(const void *a, const void *b) {
+    return strcmp(((const VerifyEntry *)a)->path, ((const VerifyEntry *)b)->path);
+}
+
+static size_t path_slot(const char *path, size_t cap) {
+    return (size_t)hash64(path, strlen(path), 0) & (cap - 1);
+}
+
+static int index_rebuild(Manifest *m) {
+    size_t cap = 512;
+    size_t *index;
+    while (cap < m->count * 2) cap *= 2;
+    index = (size_t *)calloc(cap, sizeof(size_t));
+    if (!index) return -1;
+    for (size_t i = 0; i < m->count; ++i) {
+        size_t s = path_slot(m->items[i].path, cap);
+        while (index[s]) s = (s + 1) & (cap - 1);
+        index[s] = i + 1;
+    }
+    free(m->index);
+    m->index = index;
+    m->index_cap = cap;
+    return 0;
+}
+
+static long manifest_find(const Manifest *m, const char *path) {
+    size_t s;
+    if (!m->index_cap) return -1;
+    for (s = path_slot(path, m->index_cap); m->index[s]; s = (s + 1) & (m->index_cap - 1)) {
+        if (strcmp(m->items[m->index[s] - 1].path, path) == 0) return (long)(m->index[s] - 1);
+    }
+    return -1;
+}
+
+static VerifyEntry *manifest_append(Manifest *m, const char *path) {
+    size_t len = strlen(path);
+    VerifyEntry *e;
+    if (m->count >= m->cap) {
+        size_t cap = m->cap ? m->cap * 2 : 256;
+        VerifyEntry *mem = (VerifyEntry *)realloc(m->items, cap * sizeof(VerifyEntry));
+        if (!mem) return NULL;
+        m->items = mem;
+        m->cap = cap;
+    }
+    e = &m->items[m->count];
+    memset(e, 0, sizeof(*e));
+    e->path = (char *)malloc(len + 1);
+    if (!e->path) return NULL;
+    memcpy(e->path, path, len + 1);
+    m->count++;
+    return e;
+}
+
+int manifest_put(Manifest *m, const char *path, uint64_t size, uint32_t crc, int known) {
+    long idx = manifest_find(m, path);
+    VerifyEntry *e;
+    if (idx < 0) {
+        if (!(e = manifest_append(m, path))) return -1;
+        if (m->count * 2 > m->index_cap) {
+            if (index_rebuild(m) != 0) {
+                free(e->path);
+                m->count--;
+                return -1;
+            }
+        } else {
+            size_t s = path_slot(path, m->index_cap);
+            while (m->index[s]) s = (s + 1) & (m->index_cap - 1);
+            m->index[s] = m->count;
+        }
+    } else {
+        e = &m->items[idx];
+    }
+    if (known || e->size != size) {
+        e->crc = crc;
+        e->known = known;
+    }
+    e->size = size;
+    e->selected = 1;
+    e->status = VERIFY_PENDING;
+    return 0;
+}
+
+int manifest_load(Manifest *m, const char *root) {
+    char path[CARTAG_PATH_MAX];
+    char line[CARTAG_PATH_MAX + 64];
+    size_t n = 0;
+    FILE *f;
+
+    memset(m, 0, sizeof(*m));
+    path_join2(path, sizeof(path), root, EXPORT_MANIFEST_NAME);
+    f = fopen(path, "r");
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int crc = 0;
+        unsigned long long size = 0;
+        int off = 0;
+        char *nl = strchr(line, '\n');
+        VerifyEntry *e;
+        if (!nl || line[0] == '#') continue;
+        *nl = '\0';
+        if (sscanf(line, "%8x\t%llu\t%n", &crc, &size, &off) != 2 || off <= 0 || line[off] == '\0') continue;
+        e = manifest_append(m, line + off);
+        if (!e) break;
+        e->size = (uint64_t)size;
+        e->crc = (uint32_t)crc;
+        e->known = 1;
+    }
+    fclose(f);
+    qsort(m->items, m->count, sizeof(VerifyEntry), cmp_entry);
+    for (size_t i = 0; i < m->count; ++i) {
+        if (n > 0 && strcmp(m->items[n - 1].path, m->items[i].path) == 0) {
+            free(m->items[i].path);
+            continue;
+        }
+        m->items[n++] = m->items[i];
+    }
+    m->count = n;
+    return index_rebuild(m);
+}
+
+int manifest_save(const Manifest *m, const char *root) {
+    char path[CARTAG_PATH_MAX];
+    char tmp[CARTAG_PATH_MAX];
+    FILE *f;
+
+    path_join2(path, sizeof(path), root, EXPORT_MANIFEST_NAME);
+    f = fs_open_part(path, tmp, sizeof(tmp));
+    if (!f) return -1;
+    fprintf(f, "%s\n", MANIFEST_HEADER);
+    for (size_t i = 0; i < m->count; ++i) {
+        const VerifyEntry *e = &m->items[i];
+        if (!e->known) continue;
+        fprintf(f, "%08x\t%llu\t%s\n", (unsigned int)e->crc, (unsigned long long)e->size, e->path);
+    }
+    return fs_commit_part(f, tmp, path, ferror(f) ? -1 : 0);
+}
+
+void manifest_free(Manifest *m) {
+    for (size_t i = 0; i < m->count; ++i) free(m->items[i].path);
+    free(m->items);
+    free(m->index);
+    memset(m, 0, sizeof(*m));
+}
+
+static void verify_one(const char *root, VerifyEntry *e, unsigned char *buf, uint64_t *bytes) {
+    char full[CARTAG_PATH_MAX];
+    uint32_t crc = 0;
+    uint64_t total = 0;
+    int failed = 0;
+
+    path_join2(full, sizeof(full), root, e->path);
+#ifndef _WIN32
+    {
+        int fd = open(full, O_RDONLY | O_CLOEXEC);
+        ssize_t r;
+        if (fd < 0) {
+            e->status = VERIFY_MISSING;
+            return;
+        }
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        for (;;) {
+            r = read(fd, buf, VERIFY_BUF_BYTES);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            crc = crc32c_update(crc, buf, (size_t)r);
+            total += (uint64_t)r;
+        }
+        failed = r < 0;
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        close(fd);
+    }
+#else
+    {
+        FILE *f = fopen(full, "rb");
+        size_t n;
+        if (!f) {
+            e->status = VERIFY_MISSING;
+            return;
+        }
+        while ((n = fread(buf, 1, VERIFY_BUF_BYTES, f)) > 0) {
+            crc = crc32c_update(crc, buf, n);
+            total += n;
+        }
+        failed = ferror(f) != 0;
+        fclose(f);
+    }
+#endif
+    *bytes += total;
+    e->read_crc = crc;
+    if (failed) {
+        e->status = VERIFY_READ_ERROR;
+    } else if (total != e->size) {
+        e->status = VERIFY_SIZE;
+    } else if (!e->known) {
+        e->crc = crc;
+        e->known = 1;
+        e->status = VERIFY_OK;
+    } else {
+        e->status = crc == e->crc ? VERIFY_OK : VERIFY_MISMATCH;
+    }
+}
+
+static void verify_loop(VerifyPool *vp, int report) {
+    unsigned char *buf = (unsigned char *)malloc(VERIFY_BUF_BYTES);
+    if (!buf) return;
+    for (;;) {
+        size_t idx;
+        size_t done;
+        uint64_t bytes = 0;
+        uint64_t total_bytes;
+        int dev;
+#ifndef _WIN32
+        pthread_mutex_lock(&vp->lock);
+#endif
+        while (vp->next < vp->m->count && !vp->m->items[vp->next].selected) vp->next++;
+        idx = vp->next < vp->m->count ? vp->next++ : vp->m->count;
+#ifndef _WIN32
+        pthread_mutex_unlock(&vp->lock);
+#endif
+        if (idx >= vp->m->count || progress_cancelled()) break;
+        dev = sched_io_acquire(vp->root, SCHED_BYTES);
+        verify_one(vp->root, &vp->m->items[idx], buf, &bytes);
+        sched_io_release(dev, bytes);
+#ifndef _WIN32
+        pthread_mutex_lock(&vp->lock);
+#endif
+        vp->done++;
+        vp->bytes += bytes;
+        done = vp->done;
+        total_bytes = vp->bytes;
+#ifndef _WIN32
+        pthread_mutex_unlock(&vp->lock);
+#endif
+        if (report) progress_advance(done, total_bytes);
+    }
+    free(buf);
+}
+
+#ifndef _WIN32
+static void *verify_worker(void *arg) {
+    verify_loop((VerifyPool *)arg, 0);
+    return NULL;
+}
+#endif
+
+size_t verify_readback(const char *root, Manifest *m, int jobs) {
+    VerifyPool vp;
+    size_t failures = 0;
+    size_t ok = 0;
+
+    memset(&vp, 0, sizeof(vp));
+    vp.root = root;
+    vp.m = m;
+    for (size_t i = 0; i < m->count; ++i) vp.total += m->items[i].selected ? 1 : 0;
+    if (vp.total == 0) return 0;
+    if (jobs < 1) jobs = 1;
+    if (jobs > VERIFY_MAX_JOBS) jobs = VERIFY_MAX_JOBS;
+    if ((size_t)jobs > vp.total) jobs = (int)vp.total;
+
+    progress_stage(STAGE_VERIFY, vp.total);
+#ifndef _WIN32
+    {
+        pthread_t th[VERIFY_MAX_JOBS];
+        int started = 0;
+        pthread_mutex_init(&vp.lock, NULL);
+        for (int j = 1; j < jobs; ++j) {
+            if (pthread_create(&th[started], NULL, verify_worker, &vp) == 0) started++;
+        }
+        verify_loop(&vp, 1);
+        for (int j = 0; j < started; ++j) pthread_join(th[j], NULL);
+        pthread_mutex_destroy(&vp.lock);
+    }
+#else
+    verify_loop(&vp, 1);
+#endif
+    progress_advance(vp.done, vp.bytes);
+
+    for (size_t i = 0; i < m->count; ++i) {
+        const VerifyEntry *e = &m->items[i];
+        const char *why = NULL;
+        if (!e->selected) continue;
+        switch (e->status) {
+            case VERIFY_OK: ok++; break;
+            case VERIFY_MISMATCH: why = "checksum divergente"; break;
+            case VERIFY_SIZE: why = "tamanho divergente"; break;
+            case VERIFY_MISSING: why = "arquivo ausente"; break;
+            case VERIFY_READ_ERROR: why = "erro de leitura"; break;
+            default: break;
+        }
+        if (!why) continue;
+        failures++;
+        if (e->status == VERIFY_MISMATCH) {
+            progress_log(LVL_ERROR, "Verificacao falhou: %s (%s: esperado %08x, lido %08x)", e->path, why,
+                         (unsigned int)e->crc, (unsigned int)e->read_crc);
+        } else {
+            progress_log(LVL_ERROR, "Verificacao falhou: %s (%s)", e->path, why);
+        }
+    }
+    progress_log(LVL_TEXT, "Verificacao: %zu ok, %zu com falha, %.1f MB relidos", ok, failures,
+                 (double)vp.bytes / (1024.0 * 1024.0));
+    if (ok + failures < vp.total) progress_log(LVL_WARN, "verificacao interrompida: %zu faixas nao conferidas", vp.total - ok - failures);
+    return failures;
+}
+
+int verify_export_dir(const char *root, int jobs) {
+    Manifest m;
+    size_t failures;
+    if (manifest_load(&m, root) != 0 || m.count == 0) {
+        progress_log(LVL_ERROR, "manifesto nao encontrado em %s (exporte com --verify primeiro)", root);
+        manifest_free(&m);
+        return -1;
+    }
+    for (size_t i = 0; i < m.count; ++i) m.items[i].selected = 1;
+    failures = verify_readback(root, &m, jobs);
+    manifest_free(&m);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,561 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_DELETE_SELF)
+#define WATCH_IDLE_MS 2000
+#define WATCH_DEBOUNCE_MS 500
+
+typedef struct {
+    int wd;
+    char path[CARTAG_PATH_MAX];
+} WatchDir;
+
+typedef struct {
+    const CliOptions *opts;
+    int fd;
+    WatchDir *dirs;
+    size_t dir_count;
+    size_t dir_cap;
+    TrackList list;
+    size_t *index;
+    size_t index_cap;
+    size_t index_used;
+    char **pushed;
+    uint64_t *pushed_sig;
+    unsigned char *stale;
+    size_t pushed_cap;
+    size_t next_slot;
+    size_t tombstones;
+    size_t changes;
+    int regroup;
+    int target_present;
+    int dirty;
+    double last_event;
+} WatchState;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int has_prefix_dir(const char *path, const char *dir) {
+    size_t n = strlen(dir);
+    return strncmp(path, dir, n) == 0 && (path[n] == '/' || path[n] == '\0');
+}
+
+static uint64_t slot_sig(const AudioTrack *t) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const char *p = t->out_path; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    h ^= t->size_bytes;
+    h *= 1099511628211ULL;
+    h ^= t->quick_hash;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+static int pushed_reserve(WatchState *ws, size_t n) {
+    char **pushed;
+    uint64_t *sig;
+    unsigned char *stale;
+    size_t cap = ws->pushed_cap ? ws->pushed_cap : 512;
+    if (n <= ws->pushed_cap) return 0;
+    while (cap < n) cap *= 2;
+    pushed = (char **)realloc(ws->pushed, cap * sizeof(char *));
+    if (!pushed) return -1;
+    ws->pushed = pushed;
+    sig = (uint64_t *)realloc(ws->pushed_sig, cap * sizeof(uint64_t));
+    if (!sig) return -1;
+    ws->pushed_sig = sig;
+    stale = (unsigned char *)realloc(ws->stale, cap);
+    if (!stale) return -1;
+    ws->stale = stale;
+    memset(ws->pushed + ws->pushed_cap, 0, (cap - ws->pushed_cap) * sizeof(char *));
+    memset(ws->pushed_sig + ws->pushed_cap, 0, (cap - ws->pushed_cap) * sizeof(uint64_t));
+    memset(ws->stale + ws->pushed_cap, 0, cap - ws->pushed_cap);
+    ws->pushed_cap = cap;
+    return 0;
+}
+
+static void pushed_forget_all(WatchState *ws) {
+    for (size_t i = 0; i < ws->pushed_cap; ++i) {
+        free(ws->pushed[i]);
+        ws->pushed[i] = NULL;
+        ws->pushed_sig[i] = 0;
+    }
+}
+
+static size_t track_slot(int root, const char *rel, size_t cap) {
+    return (size_t)hash64(rel, strlen(rel), (uint64_t)root) & (cap - 1);
+}
+
+static int index_rebuild(WatchState *ws) {
+    size_t cap = 512;
+    size_t used = 0;
+    size_t *index;
+    while (cap < ws->list.count * 2) cap *= 2;
+    index = (size_t *)calloc(cap, sizeof(size_t));
+    if (!index) return -1;
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        const AudioTrack *t = &ws->list.tracks[i];
+        size_t s;
+        if (t->excluded) continue;
+        s = track_slot(t->root_index, t->rel_path, cap);
+        while (index[s]) s = (s + 1) & (cap - 1);
+        index[s] = i + 1;
+        used++;
+    }
+    free(ws->index);
+    ws->index = index;
+    ws->index_cap = cap;
+    ws->index_used = used;
+    return 0;
+}
+
+static int index_add(WatchState *ws, size_t i) {
+    const AudioTrack *t = &ws->list.tracks[i];
+    size_t s;
+    if ((ws->index_used + 1) * 2 > ws->index_cap) return index_rebuild(ws);
+    s = track_slot(t->root_index, t->rel_path, ws->index_cap);
+    while (ws->index[s]) s = (s + 1) & (ws->index_cap - 1);
+    ws->index[s] = i + 1;
+    ws->index_used++;
+    return 0;
+}
+
+static long find_track(const WatchState *ws, int root, const char *rel) {
+    size_t s;
+    if (!ws->index_cap) return -1;
+    for (s = track_slot(root, rel, ws->index_cap); ws->index[s]; s = (s + 1) & (ws->index_cap - 1)) {
+        const AudioTrack *t = &ws->list.tracks[ws->index[s] - 1];
+        if (!t->excluded && t->root_index == root && strcmp(t->rel_path, rel) == 0) return (long)(ws->index[s] - 1);
+    }
+    return -1;
+}
+
+static void tombstone(WatchState *ws, size_t i) {
+    AudioTrack *t = &ws->list.tracks[i];
+    if (!t->duplicate) ws->regroup = 1;
+    t->excluded = 1;
+    t->rel_path[0] = '\0';
+    ws->tombstones++;
+    ws->changes++;
+    ws->dirty = 1;
+}
+
+static size_t root_count(const WatchState *ws) {
+    return 1 + (ws->opts->root_count < CARTAG_MAX_ROOTS ? ws->opts->root_count : CARTAG_MAX_ROOTS);
+}
+
+static const char *root_path(const WatchState *ws, size_t k) {
+    return k == 0 ? ws->opts->input : ws->opts->roots[k - 1];
+}
+
+static int rel_from_full(const WatchState *ws, const char *full, char *rel, size_t rel_sz) {
+    int best = -1;
+    size_t best_n = 0;
+    for (size_t k = 0; k < root_count(ws); ++k) {
+        size_t n = strlen(root_path(ws, k));
+        if (n >= best_n && strncmp(full, root_path(ws, k), n) == 0 && full[n] == '/') {
+            best = (int)k;
+            best_n = n;
+        }
+    }
+    if (best < 0) {
+        str_copy(rel, rel_sz, full);
+        return 0;
+    }
+    str_copy(rel, rel_sz, full + best_n + 1);
+    return best;
+}
+
+static int upsert_track(void *ctx, const AudioTrack *probed) {
+    WatchState *ws = (WatchState *)ctx;
+    AudioTrack t = *probed;
+    long idx;
+
+    t.root_index = rel_from_full(ws, probed->path, t.rel_path, sizeof(t.rel_path));
+    pipeline_process_track(&t, ws->opts);
+    idx = find_track(ws, t.root_index, t.rel_path);
+    if (idx >= 0) {
+        t.slot = ws->list.tracks[idx].slot;
+        ws->list.tracks[idx] = t;
+    } else {
+        if (pushed_reserve(ws, ws->list.count + 1) != 0) return 0;
+        t.slot = ws->next_slot + 1;
+        if (tracklist_push(&ws->list, &t) != 0) return 0;
+        if (index_add(ws, ws->list.count - 1) != 0) {
+            ws->list.count--;
+            return 0;
+        }
+        idx = (long)ws->list.count - 1;
+        ws->next_slot++;
+    }
+    ws->stale[idx] = 1;
+    ws->regroup = 1;
+    ws->changes++;
+    ws->dirty = 1;
+    return g_stop ? 1 : 0;
+}
+
+static void remove_path(WatchState *ws, const char *full, int dir) {
+    char rel[CARTAG_PATH_MAX];
+    int root = rel_from_full(ws, full, rel, sizeof(rel));
+    long idx = find_track(ws, root, rel);
+    if (idx >= 0) tombstone(ws, (size_t)idx);
+    if (!dir) return;
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        AudioTrack *t = &ws->list.tracks[i];
+        if (!t->excluded && t->root_index == root && has_prefix_dir(t->rel_path, rel)) tombstone(ws, i);
+    }
+}
+
+static void add_watch_tree(WatchState *ws, const char *dir, int depth) {
+    DIR *d;
+    struct dirent *ent;
+    char full[CARTAG_PATH_MAX];
+    int wd;
+
+    if (depth > 16) return;
+    wd = inotify_add_watch(ws->fd, dir, WATCH_MASK);
+    if (wd < 0) return;
+    if (ws->dir_count >= ws->dir_cap) {
+        size_t cap = ws->dir_cap ? ws->dir_cap * 2 : 64;
+        WatchDir *mem = (WatchDir *)realloc(ws->dirs, cap * sizeof(WatchDir));
+        if (!mem) return;
+        ws->dirs = mem;
+        ws->dir_cap = cap;
+    }
+    ws->dirs[ws->dir_count].wd = wd;
+    str_copy(ws->dirs[ws->dir_count].path, sizeof(ws->dirs[0].path), dir);
+    ws->dir_count++;
+
+    d = opendir(dir);
+    if (!d) return;
+    while ((ent = readdir(d)) != NULL) {
+        struct stat st;
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        path_join2(full, sizeof(full), dir, ent->d_name);
+        if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) add_watch_tree(ws, full, depth + 1);
+    }
+    closedir(d);
+}
+
+static const char *dir_for_wd(const WatchState *ws, int wd) {
+    for (size_t i = 0; i < ws->dir_count; ++i) {
+        if (ws->dirs[i].wd == wd) return ws->dirs[i].path;
+    }
+    return NULL;
+}
+
+static void drop_watches_under(WatchState *ws, const char *dir, int rm) {
+    size_t n = 0;
+    for (size_t i = 0; i < ws->dir_count; ++i) {
+        if (has_prefix_dir(ws->dirs[i].path, dir)) {
+            if (rm) inotify_rm_watch(ws->fd, ws->dirs[i].wd);
+            continue;
+        }
+        ws->dirs[n++] = ws->dirs[i];
+    }
+    ws->dir_count = n;
+}
+
+static void drop_watch_wd(WatchState *ws, int wd) {
+    size_t n = 0;
+    for (size_t i = 0; i < ws->dir_count; ++i) {
+        if (ws->dirs[i].wd != wd) ws->dirs[n++] = ws->dirs[i];
+    }
+    ws->dir_count = n;
+}
+
+static void handle_event(WatchState *ws, const struct inotify_event *ev) {
+    const char *dir = dir_for_wd(ws, ev->wd);
+    char full[CARTAG_PATH_MAX];
+    AudioTrack t;
+
+    if (ev->mask & IN_IGNORED) {
+        drop_watch_wd(ws, ev->wd);
+        return;
+    }
+    if (!dir || ev->len == 0) return;
+    path_join2(full, sizeof(full), dir, ev->name);
+
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            add_watch_tree(ws, full, 0);
+            fs_scan_audio_cb(full, upsert_track, ws);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            drop_watches_under(ws, full, (ev->mask & IN_MOVED_FROM) != 0);
+            remove_path(ws, full, 1);
+        }
+        return;
+    }
+
+    if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        if (fs_probe_track(full, ws->opts->input, &t) == 0) upsert_track(ws, &t);
+    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        remove_path(ws, full, 0);
+    }
+}
+
+static void drain_events(WatchState *ws) {
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(ws->fd, buf, sizeof(buf))) > 0) {
+        char *p = buf;
+        while (p < buf + n) {
+            const struct inotify_event *ev = (const struct inotify_event *)(void *)p;
+            handle_event(ws, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    ws->last_event = now_seconds();
+}
+
+static int target_available(const CliOptions *opts) {
+    struct stat st;
+    if (opts->export_path[0] == '\0') return 0;
+    if (stat(opts->export_path, &st) != 0 || !S_ISDIR(st.st_mode)) return 0;
+    return access(opts->export_path, W_OK) == 0;
+}
+
+static void compact(WatchState *ws) {
+    size_t n = 0;
+    if (ws->tombstones < 64 || ws->tombstones * 2 < ws->list.count) return;
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        if (ws->list.tracks[i].excluded) {
+            free(ws->pushed[i]);
+            ws->pushed[i] = NULL;
+            continue;
+        }
+        ws->list.tracks[n] = ws->list.tracks[i];
+        ws->pushed[n] = ws->pushed[i];
+        ws->pushed_sig[n] = ws->pushed_sig[i];
+        ws->stale[n] = ws->stale[i];
+        if (n != i) ws->pushed[i] = NULL;
+        n++;
+    }
+    ws->list.count = n;
+    ws->tombstones = 0;
+    if (index_rebuild(ws) != 0) {
+        free(ws->index);
+        ws->index = NULL;
+        ws->index_cap = 0;
+        ws->index_used = 0;
+    }
+}
+
+static int uses_dedupe(const CliOptions *opts) {
+    return opts->dedupe || opts->car_safe || opts->fingerprint || opts->fuzzy != FUZZY_OFF ||
+           select_uses_duplicate(&opts->select_query);
+}
+
+static void organize_one(WatchState *ws, AudioTrack *t) {
+    TrackList one;
+    one.tracks = t;
+    one.count = 1;
+    one.capacity = 1;
+    organizer_plan(&one, ws->opts);
+    if (ws->opts->prefix || ws->opts->car_safe) organizer_apply_prefix(&one);
+}
+
+static void replan(WatchState *ws) {
+    const CliOptions *opts = ws->opts;
+    LibraryStats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    if (ws->regroup && uses_dedupe(opts)) {
+        for (size_t i = 0; i < ws->list.count; ++i) ws->list.tracks[i].duplicate = 0;
+        pipeline_dedupe(&ws->list, opts, &stats);
+    } else if (opts->select_query.count) {
+        for (size_t i = 0; i < ws->list.count; ++i) {
+            TrackList one;
+            if (!ws->stale[i]) continue;
+            one.tracks = &ws->list.tracks[i];
+            one.count = 1;
+            one.capacity = 1;
+            select_apply(&opts->select_query, &one);
+        }
+    }
+
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        if (ws->stale[i]) audio_plan_conversion(&ws->list.tracks[i], opts, opts->target_kbps);
+    }
+    if (opts->fit) {
+        for (size_t i = 0; i < ws->list.count; ++i) ws->list.tracks[i].omitted = 0;
+        capacity_plan(&ws->list, opts);
+    }
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        if (ws->stale[i] || opts->fit) organize_one(ws, &ws->list.tracks[i]);
+        ws->stale[i] = 0;
+    }
+    ws->regroup = 0;
+}
+
+static void push_delta(WatchState *ws) {
+    const char *root = ws->opts->export_path;
+    char dst[CARTAG_PATH_MAX];
+    size_t copied = 0;
+    size_t removed = 0;
+
+    for (size_t i = 0; i < ws->list.count; ++i) {
+        const AudioTrack *t = &ws->list.tracks[i];
+        int live = !t->excluded && !t->duplicate && !t->unselected && !t->omitted;
+        if (!ws->pushed[i]) continue;
+        if (live && strcmp(ws->pushed[i], t->out_path) == 0) continue;
+        path_join2(dst, sizeof(dst), root, ws->pushed[i]);
+        if (unlink(dst) == 0) removed++;
+        free(ws->pushed[i]);
+        ws->pushed[i] = NULL;
+        ws->pushed_sig[i] = 0;
+    }
+
+    for (size_t i = 0; i < ws->list.count && !g_stop; ++i) {
+        AudioTrack *t = &ws->list.tracks[i];
+        uint64_t sig;
+        struct stat src_st;
+        struct stat dst_st;
+        if (t->excluded || t->duplicate || t->unselected || t->omitted) continue;
+        sig = slot_sig(t);
+        if (ws->pushed[i] && ws->pushed_sig[i] == sig) continue;
+        pipeline_convert_track(t, ws->opts);
+        path_join2(dst, sizeof(dst), root, t->out_path[0] ? t->out_path : t->filename);
+        if (!ws->pushed[i] && stat(t->path, &src_st) == 0 && stat(dst, &dst_st) == 0 &&
+            src_st.st_size == dst_st.st_size) {
+            ws->pushed[i] = strdup(t->out_path);
+            ws->pushed_sig[i] = sig;
+            continue;
+        }
+        if (fs_copy_file(t->path, dst, NULL) != 0) {
+            progress_log(LVL_ERROR, "Falha ao copiar: %s", t->filename);
+            continue;
+        }
+        free(ws->pushed[i]);
+        ws->pushed[i] = strdup(t->out_path);
+        ws->pushed_sig[i] = sig;
+        copied++;
+    }
+    if (copied || removed) {
+        progress_log(LVL_INFO, "watch: %zu copiadas, %zu removidas em %s", copied, removed, root);
+    }
+}
+
+static void cycle(WatchState *ws) {
+    int present = target_available(ws->opts);
+
+    if (present != ws->target_present) {
+        ws->target_present = present;
+        pushed_forget_all(ws);
+        progress_log(LVL_INFO, "watch: destino %s %s", ws->opts->export_path, present ? "disponivel" : "ausente");
+        if (present) ws->dirty = 1;
+    }
+    if (!ws->dirty) return;
+    if (now_seconds() - ws->last_event < WATCH_DEBOUNCE_MS / 1000.0) return;
+
+    if (ws->changes) replan(ws);
+    if (ws->changes) progress_log(LVL_INFO, "watch: %zu alteracoes, %zu faixas", ws->changes, ws->list.count - ws->tombstones);
+    ws->changes = 0;
+    ws->dirty = 0;
+    if (ws->target_present) push_delta(ws);
+    compact(ws);
+}
+
+int watch_run(const CliOptions *opts) {
+    WatchState ws;
+    struct sigaction sa;
+
+    memset(&ws, 0, sizeof(ws));
+    ws.opts = opts;
+    ws.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ws.fd < 0) {
+        progress_log(LVL_ERROR, "watch: inotify indisponivel (%s)", strerror(errno));
+        return 5;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (size_t k = 0; k < root_count(&ws); ++k) {
+        size_t before = ws.dir_count;
+        add_watch_tree(&ws, root_path(&ws, k), 0);
+        if (ws.dir_count == before) {
+            progress_log(LVL_ERROR, "Falha ao escanear entrada: %s", root_path(&ws, k));
+            continue;
+        }
+        fs_scan_audio_cb(root_path(&ws, k), upsert_track, &ws);
+    }
+    if (ws.dir_count == 0) {
+        free(ws.pushed);
+        free(ws.pushed_sig);
+        free(ws.stale);
+        free(ws.index);
+        tracklist_free(&ws.list);
+        close(ws.fd);
+        return 3;
+    }
+    progress_log(LVL_INFO, "watch: %zu faixas, %zu diretorios monitorados em %zu raiz(es) (Ctrl+C encerra)",
+                 ws.list.count, ws.dir_count, root_count(&ws));
+    ws.dirty = 1;
+
+    while (!g_stop) {
+        struct pollfd pfd;
+        int rc;
+        pfd.fd = ws.fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        rc = poll(&pfd, 1, ws.dirty ? WATCH_DEBOUNCE_MS : WATCH_IDLE_MS);
+        if (rc < 0 && errno != EINTR) break;
+        if (rc > 0 && (pfd.revents & POLLIN)) drain_events(&ws);
+        cycle(&ws);
+        log_flush_issues();
+        log_flush();
+    }
+
+    pushed_forget_all(&ws);
+    free(ws.pushed);
+    free(ws.pushed_sig);
+    free(ws.stale);
+    free(ws.index);
+    free(ws.dirs);
+    tracklist_free(&ws.list);
+    close(ws.fd);
+    return 0;
+}
+
+#else
+
+int watch_run(const CliOptions *opts) {
+    (void)opts;
+    progress_log(LVL_ERROR, "watch: modo --watch requer Linux (inotify)");
+    return 5;
+}
+
+#endif
@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartag.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_failed;
+static int g_checks;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        g_checks++;                                                        \
+        if (!(cond)) {                                                     \
+            g_failed++;                                                    \
+            fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #cond); \
+        }                                                                  \
+    } while (0)
+
+static char g_tmp[CARTAG_PATH_MAX];
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fputs(text, f);
+    fclose(f);
+}
+
+static size_t count_lines(const char *path, char kind) {
+    FILE *f = fopen(path, "r");
+    char line[CARTAG_PATH_MAX + 128];
+    size_t n = 0;
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) n += line[0] == kind;
+    fclose(f);
+    return n;
+}
+
+static void add_track(TrackList *list, const char *artist, const char *title, AudioFormat fmt, int year,
+                      int duration, uint64_t size) {
+    AudioTrack t;
+    memset(&t, 0, sizeof(t));
+    snprintf(t.artist, sizeof(t.artist), "%s", artist);
+    snprintf(t.title, sizeof(t.title), "%s", title);
+    snprintf(t.filename, sizeof(t.filename), "%s - %s.%s", artist, title, fmt == FORMAT_FLAC ? "flac" : "mp3");
+    t.format = fmt;
+    t.year = year;
+    t.duration_seconds = duration;
+    t.size_bytes = size;
+    t.has_tags = 1;
+    tracklist_push(list, &t);
+}
+
+static size_t select_count(TrackList *list, const char *expr) {
+    SelectQuery q;
+    char err[256];
+    size_t n;
+    if (select_compile(&q, expr, err, sizeof(err)) != 0) {
+        fprintf(stderr, "selecao rejeitada: %s (%s)\n", expr, err);
+        return (size_t)-1;
+    }
+    n = select_apply(&q, list);
+    select_free(&q);
+    return n;
+}
+
+static void test_select(void) {
+    TrackList list;
+    SelectQuery q;
+    char err[256];
+
+    memset(&list, 0, sizeof(list));
+    add_track(&list, "The Beatles", "Let It Be", FORMAT_MP3, 1970, 243, 4u << 20);
+    add_track(&list, "Daft Punk", "Get Lucky", FORMAT_FLAC, 2013, 369, 40u << 20);
+    add_track(&list, "Pitty", "Na Sua Estante", FORMAT_MP3, 2005, 210, 5u << 20);
+    list.tracks[2].duplicate = 1;
+
+    CHECK(select_count(&list, "year >= 2000") == 2);
+    CHECK(select_count(&list, "format = flac") == 1);
+    CHECK(!list.tracks[1].unselected && list.tracks[0].unselected);
+    CHECK(select_count(&list, "artist ~ beat or duration < 3:40") == 2);
+    CHECK(select_count(&list, "size > 10M and not lossless") == 0);
+    CHECK(select_count(&list, "artist in (pitty, \"daft punk\")") == 2);
+    CHECK(select_count(&list, "not duplicate") == 2);
+
+    CHECK(select_compile(&q, "year >=", err, sizeof(err)) != 0 && err[0]);
+    CHECK(select_compile(&q, "color = red", err, sizeof(err)) != 0);
+    CHECK(select_compile(&q, "duplicate and year > 1990", err, sizeof(err)) == 0 && select_uses_duplicate(&q));
+    select_free(&q);
+    tracklist_free(&list);
+}
+
+static void test_fuzzy(void) {
+    TrackList list;
+    LibraryStats stats;
+
+    memset(&list, 0, sizeof(list));
+    memset(&stats, 0, sizeof(stats));
+    add_track(&list, "Legiao Urbana", "", FORMAT_MP3, 1986, 200, 3u << 20);
+    add_track(&list, "Legiao Urbana", "(Ao Vivo)", FORMAT_MP3, 1986, 200, 3u << 20);
+    add_track(&list, "Legiao Urbana", "Tempo Perdido", FORMAT_MP3, 1986, 200, 3u << 20);
+    add_track(&list, "Legiao Urbana", "Tempo Perdido (Remaster)", FORMAT_FLAC, 1986, 200, 30u << 20);
+    fuzzy_dedupe(&list, FUZZY_LOSSLESS, 80, 0, &stats);
+    CHECK(!list.tracks[0].duplicate && !list.tracks[1].duplicate);
+    CHECK(list.tracks[2].duplicate && !list.tracks[3].duplicate);
+    tracklist_free(&list);
+}
+
+static void test_cue_parse(void) {
+    char path[CARTAG_PATH_MAX];
+    CueSheet cs;
+
+    path_join2(path, sizeof(path), g_tmp, "album.cue");
+    write_file(path,
+               "REM GENRE Rock\r\n"
+               "REM DATE 1994\r\n"
+               "PERFORMER \"Skank\"\r\n"
+               "TITLE \"Calango\"\r\n"
+               "FILE \"album.flac\" WAVE\r\n"
+               "  TRACK 01 AUDIO\r\n"
+               "    TITLE \"Jackie Tequila\"\r\n"
+               "    INDEX 01 00:00:00\r\n"
+               "  TRACK 02 AUDIO\r\n"
+               "    TITLE \"Esmola\"\r\n"
+               "    PERFORMER \"Skank\"\r\n"
+               "    INDEX 00 03:58:10\r\n"
+               "    INDEX 01 04:00:00\r\n");
+    CHECK(cue_parse(path, &cs) == 0);
+    CHECK(cs.count == 2);
+    CHECK(strcmp(cs.file, "album.flac") == 0);
+    CHECK(strcmp(cs.performer, "Skank") == 0 && strcmp(cs.title, "Calango") == 0);
+    CHECK(strcmp(cs.genre, "Rock") == 0 && cs.year == 1994);
+    CHECK(strcmp(cs.tracks[0].title, "Jackie Tequila") == 0);
+    CHECK(cs.tracks[1].number == 2 && cs.tracks[1].start == 240u * CUE_FRAMES_PER_SECOND);
+
+    write_file(path,
+               "FILE \"a.flac\" WAVE\n"
+               "  TRACK 01 AUDIO\n"
+               "    INDEX 01 02:00:00\n"
+               "  TRACK 02 AUDIO\n"
+               "    INDEX 01 01:00:00\n");
+    CHECK(cue_parse(path, &cs) != 0);
+    write_file(path, "FILE \"a.flac\" WAVE\n  TRACK 01 AUDIO\n    INDEX 01 00:00:00\n");
+    CHECK(cue_parse(path, &cs) != 0);
+}
+
+static void test_manifest(void) {
+    Manifest m;
+    char dir[CARTAG_PATH_MAX];
+
+    path_join2(dir, sizeof(dir), g_tmp, "manifest");
+    fs_ensure_directory(dir);
+    memset(&m, 0, sizeof(m));
+    CHECK(manifest_load(&m, dir) != 0);
+    for (int i = 0; i < 600; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "Artist %d/Song.mp3", i);
+        CHECK(manifest_put(&m, name, (uint64_t)i * 1000, (uint32_t)i * 7u, 1) == 0);
+    }
+    CHECK(manifest_put(&m, "Artist 7/Song.mp3", 99, 0xabcdu, 1) == 0);
+    CHECK(manifest_put(&m, "pending.mp3", 5, 0, 0) == 0);
+    CHECK(m.count == 601);
+    CHECK(manifest_save(&m, dir) == 0);
+    manifest_free(&m);
+
+    CHECK(manifest_load(&m, dir) == 0);
+    CHECK(m.count == 600);
+    for (size_t i = 0; i < m.count; ++i) {
+        const VerifyEntry *e = &m.items[i];
+        int k = atoi(e->path + 7);
+        if (k == 7) CHECK(e->size == 99 && e->crc == 0xabcdu);
+        else CHECK(e->size == (uint64_t)k * 1000 && e->crc == (uint32_t)k * 7u && e->known);
+    }
+    CHECK(manifest_put(&m, "Artist 599/Song.mp3", 1, 2, 1) == 0 && m.count == 600);
+    manifest_free(&m);
+}
+
+static void test_journal(void) {
+    char src[CARTAG_PATH_MAX];
+    char dst[CARTAG_PATH_MAX];
+    char jpath[CARTAG_PATH_MAX];
+    char *argv[5];
+    CliOptions opts;
+    TrackList list;
+
+    path_join2(src, sizeof(src), g_tmp, "jsrc");
+    path_join2(dst, sizeof(dst), g_tmp, "jdst");
+    fs_ensure_directory(src);
+    memset(&list, 0, sizeof(list));
+    for (int i = 0; i < 3; ++i) {
+        char path[CARTAG_PATH_MAX];
+        char name[32];
+        char body[64];
+        AudioTrack t;
+        snprintf(name, sizeof(name), "faixa%d.mp3", i);
+        snprintf(body, sizeof(body), "ID3 conteudo %d", i);
+        path_join2(path, sizeof(path), src, name);
+        write_file(path, body);
+        if (fs_probe_track(path, src, &t) == 0) tracklist_push(&list, &t);
+    }
+    CHECK(list.count == 3);
+
+    argv[0] = "cartag";
+    argv[1] = src;
+    argv[2] = "--export";
+    argv[3] = dst;
+    argv[4] = NULL;
+    CHECK(cli_parse(4, argv, &opts) == 0);
+    CHECK(exporter_run(&list, &opts) == 0);
+    path_join2(jpath, sizeof(jpath), dst, EXPORT_JOURNAL_NAME);
+    CHECK(count_lines(jpath, 'C') == 3);
+    CHECK(count_lines(jpath, 'P') == 3);
+
+    opts.resume = 1;
+    for (int run = 0; run < 2; ++run) CHECK(exporter_run(&list, &opts) == 0);
+    CHECK(count_lines(jpath, 'C') == 3);
+    CHECK(count_lines(jpath, 'P') == 0);
+    cli_free(&opts);
+    tracklist_free(&list);
+}
+
+static int make_ytdlp(char *exe, size_t exe_sz, const char *log) {
+    FILE *f;
+    path_join2(exe, exe_sz, g_tmp, "fake-ytdlp");
+    f = fopen(exe, "w");
+    if (!f) return -1;
+    fprintf(f,
+            "#!/bin/sh\n"
+            "out=; url=\n"
+            "while [ $# -gt 0 ]; do\n"
+            "  case \"$1\" in -o) out=\"$2\"; shift ;; *) url=\"$1\" ;; esac\n"
+            "  shift\n"
+            "done\n"
+            "echo + >> '%s'\n"
+            "sleep 0.2\n"
+            "case \"$url\" in *fail*) echo - >> '%s'; exit 1 ;; esac\n"
+            "name=\"$(dirname \"$out\")/${url##*/}.mp3\"\n"
+            "printf 'ID3' > \"$name\"\n"
+            "echo \"[download]  50.0%% of 1.00MiB\"\n"
+            "echo \"cartag-file:$name\"\n"
+            "echo - >> '%s'\n",
+            log, log, log);
+    fclose(f);
+    return chmod(exe, 0755);
+}
+
+static int max_overlap(const char *log) {
+    FILE *f = fopen(log, "r");
+    char line[16];
+    int cur = 0;
+    int best = 0;
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        cur += line[0] == '+' ? 1 : -1;
+        if (cur > best) best = cur;
+    }
+    fclose(f);
+    return best;
+}
+
+static void test_downloader(void) {
+    const char *urls[] = {"https://example.com/v1", "https://example.com/v2", "nao-e-url",
+                          "https://example.com/fail", "https://example.com/v3", "https://example.com/v4"};
+    char exe[CARTAG_PATH_MAX];
+    char log[CARTAG_PATH_MAX];
+    char out[CARTAG_PATH_MAX];
+    char warn[256];
+    TrackList list;
+    int found = 0;
+
+    path_join2(log, sizeof(log), g_tmp, "ytdlp.log");
+    path_join2(out, sizeof(out), g_tmp, "dl");
+    CHECK(make_ytdlp(exe, sizeof(exe), log) == 0);
+    setenv("CARTAG_YTDLP", exe, 1);
+
+    memset(&list, 0, sizeof(list));
+    CHECK(downloader_fetch_batch(urls, 6, out, 2, &list, warn, sizeof(warn)) == 0);
+    CHECK(list.count == 4);
+    CHECK(strstr(warn, "4 faixas baixadas de 6 URLs (2 falhas)") != NULL);
+    for (size_t i = 0; i < list.count; ++i) {
+        const AudioTrack *t = &list.tracks[i];
+        CHECK(t->format == FORMAT_MP3 && t->size_bytes == 3);
+        found += strcmp(t->filename, "v3.mp3") == 0;
+    }
+    CHECK(found == 1);
+    CHECK(max_overlap(log) >= 1 && max_overlap(log) <= 2);
+    tracklist_free(&list);
+
+    remove(log);
+    memset(&list, 0, sizeof(list));
+    CHECK(downloader_fetch_batch(urls + 3, 1, out, 4, &list, warn, sizeof(warn)) != 0);
+    CHECK(list.count == 0);
+    tracklist_free(&list);
+    unsetenv("CARTAG_YTDLP");
+}
+
+int main(void) {
+    char cmd[CARTAG_PATH_MAX + 16];
+    const char *base = getenv("TMPDIR");
+
+    snprintf(g_tmp, sizeof(g_tmp), "%s/cartag-check-XXXXXX", base && base[0] ? base : "/tmp");
+    if (!mkdtemp(g_tmp)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    log_set_output(OUTPUT_JSON);
+
+    test_select();
+    test_fuzzy();
+    test_cue_parse();
+    test_manifest();
+    test_journal();
+    test_downloader();
+
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_tmp);
+    if (system(cmd) != 0) fprintf(stderr, "aviso: %s nao removido\n", g_tmp);
+    fprintf(stderr, "%d verificacoes, %d falhas\n", g_checks, g_failed);
+    return g_failed ? 1 : 0;
+}